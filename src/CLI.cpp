@@ -3,10 +3,21 @@
  * License: see LICENSE.md file
  *******************************************************/
 #include <QApplication>
+#include <algorithm>
+#include <boost/thread.hpp>
 
 #include "CLI11.h"
+#include "acquisitionDaemon.h"
+#include "frameStatistics.h"
+#include "locoCodec.h"
 #include "mainwindow.h"
+#include "nearLossless.h"
+#include "recompressor.h"
+#include "roiTracker.h"
+#include "spectralClassifier.h"
+#include "thermalGovernor.h"
 #include "util.h"
+#include "viewAlignment.h"
 
 /**
  * @brief Application entry point and command line interface setup.
@@ -17,13 +28,445 @@ int main(int argc, char **argv)
 
     // initialize dummy variables as default values
     g_commandLineArguments.test_mode = false;
+    g_commandLineArguments.archive_bandwidth = 0;
+    g_commandLineArguments.archive_clevel = 0;
+    g_commandLineArguments.archive_noise_tolerance = 0;
+    g_commandLineArguments.read_noise = 0;
+    g_commandLineArguments.sensor_gain = 0;
+    g_commandLineArguments.adaptive_compression = false;
+    g_commandLineArguments.codec = "zstd";
+    g_commandLineArguments.columnar_metadata = false;
+    g_commandLineArguments.thermal_limit = 0;
+    g_commandLineArguments.thermal_hysteresis = ThermalGovernorOptions().hysteresisC;
+    g_commandLineArguments.stabilize_rotation = false;
+    g_commandLineArguments.record_class_maps = false;
+    g_commandLineArguments.roi_budget = RoiTrackingOptions().budgetMilliseconds;
+    g_commandLineArguments.noise_window = 0;
 
     // add options to CLI
     app.add_flag("-t,--test", g_commandLineArguments.test_mode, "Test mode");
     app.add_flag("-v,--version", g_commandLineArguments.version, "Print version and build information");
+    app.add_option("--staging-folder", g_commandLineArguments.staging_folder,
+                   "Fast local folder where recordings are written before being moved to the base folder");
+    app.add_option("--archive-bandwidth", g_commandLineArguments.archive_bandwidth,
+                   "Maximum rate in MB/s used to move recordings to the base folder, 0 for no limit")
+        ->check(CLI::NonNegativeNumber);
+    app.add_option("--archive-clevel", g_commandLineArguments.archive_clevel,
+                   "Compression level used to recompress recordings when moving them, 0 keeps them unchanged")
+        ->check(CLI::Range(0, 9));
+    app.add_option("--archive-noise-tolerance", g_commandLineArguments.archive_noise_tolerance,
+                   "Store recordings near-lossless when moving them, with a maximum error per pixel given as a "
+                   "fraction of the sensor noise, 0 keeps them lossless")
+        ->check(CLI::NonNegativeNumber);
+    app.add_option("--read-noise", g_commandLineArguments.read_noise,
+                   "Read noise of the sensor in DN, used by the near-lossless mode")
+        ->check(CLI::NonNegativeNumber);
+    app.add_option("--sensor-gain", g_commandLineArguments.sensor_gain,
+                   "Conversion gain of the sensor in DN per electron, used by the near-lossless mode")
+        ->check(CLI::NonNegativeNumber);
+    auto *stripeOption =
+        app.add_option("--stripe-folder", g_commandLineArguments.stripe_folders,
+                       "Folder on a separate storage device across which recordings are striped, can be repeated");
+    auto *mirrorOption =
+        app.add_option("--mirror-folder", g_commandLineArguments.mirror_folder,
+                       "Folder on a separate storage device where a second copy of each recording is written")
+            ->excludes(stripeOption);
+    // the images of mirrored recordings are compressed once for all destinations, the compression can not adapt to
+    // the load of each of them
+    auto *adaptiveOption =
+        app.add_flag("--adaptive-compression", g_commandLineArguments.adaptive_compression,
+                     "Adapt the compression codec and level of each image to the load of the recorder")
+            ->excludes(mirrorOption);
+    app.add_option("--codec", g_commandLineArguments.codec,
+                   "Codec used to compress the images, loco is a lossless predictive codec for raw sensor data")
+        ->check(CLI::IsMember({"zstd", "loco"}))
+        ->excludes(adaptiveOption);
+    app.add_flag("--columnar-metadata", g_commandLineArguments.columnar_metadata,
+                 "Store the per-frame metadata delta, run-length and dictionary encoded");
+    app.add_option("--attach", g_commandLineArguments.daemon_socket,
+                   "Control socket of a running acquisition daemon, the GUI then shows its previews and controls it "
+                   "instead of acquiring images itself");
+    app.add_option("--thermal-limit", g_commandLineArguments.thermal_limit,
+                   "Camera temperature in degrees Celsius above which the frame rate is reduced in steps, 0 disables "
+                   "the thermal governor")
+        ->check(CLI::NonNegativeNumber);
+    app.add_option("--thermal-hysteresis", g_commandLineArguments.thermal_hysteresis,
+                   "Degrees Celsius below the thermal limit the camera has to cool down to before the frame rate is "
+                   "increased again")
+        ->check(CLI::NonNegativeNumber);
+    app.add_flag("--stabilize-rotation", g_commandLineArguments.stabilize_rotation,
+                 "Compensate the rotation of the camera in addition to its translation when motion compensation is "
+                 "selected");
+    auto *classifierOption =
+        app.add_option("--classifier", g_commandLineArguments.classifier_model,
+                       "Linear or quadratic discriminant model used to classify the spectra of the displayed images")
+            ->check(CLI::ExistingFile);
+    app.add_flag("--record-class-maps", g_commandLineArguments.record_class_maps,
+                 "Record the class maps of the displayed images next to each recording")
+        ->needs(classifierOption);
+    auto *roiOption = app.add_option("--roi", g_commandLineArguments.rois,
+                                     "Region of interest x,y,width,height in pixels of the frame that follows the "
+                                     "tissue and whose trajectory is recorded, can be repeated")
+                          ->check(CLI::Validator(
+                              [](std::string &value) {
+                                  try
+                                  {
+                                      ParseRoi(value);
+                                      return std::string();
+                                  }
+                                  catch (const std::invalid_argument &e)
+                                  {
+                                      return std::string(e.what());
+                                  }
+                              },
+                              "X,Y,WIDTH,HEIGHT"));
+    app.add_option("--roi-budget", g_commandLineArguments.roi_budget,
+                   "Time in milliseconds spent tracking the regions of interest of each displayed frame")
+        ->check(CLI::NonNegativeNumber)
+        ->needs(roiOption);
+    app.add_option("--noise-window", g_commandLineArguments.noise_window,
+                   "Number of displayed frames over which the temporal noise of each band is estimated, 0 disables "
+                   "the estimation")
+        ->check(CLI::NonNegativeNumber);
+    app.add_option("--white-balance", g_commandLineArguments.white_balance,
+                   "Automatic white balance of the images of RGB cameras, its gains can be locked in the display "
+                   "settings and are recorded in the metadata")
+        ->check(CLI::IsMember({"gray-world", "white-patch"}));
+
+    // acquisition and recording without user interface, the GUI attaches to it with --attach
+    DaemonOptions daemonOptions;
+    CLI::App *daemonApp = app.add_subcommand(
+        "daemon", "Run the acquisition and recording pipeline in the background, controlled through a local socket");
+    daemonApp->add_option("--socket", daemonOptions.socketPath, "Path of the local control socket");
+    daemonApp->add_option("--preview", daemonOptions.previewName,
+                       "Name of the shared memory object where previews of the images are published");
+
+    // requests sent to a running acquisition daemon
+    std::string controlSocketPath = DAEMON_CONTROL_DEFAULT_SOCKET;
+    std::vector<std::string> controlRequest;
+    CLI::App *control =
+        app.add_subcommand("control", "Send a request to a running acquisition daemon, e.g. status or stop");
+    control->add_option("request", controlRequest, "Command and argument of the request")->required();
+    control->add_option("--socket", controlSocketPath, "Path of the local control socket of the daemon");
+
+    // quality report of recordings, computed from the per-frame statistics stored in the metadata
+    std::string qaFilePath;
+    float qaSaturationThreshold = 0.01;
+    float qaUnderexposureThreshold = 0.5;
+    bool qaPerFrame = false;
+    CLI::App *qa = app.add_subcommand("qa", "Print a quality report of a recording without reading its images");
+    qa->add_option("file", qaFilePath, "Path to the .b2nd file")->required()->check(CLI::ExistingFile);
+    qa->add_option("--saturation-threshold", qaSaturationThreshold,
+                   "Fraction of saturated pixels above which a frame is flagged");
+    qa->add_option("--underexposure-threshold", qaUnderexposureThreshold,
+                   "Fraction of under-exposed pixels above which a frame is flagged");
+    qa->add_flag("--per-frame", qaPerFrame, "Print the statistics of each frame as comma separated values");
+
+    // comparison of the codecs on the images of a recording
+    std::string benchmarkFilePath;
+    int64_t benchmarkFrames = 100;
+    unsigned int benchmarkMosaicWidth = 1;
+    unsigned int benchmarkMosaicHeight = 1;
+    CLI::App *benchmark =
+        app.add_subcommand("benchmark-codecs", "Compare the ratio and speed of the compression codecs on a recording");
+    benchmark->add_option("file", benchmarkFilePath, "Path to the .b2nd file or recording manifest")
+        ->required()
+        ->check(CLI::ExistingFile);
+    benchmark->add_option("--frames", benchmarkFrames, "Maximum number of frames to compress, 0 for all frames")
+        ->check(CLI::NonNegativeNumber);
+    benchmark->add_option("--mosaic-width", benchmarkMosaicWidth, "Width of the mosaic of the sensor")
+        ->check(CLI::Range(1, 255));
+    benchmark->add_option("--mosaic-height", benchmarkMosaicHeight, "Height of the mosaic of the sensor")
+        ->check(CLI::Range(1, 255));
+
+    // throughput of the spectral classifier on images of a full sensor
+    std::string benchmarkClassifierPath;
+    int benchmarkClassifierFrames = 20;
+    int benchmarkClassifierClasses = 4;
+    int benchmarkClassifierWidth = 2048;
+    int benchmarkClassifierHeight = 1088;
+    CLI::App *benchmarkClassifier = app.add_subcommand(
+        "benchmark-classifier",
+        "Measure the throughput of the spectral classifier, by default of random models for 16 and 25 bands");
+    benchmarkClassifier->add_option("--model", benchmarkClassifierPath, "Path to a classifier model to measure instead")
+        ->check(CLI::ExistingFile);
+    benchmarkClassifier->add_option("--frames", benchmarkClassifierFrames, "Number of images to classify")
+        ->check(CLI::PositiveNumber);
+    benchmarkClassifier->add_option("--classes", benchmarkClassifierClasses, "Number of classes of the random models")
+        ->check(CLI::Range(1, 256));
+    benchmarkClassifier->add_option("--width", benchmarkClassifierWidth, "Width of the images in pixels")
+        ->check(CLI::PositiveNumber);
+    benchmarkClassifier->add_option("--height", benchmarkClassifierHeight, "Height of the images in pixels")
+        ->check(CLI::PositiveNumber);
+
+    // alignment of the views of two cameras from recordings of a chessboard target
+    std::string alignmentSourcePath;
+    std::string alignmentTargetPath;
+    std::string alignmentOutputPath;
+    int alignmentSourceMosaicWidth = 1;
+    int alignmentSourceMosaicHeight = 1;
+    int alignmentTargetMosaic = 1;
+    int alignmentPatternColumns = 9;
+    int alignmentPatternRows = 6;
+    int64_t alignmentFrame = 0;
+    CLI::App *calibrateAlignment = app.add_subcommand(
+        "calibrate-alignment", "Estimate the alignment of the views of two cameras from recordings of a chessboard");
+    calibrateAlignment
+        ->add_option("source", alignmentSourcePath,
+                     "Recording of the camera whose images are overlaid, e.g. a spectral camera")
+        ->required()
+        ->check(CLI::ExistingFile);
+    calibrateAlignment
+        ->add_option("target", alignmentTargetPath, "Recording of the camera the images are overlaid on, e.g. RGB")
+        ->required()
+        ->check(CLI::ExistingFile);
+    calibrateAlignment->add_option("--output", alignmentOutputPath, "Path of the JSON file of the alignment")
+        ->required();
+    calibrateAlignment->add_option("--source-mosaic-width", alignmentSourceMosaicWidth, "Width of the source mosaic")
+        ->check(CLI::Range(1, 255));
+    calibrateAlignment->add_option("--source-mosaic-height", alignmentSourceMosaicHeight, "Height of the source mosaic")
+        ->check(CLI::Range(1, 255));
+    calibrateAlignment->add_option("--target-mosaic", alignmentTargetMosaic, "Size of the square target mosaic")
+        ->check(CLI::Range(1, 255));
+    calibrateAlignment->add_option("--pattern-columns", alignmentPatternColumns, "Inner corners per chessboard row")
+        ->check(CLI::Range(3, 100));
+    calibrateAlignment->add_option("--pattern-rows", alignmentPatternRows, "Inner corners per chessboard column")
+        ->check(CLI::Range(3, 100));
+    calibrateAlignment->add_option("--frame", alignmentFrame, "Index of the frame of both recordings to use")
+        ->check(CLI::NonNegativeNumber);
+
+    // verification of near-lossless copies against their original
+    std::string verifyOriginalPath;
+    std::string verifyCopyPath;
+    CLI::App *verify = app.add_subcommand("verify-near-lossless",
+                                          "Check that the error of a near-lossless copy stays within its noise bound");
+    verify->add_option("original", verifyOriginalPath, "Path to the original .b2nd file")
+        ->required()
+        ->check(CLI::ExistingFile);
+    verify->add_option("copy", verifyCopyPath, "Path to the near-lossless .b2nd file")
+        ->required()
+        ->check(CLI::ExistingFile);
+
+    // recompression of existing recordings with another compression profile
+    std::vector<std::string> recompressPaths;
+    std::string recompressCodec = "zstd";
+    RecompressionProfile recompressProfile;
+    unsigned int recompressThreads = std::max(boost::thread::hardware_concurrency(), 1u);
+    bool recompressReplace = false;
+    CLI::App *recompress = app.add_subcommand(
+        "recompress", "Recompress recordings, or all recordings in directory trees, with a new compression profile");
+    recompress->add_option("paths", recompressPaths, "Paths to .b2nd files or directories")->required();
+    recompress->add_option("--codec", recompressCodec, "Codec of the recompressed files")
+        ->check(CLI::IsMember({"zstd", "lz4", "loco"}));
+    recompress->add_option("--clevel", recompressProfile.clevel, "Compression level of the recompressed files")
+        ->check(CLI::Range(1, 9));
+    recompress->add_option("--mosaic-width", recompressProfile.mosaicWidth, "Width of the mosaic of the sensor")
+        ->check(CLI::Range(1, 255));
+    recompress->add_option("--mosaic-height", recompressProfile.mosaicHeight, "Height of the mosaic of the sensor")
+        ->check(CLI::Range(1, 255));
+    recompress->add_option("--threads", recompressThreads, "Number of threads used to recompress the images")
+        ->check(CLI::Range(1, 256));
+    recompress->add_flag("--replace", recompressReplace,
+                         std::string("Replace the original files instead of writing a copy ending with ") +
+                             RECOMPRESSED_FILE_SUFFIX + " alongside them");
 
     CLI11_PARSE(app, argc, argv);
 
+    if (g_commandLineArguments.archive_noise_tolerance > 0 && g_commandLineArguments.read_noise <= 0 &&
+        g_commandLineArguments.sensor_gain <= 0)
+    {
+        std::cerr << "--archive-noise-tolerance needs --read-noise or --sensor-gain\n";
+        return 1;
+    }
+
+    if (*control)
+    {
+        std::string request;
+        for (const auto &word : controlRequest)
+        {
+            request += (request.empty() ? "" : " ") + word;
+        }
+        try
+        {
+            std::cout << SendControlRequest(controlSocketPath, request) << "\n";
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    if (*daemonApp)
+    {
+        blosc2_init();
+        RegisterLocoCodec();
+        daemonOptions.recording.stripeFolders = g_commandLineArguments.stripe_folders;
+        daemonOptions.mirrorFolder = g_commandLineArguments.mirror_folder;
+        daemonOptions.recording.compression.adaptive = g_commandLineArguments.adaptive_compression;
+        daemonOptions.recording.compression.locoCodec = g_commandLineArguments.codec == "loco";
+        daemonOptions.recording.compression.columnarMetadata = g_commandLineArguments.columnar_metadata;
+        daemonOptions.thermal.limitC = g_commandLineArguments.thermal_limit;
+        daemonOptions.thermal.hysteresisC = g_commandLineArguments.thermal_hysteresis;
+        int status = 0;
+        try
+        {
+            AcquisitionDaemon acquisitionDaemon(daemonOptions);
+            acquisitionDaemon.Run();
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cerr << e.what() << "\n";
+            status = 1;
+        }
+        blosc2_destroy();
+        return status;
+    }
+
+    if (*recompress)
+    {
+        blosc2_init();
+        RegisterLocoCodec();
+        recompressProfile.compcode = recompressCodec == "loco"  ? LOCO_CODEC_ID
+                                     : recompressCodec == "lz4" ? BLOSC_LZ4
+                                                                : BLOSC_ZSTD;
+        int status = 0;
+        std::vector<RecompressionResult> results;
+        try
+        {
+            for (const auto &source : FindRecordings(recompressPaths))
+            {
+                try
+                {
+                    std::string destination = recompressReplace ? source : GetRecompressedPath(source);
+                    results.push_back(RecompressRecording(source, destination, recompressProfile, recompressThreads));
+                }
+                catch (const std::runtime_error &e)
+                {
+                    // the original is left untouched, the remaining recordings are still recompressed
+                    std::cerr << e.what() << "\n";
+                    status = 1;
+                }
+            }
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cerr << e.what() << "\n";
+            status = 1;
+        }
+        WriteRecompressionReport(results, std::cout);
+        blosc2_destroy();
+        return status;
+    }
+
+    if (*verify)
+    {
+        blosc2_init();
+        RegisterLocoCodec();
+        int status = 0;
+        try
+        {
+            NearLosslessReport report = VerifyNearLossless(verifyOriginalPath, verifyCopyPath);
+            WriteNearLosslessReport(report, std::cout);
+            status = report.violations == 0 ? 0 : 1;
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cerr << e.what() << "\n";
+            status = 1;
+        }
+        blosc2_destroy();
+        return status;
+    }
+
+    if (*benchmark)
+    {
+        blosc2_init();
+        RegisterLocoCodec();
+        int status = 0;
+        try
+        {
+            WriteCodecBenchmark(benchmarkFilePath, benchmarkFrames, benchmarkMosaicWidth, benchmarkMosaicHeight,
+                                std::cout);
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cerr << e.what() << "\n";
+            status = 1;
+        }
+        blosc2_destroy();
+        return status;
+    }
+
+    if (*benchmarkClassifier)
+    {
+        try
+        {
+            std::vector<SpectralClassifier> classifiers;
+            if (!benchmarkClassifierPath.empty())
+            {
+                classifiers.push_back(SpectralClassifier::Load(benchmarkClassifierPath));
+            }
+            else
+            {
+                for (int nBands : {16, 25})
+                {
+                    classifiers.push_back(CreateRandomClassifier(nBands, benchmarkClassifierClasses, false));
+                    classifiers.push_back(CreateRandomClassifier(nBands, benchmarkClassifierClasses, true));
+                }
+            }
+            WriteClassifierBenchmark(classifiers, benchmarkClassifierFrames, benchmarkClassifierWidth,
+                                     benchmarkClassifierHeight, std::cout);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    if (*calibrateAlignment)
+    {
+        blosc2_init();
+        RegisterLocoCodec();
+        int status = 0;
+        try
+        {
+            ViewAlignment alignment = CalibrateViewAlignment(
+                alignmentSourcePath, alignmentSourceMosaicWidth, alignmentSourceMosaicHeight, alignmentTargetPath,
+                alignmentTargetMosaic, cv::Size(alignmentPatternColumns, alignmentPatternRows), alignmentFrame);
+            WriteViewAlignment(alignmentOutputPath, alignment);
+            std::cout << "Reprojection error: " << alignment.reprojectionError << " pixels\n";
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << "\n";
+            status = 1;
+        }
+        blosc2_destroy();
+        return status;
+    }
+
+    if (*qa)
+    {
+        blosc2_init();
+        int status = 0;
+        try
+        {
+            WriteQualityReport(ReadFrameStatistics(qaFilePath), qaSaturationThreshold, qaUnderexposureThreshold,
+                               qaPerFrame, std::cout);
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cerr << e.what() << "\n";
+            status = 1;
+        }
+        blosc2_destroy();
+        return status;
+    }
+
     if (g_commandLineArguments.version)
     {
         std::cout << "Version: " << PROJECT_VERSION_MAJOR << "." << PROJECT_VERSION_MINOR << "."
@@ -0,0 +1,497 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "acquisitionDaemon.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <sstream>
+
+#include "bitDepth.h"
+#include "constants.h"
+#include "frameStatistics.h"
+#include "logger.h"
+#include "mirroredRecording.h"
+#include "writerQueue.h"
+
+AcquisitionDaemon::AcquisitionDaemon(DaemonOptions options, const std::shared_ptr<XiAPIWrapper> &xiAPIWrapper)
+    : m_options(std::move(options)), m_thermalGovernor(m_options.thermal)
+{
+    this->m_xiAPIWrapper = xiAPIWrapper == nullptr ? this->m_xiAPIWrapper : xiAPIWrapper;
+    m_cameraInterface.Initialize(this->m_xiAPIWrapper);
+    m_imageContainer.Initialize(this->m_xiAPIWrapper);
+    // a brief dropout of the camera does not end the recording
+    m_imageContainer.SetRecoveryHandler([this] {
+        if (m_cameraRecovery.Recover())
+        {
+            return true;
+        }
+        // the image container closes the recording on the polling thread next, the queued frames are written first
+        this->StopProcessingFrames();
+        return false;
+    });
+    this->RegisterMetadataProviders("");
+    // the slot runs on the polling thread, no event loop is needed
+    QObject::connect(&m_imageContainer, &ImageContainer::NewImage, [this] { this->HandleNewImage(); });
+}
+
+AcquisitionDaemon::~AcquisitionDaemon()
+{
+    try
+    {
+        boost::lock_guard<boost::mutex> guard(m_mutexCamera);
+        this->CloseCamera();
+    }
+    catch (const std::exception &e)
+    {
+        LOG_XILENS(error) << "Could not close camera: " << e.what();
+    }
+}
+
+void AcquisitionDaemon::Run()
+{
+    m_previewPublisher = std::make_unique<PreviewPublisher>(m_options.previewName);
+    {
+        ControlServer server(m_options.socketPath, [this](const std::string &command, const std::string &argument) {
+            return this->HandleCommand(command, argument);
+        });
+        boost::unique_lock<boost::mutex> lock(m_mutexShutdown);
+        while (!m_shutdownCondition.wait_for(lock, boost::chrono::seconds(TEMP_LOG_INTERVAL),
+                                             [this] { return m_shutdown; }))
+        {
+            // the shutdown command holds the camera lock while it takes the shutdown lock
+            lock.unlock();
+            this->UpdateCameraTemperature();
+            lock.lock();
+        }
+    }
+    boost::lock_guard<boost::mutex> guard(m_mutexCamera);
+    this->CloseCamera();
+    m_previewPublisher = nullptr;
+    LOG_XILENS(info) << "Acquisition daemon shut down";
+}
+
+std::string AcquisitionDaemon::HandleCommand(const std::string &command, const std::string &argument)
+{
+    boost::lock_guard<boost::mutex> guard(m_mutexCamera);
+    if (command == "status")
+    {
+        return this->GetStatus();
+    }
+    if (command == "preview")
+    {
+        return m_options.previewName;
+    }
+    if (command == "cameras")
+    {
+        return m_cameraInterface.GetAvailableCameraIdentifiers().join(",").toStdString();
+    }
+    if (command == "open")
+    {
+        this->OpenCamera(QString::fromStdString(argument));
+        return "";
+    }
+    if (command == "close")
+    {
+        this->CloseCamera();
+        return "";
+    }
+    if (command == "exposure")
+    {
+        if (!m_cameraOpen)
+        {
+            throw std::runtime_error("No camera is open.");
+        }
+        int exposureMs;
+        try
+        {
+            exposureMs = std::stoi(argument);
+        }
+        catch (const std::logic_error &)
+        {
+            throw std::runtime_error("Invalid exposure time: " + argument);
+        }
+        boost::lock_guard<boost::mutex> handleGuard(m_cameraInterface.m_mutexCameraHandle);
+        if (m_cameraInterface.m_cameraHandle == INVALID_HANDLE_VALUE)
+        {
+            throw std::runtime_error("The camera is being reopened.");
+        }
+        m_cameraInterface.m_camera->SetExposureMs(exposureMs);
+        return std::to_string(m_cameraInterface.m_camera->GetExposureMs());
+    }
+    if (command == "record")
+    {
+        return this->StartRecording(argument);
+    }
+    if (command == "stop")
+    {
+        return this->StopRecording();
+    }
+    if (command == "shutdown")
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutexShutdown);
+            m_shutdown = true;
+        }
+        m_shutdownCondition.notify_all();
+        return "";
+    }
+    throw std::runtime_error("Unknown command: " + command);
+}
+
+void AcquisitionDaemon::HandleNewImage()
+{
+    auto now = std::chrono::steady_clock::now();
+    bool preview =
+        m_previewPublisher && now - m_lastPreviewTime >= std::chrono::milliseconds(m_options.previewIntervalMs);
+    bool record = m_recording;
+    if (!preview && !record)
+    {
+        return;
+    }
+    boost::unique_lock<boost::mutex> lock(m_mutexFrameQueue);
+    if (m_frameQueueCount == m_frameQueue.size())
+    {
+        if (!record)
+        {
+            // previews are skipped while the processing thread is behind
+            return;
+        }
+        // the camera buffers the images acquired meanwhile, as it did when the polling thread wrote them itself
+        m_frameProcessed.wait(lock,
+                              [this] { return m_frameQueueCount < m_frameQueue.size() || !m_processingFrames; });
+        if (!m_processingFrames)
+        {
+            return;
+        }
+    }
+    // the processing thread never touches frames that are not queued, they can be filled without the lock
+    QueuedFrame &frame = m_frameQueue[(m_frameQueueHead + m_frameQueueCount) % m_frameQueue.size()];
+    lock.unlock();
+    XI_IMG image = m_imageContainer.GetCurrentImage();
+    if (image.bp == nullptr)
+    {
+        return;
+    }
+    const size_t nPixels = static_cast<size_t>(image.width) * image.height;
+    frame.pixels.resize(nPixels);
+    const auto *pixels = static_cast<const uint16_t *>(image.bp);
+    std::copy(pixels, pixels + nPixels, frame.pixels.begin());
+    frame.image = image;
+    frame.image.bp = frame.pixels.data();
+    frame.image.bp_size = static_cast<DWORD>(nPixels * sizeof(uint16_t));
+    frame.record = record;
+    frame.preview = preview;
+    if (preview)
+    {
+        m_lastPreviewTime = now;
+    }
+    lock.lock();
+    m_frameQueueCount++;
+    lock.unlock();
+    m_frameQueued.notify_one();
+}
+
+void AcquisitionDaemon::ProcessFrames()
+{
+    while (true)
+    {
+        QueuedFrame *frame;
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutexFrameQueue);
+            m_frameQueued.wait(lock, [this] { return m_frameQueueCount > 0 || !m_processingFrames; });
+            if (m_frameQueueCount == 0)
+            {
+                return;
+            }
+            frame = &m_frameQueue[m_frameQueueHead];
+        }
+        this->ProcessFrame(*frame);
+        {
+            boost::lock_guard<boost::mutex> guard(m_mutexFrameQueue);
+            m_frameQueueHead = (m_frameQueueHead + 1) % m_frameQueue.size();
+            m_frameQueueCount--;
+        }
+        m_frameProcessed.notify_all();
+    }
+}
+
+void AcquisitionDaemon::ProcessFrame(QueuedFrame &frame)
+{
+    if (frame.record)
+    {
+        // the frame statistics pass over the whole frame runs here, not on the polling thread
+        boost::lock_guard<boost::mutex> guard(m_mutexRecording);
+        if (m_imageContainer.m_imageFile)
+        {
+            try
+            {
+                m_metadataProviders.Sample(frame.image, m_metadataRecord);
+                m_imageContainer.m_imageFile->WriteImageData(frame.image, m_metadataRecord);
+                m_recordedFrames++;
+            }
+            catch (const std::runtime_error &e)
+            {
+                m_failedFrames++;
+                LOG_XILENS(error) << "Error while saving image: " << e.what();
+            }
+        }
+    }
+    if (frame.preview)
+    {
+        m_previewPublisher->Publish(frame.image, m_recording, m_recordedFrames);
+    }
+}
+
+void AcquisitionDaemon::StartProcessingFrames()
+{
+    m_frameQueue.resize(RECORDING_BACKLOG_CAPACITY);
+    m_frameQueueHead = 0;
+    m_frameQueueCount = 0;
+    m_processingFrames = true;
+    m_processingThread = boost::thread([this] { this->ProcessFrames(); });
+}
+
+void AcquisitionDaemon::StopProcessingFrames()
+{
+    {
+        boost::lock_guard<boost::mutex> guard(m_mutexFrameQueue);
+        m_processingFrames = false;
+    }
+    m_frameQueued.notify_all();
+    m_frameProcessed.notify_all();
+    if (m_processingThread.joinable())
+    {
+        m_processingThread.join();
+    }
+}
+
+void AcquisitionDaemon::WaitForQueuedFrames()
+{
+    boost::unique_lock<boost::mutex> lock(m_mutexFrameQueue);
+    m_frameProcessed.wait(lock, [this] { return m_frameQueueCount == 0 || !m_processingFrames; });
+}
+
+std::string AcquisitionDaemon::GetStatus()
+{
+    std::ostringstream status;
+    status << "camera=" << (m_cameraOpen ? m_cameraInterface.m_cameraIdentifier.toStdString() : "none")
+           << " recording=" << (m_recording ? 1 : 0) << " received=" << m_imageContainer.GetReceivedImageCount()
+           << " recorded=" << m_recordedFrames << " failed=" << m_failedFrames
+           << " segment=" << m_cameraRecovery.GetSegment() << " thermal_step=" << m_thermalGovernor.GetStep();
+    if (m_cameraOpen)
+    {
+        boost::lock_guard<boost::mutex> handleGuard(m_cameraInterface.m_mutexCameraHandle);
+        // the exposure time is unknown while the camera is being reopened
+        if (m_cameraInterface.m_cameraHandle != INVALID_HANDLE_VALUE)
+        {
+            status << " exposure=" << m_cameraInterface.m_camera->GetExposureMs();
+        }
+        status << " bit_depth=" << m_cameraInterface.m_camera->GetDataBitDepth();
+    }
+    // the path is the last entry, such that it can hold spaces
+    boost::lock_guard<boost::mutex> guard(m_mutexRecording);
+    if (m_recording)
+    {
+        auto *mirrored = dynamic_cast<MirroredFileImage *>(m_imageContainer.m_imageFile.get());
+        if (mirrored != nullptr)
+        {
+            // images are written with the recording mutex locked, the status of the mirrors is consistent
+            size_t healthy = 0;
+            size_t pending = 0;
+            auto mirrorStatus = mirrored->GetMirrorStatus();
+            for (const auto &mirror : mirrorStatus)
+            {
+                healthy += mirror.healthy ? 1 : 0;
+                pending = std::max(pending, mirror.healthy ? mirror.pendingImages : 0);
+            }
+            status << " mirrors=" << healthy << "/" << mirrorStatus.size() << " mirror_pending=" << pending;
+        }
+        status << " file=" << m_imageContainer.m_imageFile->GetFilePath();
+    }
+    return status.str();
+}
+
+void AcquisitionDaemon::OpenCamera(const QString &cameraIdentifier)
+{
+    // clients that attach again open the camera the daemon already acquires from, this must not stop the recording
+    if (m_cameraOpen && cameraIdentifier == m_cameraInterface.m_cameraIdentifier)
+    {
+        return;
+    }
+    this->CloseCamera();
+    QString cameraModel = cameraIdentifier.split("@").at(0);
+    if (!getCameraMapper().contains(cameraModel))
+    {
+        throw std::runtime_error("Camera model not in CAMERA_MAPPER: " + cameraModel.toStdString());
+    }
+    if (!m_cameraInterface.m_availableCameras.contains(cameraIdentifier))
+    {
+        m_cameraInterface.GetAvailableCameraIdentifiers();
+    }
+    m_cameraInterface.m_cameraIdentifier = cameraIdentifier;
+    m_cameraInterface.SetCameraProperties(cameraModel);
+    m_cameraInterface.StartAcquisition(cameraIdentifier);
+    // the providers depend on the bit depth queried when the camera is opened, frames are polled only afterwards
+    this->RegisterMetadataProviders(cameraModel);
+    m_cameraRecovery.Reset();
+    m_thermalGovernor.Reset();
+    m_cameraInterface.m_camera->m_cameraFamily->get()->UpdateCameraTemperature();
+    this->StartProcessingFrames();
+    m_imageContainer.StartPolling();
+    m_pollingThread = boost::thread([this] {
+        try
+        {
+            m_imageContainer.PollImage(&m_cameraInterface.m_cameraHandle, 5);
+        }
+        catch (const std::exception &e)
+        {
+            // the image container closes the recording when the camera fails
+            boost::lock_guard<boost::mutex> guard(m_mutexRecording);
+            m_recording = false;
+            LOG_XILENS(error) << "Acquisition stopped: " << e.what();
+        }
+    });
+    m_cameraOpen = true;
+    LOG_XILENS(info) << "Started acquisition of " << cameraIdentifier.toStdString();
+}
+
+void AcquisitionDaemon::CloseCamera()
+{
+    if (!m_cameraOpen)
+    {
+        return;
+    }
+    if (m_recording)
+    {
+        this->StopRecording();
+    }
+    m_cameraOpen = false;
+    m_imageContainer.StopPolling();
+    m_pollingThread.interrupt();
+    m_pollingThread.join();
+    this->StopProcessingFrames();
+    m_cameraInterface.StopAcquisition();
+    m_cameraInterface.CloseDevice();
+    LOG_XILENS(info) << "Stopped acquisition";
+}
+
+std::string AcquisitionDaemon::StartRecording(const std::string &filePath)
+{
+    if (!m_cameraOpen)
+    {
+        throw std::runtime_error("No camera is open.");
+    }
+    if (filePath.empty())
+    {
+        throw std::runtime_error("No file path given.");
+    }
+    boost::lock_guard<boost::mutex> guard(m_mutexRecording);
+    if (m_recording)
+    {
+        throw std::runtime_error("Already recording to " + m_imageContainer.m_imageFile->GetFilePath());
+    }
+    RecordingOptions options = m_options.recording;
+    std::string fullPath = filePath + (options.stripeFolders.empty() ? ".b2nd" : RECORDING_MANIFEST_EXTENSION);
+    boost::filesystem::path parent = boost::filesystem::path(fullPath).parent_path();
+    if (!parent.empty())
+    {
+        boost::filesystem::create_directories(parent);
+    }
+    if (!m_options.mirrorFolder.empty())
+    {
+        boost::filesystem::create_directories(m_options.mirrorFolder);
+        options.mirrorFilePath =
+            (boost::filesystem::path(m_options.mirrorFolder) / boost::filesystem::path(fullPath).filename()).string();
+    }
+    m_imageContainer.InitializeFile(fullPath.c_str(), m_metadataProviders.GetSchema(), options);
+    if (options.stripeFolders.empty())
+    {
+        // striped recordings already write each stripe on its own thread, other files are written on a dedicated
+        // thread such that a slow disk does not stall the polling thread
+        XI_IMG image = m_imageContainer.GetCurrentImage();
+        m_imageContainer.m_imageFile = std::make_unique<WriterQueue>(
+            std::move(m_imageContainer.m_imageFile), RECORDING_BACKLOG_CAPACITY, image.height, image.width);
+    }
+    m_metadataRecord = m_metadataProviders.GetSchema().CreateRecord();
+    m_recordedFrames = 0;
+    m_failedFrames = 0;
+    m_recording = true;
+    LOG_XILENS(info) << "Recording to " << fullPath;
+    return fullPath;
+}
+
+std::string AcquisitionDaemon::StopRecording()
+{
+    std::unique_ptr<RecordingFile> file;
+    {
+        boost::lock_guard<boost::mutex> guard(m_mutexRecording);
+        if (!m_recording)
+        {
+            throw std::runtime_error("Not recording.");
+        }
+        m_recording = false;
+    }
+    // the polling thread does not queue frames for the recording anymore, the frames already queued are written
+    this->WaitForQueuedFrames();
+    {
+        boost::lock_guard<boost::mutex> guard(m_mutexRecording);
+        file = std::move(m_imageContainer.m_imageFile);
+    }
+    // the file is closed outside the lock, such that the previews continue while the queued images are written
+    file->AppendMetadata();
+    std::string filePath = file->GetFilePath();
+    file = nullptr;
+    LOG_XILENS(info) << "Total of frames recorded: " << m_recordedFrames;
+    LOG_XILENS(info) << "Total of frames that could not be saved: " << m_failedFrames;
+    return filePath;
+}
+
+void AcquisitionDaemon::UpdateCameraTemperature()
+{
+    // the temperature metadata is cached, see CameraTemperatureProvider
+    boost::lock_guard<boost::mutex> guard(m_mutexCamera);
+    if (!m_cameraOpen)
+    {
+        return;
+    }
+    boost::lock_guard<boost::mutex> handleGuard(m_cameraInterface.m_mutexCameraHandle);
+    if (m_cameraInterface.m_cameraHandle == INVALID_HANDLE_VALUE)
+    {
+        // the camera is being reopened, the temperature is updated again at the next interval
+        return;
+    }
+    try
+    {
+        m_cameraInterface.m_camera->m_cameraFamily->get()->UpdateCameraTemperature();
+        GovernFrameRate(m_thermalGovernor, *m_cameraInterface.m_camera);
+    }
+    catch (const std::exception &e)
+    {
+        LOG_XILENS(warning) << "Could not update camera temperature: " << e.what();
+    }
+}
+
+void AcquisitionDaemon::RegisterMetadataProviders(const QString &cameraModel)
+{
+    m_metadataProviders = MetadataProviderRegistry();
+    m_metadataProviders.Register(std::make_shared<ImageMetadataProvider>());
+    m_metadataProviders.Register(std::make_shared<CameraTemperatureProvider>(&m_cameraInterface.m_cameraFamily));
+    m_metadataProviders.Register(std::make_shared<AcquisitionSegmentProvider>(&m_cameraRecovery));
+    m_metadataProviders.Register(std::make_shared<ThermalGovernorProvider>(&m_thermalGovernor));
+    // the camera reports its bit depth once opened, the default is assumed before
+    int sensorBitDepth = DEFAULT_BIT_DEPTH;
+    int dataBitDepth = DEFAULT_BIT_DEPTH;
+    if (m_cameraInterface.m_camera != nullptr)
+    {
+        sensorBitDepth = m_cameraInterface.m_camera->GetSensorBitDepth();
+        dataBitDepth = m_cameraInterface.m_camera->GetDataBitDepth();
+    }
+    m_metadataProviders.Register(std::make_shared<BitDepthProvider>(sensorBitDepth, dataBitDepth));
+    auto frameStatistics = FrameStatisticsProvider::FromCameraData(getCameraMapper().value(cameraModel), dataBitDepth);
+    m_metadataProviders.Register(frameStatistics);
+    m_options.recording.compression.mosaicWidth = frameStatistics->GetMosaicWidth();
+    m_options.recording.compression.mosaicHeight = frameStatistics->GetMosaicHeight();
+    m_metadataRecord = m_metadataProviders.GetSchema().CreateRecord();
+}
@@ -0,0 +1,210 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_ACQUISITION_DAEMON_H
+#define XILENS_ACQUISITION_DAEMON_H
+
+#include <atomic>
+#include <boost/thread.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cameraInterface.h"
+#include "cameraRecovery.h"
+#include "daemonControl.h"
+#include "imageContainer.h"
+#include "metadataProviders.h"
+#include "previewChannel.h"
+#include "thermalGovernor.h"
+#include "xiAPIWrapper.h"
+
+/**
+ * @brief Options of the acquisition daemon.
+ */
+struct DaemonOptions
+{
+    /**
+     * Path of the local control socket, see ControlServer.
+     */
+    std::string socketPath = DAEMON_CONTROL_DEFAULT_SOCKET;
+
+    /**
+     * Name of the shared memory object where previews are published, see PreviewPublisher.
+     */
+    std::string previewName = PREVIEW_CHANNEL_DEFAULT_NAME;
+
+    /**
+     * Shortest time between two published previews, previews are only meant to be looked at.
+     */
+    int previewIntervalMs = 35;
+
+    /**
+     * Layout and compression of the recordings, the mirror file path is derived from DaemonOptions::mirrorFolder.
+     */
+    RecordingOptions recording;
+
+    /**
+     * Folder where a second copy of each recording is written, see MirroredFileImage. Ignored when empty.
+     */
+    std::string mirrorFolder;
+
+    /**
+     * Thresholds of the thermal governor, it is disabled by default.
+     */
+    ThermalGovernorOptions thermal;
+};
+
+/**
+ * @brief Runs the acquisition and recording pipeline without a user interface.
+ *
+ * The daemon owns the camera and the recording file, it is controlled through a local socket and publishes previews of
+ * the acquired images through shared memory. The GUI attaches to it as a client, so a GUI that hangs, crashes or is
+ * restarted does not interrupt the acquisition nor the recording. The commands of the control socket are:
+ *  - `status`: state of the daemon as `key=value` pairs, see ParseControlStatus.
+ *  - `preview`: name of the shared memory object of the previews.
+ *  - `cameras`: comma separated identifiers of the connected cameras.
+ *  - `open <camera identifier>`: starts the acquisition of a camera, replacing the current one. Opening the camera
+ *    that is already open keeps the acquisition and the recording running, such that clients can attach again.
+ *  - `close`: stops the recording, if any, and the acquisition.
+ *  - `exposure <milliseconds>`: sets the exposure time, the reply holds the exposure time set by the camera.
+ *  - `record <file path>`: starts recording to the given path, without extension. The reply holds the full path.
+ *  - `stop`: stops the recording, the reply holds the path of the closed recording.
+ *  - `shutdown`: stops the recording and the acquisition and makes AcquisitionDaemon::Run return.
+ */
+class AcquisitionDaemon
+{
+  public:
+    /**
+     * @param options options of the daemon
+     * @param xiAPIWrapper wrapper of the xiAPI, useful for mocking the API during testing
+     */
+    explicit AcquisitionDaemon(DaemonOptions options, const std::shared_ptr<XiAPIWrapper> &xiAPIWrapper = nullptr);
+
+    ~AcquisitionDaemon();
+
+    AcquisitionDaemon(const AcquisitionDaemon &) = delete;
+    AcquisitionDaemon &operator=(const AcquisitionDaemon &) = delete;
+
+    /**
+     * Opens the control socket and the preview channel and serves requests until the `shutdown` command is received.
+     * The camera temperature is updated periodically while waiting.
+     *
+     * @throws std::runtime_error if the control socket or the preview channel can not be created
+     */
+    void Run();
+
+    /**
+     * Handles a command of the control socket, see the class description.
+     *
+     * @param command name of the command
+     * @param argument argument of the command
+     * @return result of the command
+     * @throws std::runtime_error if the command is unknown or fails
+     */
+    std::string HandleCommand(const std::string &command, const std::string &argument);
+
+  private:
+    /**
+     * A copy of an image waiting in the frame queue of the daemon
+     */
+    struct QueuedFrame
+    {
+        XI_IMG image;
+        std::vector<uint16_t> pixels;
+        bool record = false;
+        bool preview = false;
+    };
+
+    /**
+     * Called from the polling thread for each new image, copies it to the frame queue when it needs to be recorded or
+     * previewed. The polling thread only waits for the processing thread when the queue is full while recording.
+     */
+    void HandleNewImage();
+
+    /**
+     * Runs on the processing thread until AcquisitionDaemon::StopProcessingFrames is called and the queue is empty.
+     */
+    void ProcessFrames();
+
+    /**
+     * Samples the metadata of a queued frame and writes it to the recording, and publishes it as preview.
+     */
+    void ProcessFrame(QueuedFrame &frame);
+
+    void StartProcessingFrames();
+
+    /**
+     * Processes the frames left in the queue and stops the processing thread, does nothing if it is not running.
+     */
+    void StopProcessingFrames();
+
+    /**
+     * Waits until the processing thread has processed all queued frames.
+     */
+    void WaitForQueuedFrames();
+
+    std::string GetStatus();
+
+    void OpenCamera(const QString &cameraIdentifier);
+
+    void CloseCamera();
+
+    std::string StartRecording(const std::string &filePath);
+
+    std::string StopRecording();
+
+    void UpdateCameraTemperature();
+
+    /**
+     * Registers the metadata providers of a camera model, see MainWindow::RegisterMetadataProviders.
+     */
+    void RegisterMetadataProviders(const QString &cameraModel);
+
+    DaemonOptions m_options;
+    std::shared_ptr<XiAPIWrapper> m_xiAPIWrapper = std::make_shared<XiAPIWrapper>();
+    CameraInterface m_cameraInterface;
+    CameraRecovery m_cameraRecovery{&m_cameraInterface};
+    ThermalGovernor m_thermalGovernor;
+    ImageContainer m_imageContainer;
+    MetadataProviderRegistry m_metadataProviders;
+    FrameMetadataRecord m_metadataRecord;
+    std::unique_ptr<PreviewPublisher> m_previewPublisher;
+    boost::thread m_pollingThread;
+    std::chrono::steady_clock::time_point m_lastPreviewTime;
+
+    /**
+     * Ring of frames copied by the polling thread for the processing thread, the metadata providers and the recording
+     * file are only used by the processing thread while the camera is open.
+     */
+    std::vector<QueuedFrame> m_frameQueue;
+    size_t m_frameQueueHead = 0;
+    size_t m_frameQueueCount = 0;
+    bool m_processingFrames = false;
+    boost::mutex m_mutexFrameQueue;
+    boost::condition_variable m_frameQueued;
+    boost::condition_variable m_frameProcessed;
+    boost::thread m_processingThread;
+
+    /**
+     * Serializes the commands and the temperature updates, which both access the camera.
+     */
+    boost::mutex m_mutexCamera;
+    bool m_cameraOpen = false;
+
+    /**
+     * Guards the recording file, the processing thread holds it while it writes an image.
+     */
+    boost::mutex m_mutexRecording;
+    std::atomic<bool> m_recording{false};
+    std::atomic<uint64_t> m_recordedFrames{0};
+    std::atomic<uint64_t> m_failedFrames{0};
+
+    boost::mutex m_mutexShutdown;
+    boost::condition_variable m_shutdownCondition;
+    bool m_shutdown = false;
+};
+
+#endif // XILENS_ACQUISITION_DAEMON_H
@@ -0,0 +1,597 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "archiveMigrator.h"
+
+#include <b2nd.h>
+#include <blosc2.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "constants.h"
+#include "logger.h"
+#include "util.h"
+
+/**
+ * Name of the journal file stored in the staging folder.
+ */
+static const char *JOURNAL_FILE_NAME = ".xilens_archive_journal";
+
+/**
+ * Size of the blocks copied at once.
+ */
+static const size_t COPY_BLOCK_SIZE = 1 << 20;
+
+/**
+ * Flushes a file or a folder to the disk, such that a following rename or journal entry can not be persisted before
+ * the content it refers to.
+ */
+static void SyncToDisk(const std::string &path)
+{
+    int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+    {
+        throw std::runtime_error("could not open " + path + " to flush it to disk");
+    }
+    int result = fsync(descriptor);
+    close(descriptor);
+    if (result != 0)
+    {
+        throw std::runtime_error("could not flush " + path + " to disk");
+    }
+}
+
+ArchiveMigrator::ArchiveMigrator(std::string stagingFolder, uint64_t bandwidthBytesPerSecond,
+                                 int archiveCompressionLevel)
+    : m_stagingFolder(std::move(stagingFolder)), m_bandwidthBytesPerSecond(bandwidthBytesPerSecond),
+      m_archiveCompressionLevel(archiveCompressionLevel)
+{
+}
+
+ArchiveMigrator::~ArchiveMigrator()
+{
+    this->Stop();
+}
+
+std::string ArchiveMigrator::GetJournalPath() const
+{
+    return (boost::filesystem::path(m_stagingFolder) / JOURNAL_FILE_NAME).string();
+}
+
+void ArchiveMigrator::Start()
+{
+    boost::filesystem::create_directories(m_stagingFolder);
+
+    // replay the journal, jobs without a matching done entry were interrupted
+    std::map<std::string, MigrationJob> pending;
+    std::vector<std::string> order;
+    std::ifstream journal(GetJournalPath());
+    std::string line;
+    while (std::getline(journal, line))
+    {
+        std::stringstream entry(line);
+        std::string state;
+        MigrationJob job;
+        if (!std::getline(entry, state, '\t') || !std::getline(entry, job.source, '\t') ||
+            !std::getline(entry, job.destination))
+        {
+            LOG_XILENS(warning) << "Ignoring malformed archive journal entry: " << line;
+            continue;
+        }
+        if (state == "PENDING")
+        {
+            if (pending.find(job.source) == pending.end())
+            {
+                order.push_back(job.source);
+            }
+            pending[job.source] = job;
+        }
+        else if (state == "DONE")
+        {
+            pending.erase(job.source);
+        }
+    }
+    journal.close();
+    for (auto job = pending.begin(); job != pending.end();)
+    {
+        // the transfer finished but the application stopped before it was marked as done
+        if (!boost::filesystem::exists(job->second.source) && boost::filesystem::exists(job->second.destination))
+        {
+            LOG_XILENS(info) << "Archive transfer of " << job->second.source << " already finished";
+            job = pending.erase(job);
+        }
+        else
+        {
+            ++job;
+        }
+    }
+
+    // compact the journal such that it only contains pending jobs
+    std::string compactedPath = GetJournalPath() + ".tmp";
+    {
+        std::ofstream compacted(compactedPath, std::ios::trunc);
+        boost::lock_guard<boost::mutex> guard(m_mutex);
+        for (const auto &source : order)
+        {
+            auto job = pending.find(source);
+            if (job != pending.end())
+            {
+                compacted << "PENDING\t" << job->second.source << "\t" << job->second.destination << "\n";
+                m_jobs.push_back(job->second);
+            }
+        }
+        compacted.flush();
+        if (!compacted)
+        {
+            throw std::runtime_error("could not write archive journal " + compactedPath);
+        }
+    }
+    SyncToDisk(compactedPath);
+    boost::filesystem::rename(compactedPath, GetJournalPath());
+    SyncToDisk(m_stagingFolder);
+    if (!m_jobs.empty())
+    {
+        LOG_XILENS(info) << "Resuming " << m_jobs.size() << " interrupted archive transfers";
+    }
+
+    {
+        boost::lock_guard<boost::mutex> guard(m_mutex);
+        m_running = true;
+    }
+    m_thread = boost::thread(&ArchiveMigrator::Run, this);
+}
+
+void ArchiveMigrator::Stop()
+{
+    {
+        boost::lock_guard<boost::mutex> guard(m_mutex);
+        m_running = false;
+    }
+    m_jobsCondition.notify_all();
+    if (m_thread.joinable())
+    {
+        // a transfer in progress is interrupted, it stays in the journal and restarts with the next start
+        m_thread.interrupt();
+        m_thread.join();
+    }
+}
+
+void ArchiveMigrator::Enqueue(const std::string &source, const std::string &destination)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    MigrationJob job{source, this->GetUniqueDestination(destination)};
+    if (job.destination != destination)
+    {
+        LOG_XILENS(warning) << destination << " is already archived, archiving " << source << " to "
+                            << job.destination << " instead";
+    }
+    // the job is journaled before it is queued, such that it is not started before it can be resumed
+    this->AppendJournalEntry("PENDING", job);
+    m_jobs.push_back(job);
+    lock.unlock();
+    m_jobsCondition.notify_all();
+}
+
+std::string ArchiveMigrator::GetUniqueDestination(const std::string &destination) const
+{
+    auto isTaken = [this](const std::string &path) {
+        return boost::filesystem::exists(path) ||
+               std::any_of(m_jobs.begin(), m_jobs.end(),
+                           [&path](const MigrationJob &job) { return job.destination == path; });
+    };
+    boost::filesystem::path path(destination);
+    std::string unique = destination;
+    for (int i = 1; isTaken(unique); i++)
+    {
+        unique = (path.parent_path() / (path.stem().string() + "_" + std::to_string(i) + path.extension().string()))
+                     .string();
+    }
+    return unique;
+}
+
+size_t ArchiveMigrator::GetPendingJobs()
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    return m_jobs.size();
+}
+
+void ArchiveMigrator::WaitUntilIdle()
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_jobsCondition.wait(lock, [this] { return m_jobs.empty() || !m_running; });
+}
+
+void ArchiveMigrator::Run()
+{
+    try
+    {
+        while (true)
+        {
+            MigrationJob job;
+            {
+                boost::unique_lock<boost::mutex> lock(m_mutex);
+                m_jobsCondition.wait(lock, [this] { return !m_jobs.empty() || !m_running; });
+                if (!m_running)
+                {
+                    return;
+                }
+                job = m_jobs.front();
+            }
+            try
+            {
+                this->Migrate(job);
+                this->AppendJournalEntry("DONE", job);
+                LOG_XILENS(info) << "Archived " << job.source << " to " << job.destination;
+            }
+            catch (const boost::thread_interrupted &)
+            {
+                throw;
+            }
+            catch (const std::exception &e)
+            {
+                // the job stays in the journal and is retried the next time the migrator starts
+                LOG_XILENS(error) << "Could not archive " << job.source << ": " << e.what();
+            }
+            {
+                boost::lock_guard<boost::mutex> guard(m_mutex);
+                m_jobs.pop_front();
+            }
+            m_jobsCondition.notify_all();
+        }
+    }
+    catch (const boost::thread_interrupted &)
+    {
+        LOG_XILENS(info) << "Archive migrator stopped";
+    }
+}
+
+void ArchiveMigrator::EnableNearLossless(const SensorNoiseModel &noiseModel, double tolerance)
+{
+    if (tolerance > 0 && noiseModel.readNoise <= 0 && noiseModel.gain <= 0)
+    {
+        // without noise there are no bits to drop, the copies would be lossless but marked as near-lossless
+        throw std::invalid_argument("The near-lossless mode needs the read noise or the gain of the sensor.");
+    }
+    m_quantizer = std::make_unique<NearLosslessQuantizer>(noiseModel, tolerance);
+}
+
+bool ArchiveMigrator::ShouldRecompress(const std::string &source) const
+{
+    return (m_archiveCompressionLevel > 0 || m_quantizer) &&
+           boost::filesystem::path(source).extension().string() == ".b2nd";
+}
+
+bool ArchiveMigrator::IsArchivedCopy(const std::string &source, const std::string &copy) const
+{
+    if (!this->ShouldRecompress(source))
+    {
+        return ComputeFileCRC32(source) == ComputeFileCRC32(copy);
+    }
+    if (m_quantizer)
+    {
+        try
+        {
+            return VerifyNearLossless(source, copy).violations == 0;
+        }
+        catch (const std::runtime_error &)
+        {
+            // the copy is not near-lossless or does not have the shape of the source
+            return false;
+        }
+    }
+    return ComputeB2NDDataCRC32(source) == ComputeB2NDDataCRC32(copy);
+}
+
+void ArchiveMigrator::Migrate(const MigrationJob &job)
+{
+    if (boost::filesystem::exists(job.destination))
+    {
+        if (!boost::filesystem::exists(job.source))
+        {
+            return;
+        }
+        // the transfer was interrupted after the rename, existing recordings are never overwritten
+        if (!this->IsArchivedCopy(job.source, job.destination))
+        {
+            throw std::runtime_error("refusing to overwrite " + job.destination + " with a different recording");
+        }
+        boost::filesystem::remove(job.source);
+        return;
+    }
+
+    std::string transferSource = job.source;
+    bool recompress = this->ShouldRecompress(job.source);
+    if (recompress)
+    {
+        transferSource = job.source + ".archive";
+        // near-lossless copies keep the compression level of the recordings unless another one is given
+        int compressionLevel =
+            m_archiveCompressionLevel > 0 ? m_archiveCompressionLevel : CreateRecordingCParams().clevel;
+        RecompressB2ND(job.source, transferSource, compressionLevel, m_quantizer.get());
+        if (!this->IsArchivedCopy(job.source, transferSource))
+        {
+            boost::filesystem::remove(transferSource);
+            throw std::runtime_error("recompressed data does not match the original data");
+        }
+    }
+
+    boost::filesystem::path destination(job.destination);
+    if (destination.has_parent_path())
+    {
+        boost::filesystem::create_directories(destination.parent_path());
+    }
+    std::string partialPath = job.destination + ".part";
+    uint32_t sourceCRC = this->CopyWithBandwidthLimit(transferSource, partialPath);
+    if (ComputeFileCRC32(partialPath) != sourceCRC)
+    {
+        boost::filesystem::remove(partialPath);
+        throw std::runtime_error("checksum of archived file does not match the checksum of the staged file");
+    }
+    // the content is on disk before the rename, and the rename before the staged file is removed
+    SyncToDisk(partialPath);
+    // rename is atomic, the archive never contains partially written recordings
+    boost::filesystem::rename(partialPath, job.destination);
+    SyncToDisk(boost::filesystem::absolute(destination).parent_path().string());
+    if (recompress)
+    {
+        boost::filesystem::remove(transferSource);
+    }
+    boost::filesystem::remove(job.source);
+}
+
+uint32_t ArchiveMigrator::CopyWithBandwidthLimit(const std::string &source, const std::string &destination)
+{
+    std::ifstream input(source, std::ios::binary);
+    if (!input)
+    {
+        throw std::runtime_error("could not open " + source);
+    }
+    std::ofstream output(destination, std::ios::binary | std::ios::trunc);
+    if (!output)
+    {
+        throw std::runtime_error("could not open " + destination);
+    }
+
+    boost::crc_32_type crc;
+    std::vector<char> buffer(COPY_BLOCK_SIZE);
+    uint64_t copiedBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (input)
+    {
+        input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        std::streamsize readBytes = input.gcount();
+        if (readBytes <= 0)
+        {
+            break;
+        }
+        crc.process_bytes(buffer.data(), static_cast<size_t>(readBytes));
+        output.write(buffer.data(), readBytes);
+        if (!output)
+        {
+            throw std::runtime_error("could not write to " + destination);
+        }
+        copiedBytes += static_cast<uint64_t>(readBytes);
+
+        if (m_bandwidthBytesPerSecond > 0)
+        {
+            auto expected = std::chrono::microseconds(copiedBytes * 1000000 / m_bandwidthBytesPerSecond);
+            auto elapsed =
+                std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+            if (expected > elapsed)
+            {
+                boost::this_thread::sleep_for(boost::chrono::microseconds((expected - elapsed).count()));
+            }
+        }
+        boost::this_thread::interruption_point();
+    }
+    output.flush();
+    return crc.checksum();
+}
+
+void ArchiveMigrator::AppendJournalEntry(const std::string &state, const MigrationJob &job)
+{
+    boost::lock_guard<boost::mutex> guard(m_journalMutex);
+    std::ofstream journal(GetJournalPath(), std::ios::app);
+    journal << state << "\t" << job.source << "\t" << job.destination << "\n";
+    journal.close();
+    if (!journal)
+    {
+        throw std::runtime_error("could not write archive journal " + GetJournalPath());
+    }
+    SyncToDisk(GetJournalPath());
+}
+
+uint32_t ComputeFileCRC32(const std::string &filePath)
+{
+    std::ifstream input(filePath, std::ios::binary);
+    if (!input)
+    {
+        throw std::runtime_error("could not open " + filePath);
+    }
+    boost::crc_32_type crc;
+    std::vector<char> buffer(COPY_BLOCK_SIZE);
+    while (input)
+    {
+        input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        crc.process_bytes(buffer.data(), static_cast<size_t>(input.gcount()));
+    }
+    return crc.checksum();
+}
+
+uint32_t ComputeB2NDDataCRC32(const std::string &filePath)
+{
+    b2nd_array_t *src;
+    int result = b2nd_open(filePath.c_str(), &src);
+    HandleBLOSCResult(result, "b2nd_open");
+    if (src->ndim != 3)
+    {
+        b2nd_free(src);
+        throw std::runtime_error("expected an array of images: " + filePath);
+    }
+    int64_t frameShape[] = {1, src->shape[1], src->shape[2]};
+    int64_t frameSize = src->shape[1] * src->shape[2] * src->sc->typesize;
+    std::vector<uint8_t> frame(static_cast<size_t>(frameSize));
+    boost::crc_32_type crc;
+    for (int64_t i = 0; i < src->shape[0]; i++)
+    {
+        int64_t start[] = {i, 0, 0};
+        int64_t stop[] = {i + 1, src->shape[1], src->shape[2]};
+        result = b2nd_get_slice_cbuffer(src, start, stop, frame.data(), frameShape, frameSize);
+        if (result != 0)
+        {
+            b2nd_free(src);
+            HandleBLOSCResult(result, "b2nd_get_slice_cbuffer");
+        }
+        crc.process_bytes(frame.data(), frame.size());
+    }
+    b2nd_free(src);
+    return crc.checksum();
+}
+
+/**
+ * Writes the quantized frames of an array of 16 bit images to a new array and stores the noise model and error bound of
+ * the quantizer in its metadata. The source array is freed on error.
+ *
+ * @return context of the new array
+ */
+static b2nd_context_t *CreateQuantizedCopy(b2nd_array_t *src, blosc2_storage *storage,
+                                           const NearLosslessQuantizer &quantizer, b2nd_array_t **dst)
+{
+    if (src->ndim != 3 || src->sc->typesize != sizeof(uint16_t) ||
+        blosc2_vlmeta_exists(src->sc, NEAR_LOSSLESS_KEY) >= 0)
+    {
+        b2nd_free(src);
+        throw std::runtime_error("only lossless arrays of 16 bit images can be stored near-lossless");
+    }
+    int64_t shape[] = {0, src->shape[1], src->shape[2]};
+    b2nd_context_t *ctx = b2nd_create_ctx(storage, src->ndim, shape, src->chunkshape, src->blockshape, src->dtype,
+                                          src->dtype_format, nullptr, 0);
+    int result = b2nd_empty(ctx, dst);
+    if (result != 0)
+    {
+        b2nd_free_ctx(ctx);
+        b2nd_free(src);
+        HandleBLOSCResult(result, "b2nd_empty");
+    }
+
+    int64_t frameShape[] = {1, src->shape[1], src->shape[2]};
+    std::vector<uint16_t> frame(static_cast<size_t>(src->shape[1] * src->shape[2]));
+    const auto frameSize = static_cast<int64_t>(frame.size() * sizeof(uint16_t));
+    unsigned int maxError = 0;
+    for (int64_t i = 0; i < src->shape[0] && result == 0; i++)
+    {
+        int64_t start[] = {i, 0, 0};
+        int64_t stop[] = {i + 1, src->shape[1], src->shape[2]};
+        result = b2nd_get_slice_cbuffer(src, start, stop, frame.data(), frameShape, frameSize);
+        if (result == 0)
+        {
+            maxError = std::max(maxError, quantizer.Quantize(frame.data(), frame.size()));
+            result = b2nd_append(*dst, frame.data(), frameSize, 0);
+        }
+    }
+    if (result != 0)
+    {
+        b2nd_free(*dst);
+        b2nd_free_ctx(ctx);
+        b2nd_free(src);
+        HandleBLOSCResult(result, "near-lossless copy");
+    }
+
+    std::map<std::string, double> parameters = {{"read_noise", quantizer.GetNoiseModel().readNoise},
+                                                {"gain", quantizer.GetNoiseModel().gain},
+                                                {"tolerance", quantizer.GetTolerance()},
+                                                {"max_error", maxError}};
+    msgpack::sbuffer buffer;
+    msgpack::pack(buffer, parameters);
+    result = blosc2_vlmeta_add((*dst)->sc, NEAR_LOSSLESS_KEY, reinterpret_cast<uint8_t *>(buffer.data()),
+                               static_cast<int32_t>(buffer.size()), nullptr);
+    if (result < 0)
+    {
+        b2nd_free(*dst);
+        b2nd_free_ctx(ctx);
+        b2nd_free(src);
+        throw std::runtime_error("could not store the parameters of the near-lossless copy: " + std::to_string(result));
+    }
+    return ctx;
+}
+
+void RecompressB2ND(const std::string &source, const std::string &destination, int compressionLevel,
+                    const NearLosslessQuantizer *quantizer)
+{
+    b2nd_array_t *src;
+    int result = b2nd_open(source.c_str(), &src);
+    HandleBLOSCResult(result, "b2nd_open");
+
+    blosc2_cparams cparams = BLOSC2_CPARAMS_DEFAULTS;
+    cparams.typesize = src->sc->typesize;
+    cparams.compcode = BLOSC_ZSTD;
+    cparams.filters[BLOSC2_MAX_FILTERS - 2] = BLOSC_BITSHUFFLE;
+    cparams.filters[BLOSC2_MAX_FILTERS - 1] = BLOSC_SHUFFLE;
+    cparams.clevel = static_cast<uint8_t>(compressionLevel);
+    cparams.nthreads = 4;
+
+    blosc2_storage storage = BLOSC2_STORAGE_DEFAULTS;
+    storage.contiguous = true;
+    storage.cparams = &cparams;
+    std::vector<char> urlpath(destination.begin(), destination.end());
+    urlpath.push_back('\0');
+    storage.urlpath = urlpath.data();
+
+    blosc2_remove_urlpath(destination.c_str());
+    b2nd_array_t *dst;
+    b2nd_context_t *ctx;
+    if (quantizer == nullptr)
+    {
+        ctx = b2nd_create_ctx(&storage, src->ndim, src->shape, src->chunkshape, src->blockshape, src->dtype,
+                              src->dtype_format, nullptr, 0);
+        result = b2nd_copy(ctx, src, &dst);
+        if (result != 0)
+        {
+            b2nd_free_ctx(ctx);
+            b2nd_free(src);
+            HandleBLOSCResult(result, "b2nd_copy");
+        }
+    }
+    else
+    {
+        ctx = CreateQuantizedCopy(src, &storage, *quantizer, &dst);
+    }
+
+    // copy variable length metadata as is, such that the archived file is self-describing
+    std::vector<char *> names(static_cast<size_t>(src->sc->nvlmetalayers));
+    int nNames = blosc2_vlmeta_get_names(src->sc, names.data());
+    for (int i = 0; i < nNames; i++)
+    {
+        uint8_t *content = nullptr;
+        int32_t contentLength = 0;
+        if (blosc2_vlmeta_get(src->sc, names[i], &content, &contentLength) >= 0)
+        {
+            if (blosc2_vlmeta_exists(dst->sc, names[i]) < 0)
+            {
+                blosc2_vlmeta_add(dst->sc, names[i], content, contentLength, nullptr);
+            }
+            else
+            {
+                blosc2_vlmeta_update(dst->sc, names[i], content, contentLength, nullptr);
+            }
+            free(content);
+        }
+        // the names are owned by the super-chunk
+    }
+
+    b2nd_free(dst);
+    b2nd_free_ctx(ctx);
+    b2nd_free(src);
+}
@@ -0,0 +1,212 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_ARCHIVE_MIGRATOR_H
+#define XILENS_ARCHIVE_MIGRATOR_H
+
+#include <boost/thread.hpp>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "nearLossless.h"
+
+/**
+ * @brief Single transfer of a finalized recording from the staging folder to the archive.
+ */
+struct MigrationJob
+{
+    /**
+     * Path of the recording in the staging folder.
+     */
+    std::string source;
+
+    /**
+     * Path where the recording is stored in the archive.
+     */
+    std::string destination;
+};
+
+/**
+ * @brief Moves finalized recordings from a fast local staging folder to the archive in the background.
+ *
+ * Recordings are written to the staging folder at acquisition speed, once a file is closed it is handed over to the
+ * migrator, which copies it to the archive on its own thread. This decouples the acquisition from the speed of the
+ * archive, e.g. a network share. Each transfer:
+ *  1. optionally recompresses the file with a higher compression level, the decompressed data is verified against the
+ *     original before continuing. Near-lossless copies are verified against the error bound of their noise model,
+ *  2. copies the file to `<destination>.part` limiting the bandwidth and computing a CRC32 of the bytes read,
+ *  3. verifies the CRC32 of the written file, flushes it to disk and renames it atomically to its destination,
+ *  4. removes the file from the staging folder.
+ *
+ * Jobs are stored in a journal inside the staging folder before they are started and marked as done once finished,
+ * every journal entry is flushed to disk. Jobs that were interrupted, e.g. by a crash or by closing the application,
+ * are restarted from scratch the next time the migrator starts, unless their file already left the staging folder.
+ * Recordings in the archive are never overwritten.
+ */
+class ArchiveMigrator
+{
+  public:
+    /**
+     * Constructs the migrator, the journal of the staging folder is not read until ArchiveMigrator::Start is called.
+     *
+     * @param stagingFolder folder where recordings are written during acquisition, the journal is stored here.
+     * @param bandwidthBytesPerSecond maximum transfer rate to the archive, 0 disables the limit.
+     * @param archiveCompressionLevel compression level used to recompress `.b2nd` files, 0 copies files unchanged.
+     */
+    ArchiveMigrator(std::string stagingFolder, uint64_t bandwidthBytesPerSecond, int archiveCompressionLevel);
+
+    /**
+     * Stops the migrator, pending jobs stay in the journal.
+     */
+    ~ArchiveMigrator();
+
+    /**
+     * Stores `.b2nd` files near-lossless in the archive, see NearLosslessQuantizer. Needs to be called before
+     * ArchiveMigrator::Start.
+     *
+     * @param noiseModel noise of the sensor used for the recordings.
+     * @param tolerance maximum error as a fraction of the standard deviation of the noise.
+     * @throws std::invalid_argument if the tolerance is positive but the noise model has neither read noise nor gain.
+     */
+    void EnableNearLossless(const SensorNoiseModel &noiseModel, double tolerance);
+
+    /**
+     * Restarts the jobs pending in the journal and starts the thread in charge of the transfers.
+     */
+    void Start();
+
+    /**
+     * Stops the thread in charge of the transfers. A transfer in progress is interrupted, it stays in the journal and
+     * restarts the next time the migrator starts.
+     */
+    void Stop();
+
+    /**
+     * Adds a job to the journal and to the queue of transfers. If the destination already exists or is the destination
+     * of a queued job, e.g. when recordings of the same name are made in test mode, a suffix `_<n>` is appended to the
+     * file name.
+     *
+     * @param source path of the recording in the staging folder.
+     * @param destination path where the recording should be stored in the archive.
+     */
+    void Enqueue(const std::string &source, const std::string &destination);
+
+    /**
+     * Queries the number of jobs not finished yet, including the one in progress.
+     */
+    size_t GetPendingJobs();
+
+    /**
+     * Blocks until all jobs are finished.
+     */
+    void WaitUntilIdle();
+
+    /**
+     * Queries the path of the journal file.
+     */
+    std::string GetJournalPath() const;
+
+  private:
+    /**
+     * Loop of the transfer thread.
+     */
+    void Run();
+
+    /**
+     * Queries a destination that is neither in the archive nor the destination of a queued job. Must be called with
+     * ArchiveMigrator::m_mutex locked.
+     *
+     * @param destination path where the recording should be stored in the archive.
+     * @return the destination itself, or the destination with the first free suffix `_<n>`.
+     */
+    std::string GetUniqueDestination(const std::string &destination) const;
+
+    /**
+     * Checks if the file is recompressed before it is copied to the archive.
+     */
+    bool ShouldRecompress(const std::string &source) const;
+
+    /**
+     * Checks that a copy holds the same recording as the source, byte by byte for copied files and by their data for
+     * recompressed recordings.
+     */
+    bool IsArchivedCopy(const std::string &source, const std::string &copy) const;
+
+    /**
+     * Executes all steps of a job. A job whose destination already holds its recording, because it was interrupted
+     * after the rename, only removes the staged file.
+     *
+     * @throws std::runtime_error if any of the steps fails or the destination holds a different file.
+     */
+    void Migrate(const MigrationJob &job);
+
+    /**
+     * Copies a file limiting the bandwidth.
+     *
+     * @return CRC32 of the copied bytes.
+     */
+    uint32_t CopyWithBandwidthLimit(const std::string &source, const std::string &destination);
+
+    /**
+     * Appends an entry to the journal and flushes it to disk.
+     */
+    void AppendJournalEntry(const std::string &state, const MigrationJob &job);
+
+    std::string m_stagingFolder;
+    uint64_t m_bandwidthBytesPerSecond;
+    int m_archiveCompressionLevel;
+
+    /**
+     * Quantizer of near-lossless copies, null when the archive is lossless.
+     */
+    std::unique_ptr<NearLosslessQuantizer> m_quantizer;
+
+    /**
+     * Jobs waiting to be transferred, the first one is in progress while the transfer thread works on it.
+     */
+    std::deque<MigrationJob> m_jobs;
+
+    boost::mutex m_mutex;
+    boost::mutex m_journalMutex;
+    boost::condition_variable m_jobsCondition;
+    boost::thread m_thread;
+    bool m_running = false;
+};
+
+/**
+ * Computes the CRC32 of the content of a file.
+ *
+ * @param filePath path to the file.
+ * @return CRC32 of all bytes of the file.
+ * @throws std::runtime_error if the file can not be read.
+ */
+uint32_t ComputeFileCRC32(const std::string &filePath);
+
+/**
+ * Computes the CRC32 of the decompressed images of a `.b2nd` file, reading one frame at a time.
+ *
+ * @param filePath path to the file.
+ * @return CRC32 of the decompressed data.
+ * @throws std::runtime_error if the file can not be read.
+ */
+uint32_t ComputeB2NDDataCRC32(const std::string &filePath);
+
+/**
+ * Writes a copy of a `.b2nd` file compressed with a different compression level. The variable length metadata is
+ * copied unchanged.
+ *
+ * @param source path to the original file.
+ * @param destination path of the recompressed file, overwritten if it exists.
+ * @param compressionLevel blosc2 compression level of the copy.
+ * @param quantizer quantizer of the images of a near-lossless copy, the noise model and the largest error bound are
+ * stored under NEAR_LOSSLESS_KEY. The copy is lossless when null.
+ * @throws std::runtime_error if the file can not be recompressed or a near-lossless copy is requested for a file that
+ * is already near-lossless.
+ */
+void RecompressB2ND(const std::string &source, const std::string &destination, int compressionLevel,
+                    const NearLosslessQuantizer *quantizer = nullptr);
+
+#endif // XILENS_ARCHIVE_MIGRATOR_H
@@ -0,0 +1,89 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "bitDepth.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "constants.h"
+#include "recordingFormat.h"
+
+int GetDisplayShift(int bitDepth)
+{
+    if (bitDepth < MIN_BIT_DEPTH || bitDepth > MAX_BIT_DEPTH)
+    {
+        throw std::invalid_argument("Unsupported bit depth: " + std::to_string(bitDepth));
+    }
+    return bitDepth - MIN_BIT_DEPTH;
+}
+
+/**
+ * Shifts the raw values of an image to 8 bit, row by row in parallel.
+ *
+ * @tparam Shift shift known at compile time, such that the loop is vectorized, or -1 to use the given shift.
+ * @param image raw image of depth CV_16U.
+ * @param converted allocated image of depth CV_8U with the size and channels of the image.
+ * @param shift shift used when Shift is -1.
+ */
+template <int Shift> static void ShiftTo8Bit(const cv::Mat &image, cv::Mat &converted, int shift)
+{
+    const int bits = Shift >= 0 ? Shift : shift;
+    const int length = image.cols * image.channels();
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range &range) {
+        for (int row = range.start; row < range.end; row++)
+        {
+            const auto *input = image.ptr<uint16_t>(row);
+            auto *output = converted.ptr<uchar>(row);
+            for (int i = 0; i < length; i++)
+            {
+                output[i] = static_cast<uchar>(std::min(input[i] >> bits, 255));
+            }
+        }
+    });
+}
+
+void ConvertTo8Bit(const cv::Mat &image, cv::Mat &converted, int bitDepth)
+{
+    if (image.depth() != CV_16U)
+    {
+        throw std::invalid_argument("Raw images of depth CV_16U are converted to 8 bit.");
+    }
+    const int shift = GetDisplayShift(bitDepth);
+    // converted into a new matrix, such that the image can be replaced by the converted image
+    cv::Mat result(image.size(), CV_8UC(image.channels()));
+    switch (bitDepth)
+    {
+    case 8:
+        ShiftTo8Bit<0>(image, result, shift);
+        break;
+    case 10:
+        ShiftTo8Bit<2>(image, result, shift);
+        break;
+    case 12:
+        ShiftTo8Bit<4>(image, result, shift);
+        break;
+    case 16:
+        ShiftTo8Bit<8>(image, result, shift);
+        break;
+    default:
+        ShiftTo8Bit<-1>(image, result, shift);
+        break;
+    }
+    converted = result;
+}
+
+void BitDepthProvider::DeclareFields(MetadataSchema &schema)
+{
+    m_sensorOffset = schema.AddIntField(SENSOR_BIT_DEPTH_KEY);
+    m_dataOffset = schema.AddIntField(DATA_BIT_DEPTH_KEY);
+}
+
+void BitDepthProvider::Sample(const XI_IMG &image, FrameMetadataRecord &record) const
+{
+    (void)image;
+    record.intValues[m_sensorOffset] = m_sensorBitDepth;
+    record.intValues[m_dataOffset] = m_dataBitDepth;
+}
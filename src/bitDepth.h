@@ -0,0 +1,60 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_BIT_DEPTH_H
+#define XILENS_BIT_DEPTH_H
+
+#include <opencv2/core/core.hpp>
+
+#include "metadataProviders.h"
+
+/**
+ * Number of bits the raw values are shifted to the right to convert them to 8 bit for display.
+ *
+ * @param bitDepth bit depth of the raw values, see Camera::GetDataBitDepth.
+ * @throws std::invalid_argument if the bit depth is not between MIN_BIT_DEPTH and MAX_BIT_DEPTH.
+ */
+int GetDisplayShift(int bitDepth);
+
+/**
+ * Converts raw values to 8 bit by shifting them to the right, values above the maximum of the bit depth saturate. The
+ * common bit depths of 8, 10, 12 and 16 bit are converted by kernels specialized for their shift.
+ *
+ * @param image raw image of type CV_16U with any number of channels.
+ * @param converted converted image of type CV_8U with the channels of the image, can be the same matrix as the image.
+ * @param bitDepth bit depth of the raw values.
+ * @throws std::invalid_argument if the image is not of depth CV_16U or the bit depth is out of range.
+ */
+void ConvertTo8Bit(const cv::Mat &image, cv::Mat &converted, int bitDepth);
+
+/**
+ * @brief Provides the bit depth of the sensor and of the raw values of the camera, such that the values of a recording
+ * can be interpreted, e.g. converted to 8 bit by the viewer.
+ */
+class BitDepthProvider : public MetadataProvider
+{
+  public:
+    /**
+     * Constructs the provider.
+     *
+     * @param sensorBitDepth bit depth of the sensor, see Camera::GetSensorBitDepth.
+     * @param dataBitDepth bit depth of the raw values, see Camera::GetDataBitDepth.
+     */
+    BitDepthProvider(int sensorBitDepth, int dataBitDepth)
+        : m_sensorBitDepth(sensorBitDepth), m_dataBitDepth(dataBitDepth)
+    {
+    }
+
+    void DeclareFields(MetadataSchema &schema) override;
+
+    void Sample(const XI_IMG &image, FrameMetadataRecord &record) const override;
+
+  private:
+    int m_sensorBitDepth;
+    int m_dataBitDepth;
+    size_t m_sensorOffset = 0;
+    size_t m_dataOffset = 0;
+};
+
+#endif // XILENS_BIT_DEPTH_H
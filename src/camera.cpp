@@ -3,7 +3,9 @@
  * License: see LICENSE.md file
  *******************************************************/
 
+#include <algorithm>
 #include <boost/thread.hpp>
+#include <cmath>
 
 #include "camera.h"
 
@@ -19,6 +21,22 @@ QMap<QString, float> CameraFamily::GetCameraTemperature()
     return this->m_cameraTemperature;
 }
 
+void CameraFamily::PublishLatestTemperature(std::initializer_list<QString> keys)
+{
+    for (size_t i = 0; i < N_TEMPERATURE_KEYS; i++)
+    {
+        if (std::find(keys.begin(), keys.end(), TEMPERATURE_KEYS[i]) != keys.end())
+        {
+            m_latestTemperature[i].store(m_cameraTemperature.value(TEMPERATURE_KEYS[i]), std::memory_order_relaxed);
+        }
+    }
+}
+
+float CameraFamily::GetLatestTemperature(size_t index) const
+{
+    return m_latestTemperature.at(index).load(std::memory_order_relaxed);
+}
+
 int Camera::InitializeCamera()
 {
     return 0;
@@ -32,6 +50,10 @@ int Camera::InitializeCameraCommonParameters()
     stat = this->m_apiWrapper->xiSetParamInt(*m_cameraHandle, XI_PRM_IMAGE_DATA_FORMAT, XI_RAW16);
     HandleResult(stat, "xiSetParam (data format raw16)");
 
+    m_sensorBitDepth = this->QueryBitDepth(XI_PRM_SENSOR_DATA_BIT_DEPTH);
+    m_dataBitDepth = this->QueryBitDepth(XI_PRM_IMAGE_DATA_BIT_DEPTH);
+    LOG_XILENS(info) << "sensor bit depth " << m_sensorBitDepth << ", image data bit depth " << m_dataBitDepth;
+
     stat = this->m_apiWrapper->xiSetParamInt(*m_cameraHandle, XI_PRM_RECENT_FRAME, 1);
     HandleResult(stat, "xiSetParam (set to acquire most recent frame)");
 
@@ -47,8 +69,9 @@ int Camera::InitializeCameraCommonParameters()
     stat = this->m_apiWrapper->xiGetParamInt(*m_cameraHandle, XI_PRM_FRAMERATE XI_PRM_INFO_MAX, &current_max_framerate);
     HandleResult(stat, "get current maximum frame rate");
 
-    stat = this->m_apiWrapper->xiSetParamInt(*m_cameraHandle, XI_PRM_FRAMERATE,
-                                             std::min(FRAMERATE_MAX, current_max_framerate));
+    // a camera reopened after a dropout keeps the frame rate reduced by the thermal governor
+    m_fullFrameRate = std::min(FRAMERATE_MAX, current_max_framerate);
+    stat = this->m_apiWrapper->xiSetParamInt(*m_cameraHandle, XI_PRM_FRAMERATE, this->GetFrameRateLimit());
     HandleResult(stat, "set maximum frame rate for ultra-fast cameras");
 
     stat = this->m_apiWrapper->xiSetParamInt(*m_cameraHandle, XI_PRM_DOWNSAMPLING, 1);
@@ -75,7 +98,8 @@ int Camera::InitializeCameraCommonParameters()
     stat = this->m_apiWrapper->xiSetParamFloat(*m_cameraHandle, XI_PRM_EXP_PRIORITY, 1.);
     HandleResult(stat, "if autoexposure is used: only change exposure, not gain");
 
-    this->SetExposure(40000);
+    // a camera reopened after a dropout keeps the exposure time set before, see Camera::RestoreExposureSettings
+    this->SetExposure(m_exposureUs > 0 ? m_exposureUs.load() : 40000);
     return stat;
 }
 
@@ -142,6 +166,7 @@ void XiSpecFamily::UpdateCameraTemperature()
     this->m_cameraTemperature[HOUSE_TEMP] = houseTemp;
     this->m_cameraTemperature[HOUSE_BACK_TEMP] = houseBackSideTemp;
     this->m_cameraTemperature[SENSOR_BOARD_TEMP] = sensorBoardTemp;
+    this->PublishLatestTemperature({CHIP_TEMP, HOUSE_TEMP, HOUSE_BACK_TEMP, SENSOR_BOARD_TEMP});
 }
 
 void XiCFamily::UpdateCameraTemperature()
@@ -150,6 +175,7 @@ void XiCFamily::UpdateCameraTemperature()
     float sensorBoardTemp;
     this->m_apiWrapper->xiGetParamFloat(*m_cameraHandle, XI_PRM_SENSOR_BOARD_TEMP, &sensorBoardTemp);
     this->m_cameraTemperature[SENSOR_BOARD_TEMP] = sensorBoardTemp;
+    this->PublishLatestTemperature({SENSOR_BOARD_TEMP});
 }
 
 void XiQFamily::UpdateCameraTemperature()
@@ -166,6 +192,7 @@ void XiQFamily::UpdateCameraTemperature()
         this->m_cameraTemperature[HOUSE_TEMP] = houseTemp;
         this->m_cameraTemperature[HOUSE_BACK_TEMP] = houseBackSideTemp;
         this->m_cameraTemperature[SENSOR_BOARD_TEMP] = sensorBoardTemp;
+        this->PublishLatestTemperature({CHIP_TEMP, HOUSE_TEMP, HOUSE_BACK_TEMP, SENSOR_BOARD_TEMP});
     }
 }
 
@@ -177,6 +204,7 @@ void Camera::SetExposure(int exp)
         // Setting "exposure" parameter (10ms=10000us)
         stat = this->m_apiWrapper->xiSetParamInt(*m_cameraHandle, XI_PRM_EXPOSURE, exp);
         HandleResult(stat, "xiSetParam (exposure set)");
+        m_exposureUs = exp;
         LOG_XILENS(info) << "set exposure to " << exp / 1000 << "ms\n" << std::flush;
     }
     else
@@ -221,9 +249,65 @@ void Camera::AutoExposure(bool on)
     {
         stat = this->m_apiWrapper->xiSetParamInt(*m_cameraHandle, XI_PRM_AEAG, on);
         HandleResult(stat, "xiSetParam (autoexposure on/off)");
+        m_autoExposure = on;
     }
     else
     {
         LOG_XILENS(warning) << "autoexposure not set: camera not initialized";
     }
 }
+
+void Camera::RestoreExposureSettings()
+{
+    if (m_autoExposure)
+    {
+        this->AutoExposure(true);
+    }
+    else if (m_exposureUs > 0)
+    {
+        this->SetExposure(m_exposureUs);
+    }
+}
+
+void Camera::SetFrameRateFraction(double fraction)
+{
+    m_frameRateFraction = std::max(0., std::min(fraction, 1.));
+    if (INVALID_HANDLE_VALUE != *m_cameraHandle && m_fullFrameRate > 0)
+    {
+        int frameRate = this->GetFrameRateLimit();
+        int stat = this->m_apiWrapper->xiSetParamInt(*m_cameraHandle, XI_PRM_FRAMERATE, frameRate);
+        HandleResult(stat, "xiSetParam (frame rate)");
+        LOG_XILENS(info) << "set frame rate to " << frameRate << "fps";
+    }
+    else
+    {
+        LOG_XILENS(warning) << "frame rate not set: camera not initialized";
+    }
+}
+
+int Camera::GetFrameRateLimit() const
+{
+    return std::max(1, static_cast<int>(std::lround(m_fullFrameRate * m_frameRateFraction)));
+}
+
+int Camera::GetSensorBitDepth() const
+{
+    return m_sensorBitDepth;
+}
+
+int Camera::GetDataBitDepth() const
+{
+    return m_dataBitDepth;
+}
+
+int Camera::QueryBitDepth(const char *parameter)
+{
+    int bitDepth = 0;
+    int stat = this->m_apiWrapper->xiGetParamInt(*m_cameraHandle, parameter, &bitDepth);
+    if (stat != XI_OK || bitDepth < MIN_BIT_DEPTH || bitDepth > MAX_BIT_DEPTH)
+    {
+        LOG_XILENS(warning) << "could not query " << parameter << ", assuming " << DEFAULT_BIT_DEPTH << " bit";
+        return DEFAULT_BIT_DEPTH;
+    }
+    return bitDepth;
+}
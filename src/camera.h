@@ -8,7 +8,11 @@
 
 #include <QMap>
 #include <QString>
+#include <array>
+#include <atomic>
 #include <boost/thread.hpp>
+#include <initializer_list>
+#include <limits>
 #include <xiApi.h>
 
 #include "constants.h"
@@ -31,9 +35,27 @@ class CameraFamily
      */
     boost::mutex m_mutexCameraTemperature;
 
+    /**
+     * Latest temperature values in the order of TEMPERATURE_KEYS. These can be read from any thread without locking.
+     * Temperatures the camera family does not report stay NaN, so that they cannot be mistaken for measurements.
+     */
+    std::array<std::atomic<float>, N_TEMPERATURE_KEYS> m_latestTemperature{};
+
+    /**
+     * Copies the values of CameraFamily::m_cameraTemperature to the lock-free cache. Should be called with
+     * CameraFamily::m_mutexCameraTemperature locked at the end of each temperature update.
+     *
+     * @param keys temperatures queried from the camera, the others are left untouched.
+     */
+    void PublishLatestTemperature(std::initializer_list<QString> keys);
+
   public:
     explicit CameraFamily(HANDLE *handle) : m_cameraHandle(handle)
     {
+        for (auto &temperature : m_latestTemperature)
+        {
+            temperature.store(std::numeric_limits<float>::quiet_NaN(), std::memory_order_relaxed);
+        }
     }
 
     /**
@@ -94,6 +116,14 @@ class CameraFamily
      * Queries camera temperature
      */
     QMap<QString, float> GetCameraTemperature();
+
+    /**
+     * Queries the latest temperature without locking nor communicating with the camera, safe to call for every frame.
+     *
+     * @param index index of the temperature in TEMPERATURE_KEYS.
+     * @return temperature in degrees Celsius, NaN if the camera family does not report it or it was not queried yet.
+     */
+    float GetLatestTemperature(size_t index) const;
 };
 
 /**
@@ -300,6 +330,79 @@ class Camera
      * lighting conditions.
      */
     void AutoExposure(bool on);
+
+    /**
+     * Applies again the exposure time and auto exposure mode last set through this object, e.g. after the camera was
+     * reopened. Nothing is applied for settings that were never set.
+     */
+    void RestoreExposureSettings();
+
+    /**
+     * Sets the frame rate to a fraction of the full frame rate of the camera, e.g. to let the camera cool down, see
+     * ThermalGovernor. The fraction is kept when the camera is initialized again after a dropout.
+     *
+     * @param fraction fraction of the full frame rate, from 0 to 1.
+     */
+    void SetFrameRateFraction(double fraction);
+
+    /**
+     * Queries the bit depth of the values digitized by the sensor, determined at initialization.
+     *
+     * @return bit depth from MIN_BIT_DEPTH to MAX_BIT_DEPTH, DEFAULT_BIT_DEPTH before the camera was initialized.
+     */
+    int GetSensorBitDepth() const;
+
+    /**
+     * Queries the bit depth of the raw values of the images, determined at initialization. The values are transferred
+     * as 16 bit, but only reach the maximum of this bit depth.
+     *
+     * @return bit depth from MIN_BIT_DEPTH to MAX_BIT_DEPTH, DEFAULT_BIT_DEPTH before the camera was initialized.
+     */
+    int GetDataBitDepth() const;
+
+  private:
+    /**
+     * Frame rate applied for the current fraction of the full frame rate, at least 1fps.
+     */
+    int GetFrameRateLimit() const;
+
+    /**
+     * Queries a bit depth parameter of the camera, cameras that do not report it or report a bit depth out of range
+     * are assumed to deliver DEFAULT_BIT_DEPTH.
+     *
+     * @param parameter XI_PRM_SENSOR_DATA_BIT_DEPTH or XI_PRM_IMAGE_DATA_BIT_DEPTH.
+     */
+    int QueryBitDepth(const char *parameter);
+
+    /**
+     * Full frame rate of the camera determined at initialization, 0 before the camera was initialized.
+     */
+    std::atomic<int> m_fullFrameRate{0};
+
+    /**
+     * Fraction of the full frame rate last set.
+     */
+    std::atomic<double> m_frameRateFraction{1};
+
+    /**
+     * Exposure time last set in microseconds, 0 if it was never set.
+     */
+    std::atomic<int> m_exposureUs{0};
+
+    /**
+     * Whether auto exposure was last turned on.
+     */
+    std::atomic<bool> m_autoExposure{false};
+
+    /**
+     * Bit depth of the sensor determined at initialization.
+     */
+    std::atomic<int> m_sensorBitDepth{DEFAULT_BIT_DEPTH};
+
+    /**
+     * Bit depth of the raw values of the images determined at initialization.
+     */
+    std::atomic<int> m_dataBitDepth{DEFAULT_BIT_DEPTH};
 };
 
 /**
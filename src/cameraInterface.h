@@ -12,6 +12,7 @@
 #include <QtCore>
 #include <boost/asio/io_service.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
 #include <opencv2/core/core.hpp>
 #include <string>
 
@@ -268,6 +269,14 @@ class CameraInterface : public QObject
      * of the camera module.
      */
     HANDLE m_cameraHandle;
+
+    /**
+     * @brief Guards the camera handle while CameraRecovery replaces it on the polling thread.
+     *
+     * Threads that use the camera while it acquires, e.g. to update its temperature or to set the exposure time, hold
+     * it and skip their work while the handle is invalid, i.e. while the camera is being reopened.
+     */
+    boost::mutex m_mutexCameraHandle;
 };
 
 #endif // CAMERA_INTERFACE_H
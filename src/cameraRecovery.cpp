@@ -0,0 +1,116 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "cameraRecovery.h"
+
+#include <boost/thread.hpp>
+#include <chrono>
+
+#include "logger.h"
+#include "recordingFormat.h"
+#include "util.h"
+
+CameraRecovery::CameraRecovery(CameraInterface *cameraInterface, int timeoutMs, int retryMs)
+    : m_cameraInterface(cameraInterface), m_timeoutMs(timeoutMs), m_retryMs(retryMs)
+{
+}
+
+bool CameraRecovery::Recover()
+{
+    auto start = std::chrono::steady_clock::now();
+    LOG_XILENS(warning) << "Camera dropped out, reopening " << m_cameraInterface->m_cameraIdentifier.toStdString();
+    this->ReleaseCamera();
+    while (true)
+    {
+        try
+        {
+            this->ReopenCamera();
+            auto dropout =
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            // the duration is published first, such that frames of the new segment never get the previous duration
+            m_lastDropoutMs = dropout.count();
+            m_segment++;
+            LOG_XILENS(info) << "Camera recovered after " << dropout.count() << "ms, acquisition segment "
+                             << m_segment;
+            return true;
+        }
+        catch (const std::exception &e)
+        {
+            LOG_XILENS(debug) << "Could not reopen camera: " << e.what();
+            this->ReleaseCamera();
+        }
+        if (std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(m_timeoutMs))
+        {
+            LOG_XILENS(error) << "Camera did not come back within " << m_timeoutMs << "ms";
+            return false;
+        }
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(m_retryMs));
+    }
+}
+
+void CameraRecovery::Reset()
+{
+    m_lastDropoutMs = 0;
+    m_segment = 0;
+}
+
+int64_t CameraRecovery::GetSegment() const
+{
+    return m_segment;
+}
+
+int64_t CameraRecovery::GetLastDropoutMs() const
+{
+    return m_lastDropoutMs;
+}
+
+void CameraRecovery::ReopenCamera()
+{
+    CameraInterface &cameraInterface = *m_cameraInterface;
+    boost::lock_guard<boost::mutex> guard(cameraInterface.m_mutexCameraHandle);
+    QString cameraIdentifier = cameraInterface.m_cameraIdentifier;
+    // the device index can change when the camera is enumerated again, the identifier holds the serial number
+    if (!cameraInterface.GetAvailableCameraIdentifiers().contains(cameraIdentifier))
+    {
+        throw std::runtime_error("Camera not connected: " + cameraIdentifier.toStdString());
+    }
+    int stat = cameraInterface.m_apiWrapper->xiOpenDevice(cameraInterface.m_availableCameras[cameraIdentifier],
+                                                          &cameraInterface.m_cameraHandle);
+    HandleResult(stat, "xiOpenDevice");
+    if (cameraInterface.GetCameraIdentifier(cameraInterface.m_cameraHandle) != cameraIdentifier)
+    {
+        throw std::runtime_error("Opened camera is not the same as the selected one.");
+    }
+    stat = cameraInterface.m_camera->InitializeCamera();
+    HandleResult(stat, "InitializeCamera");
+    cameraInterface.m_camera->RestoreExposureSettings();
+    stat = cameraInterface.m_apiWrapper->xiStartAcquisition(cameraInterface.m_cameraHandle);
+    HandleResult(stat, "xiStartAcquisition");
+}
+
+void CameraRecovery::ReleaseCamera()
+{
+    CameraInterface &cameraInterface = *m_cameraInterface;
+    boost::lock_guard<boost::mutex> guard(cameraInterface.m_mutexCameraHandle);
+    if (cameraInterface.m_cameraHandle == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    cameraInterface.m_apiWrapper->xiStopAcquisition(cameraInterface.m_cameraHandle);
+    cameraInterface.m_apiWrapper->xiCloseDevice(cameraInterface.m_cameraHandle);
+    cameraInterface.m_cameraHandle = INVALID_HANDLE_VALUE;
+}
+
+void AcquisitionSegmentProvider::DeclareFields(MetadataSchema &schema)
+{
+    m_segmentOffset = schema.AddIntField(ACQUISITION_SEGMENT_KEY);
+    m_dropoutOffset = schema.AddIntField(DROPOUT_DURATION_KEY);
+}
+
+void AcquisitionSegmentProvider::Sample(const XI_IMG &image, FrameMetadataRecord &record) const
+{
+    (void)image;
+    record.intValues[m_segmentOffset] = m_recovery->GetSegment();
+    record.intValues[m_dropoutOffset] = m_recovery->GetLastDropoutMs();
+}
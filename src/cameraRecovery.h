@@ -0,0 +1,117 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_CAMERA_RECOVERY_H
+#define XILENS_CAMERA_RECOVERY_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "cameraInterface.h"
+#include "metadataProviders.h"
+
+/**
+ * Time during which a camera that dropped out is reopened before the acquisition is given up, in milliseconds.
+ */
+constexpr int CAMERA_RECOVERY_TIMEOUT_MS = 10000;
+
+/**
+ * Time between two attempts to reopen a camera that dropped out, in milliseconds.
+ */
+constexpr int CAMERA_RECOVERY_RETRY_MS = 20;
+
+/**
+ * @brief Reopens a camera that dropped out, e.g. after a brief USB glitch, and resumes its acquisition.
+ *
+ * The camera is looked up again by its identifier, which holds the sensor serial number, since the device index can
+ * change when the camera is enumerated again. The camera objects of the interface are kept, the device is initialized
+ * with the same parameters as when it was opened and the exposure settings are restored, see
+ * Camera::RestoreExposureSettings. Each recovery starts a new acquisition segment, recorded with each frame by
+ * AcquisitionSegmentProvider, such that recordings continue into the same file across dropouts. The handle of the
+ * camera is only replaced while CameraInterface::m_mutexCameraHandle is held.
+ */
+class CameraRecovery
+{
+  public:
+    /**
+     * Constructs the recovery of a camera.
+     *
+     * @param cameraInterface interface of the camera, the camera identifier and camera objects have to be set
+     * @param timeoutMs time during which the camera is reopened before Recover gives up, in milliseconds
+     * @param retryMs time between two attempts to reopen the camera, in milliseconds
+     */
+    explicit CameraRecovery(CameraInterface *cameraInterface, int timeoutMs = CAMERA_RECOVERY_TIMEOUT_MS,
+                            int retryMs = CAMERA_RECOVERY_RETRY_MS);
+
+    /**
+     * Reopens the camera after its acquisition failed and restarts the acquisition. Called on the polling thread, it
+     * is interrupted when the polling thread is interrupted.
+     *
+     * @return true if the acquisition was restarted, false if the camera did not come back before the timeout
+     */
+    bool Recover();
+
+    /**
+     * Starts again with the first acquisition segment, called when a new acquisition starts.
+     */
+    void Reset();
+
+    /**
+     * Index of the current acquisition segment, the number of recoveries since the acquisition started.
+     */
+    int64_t GetSegment() const;
+
+    /**
+     * Duration of the last dropout in milliseconds, from the failure to the restarted acquisition, 0 if the camera did
+     * not drop out.
+     */
+    int64_t GetLastDropoutMs() const;
+
+  private:
+    /**
+     * Looks the camera up by its identifier, opens and initializes it and starts the acquisition.
+     *
+     * @throws std::runtime_error if the camera is not connected or can not be opened
+     */
+    void ReopenCamera();
+
+    /**
+     * Releases the handle of the camera that dropped out, errors are expected since the device is gone.
+     */
+    void ReleaseCamera();
+
+    CameraInterface *m_cameraInterface;
+    int m_timeoutMs;
+    int m_retryMs;
+    std::atomic<int64_t> m_segment{0};
+    std::atomic<int64_t> m_lastDropoutMs{0};
+};
+
+/**
+ * @brief Provides the acquisition segment of each frame and the duration of the dropout that preceded it, see
+ * CameraRecovery.
+ */
+class AcquisitionSegmentProvider : public MetadataProvider
+{
+  public:
+    /**
+     * Constructs the provider.
+     *
+     * @param recovery recovery of the recorded camera, it has to outlive the provider
+     */
+    explicit AcquisitionSegmentProvider(const CameraRecovery *recovery) : m_recovery(recovery)
+    {
+    }
+
+    void DeclareFields(MetadataSchema &schema) override;
+
+    void Sample(const XI_IMG &image, FrameMetadataRecord &record) const override;
+
+  private:
+    const CameraRecovery *m_recovery;
+    size_t m_segmentOffset = 0;
+    size_t m_dropoutOffset = 0;
+};
+
+#endif // XILENS_CAMERA_RECOVERY_H
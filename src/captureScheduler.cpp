@@ -0,0 +1,446 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "captureScheduler.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "logger.h"
+#include "util.h"
+
+struct CaptureScheduler::Wait
+{
+    FrameCondition condition;
+    int timeoutMs;
+    CaptureToken token;
+    CaptureFrameHandler handler;
+
+    /**
+     * Fails the wait after the timeout, only used on the thread of the scheduler.
+     */
+    std::shared_ptr<boost::asio::steady_timer> timer;
+};
+
+/**
+ * Copy of a frame that satisfied a wait, the buffer of the camera is reused for the next frame.
+ */
+struct CaptureScheduler::Frame
+{
+    XI_IMG image;
+    std::vector<uint16_t> pixels;
+};
+
+void CaptureTask::promise_type::unhandled_exception()
+{
+    try
+    {
+        throw;
+    }
+    catch (const std::exception &e)
+    {
+        LOG_XILENS(error) << "Error in camera operation: " << e.what();
+    }
+}
+
+CaptureTask::CaptureTask(std::coroutine_handle<promise_type> handle) : m_handle(handle)
+{
+}
+
+CaptureTask::CaptureTask(CaptureTask &&other) noexcept : m_handle(std::exchange(other.m_handle, nullptr))
+{
+}
+
+CaptureTask &CaptureTask::operator=(CaptureTask &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+        m_handle = std::exchange(other.m_handle, nullptr);
+    }
+    return *this;
+}
+
+CaptureTask::~CaptureTask()
+{
+    if (m_handle)
+    {
+        m_handle.destroy();
+    }
+}
+
+void CaptureTask::Resume()
+{
+    // the coroutine destroys its frame when it returns
+    auto handle = std::exchange(m_handle, nullptr);
+    if (handle)
+    {
+        handle.resume();
+    }
+}
+
+SetParamIntAwaitable::SetParamIntAwaitable(CaptureScheduler *scheduler, std::shared_ptr<XiAPIWrapper> apiWrapper,
+                                           HANDLE *cameraHandle, boost::mutex *cameraHandleMutex,
+                                           std::string parameter, int value, CaptureToken token)
+    : m_scheduler(scheduler), m_apiWrapper(std::move(apiWrapper)), m_cameraHandle(cameraHandle),
+      m_cameraHandleMutex(cameraHandleMutex), m_parameter(std::move(parameter)), m_value(value),
+      m_token(std::move(token))
+{
+}
+
+void SetParamIntAwaitable::await_suspend(std::coroutine_handle<> coroutine)
+{
+    m_scheduler->AsyncSetParamInt(m_apiWrapper, m_cameraHandle, m_cameraHandleMutex, m_parameter, m_value, m_token,
+                                  [this, coroutine](std::exception_ptr error) {
+                                      m_error = std::move(error);
+                                      coroutine.resume();
+                                  });
+}
+
+void SetParamIntAwaitable::await_resume() const
+{
+    if (m_error != nullptr)
+    {
+        std::rethrow_exception(m_error);
+    }
+}
+
+WaitFrameAwaitable::WaitFrameAwaitable(CaptureScheduler *scheduler, FrameCondition condition, int timeoutMs,
+                                       CaptureToken token)
+    : m_scheduler(scheduler), m_condition(std::move(condition)), m_timeoutMs(timeoutMs), m_token(std::move(token))
+{
+}
+
+void WaitFrameAwaitable::await_suspend(std::coroutine_handle<> coroutine)
+{
+    m_scheduler->AsyncWaitFrame(m_condition, m_timeoutMs, m_token,
+                                [this, coroutine](std::exception_ptr error, const XI_IMG &image) {
+                                    m_error = std::move(error);
+                                    // resumed within the handler, which keeps the copy of the frame alive
+                                    m_image = &image;
+                                    coroutine.resume();
+                                });
+}
+
+const XI_IMG &WaitFrameAwaitable::await_resume() const
+{
+    if (m_error != nullptr)
+    {
+        std::rethrow_exception(m_error);
+    }
+    return *m_image;
+}
+
+FrameCondition AnyFrame()
+{
+    return [](const XI_IMG &) { return true; };
+}
+
+FrameCondition FrameWithExposure(int exposureUs)
+{
+    return [exposureUs](const XI_IMG &image) { return static_cast<int>(image.exposure_time_us) == exposureUs; };
+}
+
+CaptureScheduler::CaptureScheduler()
+    : m_ioWork(std::make_unique<boost::asio::io_service::work>(m_ioService)), m_thread([this] {
+          while (true)
+          {
+              try
+              {
+                  m_ioService.run();
+                  return;
+              }
+              catch (const std::exception &e)
+              {
+                  // a failing handler must not stop the operations of other sequences
+                  LOG_XILENS(error) << "Error in camera operation: " << e.what();
+              }
+          }
+      })
+{
+}
+
+CaptureScheduler::~CaptureScheduler()
+{
+    this->Stop();
+}
+
+void CaptureScheduler::Stop()
+{
+    std::vector<std::shared_ptr<Wait>> waits;
+    {
+        boost::lock_guard<boost::mutex> guard(m_mutexWaits);
+        if (m_stopped)
+        {
+            return;
+        }
+        m_stopped = true;
+        waits.swap(m_waits);
+    }
+    for (const auto &wait : waits)
+    {
+        this->CompleteWait(wait, std::make_exception_ptr(CaptureCancelledError()), nullptr);
+    }
+    // the thread runs until the handlers, and the operations they start, completed
+    m_ioWork.reset();
+    m_thread.join();
+}
+
+CaptureToken CaptureScheduler::CreateToken()
+{
+    return std::make_shared<std::atomic<bool>>(false);
+}
+
+void CaptureScheduler::Cancel(const CaptureToken &token)
+{
+    if (token == nullptr)
+    {
+        return;
+    }
+    *token = true;
+    std::vector<std::shared_ptr<Wait>> cancelled;
+    {
+        boost::lock_guard<boost::mutex> guard(m_mutexWaits);
+        auto it = m_waits.begin();
+        while (it != m_waits.end())
+        {
+            if ((*it)->token == token)
+            {
+                cancelled.push_back(*it);
+                it = m_waits.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+    for (const auto &wait : cancelled)
+    {
+        this->CompleteWait(wait, std::make_exception_ptr(CaptureCancelledError()), nullptr);
+    }
+}
+
+void CaptureScheduler::NotifyFrame(const XI_IMG &image)
+{
+    std::vector<std::shared_ptr<Wait>> satisfied;
+    {
+        boost::lock_guard<boost::mutex> guard(m_mutexWaits);
+        auto it = m_waits.begin();
+        while (it != m_waits.end())
+        {
+            if ((*it)->condition(image))
+            {
+                satisfied.push_back(*it);
+                it = m_waits.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+    if (satisfied.empty())
+    {
+        return;
+    }
+    auto frame = std::make_shared<Frame>();
+    frame->image = image;
+    if (image.bp != nullptr)
+    {
+        const auto *pixels = static_cast<const uint16_t *>(image.bp);
+        frame->pixels.assign(pixels, pixels + static_cast<size_t>(image.width) * image.height);
+    }
+    frame->image.bp = frame->pixels.data();
+    frame->image.bp_size = static_cast<DWORD>(frame->pixels.size() * sizeof(uint16_t));
+    for (const auto &wait : satisfied)
+    {
+        this->CompleteWait(wait, nullptr, frame);
+    }
+}
+
+void CaptureScheduler::Post(std::function<void()> function)
+{
+    m_ioService.post(std::move(function));
+}
+
+/**
+ * Locks the handle of the camera, such that it is not replaced while it is used. It is invalid while the camera is
+ * reopened, the operation fails then instead of using it.
+ */
+static boost::unique_lock<boost::mutex> LockCameraHandle(HANDLE *cameraHandle, boost::mutex *cameraHandleMutex)
+{
+    boost::unique_lock<boost::mutex> lock;
+    if (cameraHandleMutex != nullptr)
+    {
+        lock = boost::unique_lock<boost::mutex>(*cameraHandleMutex);
+    }
+    if (*cameraHandle == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error("The camera is being reopened.");
+    }
+    return lock;
+}
+
+void CaptureScheduler::AsyncSetParamInt(std::shared_ptr<XiAPIWrapper> apiWrapper, HANDLE *cameraHandle,
+                                        boost::mutex *cameraHandleMutex, std::string parameter, int value,
+                                        CaptureToken token, CaptureHandler handler)
+{
+    m_ioService.post([apiWrapper, cameraHandle, cameraHandleMutex, parameter, value, token, handler] {
+        std::exception_ptr error;
+        try
+        {
+            if (token != nullptr && *token)
+            {
+                throw CaptureCancelledError();
+            }
+            auto lock = LockCameraHandle(cameraHandle, cameraHandleMutex);
+            int stat = apiWrapper->xiSetParamInt(*cameraHandle, parameter.c_str(), value);
+            HandleResult(stat, "xiSetParam (" + parameter + ")");
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        handler(error);
+    });
+}
+
+void CaptureScheduler::AsyncWaitFrame(FrameCondition condition, int timeoutMs, CaptureToken token,
+                                      CaptureFrameHandler handler)
+{
+    auto wait = std::make_shared<Wait>();
+    wait->condition = std::move(condition);
+    wait->timeoutMs = timeoutMs;
+    wait->token = std::move(token);
+    wait->handler = std::move(handler);
+    boost::lock_guard<boost::mutex> guard(m_mutexWaits);
+    if (m_stopped || (wait->token != nullptr && *wait->token))
+    {
+        this->CompleteWait(wait, std::make_exception_ptr(CaptureCancelledError()), nullptr);
+        return;
+    }
+    m_waits.push_back(wait);
+    // posted while the lock is held, such that the timer is started before the wait can complete
+    m_ioService.post([this, wait] {
+        wait->timer = std::make_shared<boost::asio::steady_timer>(m_ioService);
+        wait->timer->expires_after(std::chrono::milliseconds(wait->timeoutMs));
+        wait->timer->async_wait([this, wait](const boost::system::error_code &error) {
+            if (error == boost::asio::error::operation_aborted)
+            {
+                return;
+            }
+            {
+                boost::lock_guard<boost::mutex> guard(m_mutexWaits);
+                auto it = std::find(m_waits.begin(), m_waits.end(), wait);
+                if (it == m_waits.end())
+                {
+                    // the wait completed in the meantime
+                    return;
+                }
+                m_waits.erase(it);
+            }
+            wait->handler(std::make_exception_ptr(std::runtime_error("Timed out waiting for a frame")), XI_IMG{});
+        });
+    });
+}
+
+void CaptureScheduler::Spawn(CaptureTask task)
+{
+    // owned by the posted handler, such that the coroutine is destroyed if the scheduler stopped before it started
+    auto owner = std::make_shared<CaptureTask>(std::move(task));
+    m_ioService.post([owner] { owner->Resume(); });
+}
+
+SetParamIntAwaitable CaptureScheduler::SetParamInt(std::shared_ptr<XiAPIWrapper> apiWrapper, HANDLE *cameraHandle,
+                                                   boost::mutex *cameraHandleMutex, std::string parameter, int value,
+                                                   CaptureToken token)
+{
+    return {this, std::move(apiWrapper), cameraHandle, cameraHandleMutex, std::move(parameter), value,
+            std::move(token)};
+}
+
+WaitFrameAwaitable CaptureScheduler::WaitFrame(FrameCondition condition, int timeoutMs, CaptureToken token)
+{
+    return {this, std::move(condition), timeoutMs, std::move(token)};
+}
+
+void CaptureScheduler::CompleteWait(const std::shared_ptr<Wait> &wait, std::exception_ptr error,
+                                    const std::shared_ptr<Frame> &frame)
+{
+    m_ioService.post([wait, error, frame] {
+        if (wait->timer != nullptr)
+        {
+            wait->timer->cancel();
+        }
+        wait->handler(error, frame != nullptr ? frame->image : XI_IMG{});
+    });
+}
+
+static int GetExposureUs(const CaptureSequenceOptions &options)
+{
+    int exposureUs = 0;
+    auto lock = LockCameraHandle(options.cameraHandle, options.cameraHandleMutex);
+    int stat = options.apiWrapper->xiGetParamInt(*options.cameraHandle, XI_PRM_EXPOSURE, &exposureUs);
+    HandleResult(stat, "xiGetParam (exposure)");
+    return exposureUs;
+}
+
+CaptureToken CaptureSequence::Start(CaptureScheduler &scheduler, CaptureSequenceOptions options,
+                                    FrameCallback onFrame, CaptureHandler onComplete)
+{
+    CaptureToken token = CaptureScheduler::CreateToken();
+    scheduler.Spawn(Run(scheduler, std::move(options), std::move(onFrame), std::move(onComplete), token));
+    return token;
+}
+
+CaptureTask CaptureSequence::Run(CaptureScheduler &scheduler, CaptureSequenceOptions options, FrameCallback onFrame,
+                                 CaptureHandler onComplete, CaptureToken token)
+{
+    // first error of the sequence, the sequence completes with it
+    std::exception_ptr error;
+    // exposure time restored when the sequence completes, 0 if it was not changed
+    int restoreExposureUs = 0;
+    try
+    {
+        FrameCondition condition = AnyFrame();
+        if (options.exposureUs > 0)
+        {
+            restoreExposureUs = GetExposureUs(options);
+            co_await scheduler.SetParamInt(options.apiWrapper, options.cameraHandle, options.cameraHandleMutex,
+                                           XI_PRM_EXPOSURE, options.exposureUs, token);
+            // the camera rounds the exposure time, frames are matched against the exposure time it applied
+            condition = FrameWithExposure(GetExposureUs(options));
+        }
+        for (int index = 0; index < options.nFrames; index++)
+        {
+            const XI_IMG &image = co_await scheduler.WaitFrame(condition, options.timeoutMs, token);
+            onFrame(index, image);
+        }
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    if (restoreExposureUs > 0)
+    {
+        try
+        {
+            // restored also when the sequence failed or was cancelled, hence without the token
+            co_await scheduler.SetParamInt(options.apiWrapper, options.cameraHandle, options.cameraHandleMutex,
+                                           XI_PRM_EXPOSURE, restoreExposureUs, nullptr);
+        }
+        catch (...)
+        {
+            if (error == nullptr)
+            {
+                error = std::current_exception();
+            }
+        }
+    }
+    onComplete(error);
+}
@@ -0,0 +1,395 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_CAPTURE_SCHEDULER_H
+#define XILENS_CAPTURE_SCHEDULER_H
+
+#include <xiApi.h>
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "xiAPIWrapper.h"
+
+/**
+ * Time to wait for a frame before an asynchronous camera operation fails, in milliseconds.
+ */
+constexpr int CAPTURE_FRAME_TIMEOUT_MS = 5000;
+
+/**
+ * Cancels the asynchronous camera operations it is passed to, see CaptureScheduler::Cancel.
+ */
+using CaptureToken = std::shared_ptr<std::atomic<bool>>;
+
+/**
+ * Called on the thread of the scheduler when an asynchronous camera operation completes.
+ *
+ * @param error exception of the failed operation, `nullptr` on success
+ */
+using CaptureHandler = std::function<void(std::exception_ptr error)>;
+
+/**
+ * Called on the thread of the scheduler with the frame an asynchronous wait completes with.
+ *
+ * @param error exception of the failed wait, `nullptr` on success
+ * @param image frame satisfying the condition of the wait, its pixels are only valid until the handler returns
+ */
+using CaptureFrameHandler = std::function<void(std::exception_ptr error, const XI_IMG &image)>;
+
+/**
+ * Condition a frame has to satisfy to complete an asynchronous wait. It is evaluated on the polling thread for each
+ * new frame and must therefore be cheap and thread safe.
+ */
+using FrameCondition = std::function<bool(const XI_IMG &image)>;
+
+/**
+ * @brief Error an asynchronous camera operation completes with when it is cancelled.
+ */
+class CaptureCancelledError : public std::runtime_error
+{
+  public:
+    CaptureCancelledError() : std::runtime_error("Camera operation cancelled")
+    {
+    }
+};
+
+/**
+ * Condition satisfied by any new frame.
+ */
+FrameCondition AnyFrame();
+
+/**
+ * Condition satisfied by frames exposed with the given exposure time.
+ *
+ * @param exposureUs exposure time in microseconds, as reported by the camera
+ */
+FrameCondition FrameWithExposure(int exposureUs);
+
+class CaptureScheduler;
+
+/**
+ * @brief Coroutine of camera operations run on the thread of a CaptureScheduler, see CaptureScheduler::Spawn.
+ *
+ * The coroutine starts suspended and is resumed on the thread of the scheduler, also each time an operation it awaits
+ * completes, see CaptureScheduler::SetParamInt and CaptureScheduler::WaitFrame. Its frame is destroyed when it
+ * returns, or with the task if it was never started. Exceptions escaping the coroutine are logged, coroutines report
+ * their errors themselves.
+ */
+class CaptureTask
+{
+  public:
+    struct promise_type
+    {
+        CaptureTask get_return_object()
+        {
+            return CaptureTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void()
+        {
+        }
+
+        void unhandled_exception();
+    };
+
+    CaptureTask(CaptureTask &&other) noexcept;
+
+    CaptureTask &operator=(CaptureTask &&other) noexcept;
+
+    CaptureTask(const CaptureTask &) = delete;
+    CaptureTask &operator=(const CaptureTask &) = delete;
+
+    /**
+     * Destroys the coroutine if it was never started.
+     */
+    ~CaptureTask();
+
+    /**
+     * Starts the coroutine on the calling thread, it runs until it awaits its first operation or returns.
+     */
+    void Resume();
+
+  private:
+    explicit CaptureTask(std::coroutine_handle<promise_type> handle);
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+/**
+ * @brief Awaits CaptureScheduler::AsyncSetParamInt in a CaptureTask, `co_await` throws the error of the operation.
+ */
+class SetParamIntAwaitable
+{
+  public:
+    SetParamIntAwaitable(CaptureScheduler *scheduler, std::shared_ptr<XiAPIWrapper> apiWrapper, HANDLE *cameraHandle,
+                         boost::mutex *cameraHandleMutex, std::string parameter, int value, CaptureToken token);
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> coroutine);
+
+    void await_resume() const;
+
+  private:
+    CaptureScheduler *m_scheduler;
+    std::shared_ptr<XiAPIWrapper> m_apiWrapper;
+    HANDLE *m_cameraHandle;
+    boost::mutex *m_cameraHandleMutex;
+    std::string m_parameter;
+    int m_value;
+    CaptureToken m_token;
+    std::exception_ptr m_error;
+};
+
+/**
+ * @brief Awaits CaptureScheduler::AsyncWaitFrame in a CaptureTask, `co_await` returns the frame or throws the error of
+ * the wait. The pixels of the frame are only valid until the coroutine awaits its next operation.
+ */
+class WaitFrameAwaitable
+{
+  public:
+    WaitFrameAwaitable(CaptureScheduler *scheduler, FrameCondition condition, int timeoutMs, CaptureToken token);
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> coroutine);
+
+    const XI_IMG &await_resume() const;
+
+  private:
+    CaptureScheduler *m_scheduler;
+    FrameCondition m_condition;
+    int m_timeoutMs;
+    CaptureToken m_token;
+    std::exception_ptr m_error;
+    const XI_IMG *m_image = nullptr;
+};
+
+/**
+ * @brief Small scheduler resuming asynchronous camera operations on the frame stream.
+ *
+ * Operations complete on the single thread of the scheduler, such that sequences of operations, e.g. "set the
+ * exposure, wait for the first frame with that exposure, capture N frames, restore the exposure", do not block a
+ * thread each while they wait for the camera. Waits are resumed by CaptureScheduler::NotifyFrame as soon as a frame
+ * satisfies their condition, so a sequence completes in the minimum number of frame periods. Sequences are written as
+ * coroutines that await the operations, see CaptureTask and CaptureSequence.
+ */
+class CaptureScheduler
+{
+  public:
+    /**
+     * Starts the thread of the scheduler.
+     */
+    CaptureScheduler();
+
+    /**
+     * Stops the scheduler, see CaptureScheduler::Stop.
+     */
+    ~CaptureScheduler();
+
+    CaptureScheduler(const CaptureScheduler &) = delete;
+    CaptureScheduler &operator=(const CaptureScheduler &) = delete;
+
+    /**
+     * Cancels all operations, waits until the handlers of the operations ran and stops the thread of the scheduler.
+     * Operations started afterwards are cancelled right away. Calling it again has no effect.
+     */
+    void Stop();
+
+    /**
+     * Creates a token to cancel a group of operations, usually the operations of one sequence.
+     */
+    static CaptureToken CreateToken();
+
+    /**
+     * Cancels the pending and future operations started with the token, they complete with CaptureCancelledError.
+     *
+     * @param token token the operations were started with
+     */
+    void Cancel(const CaptureToken &token);
+
+    /**
+     * Hands a new frame to the pending waits, called on the polling thread for each new frame. The pixels are only
+     * copied when a wait is satisfied by the frame.
+     *
+     * @param image new frame, its pixels have to stay valid until the call returns
+     */
+    void NotifyFrame(const XI_IMG &image);
+
+    /**
+     * Runs a function on the thread of the scheduler.
+     *
+     * @param function function to run
+     */
+    void Post(std::function<void()> function);
+
+    /**
+     * Sets an integer parameter of the camera on the thread of the scheduler.
+     *
+     * @param apiWrapper wrapper of the XiAPI
+     * @param cameraHandle handle of the camera, the operation fails if it is invalid, e.g. while the camera is reopened
+     * @param cameraHandleMutex mutex held while the handle is replaced, see CameraInterface::m_mutexCameraHandle,
+     * `nullptr` if the handle is never replaced
+     * @param parameter name of the parameter, e.g. `XI_PRM_EXPOSURE`
+     * @param value value of the parameter
+     * @param token token to cancel the operation, `nullptr` if it can not be cancelled
+     * @param handler called when the parameter is set or could not be set
+     */
+    void AsyncSetParamInt(std::shared_ptr<XiAPIWrapper> apiWrapper, HANDLE *cameraHandle,
+                          boost::mutex *cameraHandleMutex, std::string parameter, int value, CaptureToken token,
+                          CaptureHandler handler);
+
+    /**
+     * Waits for the first new frame satisfying a condition.
+     *
+     * @param condition condition the frame has to satisfy
+     * @param timeoutMs time after which the wait fails if no frame satisfied the condition, in milliseconds
+     * @param token token to cancel the operation, `nullptr` if it can not be cancelled
+     * @param handler called with the frame, or with the error when the wait timed out or was cancelled
+     */
+    void AsyncWaitFrame(FrameCondition condition, int timeoutMs, CaptureToken token, CaptureFrameHandler handler);
+
+    /**
+     * Starts a coroutine on the thread of the scheduler.
+     *
+     * @param task coroutine to run, it is destroyed without running if the scheduler stopped
+     */
+    void Spawn(CaptureTask task);
+
+    /**
+     * Sets an integer parameter of the camera from a coroutine spawned on the scheduler, see
+     * CaptureScheduler::AsyncSetParamInt.
+     */
+    SetParamIntAwaitable SetParamInt(std::shared_ptr<XiAPIWrapper> apiWrapper, HANDLE *cameraHandle,
+                                     boost::mutex *cameraHandleMutex, std::string parameter, int value,
+                                     CaptureToken token);
+
+    /**
+     * Waits for a frame from a coroutine spawned on the scheduler, see CaptureScheduler::AsyncWaitFrame.
+     */
+    WaitFrameAwaitable WaitFrame(FrameCondition condition, int timeoutMs, CaptureToken token);
+
+  private:
+    struct Wait;
+
+    struct Frame;
+
+    /**
+     * Completes the wait on the thread of the scheduler.
+     */
+    void CompleteWait(const std::shared_ptr<Wait> &wait, std::exception_ptr error, const std::shared_ptr<Frame> &frame);
+
+    boost::asio::io_service m_ioService;
+    std::unique_ptr<boost::asio::io_service::work> m_ioWork;
+    boost::thread m_thread;
+
+    /**
+     * Protects the pending waits and the stopped flag, NotifyFrame is called on the polling thread.
+     */
+    boost::mutex m_mutexWaits;
+    std::vector<std::shared_ptr<Wait>> m_waits;
+    bool m_stopped = false;
+};
+
+/**
+ * @brief Settings of a CaptureSequence.
+ */
+struct CaptureSequenceOptions
+{
+    /**
+     * Wrapper of the XiAPI used to set the exposure time.
+     */
+    std::shared_ptr<XiAPIWrapper> apiWrapper;
+
+    /**
+     * Handle of the camera, the sequence fails if it is invalid when the exposure time is queried or set.
+     */
+    HANDLE *cameraHandle = nullptr;
+
+    /**
+     * Mutex held while the handle of the camera is replaced, see CameraInterface::m_mutexCameraHandle. `nullptr` if
+     * the handle is never replaced.
+     */
+    boost::mutex *cameraHandleMutex = nullptr;
+
+    /**
+     * Number of consecutive frames to capture.
+     */
+    int nFrames = 1;
+
+    /**
+     * Exposure time of the captured frames in microseconds, the exposure time is restored afterwards. The current
+     * exposure time is kept when it is 0.
+     */
+    int exposureUs = 0;
+
+    /**
+     * Time to wait for each frame before the sequence fails, in milliseconds.
+     */
+    int timeoutMs = CAPTURE_FRAME_TIMEOUT_MS;
+};
+
+/**
+ * @brief Captures consecutive frames, optionally with another exposure time that is restored afterwards.
+ *
+ * The sequence is a CaptureTask run on a CaptureScheduler. Frames exposed before a new exposure time took effect are
+ * skipped. The exposure time is restored also when the sequence fails or is cancelled.
+ */
+class CaptureSequence
+{
+  public:
+    /**
+     * Called on the thread of the scheduler for each captured frame.
+     *
+     * @param index index of the frame in the sequence
+     * @param image captured frame, its pixels are only valid until the callback returns
+     * @throws std::exception to stop the sequence, it completes with the exception
+     */
+    using FrameCallback = std::function<void(int index, const XI_IMG &image)>;
+
+    /**
+     * Starts a sequence on the scheduler.
+     *
+     * @param scheduler scheduler running the sequence, it has to outlive the sequence
+     * @param options settings of the sequence
+     * @param onFrame called for each captured frame
+     * @param onComplete called once when the sequence completed, failed or was cancelled
+     * @return token to cancel the sequence with CaptureScheduler::Cancel
+     */
+    static CaptureToken Start(CaptureScheduler &scheduler, CaptureSequenceOptions options, FrameCallback onFrame,
+                              CaptureHandler onComplete);
+
+  private:
+    /**
+     * Coroutine of the sequence, the parameters are kept in its frame until it returns.
+     */
+    static CaptureTask Run(CaptureScheduler &scheduler, CaptureSequenceOptions options, FrameCallback onFrame,
+                           CaptureHandler onComplete, CaptureToken token);
+};
+
+#endif // XILENS_CAPTURE_SCHEDULER_H
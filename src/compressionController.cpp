@@ -0,0 +1,70 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "compressionController.h"
+
+#include <blosc2.h>
+
+#include <algorithm>
+
+CompressionController::CompressionController(CompressionSettings initialSettings, int maxClevel)
+    : m_maxStep(std::max(1, std::min(maxClevel, 9)))
+{
+    m_step = initialSettings.compcode == BLOSC_ZSTD ? std::max(1, std::min(initialSettings.clevel, m_maxStep)) : 0;
+}
+
+bool CompressionController::Update(double compressionSeconds, double intervalSeconds, double queueFill)
+{
+    if (intervalSeconds <= 0)
+    {
+        return false;
+    }
+    double load = compressionSeconds / intervalSeconds;
+    m_load = m_hasLoad ? LOAD_SMOOTHING * load + (1 - LOAD_SMOOTHING) * m_load : load;
+    m_hasLoad = true;
+
+    int previousStep = m_step;
+    if (m_load > HIGH_LOAD || queueFill > HIGH_QUEUE_FILL)
+    {
+        m_lowLoadImages = 0;
+        m_step = std::max(0, m_step - 1);
+    }
+    else if (m_load < LOW_LOAD && queueFill < LOW_QUEUE_FILL)
+    {
+        if (++m_lowLoadImages >= STEP_UP_HOLD)
+        {
+            m_lowLoadImages = 0;
+            m_step = std::min(m_maxStep, m_step + 1);
+        }
+    }
+    else
+    {
+        m_lowLoadImages = 0;
+    }
+    return m_step != previousStep;
+}
+
+CompressionSettings CompressionController::GetSettings() const
+{
+    if (m_step == 0)
+    {
+        return {BLOSC_LZ4, 1};
+    }
+    return {BLOSC_ZSTD, m_step};
+}
+
+double CompressionController::GetLoad() const
+{
+    return m_load;
+}
+
+std::string CompressionCodecToString(int compcode)
+{
+    const char *name = nullptr;
+    if (blosc2_compcode_to_compname(compcode, &name) < 0 || name == nullptr)
+    {
+        return "unknown";
+    }
+    return name;
+}
@@ -0,0 +1,120 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_COMPRESSION_CONTROLLER_H
+#define XILENS_COMPRESSION_CONTROLLER_H
+
+#include <string>
+
+/**
+ * @brief Codec and compression level used for an image.
+ */
+struct CompressionSettings
+{
+    /**
+     * blosc2 codec, e.g. BLOSC_ZSTD.
+     */
+    int compcode;
+
+    /**
+     * blosc2 compression level, from 1 (fastest) to 9 (best ratio).
+     */
+    int clevel;
+
+    bool operator==(const CompressionSettings &other) const
+    {
+        return compcode == other.compcode && clevel == other.clevel;
+    }
+};
+
+/**
+ * @brief Chooses the compression settings of each image from live measurements of the recorder.
+ *
+ * The settings are ordered in a ladder from fastest to best ratio: LZ4 level 1 followed by ZSTD levels 1 to the
+ * maximum level. The controller tracks the load of the recorder, i.e. the time spent compressing an image relative to
+ * the time between images, and the fill level of the queue in front of the writer:
+ *  - when the load or the queue fill is high, it steps down the ladder after each image until the recorder catches up,
+ *  - when both are low for CompressionController::STEP_UP_HOLD consecutive images, it steps up the ladder once.
+ *
+ * The asymmetry keeps the recorder within its real-time budget when the scene becomes harder to compress, while it
+ * slowly recovers the best ratio that fits the budget.
+ */
+class CompressionController
+{
+  public:
+    /**
+     * Load above which the compression level is reduced.
+     */
+    static constexpr double HIGH_LOAD = 0.8;
+
+    /**
+     * Load below which the compression level can be increased.
+     */
+    static constexpr double LOW_LOAD = 0.4;
+
+    /**
+     * Queue fill above which the compression level is reduced.
+     */
+    static constexpr double HIGH_QUEUE_FILL = 0.5;
+
+    /**
+     * Queue fill below which the compression level can be increased.
+     */
+    static constexpr double LOW_QUEUE_FILL = 0.1;
+
+    /**
+     * Number of consecutive images with low load needed to increase the compression level.
+     */
+    static constexpr int STEP_UP_HOLD = 30;
+
+    /**
+     * Weight of the newest measurement in the moving average of the load.
+     */
+    static constexpr double LOAD_SMOOTHING = 0.2;
+
+    /**
+     * Constructs the controller.
+     *
+     * @param initialSettings settings used until the first measurement, the codec is expected to be ZSTD.
+     * @param maxClevel highest ZSTD compression level the controller may choose.
+     */
+    explicit CompressionController(CompressionSettings initialSettings, int maxClevel = 9);
+
+    /**
+     * Updates the settings with the measurements of the last image.
+     *
+     * @param compressionSeconds time spent compressing and writing the last image.
+     * @param intervalSeconds time between the last two images, measurements with non-positive intervals are ignored.
+     * @param queueFill fraction of the queue in front of the writer in use, from 0 to 1.
+     * @return true if the settings changed.
+     */
+    bool Update(double compressionSeconds, double intervalSeconds, double queueFill);
+
+    /**
+     * Queries the settings to use for the next image.
+     */
+    CompressionSettings GetSettings() const;
+
+    /**
+     * Queries the moving average of the load.
+     */
+    double GetLoad() const;
+
+  private:
+    /**
+     * Position in the ladder of settings, 0 is LZ4 and n is ZSTD level n.
+     */
+    int m_step;
+    int m_maxStep;
+    double m_load = 0;
+    bool m_hasLoad = false;
+    int m_lowLoadImages = 0;
+};
+
+/**
+ * Converts a blosc2 codec identifier to its name, e.g. "zstd".
+ */
+std::string CompressionCodecToString(int compcode);
+
+#endif // XILENS_COMPRESSION_CONTROLLER_H
@@ -12,6 +12,8 @@
 #include <QVariant>
 #include <opencv2/opencv.hpp>
 
+#include "recordingFormat.h"
+
 /**
  * @brief Maximum width of image to display.
  */
@@ -35,6 +37,25 @@ const cv::Vec3b SATURATION_COLOR = cv::Vec3b(180, 105, 255);
  */
 const cv::Vec3b DARK_COLOR = cv::Vec3b(0, 0, 255);
 
+/**
+ * @brief Opacity of the class overlay painted on the color image, see SpectralClassifier.
+ */
+const double CLASS_OVERLAY_OPACITY = 0.4;
+
+/**
+ * @brief Color of the tracked regions of interest drawn on the displayed images, see RoiTracker.
+ *
+ * Green, the same in the BGR and RGB order.
+ */
+const cv::Scalar ROI_FOUND_COLOR = cv::Scalar(0, 255, 0);
+
+/**
+ * @brief Color of the regions of interest that were lost by the tracker, drawn at their last position.
+ *
+ * White, the same in the BGR and RGB order.
+ */
+const cv::Scalar ROI_LOST_COLOR = cv::Scalar(255, 255, 255);
+
 /**
  * @brief File name where logs are stored.
  */
@@ -56,6 +77,14 @@ const QString HOUSE_BACK_TEMP = "temperature_house_back_side";
  * @brief Variable used to identify camera board temperature.
  */
 const QString SENSOR_BOARD_TEMP = "temperature_sensor_board";
+/**
+ * @brief All temperature keys, the order defines the index of each temperature in CameraFamily::GetLatestTemperature.
+ */
+const QString TEMPERATURE_KEYS[] = {CHIP_TEMP, HOUSE_TEMP, HOUSE_BACK_TEMP, SENSOR_BOARD_TEMP};
+/**
+ * @brief Number of temperature values queried from the cameras.
+ */
+const size_t N_TEMPERATURE_KEYS = sizeof(TEMPERATURE_KEYS) / sizeof(TEMPERATURE_KEYS[0]);
 /**
  * @brief Variable used to identify how ofter temperature is queried from the camera.
  */
@@ -78,16 +107,31 @@ const int FRAMERATE_MAX = 80;
 /**
  * @brief maximum value in range [0, 255] above which pixels are considered over-saturated.
  *
- * The maximum value is `225` in the range `[0,255]`, which corresponds to `900` in the range `[0, 1024]`.
+ * The maximum value is `225` in the range `[0,255]`, which corresponds to `900` in the range `[0, 1024]` of 10 bit raw
+ * values. Raw values of other bit depths are compared to the value shifted to their bit depth.
  */
 const int OVEREXPOSURE_PIXEL_BOUNDARY_VALUE = 225;
 /**
  * @brief minimum value in range [0, 255] below which pixels are considered under-saturated.
  *
- * The minimum value is `10` in the range `[0,255]`, which corresponds to `40` in the range `[0, 1024]`.
+ * The minimum value is `10` in the range `[0,255]`, which corresponds to `40` in the range `[0, 1024]` of 10 bit raw
+ * values.
  */
 const int UNDEREXPOSURE_PIXEL_BOUNDARY_VALUE = 10;
 
+/**
+ * @brief Bit depth of the raw values assumed when the camera does not report it, the 10 bit of most XIMEA sensors.
+ */
+const int DEFAULT_BIT_DEPTH = 10;
+/**
+ * @brief Smallest bit depth of the raw values supported, that of the 8 bit values displayed.
+ */
+const int MIN_BIT_DEPTH = 8;
+/**
+ * @brief Largest bit depth of the raw values supported, that of the 16 bit values transferred by the camera.
+ */
+const int MAX_BIT_DEPTH = 16;
+
 /**
  * @brief Name of spectral camera type.
  */
@@ -159,11 +203,17 @@ struct CameraData
     std::vector<int> mosaicShape;
     std::vector<int> bgrChannels;
 
+    /**
+     * Center wavelength in nanometers of each band of spectral cameras, used for true color rendering. Empty when not
+     * known.
+     */
+    std::vector<float> bandCenters;
+
     /**
      * Method to initialize camera metadata object from a QJsonObject.
      *
      * @param jsonObject Object containing camera metadata: `cameraType, cameraFamily, mosaicWidth, mosaicHeight,
-     * bgrChannels`.
+     * bgrChannels, bandCenters`.
      * @return structure containing the camera metadata.
      */
     static CameraData fromJson(const QJsonObject &jsonObject)
@@ -185,6 +235,14 @@ struct CameraData
         {
             data.bgrChannels = std::vector<int>(); // Optional, but explicitly sets it as empty
         }
+        if (jsonObject.contains("bandCenters") && jsonObject["bandCenters"].isArray())
+        {
+            QJsonArray array = jsonObject["bandCenters"].toArray();
+            for (const auto &entry : array)
+            {
+                data.bandCenters.push_back(static_cast<float>(entry.toDouble()));
+            }
+        }
         return data;
     }
 };
@@ -225,33 +283,35 @@ bool isCameraSupported(const QString &type, const QString &family);
 QMap<QString, CameraData> &getCameraMapper();
 
 /**
- * @brief Name of key to be used to store exposure time in the metadata of the arrays.
+ * @brief Number of pending record tasks at which the backlog of the recorder is considered full.
  */
-constexpr const char *EXPOSURE_KEY = "exposure_us";
+const int RECORDING_BACKLOG_CAPACITY = 8;
 
 /**
- * @brief Name of key to be used to store frame number in the metadata of the arrays.
+ * @brief Number of frames for which metadata memory is reserved when a file is opened.
  */
-constexpr const char *FRAME_NUMBER_KEY = "acq_nframe";
+const size_t METADATA_RESERVED_FRAMES = 4096;
 
 /**
- * @brief Name of key to be used to store filter array format in the metadata of the arrays.
+ * @brief Number of images that can wait in the queue of each stripe of a striped recording.
  */
-constexpr const char *COLOR_FILTER_ARRAY_FORMAT_KEY = "color_filter_array";
+const size_t WRITER_QUEUE_CAPACITY = 32;
 
 /**
- * @brief Name of key to be used to store time stamp in the metadata of the arrays.
+ * @brief Time in milliseconds a mirror of a recording can keep the acquisition waiting for room in its queue, a mirror
+ * that lags further behind is dropped so that it does not stall the first destination.
  */
-constexpr const char *TIME_STAMP_KEY = "time_stamp";
+const int MIRROR_MAX_LAG_MS = 200;
 
-/**
- * @brief Maximum number of frames used to compute the frames per second at which recordings happen.
- */
-const int MAX_FRAMES_TO_COMPUTE_FPS = 10;
 
 /**
  * @brief Rate in milliseconds at which the frames per second display in the UI is updated.
  */
 const int UPDATE_RATE_MS_FPS_TIMER = 2000;
 
+/**
+ * @brief Rate in milliseconds at which the recording telemetry (recorded images, elapsed time) in the UI is updated.
+ */
+const int UPDATE_RATE_MS_TELEMETRY_TIMER = 100;
+
 #endif
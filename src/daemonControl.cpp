@@ -0,0 +1,247 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "daemonControl.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <istream>
+#include <stdexcept>
+
+#include "logger.h"
+
+/**
+ * Longest request accepted by the server, longer requests close the connection
+ */
+constexpr size_t CONTROL_REQUEST_MAX_LENGTH = 64 * 1024;
+
+/**
+ * Reads a line from a stream buffer filled by `read_until` and strips the line break
+ */
+static std::string ReadLine(boost::asio::streambuf &buffer)
+{
+    std::istream stream(&buffer);
+    std::string line;
+    std::getline(stream, line);
+    if (!line.empty() && line.back() == '\r')
+    {
+        line.pop_back();
+    }
+    return line;
+}
+
+void ParseControlRequest(const std::string &request, std::string &command, std::string &argument)
+{
+    size_t separator = request.find(' ');
+    command = request.substr(0, separator);
+    argument = separator == std::string::npos ? std::string() : request.substr(separator + 1);
+}
+
+std::string HandleControlRequest(const ControlHandler &handler, const std::string &request)
+{
+    std::string command;
+    std::string argument;
+    ParseControlRequest(request, command, argument);
+    try
+    {
+        std::string result = handler(command, argument);
+        return result.empty() ? "ok" : "ok " + result;
+    }
+    catch (const std::exception &e)
+    {
+        std::string message = e.what();
+        // the reply has to stay on a single line
+        std::replace(message.begin(), message.end(), '\n', ' ');
+        return "error " + message;
+    }
+}
+
+std::map<std::string, std::string> ParseControlStatus(const std::string &status)
+{
+    std::map<std::string, std::string> entries;
+    size_t start = 0;
+    while (start < status.size())
+    {
+        size_t separator = status.find('=', start);
+        if (separator == std::string::npos)
+        {
+            break;
+        }
+        std::string key = status.substr(start, separator - start);
+        size_t end = key == "file" ? std::string::npos : status.find(' ', separator);
+        entries[key] = status.substr(separator + 1, end == std::string::npos ? std::string::npos : end - separator - 1);
+        start = end == std::string::npos ? status.size() : end + 1;
+    }
+    return entries;
+}
+
+struct ControlServer::Connection
+{
+    explicit Connection(boost::asio::io_service &ioService) : socket(ioService), buffer(CONTROL_REQUEST_MAX_LENGTH)
+    {
+    }
+
+    boost::asio::local::stream_protocol::socket socket;
+    boost::asio::streambuf buffer;
+    std::string reply;
+};
+
+ControlServer::ControlServer(std::string socketPath, ControlHandler handler)
+    : m_socketPath(std::move(socketPath)), m_handler(std::move(handler)), m_acceptor(m_ioService)
+{
+    boost::asio::local::stream_protocol::endpoint endpoint(m_socketPath);
+    if (boost::filesystem::exists(m_socketPath))
+    {
+        boost::asio::local::stream_protocol::socket probe(m_ioService);
+        boost::system::error_code error;
+        probe.connect(endpoint, error);
+        if (!error)
+        {
+            throw std::runtime_error("Another daemon is listening on " + m_socketPath);
+        }
+        LOG_XILENS(warning) << "Replacing stale control socket " << m_socketPath;
+        boost::filesystem::remove(m_socketPath);
+    }
+    try
+    {
+        m_acceptor.open(endpoint.protocol());
+        // the socket controls the camera and the recordings, only the user running the daemon may connect, the socket
+        // file is created with mode 0600
+        mode_t previousMask = umask(S_IRWXG | S_IRWXO | S_IXUSR);
+        boost::system::error_code bindError;
+        m_acceptor.bind(endpoint, bindError);
+        umask(previousMask);
+        if (bindError)
+        {
+            throw boost::system::system_error(bindError);
+        }
+        m_acceptor.listen();
+    }
+    catch (const boost::system::system_error &e)
+    {
+        throw std::runtime_error("Could not bind control socket " + m_socketPath + ": " + e.what());
+    }
+    this->Accept();
+    m_thread = boost::thread([this] { m_ioService.run(); });
+    LOG_XILENS(info) << "Listening for control requests on " << m_socketPath;
+}
+
+ControlServer::~ControlServer()
+{
+    m_ioService.stop();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    boost::system::error_code error;
+    m_acceptor.close(error);
+    boost::filesystem::remove(m_socketPath, error);
+}
+
+void ControlServer::Accept()
+{
+    auto connection = std::make_shared<Connection>(m_ioService);
+    m_acceptor.async_accept(connection->socket, [this, connection](const boost::system::error_code &error) {
+        if (error == boost::asio::error::operation_aborted)
+        {
+            return;
+        }
+        if (!error)
+        {
+            this->ReadRequest(connection);
+        }
+        this->Accept();
+    });
+}
+
+void ControlServer::ReadRequest(const std::shared_ptr<Connection> &connection)
+{
+    boost::asio::async_read_until(
+        connection->socket, connection->buffer, '\n',
+        [this, connection](const boost::system::error_code &error, size_t) {
+            // the client disconnected or sent a request that is too long, the connection is dropped
+            if (error)
+            {
+                return;
+            }
+            connection->reply = HandleControlRequest(m_handler, ReadLine(connection->buffer)) + "\n";
+            boost::asio::async_write(connection->socket, boost::asio::buffer(connection->reply),
+                                     [this, connection](const boost::system::error_code &error, size_t) {
+                                         if (!error)
+                                         {
+                                             this->ReadRequest(connection);
+                                         }
+                                     });
+        });
+}
+
+std::string SendControlRequest(const std::string &socketPath, const std::string &request, int timeoutMs)
+{
+    boost::asio::io_service ioService;
+    boost::asio::local::stream_protocol::socket socket(ioService);
+    boost::asio::steady_timer timer(ioService);
+    boost::asio::streambuf buffer;
+    std::string line = request + "\n";
+    boost::system::error_code failure;
+    bool completed = false;
+    bool timedOut = false;
+    auto complete = [&](const boost::system::error_code &error) {
+        completed = true;
+        failure = error;
+        timer.cancel();
+    };
+    timer.expires_after(std::chrono::milliseconds(timeoutMs));
+    timer.async_wait([&](const boost::system::error_code &error) {
+        if (!error && !completed)
+        {
+            // closing the socket aborts the pending operation, it completes with an error
+            timedOut = true;
+            boost::system::error_code ignored;
+            socket.close(ignored);
+        }
+    });
+    auto onRead = [&](const boost::system::error_code &error, size_t) { complete(error); };
+    auto onWrite = [&](const boost::system::error_code &error, size_t) {
+        if (error)
+        {
+            complete(error);
+            return;
+        }
+        boost::asio::async_read_until(socket, buffer, '\n', onRead);
+    };
+    auto onConnect = [&](const boost::system::error_code &error) {
+        if (error)
+        {
+            complete(error);
+            return;
+        }
+        boost::asio::async_write(socket, boost::asio::buffer(line), onWrite);
+    };
+    socket.async_connect(boost::asio::local::stream_protocol::endpoint(socketPath), onConnect);
+    ioService.run();
+    if (timedOut)
+    {
+        throw std::runtime_error("The acquisition daemon at " + socketPath + " did not reply within " +
+                                 std::to_string(timeoutMs) + " ms");
+    }
+    if (failure)
+    {
+        throw std::runtime_error("Could not reach the acquisition daemon at " + socketPath + ": " + failure.message());
+    }
+    std::string reply = ReadLine(buffer);
+    std::string status;
+    std::string result;
+    ParseControlRequest(reply, status, result);
+    if (status == "ok")
+    {
+        return result;
+    }
+    if (status == "error")
+    {
+        throw std::runtime_error(result);
+    }
+    throw std::runtime_error("Unexpected reply of the acquisition daemon: " + reply);
+}
@@ -0,0 +1,125 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_DAEMON_CONTROL_H
+#define XILENS_DAEMON_CONTROL_H
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+/**
+ * Path of the local socket used by default to control the acquisition daemon.
+ */
+constexpr const char *DAEMON_CONTROL_DEFAULT_SOCKET = "/tmp/xilens-daemon.sock";
+
+/**
+ * Time in milliseconds a client waits for the reply of the acquisition daemon, long enough for the daemon to write the
+ * backlog of a recording when it is stopped.
+ */
+constexpr int DAEMON_CONTROL_TIMEOUT_MS = 10000;
+
+/**
+ * @brief Line based protocol of the control socket of the acquisition daemon.
+ *
+ * Each request is a single line holding a command and an optional argument separated by a space, e.g.
+ * `record /data/recording`. Each request is answered by a single line starting with `ok`, followed by the result of
+ * the command if any, or with `error` followed by a description of the failure.
+ */
+
+/**
+ * Handles a request of the control socket.
+ *
+ * @param command first word of the request
+ * @param argument rest of the request after the first space, empty if there is none
+ * @return result of the command, sent after `ok`
+ * @throws std::exception to answer with `error` and the description of the exception
+ */
+using ControlHandler = std::function<std::string(const std::string &command, const std::string &argument)>;
+
+/**
+ * Splits a request into its command and argument.
+ *
+ * @param request line of the request, without the line break
+ * @param command first word of the request
+ * @param argument rest of the request after the first space
+ */
+void ParseControlRequest(const std::string &request, std::string &command, std::string &argument);
+
+/**
+ * Handles a request and formats the reply line, without the line break.
+ *
+ * @param handler handler of the commands
+ * @param request line of the request, without the line break
+ * @return `ok` and the result of the handler, or `error` and the description of the failure
+ */
+std::string HandleControlRequest(const ControlHandler &handler, const std::string &request);
+
+/**
+ * Parses the result of the `status` command of the acquisition daemon into its `key=value` entries. The `file` entry
+ * comes last and extends to the end of the result, such that file paths can hold spaces.
+ *
+ * @param status result of the `status` command
+ * @return value of each key
+ */
+std::map<std::string, std::string> ParseControlStatus(const std::string &status);
+
+/**
+ * @brief Serves the control socket of the acquisition daemon.
+ *
+ * Requests are handled one at a time on the thread of the server, clients can connect, disconnect and reconnect at any
+ * time without affecting the daemon.
+ */
+class ControlServer
+{
+  public:
+    /**
+     * Binds the socket and starts the thread of the server. A socket file left behind by a daemon that did not shut
+     * down cleanly is replaced. Only the owner of the socket file can read and write it, i.e. connect to it.
+     *
+     * @param socketPath path of the local socket
+     * @param handler handler of the commands, called on the thread of the server
+     * @throws std::runtime_error if another daemon is listening on the socket or it can not be bound
+     */
+    ControlServer(std::string socketPath, ControlHandler handler);
+
+    /**
+     * Stops the thread of the server, closes all connections and removes the socket file.
+     */
+    ~ControlServer();
+
+    ControlServer(const ControlServer &) = delete;
+    ControlServer &operator=(const ControlServer &) = delete;
+
+  private:
+    struct Connection;
+
+    void Accept();
+
+    void ReadRequest(const std::shared_ptr<Connection> &connection);
+
+    std::string m_socketPath;
+    ControlHandler m_handler;
+    boost::asio::io_service m_ioService;
+    boost::asio::local::stream_protocol::acceptor m_acceptor;
+    boost::thread m_thread;
+};
+
+/**
+ * Sends a request to the acquisition daemon and waits for its reply, at most for the given time such that a daemon
+ * that stopped answering does not block the caller.
+ *
+ * @param socketPath path of the local socket of the daemon
+ * @param request line of the request, without the line break
+ * @param timeoutMs time in milliseconds after which the request fails if the daemon did not reply
+ * @return result of the command, the reply without the leading `ok`
+ * @throws std::runtime_error if the daemon can not be reached, does not reply in time or replies with an error
+ */
+std::string SendControlRequest(const std::string &socketPath, const std::string &request,
+                               int timeoutMs = DAEMON_CONTROL_TIMEOUT_MS);
+
+#endif // XILENS_DAEMON_CONTROL_H
@@ -33,6 +33,13 @@ class Displayer : public QObject
 
     virtual void SetCameraProperties(QString cameraModel) = 0;
 
+    /**
+     * Sets the bit depth of the raw values of the camera, known once the camera is opened.
+     *
+     * @param bitDepth bit depth from MIN_BIT_DEPTH to MAX_BIT_DEPTH.
+     */
+    virtual void SetBitDepth(int bitDepth) = 0;
+
     /**
      *  Blocks the display of images
      */
@@ -59,6 +66,11 @@ class Displayer : public QObject
      */
     void SaturationPercentageReady(double undersaturation, double oversaturation);
 
+    /**
+     * Qt signal emitted when the temporal noise of the displayed images is ready to be displayed in the UI.
+     */
+    void NoiseEstimateReady(double snr, double readNoise);
+
   protected:
     /**
      * Indicate that process should stop displaying images.
@@ -3,20 +3,65 @@
  * License: see LICENSE.md file
  *******************************************************/
 #include <boost/thread.hpp>
+#include <cmath>
 #include <iostream>
+#include <memory>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <string>
 #include <utility>
+#include <vector>
 
+#include "bitDepth.h"
 #include "constants.h"
 #include "displayFunctional.h"
 #include "logger.h"
 #include "mainwindow.h"
+#include "noiseEstimator.h"
+#include "roiTracker.h"
 #include "util.h"
+#include "whiteBalance.h"
 
 typedef cv::Point3_<uint8_t> Pixel;
 
+/**
+ * Draws the tracked regions of interest on a displayed image, at their center and with their size.
+ *
+ * @param image displayed image of type CV_8UC3.
+ * @param tracks regions in pixels of the frame.
+ * @param frameSize size of the frame.
+ * @param registeredSize size of the image the motion was compensated on, before it was downsampled for display.
+ * @param motion compensated motion in pixels of the registered image, null if the image is not stabilized.
+ */
+static void DrawTrackedRois(cv::Mat &image, const std::vector<TrackedRoi> &tracks, cv::Size frameSize,
+                            cv::Size registeredSize, const FrameTransform *motion)
+{
+    cv::Point2d frameScale(registeredSize.width / static_cast<double>(frameSize.width),
+                           registeredSize.height / static_cast<double>(frameSize.height));
+    cv::Point2d displayScale(image.cols / static_cast<double>(registeredSize.width),
+                             image.rows / static_cast<double>(registeredSize.height));
+    for (const auto &track : tracks)
+    {
+        cv::Point2d center((track.rect.x + track.rect.width / 2.) * frameScale.x,
+                           (track.rect.y + track.rect.height / 2.) * frameScale.y);
+        if (motion != nullptr)
+        {
+            // the stabilized image shows each point q of the image at R^T (q - c - d) + c, see FrameTransform
+            double angle = motion->angleDeg * CV_PI / 180;
+            cv::Point2d imageCenter((registeredSize.width - 1) / 2., (registeredSize.height - 1) / 2.);
+            cv::Point2d q = center - imageCenter - cv::Point2d(motion->dx, motion->dy);
+            center = cv::Point2d(std::cos(angle) * q.x - std::sin(angle) * q.y,
+                                 std::sin(angle) * q.x + std::cos(angle) * q.y) +
+                     imageCenter;
+        }
+        cv::Size2d size(track.rect.width * frameScale.x * displayScale.x,
+                        track.rect.height * frameScale.y * displayScale.y);
+        cv::Point2d topLeft(center.x * displayScale.x - size.width / 2, center.y * displayScale.y - size.height / 2);
+        cv::Rect rect(cvRound(topLeft.x), cvRound(topLeft.y), cvRound(size.width), cvRound(size.height));
+        cv::rectangle(image, rect, track.found ? ROI_FOUND_COLOR : ROI_LOST_COLOR, 1);
+    }
+}
+
 DisplayerFunctional::DisplayerFunctional(MainWindow *mainWindow) : Displayer(), m_mainWindow(mainWindow)
 {
     auto result = QObject::connect(&m_displayTimer, &QTimer::timeout, this, &DisplayerFunctional::OnDisplayTimeout);
@@ -24,6 +69,21 @@ DisplayerFunctional::DisplayerFunctional(MainWindow *mainWindow) : Displayer(),
     {
         LOG_XILENS(error) << "Error while connecting displayer to timer";
     }
+    RegistrationOptions registrationOptions;
+    registrationOptions.estimateRotation = g_commandLineArguments.stabilize_rotation;
+    m_registration = FrameRegistration(registrationOptions);
+    if (!g_commandLineArguments.classifier_model.empty())
+    {
+        try
+        {
+            m_classifier = std::make_shared<const SpectralClassifier>(
+                SpectralClassifier::Load(g_commandLineArguments.classifier_model));
+        }
+        catch (const std::runtime_error &e)
+        {
+            LOG_XILENS(error) << e.what();
+        }
+    }
     m_displayTimer.setInterval(m_displayIntervalMilliseconds);
     m_displayTimer.start();
     m_displayThread = boost::thread(&DisplayerFunctional::ProcessImageOnThread, this);
@@ -61,7 +121,7 @@ void PrepareBGRImage(cv::Mat &bgr_image, int bgr_norm)
     bgr_image.convertTo(bgr_image, CV_8UC3);
 }
 
-void DisplayerFunctional::NormalizeBGRImage(cv::Mat &bgr_image)
+void DisplayerFunctional::NormalizeBGRImage(cv::Mat &bgr_image, unsigned clip_limit)
 {
     cv::Mat lab_image;
     cvtColor(bgr_image, lab_image, cv::COLOR_BGR2Lab);
@@ -71,7 +131,7 @@ void DisplayerFunctional::NormalizeBGRImage(cv::Mat &bgr_image)
 
     // apply m_clahe to the L channel and save it in lab_planes
     cv::Mat dst;
-    this->m_clahe->setClipLimit(m_mainWindow->GetBGRNorm());
+    this->m_clahe->setClipLimit(clip_limit);
     this->m_clahe->apply(lab_planes[0], dst);
     dst.copyTo(lab_planes[0]);
 
@@ -82,7 +142,7 @@ void DisplayerFunctional::NormalizeBGRImage(cv::Mat &bgr_image)
     cv::cvtColor(lab_image, bgr_image, cv::COLOR_Lab2BGR);
 }
 
-void DisplayerFunctional::PrepareRawImage(cv::Mat &raw_image, bool equalize_hist)
+void DisplayerFunctional::PrepareRawImage(cv::Mat &raw_image, bool equalize_hist, bool saturation_overlay)
 {
     cv::Mat mask = raw_image.clone();
     cvtColor(mask, mask, cv::COLOR_GRAY2RGB);
@@ -93,7 +153,7 @@ void DisplayerFunctional::PrepareRawImage(cv::Mat &raw_image, bool equalize_hist
     }
     cvtColor(raw_image, raw_image, cv::COLOR_GRAY2RGB);
 
-    if (m_mainWindow->IsSaturationButtonChecked())
+    if (saturation_overlay)
     {
         // Parallel execution on each pixel using C++11 lambda.
         raw_image.forEach<Pixel>([mask](Pixel &p, const int position[]) -> void {
@@ -134,8 +194,7 @@ void DisplayerFunctional::GetBand(cv::Mat &image, cv::Mat &band_image, unsigned
         }
         row++;
     }
-    band_image /= m_scaling_factor; // 10 bit to 8 bit
-    band_image.convertTo(band_image, CV_8UC1);
+    ConvertTo8Bit(band_image, band_image, m_bitDepth);
 }
 
 void DisplayerFunctional::DownsampleImageIfNecessary(cv::Mat &image)
@@ -196,11 +255,29 @@ void DisplayerFunctional::ProcessImage(XI_IMG &image)
     }
     cv::Mat currentImage;
     int filterArrayType;
+    int64_t frameNumber;
     {
         boost::lock_guard<boost::mutex> guard(m_mutexImageDisplay);
         currentImage =
             cv::Mat(static_cast<int>(image.height), static_cast<int>(image.width), CV_16UC1, image.bp).clone();
         filterArrayType = image.color_filter_array;
+        frameNumber = image.nframe;
+    }
+    RoiTrackingWorker *roiTracking = m_mainWindow->GetRoiTracking();
+    if (roiTracking != nullptr)
+    {
+        // the raw frame is not modified by the display, the tracker can reference it
+        roiTracking->Submit(currentImage, frameNumber);
+    }
+    // take a single snapshot of the UI values such that all of them are consistent during the processing of this image
+    auto settings = m_mainWindow->GetUiSettings();
+    const int bitDepth = m_bitDepth;
+    auto noiseEstimator = m_mainWindow->GetNoiseEstimator();
+    NoiseEstimate noise;
+    if (noiseEstimator != nullptr)
+    {
+        noiseEstimator->Update(currentImage);
+        noise = noiseEstimator->GetEstimate();
     }
     cv::Mat rawImage;
     static cv::Mat bgrImage;
@@ -208,23 +285,27 @@ void DisplayerFunctional::ProcessImage(XI_IMG &image)
     if (m_cameraType == CAMERA_TYPE_SPECTRAL)
     {
         rawImage = InitializeBandImage(currentImage);
-        this->GetBand(currentImage, rawImage, m_mainWindow->GetBand());
-        bgrImage = cv::Mat::zeros(currentImage.rows / this->m_mosaicShape[0],
-                                  currentImage.cols / this->m_mosaicShape[1], CV_8UC3);
-        this->GetBGRImage(currentImage, bgrImage);
+        this->GetBand(currentImage, rawImage, settings->band);
+        auto trueColorRenderer = std::atomic_load(&m_trueColorRenderer);
+        if (settings->trueColor && trueColorRenderer != nullptr)
+        {
+            trueColorRenderer->Render(currentImage, bgrImage);
+        }
+        else
+        {
+            bgrImage = cv::Mat::zeros(currentImage.rows / this->m_mosaicShape[0],
+                                      currentImage.cols / this->m_mosaicShape[1], CV_8UC3);
+            this->GetBGRImage(currentImage, bgrImage);
+        }
     }
     else if (m_cameraType == CAMERA_TYPE_GRAY)
     {
-        rawImage = currentImage.clone();
-        rawImage /= m_scaling_factor; // 10 bit to 8 bit
-        rawImage.convertTo(rawImage, CV_8UC1);
+        ConvertTo8Bit(currentImage, rawImage, bitDepth);
         cv::cvtColor(rawImage, bgrImage, cv::COLOR_GRAY2BGR);
     }
     else if (m_cameraType == CAMERA_TYPE_RGB)
     {
-        rawImage = currentImage.clone();
-        rawImage /= m_scaling_factor; // 10 bit to 8 bit
-        rawImage.convertTo(rawImage, CV_8UC3);
+        ConvertTo8Bit(currentImage, rawImage, bitDepth);
 
         bgrImage = currentImage.clone();
         if (filterArrayType == XI_CFA_BAYER_GBRG)
@@ -236,25 +317,81 @@ void DisplayerFunctional::ProcessImage(XI_IMG &image)
             LOG_XILENS(error) << "Could not interpret filter array of type: " << filterArrayType;
         }
 
-        bgrImage.convertTo(bgrImage, CV_8UC3, 1.0 / m_scaling_factor);
+        WhiteBalanceEstimator *whiteBalance = m_mainWindow->GetWhiteBalance();
+        if (whiteBalance != nullptr && bgrImage.type() == CV_16UC3)
+        {
+            whiteBalance->SetLocked(settings->lockWhiteBalance);
+            whiteBalance->Update(currentImage, filterArrayType, bitDepth);
+            // the gains are applied by the conversion to 8 bit, without another pass over the image
+            ApplyWhiteBalance(bgrImage, bgrImage, whiteBalance->GetGains(), 1.0 / (1 << GetDisplayShift(bitDepth)));
+        }
+        else
+        {
+            ConvertTo8Bit(bgrImage, bgrImage, bitDepth);
+        }
     }
     else
     {
         LOG_XILENS(error) << "Could not recognize camera type: " << m_cameraType.toStdString();
         throw std::runtime_error("Could not recognize camera type: " + m_cameraType.toStdString());
     }
-    cv::Mat rawImageToDisplay = rawImage.clone();
+    cv::Mat classOverlay;
+    auto classifier = std::atomic_load(&m_cameraClassifier);
+    ClassMapRecorder &classMapRecorder = m_mainWindow->GetClassMapRecorder();
+    if (classifier != nullptr && (settings->classify || classMapRecorder.IsRecording()))
+    {
+        cv::Mat labels;
+        classifier->Classify(currentImage, m_mosaicShape[1], m_mosaicShape[0], labels);
+        classMapRecorder.Write(labels, frameNumber);
+        if (settings->classify)
+        {
+            classifier->Colorize(labels, classOverlay);
+        }
+    }
+    cv::Mat rawImageToDisplay;
+    const cv::Size registeredSize = bgrImage.size();
+    if (settings->stabilize)
+    {
+        // the motion is estimated on the color image, which does not change with the displayed band
+        m_registration.Register(bgrImage);
+        m_registration.Apply(rawImage, rawImageToDisplay);
+        m_registration.Apply(bgrImage, bgrImage);
+        if (!classOverlay.empty())
+        {
+            m_registration.Apply(classOverlay, classOverlay);
+        }
+    }
+    else
+    {
+        // the first image once the motion compensation is selected again becomes the reference
+        m_registration.Reset();
+        rawImageToDisplay = rawImage.clone();
+    }
     DownsampleImageIfNecessary(rawImageToDisplay);
-    this->PrepareRawImage(rawImageToDisplay, m_mainWindow->GetNormalize());
+    this->PrepareRawImage(rawImageToDisplay, settings->normalize, settings->saturationOverlay);
     // display BGR image
     DownsampleImageIfNecessary(bgrImage);
-    if (m_mainWindow->GetNormalize())
+    if (settings->normalize)
     {
-        NormalizeBGRImage(bgrImage);
+        NormalizeBGRImage(bgrImage, settings->bgrNorm);
     }
     else
     {
-        PrepareBGRImage(bgrImage, static_cast<int>(m_mainWindow->GetBGRNorm()));
+        PrepareBGRImage(bgrImage, static_cast<int>(settings->bgrNorm));
+    }
+    if (!classOverlay.empty())
+    {
+        DownsampleImageIfNecessary(classOverlay);
+        cv::addWeighted(bgrImage, 1 - CLASS_OVERLAY_OPACITY, classOverlay, CLASS_OVERLAY_OPACITY, 0, bgrImage);
+    }
+    if (roiTracking != nullptr)
+    {
+        std::vector<TrackedRoi> tracks;
+        roiTracking->GetTracks(tracks);
+        FrameTransform motion = m_registration.GetTransform();
+        const FrameTransform *stabilization = settings->stabilize ? &motion : nullptr;
+        DrawTrackedRois(rawImageToDisplay, tracks, currentImage.size(), registeredSize, stabilization);
+        DrawTrackedRois(bgrImage, tracks, currentImage.size(), registeredSize, stabilization);
     }
     // Update saturation display and display images through the main thread
     auto bgrQImage = GetQImageFromMatrix(bgrImage, QImage::Format_RGB888);
@@ -263,6 +400,24 @@ void DisplayerFunctional::ProcessImage(XI_IMG &image)
     emit ImageReadyToUpdateRGB(bgrQImage);
     emit ImageReadyToUpdateRaw(rawQImage);
     emit SaturationPercentageReady(saturationValues.first, saturationValues.second);
+    if (noiseEstimator != nullptr && noise.frames >= 2)
+    {
+        // the signal to noise ratio of the displayed band, or of the whole image for cameras without bands
+        double snr = 0;
+        if (m_cameraType == CAMERA_TYPE_SPECTRAL && settings->band >= 1 && settings->band <= noise.bandSnr.size())
+        {
+            snr = noise.bandSnr[settings->band - 1];
+        }
+        else
+        {
+            for (float bandSnr : noise.bandSnr)
+            {
+                snr += bandSnr;
+            }
+            snr /= static_cast<double>(noise.bandSnr.size());
+        }
+        emit NoiseEstimateReady(snr, noise.readNoise);
+    }
 }
 
 void DisplayerFunctional::GetBGRImage(cv::Mat &image, cv::Mat &bgr_image)
@@ -314,6 +469,65 @@ void DisplayerFunctional::SetCameraProperties(QString cameraModel)
     this->m_cameraType = getCameraMapper().value(cameraModel).cameraType;
     this->m_cameraModel = cameraModel;
     this->m_mosaicShape = getCameraMapper().value(cameraModel).mosaicShape;
+    this->UpdateTrueColorRenderer();
+
+    std::shared_ptr<const SpectralClassifier> cameraClassifier;
+    if (m_classifier != nullptr && m_cameraType == CAMERA_TYPE_SPECTRAL)
+    {
+        if (m_mosaicShape[0] * m_mosaicShape[1] == m_classifier->GetNumberOfBands())
+        {
+            cameraClassifier = m_classifier;
+        }
+        else
+        {
+            LOG_XILENS(warning) << "Classifier with " << m_classifier->GetNumberOfBands()
+                                << " bands can not be used with the " << m_mosaicShape[0] << "x" << m_mosaicShape[1]
+                                << " mosaic of " << cameraModel.toStdString();
+        }
+    }
+    std::atomic_store(&m_cameraClassifier, cameraClassifier);
+
+    if (m_mainWindow != nullptr && m_mainWindow->GetRoiTracking() != nullptr)
+    {
+        // the regions are given for the frames of the new camera
+        m_mainWindow->GetRoiTracking()->Reset();
+    }
+}
+
+void DisplayerFunctional::SetBitDepth(int bitDepth)
+{
+    // validates the bit depth before it is used by the display thread
+    GetDisplayShift(bitDepth);
+    if (m_bitDepth.exchange(bitDepth) != bitDepth)
+    {
+        this->UpdateTrueColorRenderer();
+    }
+}
+
+std::shared_ptr<const TrueColorRenderer> DisplayerFunctional::GetTrueColorRenderer() const
+{
+    return std::atomic_load(&m_trueColorRenderer);
+}
+
+void DisplayerFunctional::UpdateTrueColorRenderer()
+{
+    std::shared_ptr<const TrueColorRenderer> trueColorRenderer;
+    auto bandCenters = getCameraMapper().value(m_cameraModel).bandCenters;
+    if (m_cameraType == CAMERA_TYPE_SPECTRAL && !bandCenters.empty())
+    {
+        try
+        {
+            // the first entry of the mosaic shape is the period of the rows, as for the bands displayed otherwise
+            trueColorRenderer = std::make_shared<const TrueColorRenderer>(
+                bandCenters, m_mosaicShape[1], m_mosaicShape[0], 1 << GetDisplayShift(m_bitDepth));
+        }
+        catch (const std::invalid_argument &e)
+        {
+            LOG_XILENS(warning) << "True color rendering not available for " << m_cameraModel.toStdString() << ": "
+                                << e.what();
+        }
+    }
+    std::atomic_store(&m_trueColorRenderer, trueColorRenderer);
 }
 
 QImage GetQImageFromMatrix(cv::Mat &image, QImage::Format format)
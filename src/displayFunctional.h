@@ -10,14 +10,19 @@
 #include <QImage>
 #include <QObject>
 #include <QTimer>
+#include <atomic>
 #include <boost/thread.hpp>
+#include <memory>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc.hpp>
 #include <string>
 
 #include "constants.h"
 #include "display.h"
+#include "frameRegistration.h"
 #include "mainwindow.h"
+#include "spectralClassifier.h"
+#include "trueColor.h"
 #include "util.h"
 
 class MainWindow;
@@ -61,6 +66,19 @@ class DisplayerFunctional : public Displayer
      */
     void SetCameraProperties(QString cameraModel) override;
 
+    /**
+     * Sets the bit depth of the raw values, they are shifted to 8 bit for display.
+     *
+     * @param bitDepth bit depth of the raw values.
+     * @throws std::invalid_argument if the bit depth is out of range.
+     */
+    void SetBitDepth(int bitDepth) override;
+
+    /**
+     * @return renderer of the color image from all bands for the current camera, null when it is not available.
+     */
+    std::shared_ptr<const TrueColorRenderer> GetTrueColorRenderer() const;
+
     /**
      * Down-samples image in case it is bigger than maximum dimensions defined by
      * constants::MAX_WIDTH_DISPLAY_WINDOW and
@@ -141,9 +159,9 @@ class DisplayerFunctional : public Displayer
     XI_IMG m_nextImage{};
 
     /**
-     * Scaling factor used to convert image from 10bit to 8bit
+     * Bit depth of the raw values, used to convert them to 8 bit. Set by the GUI thread when a camera is opened.
      */
-    int m_scaling_factor = 4;
+    std::atomic<int> m_bitDepth{DEFAULT_BIT_DEPTH};
 
     /**
      * explicit mutex declaration
@@ -155,6 +173,33 @@ class DisplayerFunctional : public Displayer
      */
     cv::Ptr<cv::CLAHE> m_clahe = cv::createCLAHE();
 
+    /**
+     * Compensates the motion of the camera in the displayed images, only used on the display thread.
+     */
+    FrameRegistration m_registration;
+
+    /**
+     * Renders the color image from all bands of spectral cameras with known band centers, null otherwise. Replaced by
+     * the GUI thread when the camera changes, hence only accessed through the atomic shared pointer operations.
+     */
+    std::shared_ptr<const TrueColorRenderer> m_trueColorRenderer;
+
+    /**
+     * Classifier loaded with `--classifier`, null when none was given or it could not be loaded.
+     */
+    std::shared_ptr<const SpectralClassifier> m_classifier;
+
+    /**
+     * Classifier used for the current camera, null when the camera does not have the bands of the classifier. Replaced
+     * by the GUI thread when the camera changes, hence only accessed through the atomic shared pointer operations.
+     */
+    std::shared_ptr<const SpectralClassifier> m_cameraClassifier;
+
+    /**
+     * Replaces the renderer of the color image for the current camera model and bit depth.
+     */
+    void UpdateTrueColorRenderer();
+
     /**
      * Processes a XIMEA image to display a Raw and RGB representation of the image in the main UI.
      *
@@ -173,8 +218,10 @@ class DisplayerFunctional : public Displayer
      * histogram normalization in case it is specified
      *
      * @param raw_image, the image to be processed
+     * @param equalize_hist indicates if histogram equalization should be applied.
+     * @param saturation_overlay indicates if saturated and dark pixels should be painted with a custom color.
      */
-    void PrepareRawImage(cv::Mat &raw_image, bool equalize_hist);
+    void PrepareRawImage(cv::Mat &raw_image, bool equalize_hist, bool saturation_overlay);
 
     /**
      * @brief Normalizes a BGR image using the LAB color space.
@@ -187,14 +234,15 @@ class DisplayerFunctional : public Displayer
      *
      * @param bgr_image The BGR image to be normalized. Note that the input image
      * will be modified.
+     * @param clip_limit threshold for contrast limiting used by CLAHE.
      */
-    void NormalizeBGRImage(cv::Mat &bgr_image);
+    void NormalizeBGRImage(cv::Mat &bgr_image, unsigned clip_limit);
 
     /**
      * @brief Extracts a specific band (channel) from an image
      *
-     * Band_image is converted to an 8-bit image and divided by the scaling factor
-     * to convert it from 10-bit to 8-bit.
+     * Band_image is converted to an 8-bit image by shifting the raw values according
+     * to their bit depth.
      *
      * @param image The input image
      * @param band_image The output band image
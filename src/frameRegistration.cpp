@@ -0,0 +1,237 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "frameRegistration.h"
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+
+/**
+ * Rotates a vector by an angle in degrees, counter-clockwise as in cv::getRotationMatrix2D.
+ */
+static cv::Point2d Rotate(const cv::Point2d &vector, double angleDeg)
+{
+    double angle = angleDeg * CV_PI / 180;
+    return {std::cos(angle) * vector.x + std::sin(angle) * vector.y,
+            -std::sin(angle) * vector.x + std::cos(angle) * vector.y};
+}
+
+/**
+ * Combines the motion of a reference relative to the first reference with the motion of an image relative to the
+ * reference.
+ */
+static FrameTransform Compose(const FrameTransform &reference, const FrameTransform &relative)
+{
+    cv::Point2d translation = Rotate({reference.dx, reference.dy}, relative.angleDeg);
+    FrameTransform transform;
+    transform.dx = translation.x + relative.dx;
+    transform.dy = translation.y + relative.dy;
+    transform.angleDeg = reference.angleDeg + relative.angleDeg;
+    return transform;
+}
+
+/**
+ * Moves the zero frequency of a spectrum computed by cv::dft to the center.
+ */
+static cv::Mat ShiftQuadrants(const cv::Mat &spectrum)
+{
+    int cols = spectrum.cols;
+    int rows = spectrum.rows;
+    int sx = cols / 2;
+    int sy = rows / 2;
+    cv::Mat shifted(spectrum.size(), spectrum.type());
+    spectrum(cv::Rect(0, 0, cols - sx, rows - sy)).copyTo(shifted(cv::Rect(sx, sy, cols - sx, rows - sy)));
+    spectrum(cv::Rect(cols - sx, 0, sx, rows - sy)).copyTo(shifted(cv::Rect(0, sy, sx, rows - sy)));
+    spectrum(cv::Rect(0, rows - sy, cols - sx, sy)).copyTo(shifted(cv::Rect(sx, 0, cols - sx, sy)));
+    spectrum(cv::Rect(cols - sx, rows - sy, sx, sy)).copyTo(shifted(cv::Rect(0, 0, sx, sy)));
+    return shifted;
+}
+
+FrameRegistration::FrameRegistration(RegistrationOptions options) : m_options(options)
+{
+}
+
+FrameTransform FrameRegistration::Register(const cv::Mat &image)
+{
+    if (image.empty() || (image.type() != CV_8UC1 && image.type() != CV_8UC3))
+    {
+        throw std::invalid_argument("Images to register have to be of type CV_8UC1 or CV_8UC3, got: " +
+                                    cv::typeToString(image.type()));
+    }
+    if (image.size() != m_imageSize)
+    {
+        m_imageSize = image.size();
+        m_scale = std::min(1., static_cast<double>(m_options.estimationSize) / std::max(image.cols, image.rows));
+        m_decimatedSize = cv::Size(std::max(2, static_cast<int>(std::lround(image.cols * m_scale))),
+                                   std::max(2, static_cast<int>(std::lround(image.rows * m_scale))));
+        cv::createHanningWindow(m_window, m_decimatedSize, CV_32F);
+        cv::Mat columns(1, image.cols, CV_32F);
+        for (int i = 0; i < image.cols; i++)
+        {
+            columns.at<float>(0, i) = static_cast<float>(i - (image.cols - 1) / 2.);
+        }
+        cv::Mat rows(image.rows, 1, CV_32F);
+        for (int i = 0; i < image.rows; i++)
+        {
+            rows.at<float>(i, 0) = static_cast<float>(i - (image.rows - 1) / 2.);
+        }
+        cv::repeat(columns, image.rows, 1, m_centeredX);
+        cv::repeat(rows, 1, image.cols, m_centeredY);
+        m_map1.release();
+        this->Reset();
+    }
+
+    cv::Mat decimated = this->Decimate(image);
+    if (m_reference.empty())
+    {
+        this->SetReference(decimated);
+        m_transform = m_referenceTransform;
+        m_response = 1;
+    }
+    else
+    {
+        FrameTransform relative = this->Estimate(decimated, m_response);
+        if (m_response < m_options.minResponse)
+        {
+            // the motion of this image is unknown, it is assumed to be the motion of the previous image
+            m_referenceTransform = m_transform;
+            this->SetReference(decimated);
+        }
+        else
+        {
+            relative.dx /= m_scale;
+            relative.dy /= m_scale;
+            m_transform = Compose(m_referenceTransform, relative);
+        }
+    }
+    this->UpdateMaps();
+    return m_transform;
+}
+
+void FrameRegistration::Apply(const cv::Mat &src, cv::Mat &dst) const
+{
+    if (m_map1.empty() || src.size() != m_imageSize)
+    {
+        throw std::invalid_argument("No image was registered with the size of the image to stabilize.");
+    }
+    // remapped into a new matrix, such that src and dst can be the same
+    cv::Mat stabilized;
+    cv::remap(src, stabilized, m_map1, m_map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+    dst = stabilized;
+}
+
+void FrameRegistration::Reset()
+{
+    m_reference.release();
+    m_referenceSpectrum.release();
+    m_referenceTransform = FrameTransform();
+    m_transform = FrameTransform();
+    m_response = 0;
+}
+
+FrameTransform FrameRegistration::GetTransform() const
+{
+    return m_transform;
+}
+
+double FrameRegistration::GetResponse() const
+{
+    return m_response;
+}
+
+cv::Mat FrameRegistration::Decimate(const cv::Mat &image) const
+{
+    cv::Mat gray = image;
+    if (image.channels() == 3)
+    {
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    }
+    cv::Mat decimated;
+    cv::resize(gray, decimated, m_decimatedSize, 0, 0, cv::INTER_AREA);
+    decimated.convertTo(decimated, CV_32F);
+    return decimated;
+}
+
+cv::Mat FrameRegistration::ComputeLogPolarSpectrum(const cv::Mat &decimated) const
+{
+    cv::Mat spectrum;
+    cv::dft(decimated.mul(m_window), spectrum, cv::DFT_COMPLEX_OUTPUT);
+    cv::Mat planes[2];
+    cv::split(spectrum, planes);
+    cv::Mat magnitude;
+    cv::magnitude(planes[0], planes[1], magnitude);
+    cv::log(magnitude + 1, magnitude);
+    magnitude = ShiftQuadrants(magnitude);
+    // a rotation of the image rotates its magnitude spectrum around the zero frequency, independently of a translation
+    cv::Point2f center(static_cast<float>(magnitude.cols / 2), static_cast<float>(magnitude.rows / 2));
+    cv::Mat polar;
+    cv::warpPolar(magnitude, polar, cv::Size(POLAR_RADII, POLAR_ANGLES), center, std::min(center.x, center.y),
+                  cv::INTER_LINEAR | cv::WARP_FILL_OUTLIERS | cv::WARP_POLAR_LOG);
+    return polar;
+}
+
+FrameTransform FrameRegistration::Estimate(const cv::Mat &decimated, double &response) const
+{
+    std::vector<double> angles = {0};
+    if (m_options.estimateRotation)
+    {
+        cv::Point2d polarShift = cv::phaseCorrelate(m_referenceSpectrum, this->ComputeLogPolarSpectrum(decimated));
+        // the magnitude spectrum is symmetric, rotations by more than 90 degrees are taken for smaller ones
+        double angle = std::fmod(std::abs(polarShift.y) * 360. / POLAR_ANGLES, 180.);
+        angle = std::min(angle, 180 - angle);
+        if (angle > 0.05)
+        {
+            // the direction of the rotation is found by correlating the image derotated in both directions
+            angles = {angle, -angle};
+        }
+    }
+    FrameTransform transform;
+    response = -1;
+    cv::Point2f center((m_decimatedSize.width - 1) / 2.f, (m_decimatedSize.height - 1) / 2.f);
+    for (double angle : angles)
+    {
+        cv::Mat derotated = decimated;
+        if (angle != 0)
+        {
+            cv::warpAffine(decimated, derotated, cv::getRotationMatrix2D(center, -angle, 1), m_decimatedSize,
+                           cv::INTER_LINEAR, cv::BORDER_REFLECT);
+        }
+        double candidateResponse = 0;
+        cv::Point2d shift = cv::phaseCorrelate(m_reference, derotated, m_window, &candidateResponse);
+        if (candidateResponse > response)
+        {
+            response = candidateResponse;
+            // the shift is measured on the derotated image, hence along the axes of the reference
+            cv::Point2d translation = Rotate(shift, angle);
+            transform.dx = translation.x;
+            transform.dy = translation.y;
+            transform.angleDeg = angle;
+        }
+    }
+    return transform;
+}
+
+void FrameRegistration::SetReference(const cv::Mat &decimated)
+{
+    m_reference = decimated;
+    if (m_options.estimateRotation)
+    {
+        m_referenceSpectrum = this->ComputeLogPolarSpectrum(decimated);
+    }
+}
+
+void FrameRegistration::UpdateMaps()
+{
+    double angle = m_transform.angleDeg * CV_PI / 180;
+    double cx = (m_imageSize.width - 1) / 2.;
+    double cy = (m_imageSize.height - 1) / 2.;
+    // each pixel p of the stabilized image is read from R (p - c) + c + d
+    cv::Mat mapX;
+    cv::Mat mapY;
+    cv::addWeighted(m_centeredX, std::cos(angle), m_centeredY, std::sin(angle), cx + m_transform.dx, mapX);
+    cv::addWeighted(m_centeredX, -std::sin(angle), m_centeredY, std::cos(angle), cy + m_transform.dy, mapY);
+    cv::convertMaps(mapX, mapY, m_map1, m_map2, CV_16SC2);
+}
@@ -0,0 +1,177 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_FRAME_REGISTRATION_H
+#define XILENS_FRAME_REGISTRATION_H
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * @brief Options of the frame registration.
+ */
+struct RegistrationOptions
+{
+    /**
+     * Longest side in pixels of the decimated image the motion is estimated on.
+     */
+    int estimationSize = 256;
+
+    /**
+     * Whether the rotation around the image center is estimated in addition to the translation.
+     */
+    bool estimateRotation = false;
+
+    /**
+     * Peak response of the phase correlation below which an estimate is rejected, e.g. because the scene changed. The
+     * reference is then replaced by the current image.
+     */
+    double minResponse = 0.2;
+};
+
+/**
+ * @brief Rigid motion of an image relative to the reference image.
+ *
+ * A point p of the reference is found at R (p - c) + c + d in the image, with c the image center, d the translation
+ * and R the rotation by FrameTransform::angleDeg, counter-clockwise as in cv::getRotationMatrix2D.
+ */
+struct FrameTransform
+{
+    /**
+     * Translation in pixels along the columns.
+     */
+    double dx = 0;
+
+    /**
+     * Translation in pixels along the rows.
+     */
+    double dy = 0;
+
+    /**
+     * Rotation around the image center in degrees.
+     */
+    double angleDeg = 0;
+};
+
+/**
+ * @brief Stabilizes a stream of images by compensating the motion of the camera, e.g. of handheld recordings or
+ * recordings affected by breathing.
+ *
+ * The motion of each image relative to a reference image is estimated by FFT phase correlation on a decimated copy of
+ * the image, see RegistrationOptions::estimationSize. When enabled, the rotation is estimated first by phase
+ * correlation of the log-polar magnitude spectra, which do not depend on the translation. The motion is undone with
+ * remap tables: the centered coordinates of the pixels are precomputed once per image size and only combined with the
+ * motion of each image, then converted to the fixed-point format that cv::remap applies fastest, in parallel over the
+ * rows. The tables are shared by all images registered with the same motion, e.g. the raw and color representations of
+ * a frame.
+ *
+ * The first image after FrameRegistration::Reset becomes the reference. Estimates with a low response are rejected
+ * and replace the reference, such that the registration recovers when the scene changes. Not thread safe.
+ */
+class FrameRegistration
+{
+  public:
+    /**
+     * Number of angles sampled by the log-polar transform of the magnitude spectrum, over 360 degrees.
+     */
+    static constexpr int POLAR_ANGLES = 720;
+
+    /**
+     * Number of radii sampled by the log-polar transform of the magnitude spectrum.
+     */
+    static constexpr int POLAR_RADII = 128;
+
+    explicit FrameRegistration(RegistrationOptions options = RegistrationOptions());
+
+    /**
+     * Estimates the motion of an image relative to the reference and prepares the remap tables that undo it.
+     *
+     * @param image image of type CV_8UC1 or CV_8UC3.
+     * @return motion of the image in pixels of the image.
+     */
+    FrameTransform Register(const cv::Mat &image);
+
+    /**
+     * Undoes the motion of the last registered image, pixels moved in from outside of the image are black.
+     *
+     * @param src image with the size of the last registered image, e.g. another representation of it.
+     * @param dst stabilized image.
+     * @throws std::invalid_argument if no image was registered with the size of src.
+     */
+    void Apply(const cv::Mat &src, cv::Mat &dst) const;
+
+    /**
+     * Starts again without reference, the next registered image becomes the reference.
+     */
+    void Reset();
+
+    /**
+     * Queries the motion of the last registered image.
+     */
+    FrameTransform GetTransform() const;
+
+    /**
+     * Queries the peak response of the phase correlation of the last registered image, close to 1 when the image only
+     * moved relative to the reference.
+     */
+    double GetResponse() const;
+
+  private:
+    /**
+     * Converts an image to a decimated gray image of type CV_32F with the size of the reference.
+     */
+    cv::Mat Decimate(const cv::Mat &image) const;
+
+    /**
+     * Computes the log-polar transform of the centered magnitude spectrum of a decimated image.
+     */
+    cv::Mat ComputeLogPolarSpectrum(const cv::Mat &decimated) const;
+
+    /**
+     * Estimates the motion of a decimated image relative to the decimated reference.
+     *
+     * @param decimated decimated image.
+     * @param response peak response of the phase correlation.
+     * @return motion in pixels of the decimated image.
+     */
+    FrameTransform Estimate(const cv::Mat &decimated, double &response) const;
+
+    /**
+     * Replaces the reference, the motion of the reference relative to the first reference is kept.
+     */
+    void SetReference(const cv::Mat &decimated);
+
+    /**
+     * Combines the precomputed centered coordinates with the motion into the remap tables.
+     */
+    void UpdateMaps();
+
+    RegistrationOptions m_options;
+    cv::Size m_imageSize;
+    cv::Size m_decimatedSize;
+    double m_scale = 1;
+    cv::Mat m_window;
+    cv::Mat m_reference;
+    cv::Mat m_referenceSpectrum;
+
+    /**
+     * Motion of the reference relative to the first reference, the reference is replaced when an estimate fails.
+     */
+    FrameTransform m_referenceTransform;
+    FrameTransform m_transform;
+    double m_response = 0;
+
+    /**
+     * Column and row of each pixel relative to the image center, precomputed once per image size.
+     */
+    cv::Mat m_centeredX;
+    cv::Mat m_centeredY;
+
+    /**
+     * Fixed-point remap tables, see cv::convertMaps.
+     */
+    cv::Mat m_map1;
+    cv::Mat m_map2;
+};
+
+#endif // XILENS_FRAME_REGISTRATION_H
@@ -0,0 +1,206 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "frameStatistics.h"
+
+#include <b2nd.h>
+
+#include <array>
+#include <iomanip>
+#include <stdexcept>
+
+#include "bitDepth.h"
+#include "metadataCodec.h"
+#include "util.h"
+
+FrameStatisticsProvider::FrameStatisticsProvider(unsigned int mosaicWidth, unsigned int mosaicHeight, int bitDepth)
+    : m_mosaicWidth(mosaicWidth), m_mosaicHeight(mosaicHeight),
+      m_saturationThreshold((OVEREXPOSURE_PIXEL_BOUNDARY_VALUE + 1) << GetDisplayShift(bitDepth)),
+      m_underexposureThreshold(UNDEREXPOSURE_PIXEL_BOUNDARY_VALUE << GetDisplayShift(bitDepth))
+{
+    if (mosaicWidth == 0 || mosaicHeight == 0 || GetNumberOfBands() > MAX_BANDS)
+    {
+        throw std::invalid_argument("Unsupported mosaic shape for frame statistics.");
+    }
+}
+
+std::shared_ptr<FrameStatisticsProvider> FrameStatisticsProvider::FromCameraData(const CameraData &cameraData,
+                                                                                 int bitDepth)
+{
+    if (cameraData.cameraType == CAMERA_TYPE_SPECTRAL && cameraData.mosaicShape.size() == 2)
+    {
+        // the first entry of the mosaic shape is the period of the rows, as in the displayer
+        return std::make_shared<FrameStatisticsProvider>(cameraData.mosaicShape[1], cameraData.mosaicShape[0],
+                                                         bitDepth);
+    }
+    if (cameraData.cameraType == CAMERA_TYPE_RGB)
+    {
+        return std::make_shared<FrameStatisticsProvider>(2, 2, bitDepth);
+    }
+    return std::make_shared<FrameStatisticsProvider>(1, 1, bitDepth);
+}
+
+size_t FrameStatisticsProvider::GetNumberOfBands() const
+{
+    return static_cast<size_t>(m_mosaicWidth) * m_mosaicHeight;
+}
+
+unsigned int FrameStatisticsProvider::GetMosaicWidth() const
+{
+    return m_mosaicWidth;
+}
+
+unsigned int FrameStatisticsProvider::GetMosaicHeight() const
+{
+    return m_mosaicHeight;
+}
+
+void FrameStatisticsProvider::DeclareFields(MetadataSchema &schema)
+{
+    m_bandMeanOffset = schema.AddFloatField(BAND_MEAN_KEY, GetNumberOfBands());
+    m_saturatedOffset = schema.AddFloatField(SATURATED_FRACTION_KEY);
+    m_underexposedOffset = schema.AddFloatField(UNDEREXPOSED_FRACTION_KEY);
+    m_focusOffset = schema.AddFloatField(FOCUS_SCORE_KEY);
+}
+
+void FrameStatisticsProvider::Sample(const XI_IMG &image, FrameMetadataRecord &record) const
+{
+    std::array<uint64_t, MAX_BANDS> sums{};
+    std::array<uint64_t, MAX_BANDS> counts{};
+    uint64_t saturated = 0;
+    uint64_t underexposed = 0;
+    uint64_t gradient = 0;
+    uint64_t gradientCount = 0;
+
+    const auto *pixels = static_cast<const uint16_t *>(image.bp);
+    const size_t width = pixels != nullptr ? image.width : 0;
+    const size_t height = pixels != nullptr ? image.height : 0;
+    for (size_t row = 0; row < height; row++)
+    {
+        const uint16_t *line = pixels + row * width;
+        const size_t bandOffset = (row % m_mosaicHeight) * m_mosaicWidth;
+        size_t mosaicCol = 0;
+        for (size_t col = 0; col < width; col++)
+        {
+            const uint16_t value = line[col];
+            sums[bandOffset + mosaicCol] += value;
+            counts[bandOffset + mosaicCol]++;
+            saturated += value >= m_saturationThreshold;
+            underexposed += value < m_underexposureThreshold;
+            if (col >= m_mosaicWidth)
+            {
+                // neighbours of the same band are one mosaic width apart
+                const int64_t difference = static_cast<int64_t>(value) - line[col - m_mosaicWidth];
+                gradient += static_cast<uint64_t>(difference * difference);
+                gradientCount++;
+            }
+            if (++mosaicCol == m_mosaicWidth)
+            {
+                mosaicCol = 0;
+            }
+        }
+    }
+
+    for (size_t band = 0; band < GetNumberOfBands(); band++)
+    {
+        record.floatValues[m_bandMeanOffset + band] =
+            counts[band] > 0 ? static_cast<float>(static_cast<double>(sums[band]) / counts[band]) : 0.f;
+    }
+    const double nPixels = static_cast<double>(width * height);
+    record.floatValues[m_saturatedOffset] = nPixels > 0 ? static_cast<float>(saturated / nPixels) : 0.f;
+    record.floatValues[m_underexposedOffset] = nPixels > 0 ? static_cast<float>(underexposed / nPixels) : 0.f;
+    record.floatValues[m_focusOffset] =
+        gradientCount > 0 ? static_cast<float>(static_cast<double>(gradient) / gradientCount) : 0.f;
+}
+
+FrameStatisticsSeries ReadFrameStatistics(const std::string &filePath)
+{
+    b2nd_array_t *src;
+    int result = b2nd_open(filePath.c_str(), &src);
+    HandleBLOSCResult(result, "b2nd_open");
+    FrameStatisticsSeries statistics;
+    try
+    {
+        statistics.bandMean = ReadMetadataColumns<float>(src, BAND_MEAN_KEY);
+        statistics.saturatedFraction = ReadMetadataColumn<float>(src, SATURATED_FRACTION_KEY);
+        statistics.underexposedFraction = ReadMetadataColumn<float>(src, UNDEREXPOSED_FRACTION_KEY);
+        statistics.focusScore = ReadMetadataColumn<float>(src, FOCUS_SCORE_KEY);
+    }
+    catch (const std::exception &e)
+    {
+        b2nd_free(src);
+        throw std::runtime_error("Could not read frame statistics from " + filePath + ": " + e.what());
+    }
+    b2nd_free(src);
+    return statistics;
+}
+
+/**
+ * Writes the ranges of consecutive frames for which the value exceeds the threshold
+ */
+static void WriteFlaggedStretches(const std::vector<float> &values, float threshold, const char *label,
+                                  std::ostream &stream)
+{
+    size_t nFlagged = 0;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (values[i] <= threshold)
+        {
+            continue;
+        }
+        size_t first = i;
+        while (i + 1 < values.size() && values[i + 1] > threshold)
+        {
+            i++;
+        }
+        stream << "  " << label << " frames " << first << "-" << i << "\n";
+        nFlagged += i - first + 1;
+    }
+    stream << label << " frames: " << nFlagged << " of " << values.size() << "\n";
+}
+
+void WriteQualityReport(const FrameStatisticsSeries &statistics, float saturationThreshold,
+                        float underexposureThreshold, bool perFrame, std::ostream &stream)
+{
+    const size_t nFrames = statistics.saturatedFraction.size();
+    if (perFrame)
+    {
+        stream << "frame," << SATURATED_FRACTION_KEY << "," << UNDEREXPOSED_FRACTION_KEY << "," << FOCUS_SCORE_KEY;
+        size_t nBands = statistics.bandMean.empty() ? 0 : statistics.bandMean[0].size();
+        for (size_t band = 0; band < nBands; band++)
+        {
+            stream << "," << BAND_MEAN_KEY << "_" << band + 1;
+        }
+        stream << "\n";
+        for (size_t i = 0; i < nFrames; i++)
+        {
+            stream << i << "," << statistics.saturatedFraction[i] << "," << statistics.underexposedFraction.at(i) << ","
+                   << statistics.focusScore.at(i);
+            if (i < statistics.bandMean.size())
+            {
+                for (float mean : statistics.bandMean[i])
+                {
+                    stream << "," << mean;
+                }
+            }
+            stream << "\n";
+        }
+        return;
+    }
+
+    double meanFocus = 0;
+    for (float focus : statistics.focusScore)
+    {
+        meanFocus += focus;
+    }
+    meanFocus = statistics.focusScore.empty() ? 0 : meanFocus / statistics.focusScore.size();
+    std::ios::fmtflags flags = stream.flags();
+    std::streamsize precision = stream.precision();
+    stream << "frames: " << nFrames << "\n";
+    stream << "mean focus score: " << std::fixed << std::setprecision(2) << meanFocus << "\n";
+    stream.flags(flags);
+    stream.precision(precision);
+    WriteFlaggedStretches(statistics.saturatedFraction, saturationThreshold, "saturated", stream);
+    WriteFlaggedStretches(statistics.underexposedFraction, underexposureThreshold, "under-exposed", stream);
+}
@@ -0,0 +1,124 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_FRAME_STATISTICS_H
+#define XILENS_FRAME_STATISTICS_H
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "metadataProviders.h"
+
+/**
+ * @brief Computes cheap summary statistics of each recorded frame in a single pass over the raw data.
+ *
+ * The statistics are stored as metadata of the recording, this allows checking large recordings for saturated, dark
+ * or blurry stretches without decompressing any image. The following fields are provided:
+ *  - BAND_MEAN_KEY: mean raw value of each band of the mosaic, one value per band.
+ *  - SATURATED_FRACTION_KEY: fraction of pixels that are displayed as over-exposed.
+ *  - UNDEREXPOSED_FRACTION_KEY: fraction of pixels that are displayed as under-exposed.
+ *  - FOCUS_SCORE_KEY: mean squared difference between horizontal neighbours of the same band, larger is sharper.
+ */
+class FrameStatisticsProvider : public MetadataProvider
+{
+  public:
+    /**
+     * Maximum number of bands supported, used to keep the accumulators of each frame on the stack.
+     */
+    static constexpr size_t MAX_BANDS = 64;
+
+    /**
+     * Constructs the provider.
+     *
+     * @param mosaicWidth width of the mosaic pattern of the sensor, 1 for sensors without filter array.
+     * @param mosaicHeight height of the mosaic pattern of the sensor, 1 for sensors without filter array.
+     * @param bitDepth bit depth of the raw values, the exposure boundaries OVEREXPOSURE_PIXEL_BOUNDARY_VALUE and
+     * UNDEREXPOSURE_PIXEL_BOUNDARY_VALUE are defined on the 8 bit values displayed and shifted to this bit depth.
+     * @throws std::invalid_argument if the mosaic is empty or has more than MAX_BANDS bands, or if the bit depth is
+     * out of range.
+     */
+    FrameStatisticsProvider(unsigned int mosaicWidth, unsigned int mosaicHeight, int bitDepth);
+
+    /**
+     * Creates a provider for a camera model, spectral cameras use their mosaic, RGB cameras use the 2x2 Bayer pattern
+     * and gray cameras a single band.
+     *
+     * @param cameraData camera properties from the camera mapper.
+     * @param bitDepth bit depth of the raw values, see Camera::GetDataBitDepth.
+     */
+    static std::shared_ptr<FrameStatisticsProvider> FromCameraData(const CameraData &cameraData, int bitDepth);
+
+    void DeclareFields(MetadataSchema &schema) override;
+
+    void Sample(const XI_IMG &image, FrameMetadataRecord &record) const override;
+
+    /**
+     * Queries the number of bands for which the mean value is computed.
+     */
+    size_t GetNumberOfBands() const;
+
+    /**
+     * Queries the shape of the mosaic pattern of the sensor.
+     */
+    unsigned int GetMosaicWidth() const;
+    unsigned int GetMosaicHeight() const;
+
+  private:
+    unsigned int m_mosaicWidth;
+    unsigned int m_mosaicHeight;
+
+    /**
+     * Raw values equal or above this value are considered over-exposed.
+     */
+    unsigned int m_saturationThreshold;
+
+    /**
+     * Raw values below this value are considered under-exposed.
+     */
+    unsigned int m_underexposureThreshold;
+
+    size_t m_bandMeanOffset = 0;
+    size_t m_saturatedOffset = 0;
+    size_t m_underexposedOffset = 0;
+    size_t m_focusOffset = 0;
+};
+
+/**
+ * @brief Statistics of all frames of a recording, as stored by FrameStatisticsProvider.
+ */
+struct FrameStatisticsSeries
+{
+    std::vector<std::vector<float>> bandMean;
+    std::vector<float> saturatedFraction;
+    std::vector<float> underexposedFraction;
+    std::vector<float> focusScore;
+};
+
+/**
+ * Reads the frame statistics from the metadata of a recording without reading any image data.
+ *
+ * @param filePath path to the `.b2nd` file.
+ * @return statistics of all frames.
+ * @throws std::runtime_error if the file can not be opened or does not contain frame statistics.
+ */
+FrameStatisticsSeries ReadFrameStatistics(const std::string &filePath);
+
+/**
+ * Writes a quality report of a recording: number of frames, averages and stretches of consecutive frames that exceed
+ * the saturation or under-exposure thresholds.
+ *
+ * @param statistics statistics of all frames of the recording.
+ * @param saturationThreshold fraction of saturated pixels above which a frame is flagged.
+ * @param underexposureThreshold fraction of under-exposed pixels above which a frame is flagged.
+ * @param perFrame if true, the statistics of each frame are written as comma separated values.
+ * @param stream stream where the report is written.
+ */
+void WriteQualityReport(const FrameStatisticsSeries &statistics, float saturationThreshold,
+                        float underexposureThreshold, bool perFrame, std::ostream &stream);
+
+#endif // XILENS_FRAME_STATISTICS_H
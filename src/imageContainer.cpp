@@ -10,6 +10,8 @@
 #include <iostream>
 
 #include "logger.h"
+#include "mirroredRecording.h"
+#include "stripedRecording.h"
 #include "util.h"
 
 ImageContainer::ImageContainer() : m_PollImage(true)
@@ -23,20 +25,44 @@ void ImageContainer::Initialize(std::shared_ptr<XiAPIWrapper> apiWrapper)
     this->m_apiWrapper = apiWrapper;
 }
 
-void ImageContainer::InitializeFile(const char *filePath)
+void ImageContainer::InitializeFile(const char *filePath, const MetadataSchema &schema,
+                                    const RecordingOptions &options)
 {
     auto image = GetCurrentImage();
-    this->m_imageFile = std::make_unique<FileImage>(filePath, image.height, image.width);
+    if (!options.stripeFolders.empty() && !options.mirrorFilePath.empty())
+    {
+        throw std::invalid_argument("Striped recordings can not be mirrored.");
+    }
+    if (!options.mirrorFilePath.empty())
+    {
+        this->m_imageFile = std::make_unique<MirroredFileImage>(
+            std::vector<std::string>{filePath, options.mirrorFilePath}, image.height, image.width, schema,
+            options.compression);
+    }
+    else if (!options.stripeFolders.empty())
+    {
+        this->m_imageFile = std::make_unique<StripedFileImage>(filePath, options.stripeFolders, image.height,
+                                                               image.width, schema, options.compression);
+    }
+    else
+    {
+        auto file = std::make_unique<FileImage>(filePath, image.height, image.width, schema);
+        file->ConfigureCompression(options.compression);
+        this->m_imageFile = std::move(file);
+    }
 }
 
-void ImageContainer::CloseFile()
+std::string ImageContainer::CloseFile()
 {
+    std::string filePath;
     if (this->m_imageFile)
     {
         this->m_imageFile->AppendMetadata();
+        filePath = this->m_imageFile->GetFilePath();
         this->m_imageFile = nullptr;
         LOG_XILENS(info) << "Closed recording file";
     }
+    return filePath;
 }
 
 ImageContainer::~ImageContainer()
@@ -50,6 +76,8 @@ void ImageContainer::PollImage(HANDLE *cameraHandle, int pollingRate)
     static int stat;
     while (m_PollImage)
     {
+        bool isNewImage = false;
+        std::exception_ptr failure;
         {
             boost::lock_guard<boost::mutex> guard(m_mutexImageAccess);
             boost::this_thread::interruption_point();
@@ -62,18 +90,32 @@ void ImageContainer::PollImage(HANDLE *cameraHandle, int pollingRate)
                 }
                 catch (const std::exception &e)
                 {
-                    this->StopPolling();
                     LOG_XILENS(error) << "Error while trying to get image from device";
-                    this->CloseFile();
-                    throw;
+                    failure = std::current_exception();
                 }
             }
-            if (m_Image.acq_nframe != lastImageId)
+            if (failure == nullptr && m_Image.acq_nframe != lastImageId)
             {
-                emit NewImage();
+                isNewImage = true;
                 lastImageId = m_Image.acq_nframe;
             }
         }
+        if (failure != nullptr)
+        {
+            // the camera is reopened without holding the image lock, the last image stays available meanwhile
+            if (m_recoveryHandler && m_recoveryHandler())
+            {
+                continue;
+            }
+            this->StopPolling();
+            this->CloseFile();
+            std::rethrow_exception(failure);
+        }
+        if (isNewImage)
+        {
+            m_receivedImageCount++;
+            emit NewImage();
+        }
         WaitMilliseconds(pollingRate);
     }
 }
@@ -88,6 +130,16 @@ void ImageContainer::StartPolling()
     m_PollImage = true;
 }
 
+void ImageContainer::SetRecoveryHandler(std::function<bool()> handler)
+{
+    m_recoveryHandler = std::move(handler);
+}
+
+unsigned long ImageContainer::GetReceivedImageCount() const
+{
+    return m_receivedImageCount.load();
+}
+
 XI_IMG ImageContainer::GetCurrentImage()
 {
     boost::lock_guard<boost::mutex> guard(m_mutexImageAccess);
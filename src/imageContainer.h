@@ -8,17 +8,42 @@
 #include <xiApi.h>
 
 #include <QObject>
+#include <atomic>
 #include <boost/thread.hpp>
+#include <functional>
 
 #include "util.h"
 #include "xiAPIWrapper.h"
 
+/**
+ * @brief Options of the files written by ImageContainer.
+ */
+struct RecordingOptions
+{
+    /**
+     * Folders across which the recording is striped, see StripedFileImage. When empty, a single file is written.
+     */
+    std::vector<std::string> stripeFolders;
+
+    /**
+     * Second destination written at the same time, see MirroredFileImage. Ignored when empty.
+     */
+    std::string mirrorFilePath;
+
+    /**
+     * Compression settings of the recording, see FileImage::ConfigureCompression. Mirrored recordings apply the
+     * codec and the encoding of the metadata to each destination, see MirroredFileImage.
+     */
+    CompressionOptions compression;
+};
+
 /**
  * @brief Container for images queried from each camera.
  *
  * This class handles the polling of images from the camera and emits a `Qt` signal when a new image is available.
- * If an error occurs when acquiring an image from the camera, e.g. connection error, the file associated with the
- * acquisition is closed, metadata is appended, and throws an exception.
+ * If an error occurs when acquiring an image from the camera, e.g. connection error, the recovery handler is called to
+ * reopen the camera, see ImageContainer::SetRecoveryHandler. When there is no handler or the camera can not be
+ * recovered, the file associated with the acquisition is closed, metadata is appended, and throws an exception.
  *
  * The file associated with the images can be initialized with ImageContainer::InitializeFile, and it can be closed
  * using ImageContainer::CloseFile. Closing the file automatically appends the corresponding metadata to the file.
@@ -31,7 +56,7 @@ class ImageContainer : public QObject
     /**
      * Pointer to image file object in charge of writing data to file.
      */
-    std::unique_ptr<FileImage> m_imageFile;
+    std::unique_ptr<RecordingFile> m_imageFile;
 
     /**
      * Wrapper to xiAPI, useful for mocking the aPI during testing
@@ -56,14 +81,18 @@ class ImageContainer : public QObject
      * It initializes the file object that will be used to store the data.
      *
      * @param filePath file path (without extension) where data will be stored
+     * @param schema per-frame metadata fields recorded with each image
+     * @param options layout and compression of the recording
+     * @throws std::invalid_argument if both stripes and a mirror are given.
      */
-    void InitializeFile(const char *filePath);
+    void InitializeFile(const char *filePath, const MetadataSchema &schema, const RecordingOptions &options = {});
 
     /**
      * Manages proper closing of file in case in case it has been initialized.
      *
+     * @return path of the closed file, empty if no file was open.
      */
-    void CloseFile();
+    std::string CloseFile();
 
     /**
      * Destructor of image container
@@ -79,7 +108,8 @@ class ImageContainer : public QObject
      * signal to notify that a new image is available.
      *
      * A lock guard is used to avoid overwriting the current container image when
-     * other processes are using it.
+     * other processes are using it. The signal is emitted after the lock is released, such that slots connected
+     * directly to it can query the current image from the polling thread.
      *
      * @param cameraHandle The handle to the camera device.
      * @param pollingRate The polling rate in milliseconds.
@@ -103,11 +133,27 @@ class ImageContainer : public QObject
      */
     void StartPolling();
 
+    /**
+     * Sets the handler called on the polling thread when an image can not be acquired, e.g. CameraRecovery::Recover.
+     * Polling continues into the same file when the handler returns true.
+     *
+     * @param handler reopens the camera and restarts the acquisition, returns false if that is not possible
+     */
+    void SetRecoveryHandler(std::function<bool()> handler);
+
     /**
      * Indicates if images should be polled or not
      */
     bool m_PollImage;
 
+    /**
+     * Queries how many new images have arrived to the container since it was created. This is safe to call from any
+     * thread and does not involve the Qt event loop.
+     *
+     * @return number of images received from the camera.
+     */
+    unsigned long GetReceivedImageCount() const;
+
   signals:
 
     /**
@@ -125,6 +171,16 @@ class ImageContainer : public QObject
      * mutex declaration used to lock guard the current image in the container
      */
     boost::mutex m_mutexImageAccess;
+
+    /**
+     * Number of new images that arrived to the container.
+     */
+    std::atomic<unsigned long> m_receivedImageCount{0};
+
+    /**
+     * Reopens the camera when an image can not be acquired, ignored when empty.
+     */
+    std::function<bool()> m_recoveryHandler;
 };
 
 #endif // IMAGE_CONTAINER_H
@@ -0,0 +1,131 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "locoCodec.h"
+
+#include <algorithm>
+#include <boost/chrono.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include "util.h"
+#include "xilensReader.h"
+
+void WriteLocoCodecParams(b2nd_array_t *array, const LocoCodecParams &params)
+{
+    std::map<std::string, uint32_t> geometry{{"width", params.width},
+                                             {"mosaic_width", params.mosaicWidth},
+                                             {"mosaic_height", params.mosaicHeight}};
+    msgpack::sbuffer sbuf;
+    msgpack::pack(sbuf, geometry);
+    WriteBLOSCVLMetadata(array, LOCO_PARAMS_KEY, sbuf);
+}
+
+bool ReadLocoCodecParams(b2nd_array_t *array, LocoCodecParams &params)
+{
+    if (blosc2_vlmeta_exists(array->sc, LOCO_PARAMS_KEY) < 0)
+    {
+        return false;
+    }
+    auto geometry = GetBLOSCVLMetadata(array, LOCO_PARAMS_KEY).get().as<std::map<std::string, uint32_t>>();
+    uint32_t width = geometry["width"];
+    uint32_t mosaicWidth = geometry["mosaic_width"];
+    uint32_t mosaicHeight = geometry["mosaic_height"];
+    if (width == 0 || mosaicWidth == 0 || mosaicHeight == 0 || mosaicWidth > UINT8_MAX || mosaicHeight > UINT8_MAX)
+    {
+        throw std::runtime_error("Invalid geometry of the LOCO codec in the metadata.");
+    }
+    params.width = width;
+    params.mosaicWidth = static_cast<uint8_t>(mosaicWidth);
+    params.mosaicHeight = static_cast<uint8_t>(mosaicHeight);
+    return true;
+}
+
+/**
+ * Measurements of a compression profile on a set of frames
+ */
+struct CodecBenchmarkResult
+{
+    const char *name;
+    blosc2_cparams cparams;
+    double rawBytes = 0;
+    double compressedBytes = 0;
+    double compressSeconds = 0;
+    double decompressSeconds = 0;
+};
+
+void WriteCodecBenchmark(const std::string &filePath, int64_t maxFrames, unsigned int mosaicWidth,
+                         unsigned int mosaicHeight, std::ostream &stream)
+{
+    RecordingReader session(filePath);
+    int64_t nFrames = session.GetNumberOfFrames();
+    if (maxFrames > 0)
+    {
+        nFrames = std::min(nFrames, maxFrames);
+    }
+    const auto frameBytes = static_cast<int32_t>(session.GetHeight() * session.GetWidth() * sizeof(uint16_t));
+    LocoCodecParams params{static_cast<uint32_t>(session.GetWidth()), static_cast<uint8_t>(mosaicWidth),
+                           static_cast<uint8_t>(mosaicHeight)};
+    std::vector<CodecBenchmarkResult> results = {{"zstd", CreateRecordingCParams()},
+                                                 {LOCO_CODEC_NAME, CreateLocoCParams(&params)}};
+
+    std::vector<uint16_t> frame;
+    std::vector<uint16_t> decompressed(static_cast<size_t>(frameBytes) / sizeof(uint16_t));
+    std::vector<uint8_t> chunk(static_cast<size_t>(frameBytes) + BLOSC2_MAX_OVERHEAD);
+    for (auto &result : results)
+    {
+        // a single block per frame, as recordings are stored
+        result.cparams.blocksize = frameBytes;
+        blosc2_context *cctx = blosc2_create_cctx(result.cparams);
+        blosc2_dparams dparams = BLOSC2_DPARAMS_DEFAULTS;
+        dparams.nthreads = result.cparams.nthreads;
+        blosc2_context *dctx = blosc2_create_dctx(dparams);
+        for (int64_t i = 0; i < nFrames; i++)
+        {
+            session.ReadFrame(i, frame);
+            auto start = boost::chrono::steady_clock::now();
+            int compressedBytes = blosc2_compress_ctx(cctx, frame.data(), frameBytes, chunk.data(),
+                                                      static_cast<int32_t>(chunk.size()));
+            auto middle = boost::chrono::steady_clock::now();
+            int decompressedBytes = blosc2_decompress_ctx(dctx, chunk.data(), compressedBytes, decompressed.data(),
+                                                          frameBytes);
+            auto end = boost::chrono::steady_clock::now();
+            if (compressedBytes <= 0 || decompressedBytes != frameBytes || decompressed != frame)
+            {
+                blosc2_free_ctx(cctx);
+                blosc2_free_ctx(dctx);
+                throw std::runtime_error(std::string("Frame ") + std::to_string(i) + " does not round-trip with " +
+                                         result.name);
+            }
+            result.rawBytes += frameBytes;
+            result.compressedBytes += compressedBytes;
+            result.compressSeconds += boost::chrono::duration<double>(middle - start).count();
+            result.decompressSeconds += boost::chrono::duration<double>(end - middle).count();
+        }
+        blosc2_free_ctx(cctx);
+        blosc2_free_ctx(dctx);
+    }
+
+    std::ios::fmtflags flags = stream.flags();
+    std::streamsize precision = stream.precision();
+    stream << "frames: " << nFrames << ", mosaic: " << mosaicWidth << "x" << mosaicHeight << "\n";
+    stream << std::left << std::setw(14) << "codec" << std::right << std::setw(8) << "ratio" << std::setw(18)
+           << "compress MB/s" << std::setw(18) << "decompress MB/s"
+           << "\n";
+    stream << std::fixed << std::setprecision(2);
+    for (const auto &result : results)
+    {
+        double megabytes = result.rawBytes / 1e6;
+        stream << std::left << std::setw(14) << result.name << std::right << std::setw(8)
+               << (result.compressedBytes > 0 ? result.rawBytes / result.compressedBytes : 0) << std::setw(18)
+               << (result.compressSeconds > 0 ? megabytes / result.compressSeconds : 0) << std::setw(18)
+               << (result.decompressSeconds > 0 ? megabytes / result.decompressSeconds : 0) << "\n";
+    }
+    stream.flags(flags);
+    stream.precision(precision);
+}
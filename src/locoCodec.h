@@ -0,0 +1,523 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_LOCO_CODEC_H
+#define XILENS_LOCO_CODEC_H
+
+#include <b2nd.h>
+#include <blosc2.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Identifier of the LOCO codec in blosc2, chosen from the range reserved for user registered codecs.
+ */
+constexpr uint8_t LOCO_CODEC_ID = 200;
+
+/**
+ * @brief Name of the LOCO codec in blosc2.
+ */
+constexpr const char *LOCO_CODEC_NAME = "xilens_loco";
+
+/**
+ * @brief Geometry of the images compressed with the LOCO codec.
+ *
+ * The parameters are only needed to compress, they are stored in the header of each compressed block such that blocks
+ * can be decompressed without them. Files also store them under LOCO_PARAMS_KEY such that images can be appended with
+ * the same geometry, see WriteLocoCodecParams. The structure needs to outlive the compression contexts that point to
+ * it.
+ */
+struct LocoCodecParams
+{
+    /**
+     * Width of the images in pixels, i.e. the length of a row in the compressed blocks.
+     */
+    uint32_t width;
+
+    /**
+     * Shape of the mosaic of the sensor, pixels are predicted from neighbours of the same band.
+     */
+    uint8_t mosaicWidth;
+    uint8_t mosaicHeight;
+};
+
+/**
+ * Registers the LOCO codec in blosc2. It needs to be called after `blosc2_init` and before compressing or
+ * decompressing data with the codec. Registering it more than once has no effect. The codec is defined in this header,
+ * such that the header-only reader can register it without linking xilens, see RecordingReader.
+ *
+ * @throws std::runtime_error if the codec can not be registered.
+ */
+inline void RegisterLocoCodec();
+
+/**
+ * Creates compression parameters that store 16 bit images with the LOCO codec.
+ *
+ * The codec follows LOCO-I, the algorithm behind JPEG-LS: each pixel is predicted with the median edge detector from
+ * its left, upper and upper-left neighbours of the same mosaic band, and the residuals are stored with adaptive
+ * Golomb-Rice codes whose parameters are learned per context of local gradient activity. Shuffle filters are disabled,
+ * the codec needs the pixels in their original order.
+ *
+ * @param params geometry of the images, it needs to outlive the compression contexts created with the parameters.
+ * @return compression parameters, blocks need to contain whole rows of the images. The number of threads is left at the
+ * default of blosc2, callers set it for their contexts.
+ */
+inline blosc2_cparams CreateLocoCParams(const LocoCodecParams *params);
+
+/**
+ * Compresses a block of 16 bit pixels, see CreateLocoCParams. Follows the signature of blosc2 codec encoders.
+ *
+ * @return size of the compressed block, 0 if it does not fit into the output, negative on error.
+ */
+inline int LocoEncode(const uint8_t *input, int32_t inputLength, uint8_t *output, int32_t outputLength,
+                      uint8_t /*meta*/, blosc2_cparams *cparams, const void * /*chunk*/);
+
+/**
+ * Decompresses a block compressed with LocoEncode. Follows the signature of blosc2 codec decoders.
+ *
+ * @return size of the decompressed block, negative on error.
+ */
+inline int LocoDecode(const uint8_t *input, int32_t inputLength, uint8_t *output, int32_t outputLength,
+                      uint8_t /*meta*/, blosc2_dparams * /*dparams*/, const void * /*chunk*/);
+
+/**
+ * Stores the geometry of the images under LOCO_PARAMS_KEY in the metadata of an array compressed with the LOCO codec.
+ *
+ * @throws std::runtime_error if the metadata can not be written.
+ */
+void WriteLocoCodecParams(b2nd_array_t *array, const LocoCodecParams &params);
+
+/**
+ * Reads the geometry stored with WriteLocoCodecParams.
+ *
+ * @return false if the array does not store the geometry, e.g. because it was written by an older version.
+ * @throws std::runtime_error if the stored geometry is invalid.
+ */
+bool ReadLocoCodecParams(b2nd_array_t *array, LocoCodecParams &params);
+
+/**
+ * Compares the compression ratio and speed of the default ZSTD profile with the LOCO codec on the frames of a
+ * recording and writes a table with the results.
+ *
+ * @param filePath path to a `.b2nd` file or to a recording manifest.
+ * @param maxFrames maximum number of frames to use, 0 uses all frames.
+ * @param mosaicWidth width of the mosaic of the sensor used for the recording.
+ * @param mosaicHeight height of the mosaic of the sensor used for the recording.
+ * @param stream destination of the table.
+ * @throws std::runtime_error if the recording can not be read or the data does not round-trip.
+ */
+void WriteCodecBenchmark(const std::string &filePath, int64_t maxFrames, unsigned int mosaicWidth,
+                         unsigned int mosaicHeight, std::ostream &stream);
+
+constexpr uint8_t LOCO_FORMAT_VERSION = 1;
+
+/**
+ * Version, mosaic width, mosaic height, padding, image width and number of pixels
+ */
+constexpr int32_t LOCO_HEADER_SIZE = 12;
+
+/**
+ * Number of contexts of local gradient activity, one per bit length of the activity
+ */
+constexpr int LOCO_CONTEXTS = 16;
+
+/**
+ * Length of the unary prefix after which a residual is stored verbatim instead of as a Golomb-Rice code
+ */
+constexpr uint32_t LOCO_ESCAPE_LENGTH = 24;
+
+/**
+ * Number of bits needed to store a mapped residual of a 16 bit pixel verbatim
+ */
+constexpr int LOCO_RESIDUAL_BITS = 17;
+
+/**
+ * Number of residuals after which the statistics of a context are halved, such that the codes adapt to the image
+ */
+constexpr uint32_t LOCO_RESET = 64;
+
+constexpr int LOCO_MAX_RICE_PARAMETER = 16;
+
+/**
+ * Writes codes most significant bit first
+ */
+struct LocoBitWriter
+{
+    uint8_t *output;
+    size_t capacity;
+    size_t position = 0;
+    uint64_t accumulator = 0;
+    int nBits = 0;
+    bool overflow = false;
+
+    void Write(uint32_t value, int length)
+    {
+        accumulator = (accumulator << length) | value;
+        nBits += length;
+        while (nBits >= 8)
+        {
+            nBits -= 8;
+            if (position < capacity)
+            {
+                output[position++] = static_cast<uint8_t>(accumulator >> nBits);
+            }
+            else
+            {
+                overflow = true;
+            }
+        }
+    }
+
+    void Flush()
+    {
+        if (nBits > 0)
+        {
+            Write(0, 8 - nBits);
+        }
+    }
+};
+
+/**
+ * Reads codes written by LocoBitWriter, reading past the end of the input yields zeros and sets the overflow flag
+ */
+struct LocoBitReader
+{
+    const uint8_t *input;
+    size_t size;
+    size_t position = 0;
+    uint64_t accumulator = 0;
+    int nBits = 0;
+    bool overflow = false;
+
+    uint32_t Read(int length)
+    {
+        while (nBits < length)
+        {
+            uint8_t byte = 0;
+            if (position < size)
+            {
+                byte = input[position++];
+            }
+            else
+            {
+                overflow = true;
+            }
+            accumulator = (accumulator << 8) | byte;
+            nBits += 8;
+        }
+        nBits -= length;
+        return static_cast<uint32_t>((accumulator >> nBits) & ((uint64_t(1) << length) - 1));
+    }
+
+    uint32_t ReadUnary(uint32_t maxLength)
+    {
+        uint32_t length = 0;
+        while (length < maxLength && Read(1) == 0)
+        {
+            length++;
+        }
+        if (length == maxLength)
+        {
+            // the terminating bit of the longest prefix
+            Read(1);
+        }
+        return length;
+    }
+};
+
+/**
+ * Statistics of the residuals of each context, used to choose the Golomb-Rice parameter
+ */
+struct LocoContexts
+{
+    uint32_t sum[LOCO_CONTEXTS];
+    uint32_t count[LOCO_CONTEXTS];
+
+    LocoContexts()
+    {
+        std::fill(sum, sum + LOCO_CONTEXTS, 4);
+        std::fill(count, count + LOCO_CONTEXTS, 1);
+    }
+
+    int GetRiceParameter(int context) const
+    {
+        int k = 0;
+        while ((count[context] << k) < sum[context] && k < LOCO_MAX_RICE_PARAMETER)
+        {
+            k++;
+        }
+        return k;
+    }
+
+    void Update(int context, uint32_t mappedResidual)
+    {
+        sum[context] += mappedResidual;
+        if (++count[context] == LOCO_RESET)
+        {
+            sum[context] >>= 1;
+            count[context] >>= 1;
+        }
+    }
+};
+
+/**
+ * Median edge detector of LOCO-I, a is the left, b the upper and c the upper-left neighbour
+ */
+inline int32_t PredictLocoMedianEdge(int32_t a, int32_t b, int32_t c)
+{
+    int32_t maximum = std::max(a, b);
+    int32_t minimum = std::min(a, b);
+    return c >= maximum ? minimum : (c <= minimum ? maximum : a + b - c);
+}
+
+inline int GetLocoActivityContext(uint32_t activity)
+{
+    int context = 0;
+    while (activity > 0 && context < LOCO_CONTEXTS - 1)
+    {
+        activity >>= 1;
+        context++;
+    }
+    return context;
+}
+
+/**
+ * Predicts a pixel from the already decoded pixels, the encoder computes the same prediction row-wise in
+ * PredictLocoRow
+ */
+inline int32_t PredictLocoPixel(const uint16_t *row, const uint16_t *up, size_t col, size_t mosaicWidth,
+                                uint32_t &activity)
+{
+    activity = 0;
+    if (col < mosaicWidth)
+    {
+        return up != nullptr ? up[col] : 0;
+    }
+    if (up == nullptr)
+    {
+        return row[col - mosaicWidth];
+    }
+    int32_t a = row[col - mosaicWidth];
+    int32_t b = up[col];
+    int32_t c = up[col - mosaicWidth];
+    activity = static_cast<uint32_t>(std::abs(a - c) + std::abs(b - c));
+    return PredictLocoMedianEdge(a, b, c);
+}
+
+/**
+ * Predicts all pixels of a row, the loop over the interior of the row has no dependencies between iterations and
+ * is vectorized by the compiler
+ */
+inline void PredictLocoRow(const uint16_t *row, const uint16_t *up, size_t length, size_t mosaicWidth,
+                           int32_t *prediction, uint32_t *activity)
+{
+    size_t edge = std::min(mosaicWidth, length);
+    for (size_t col = 0; col < edge; col++)
+    {
+        prediction[col] = up != nullptr ? up[col] : 0;
+        activity[col] = 0;
+    }
+    if (up == nullptr)
+    {
+        for (size_t col = edge; col < length; col++)
+        {
+            prediction[col] = row[col - mosaicWidth];
+            activity[col] = 0;
+        }
+        return;
+    }
+    for (size_t col = edge; col < length; col++)
+    {
+        int32_t a = row[col - mosaicWidth];
+        int32_t b = up[col];
+        int32_t c = up[col - mosaicWidth];
+        int32_t maximum = std::max(a, b);
+        int32_t minimum = std::min(a, b);
+        prediction[col] = c >= maximum ? minimum : (c <= minimum ? maximum : a + b - c);
+        activity[col] = static_cast<uint32_t>(std::abs(a - c) + std::abs(b - c));
+    }
+}
+
+inline void WriteLocoUInt32(uint8_t *output, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        output[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+inline uint32_t ReadLocoUInt32(const uint8_t *input)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        value |= static_cast<uint32_t>(input[i]) << (8 * i);
+    }
+    return value;
+}
+
+inline int LocoEncode(const uint8_t *input, int32_t inputLength, uint8_t *output, int32_t outputLength,
+                      uint8_t /*meta*/, blosc2_cparams *cparams, const void * /*chunk*/)
+{
+    if (inputLength <= 0 || inputLength % 2 != 0 || outputLength <= LOCO_HEADER_SIZE)
+    {
+        return 0;
+    }
+    const size_t nPixels = static_cast<size_t>(inputLength) / 2;
+    LocoCodecParams params{static_cast<uint32_t>(nPixels), 1, 1};
+    if (cparams != nullptr && cparams->codec_params != nullptr)
+    {
+        params = *static_cast<const LocoCodecParams *>(cparams->codec_params);
+    }
+    if (params.width == 0 || params.mosaicWidth == 0 || params.mosaicHeight == 0)
+    {
+        return BLOSC2_ERROR_CODEC_PARAM;
+    }
+
+    // the input of blosc2 codecs is not aligned, scratch buffers are reused by each compression thread
+    thread_local std::vector<uint16_t> pixels;
+    thread_local std::vector<int32_t> prediction;
+    thread_local std::vector<uint32_t> activity;
+    pixels.resize(nPixels);
+    std::memcpy(pixels.data(), input, static_cast<size_t>(inputLength));
+    prediction.resize(params.width);
+    activity.resize(params.width);
+
+    output[0] = LOCO_FORMAT_VERSION;
+    output[1] = params.mosaicWidth;
+    output[2] = params.mosaicHeight;
+    output[3] = 0;
+    WriteLocoUInt32(output + 4, params.width);
+    WriteLocoUInt32(output + 8, static_cast<uint32_t>(nPixels));
+
+    LocoBitWriter writer{output + LOCO_HEADER_SIZE, static_cast<size_t>(outputLength - LOCO_HEADER_SIZE)};
+    LocoContexts contexts;
+    for (size_t start = 0, row = 0; start < nPixels; start += params.width, row++)
+    {
+        const size_t length = std::min<size_t>(params.width, nPixels - start);
+        const uint16_t *current = pixels.data() + start;
+        const uint16_t *up = row >= params.mosaicHeight ? current - params.mosaicHeight * params.width : nullptr;
+        PredictLocoRow(current, up, length, params.mosaicWidth, prediction.data(), activity.data());
+        for (size_t col = 0; col < length; col++)
+        {
+            int32_t residual = static_cast<int32_t>(current[col]) - prediction[col];
+            auto mapped = static_cast<uint32_t>(residual >= 0 ? 2 * residual : -2 * residual - 1);
+            int context = GetLocoActivityContext(activity[col]);
+            int k = contexts.GetRiceParameter(context);
+            uint32_t quotient = mapped >> k;
+            if (quotient < LOCO_ESCAPE_LENGTH)
+            {
+                writer.Write(1, static_cast<int>(quotient) + 1);
+                writer.Write(mapped & ((1u << k) - 1), k);
+            }
+            else
+            {
+                writer.Write(1, LOCO_ESCAPE_LENGTH + 1);
+                writer.Write(mapped, LOCO_RESIDUAL_BITS);
+            }
+            contexts.Update(context, mapped);
+        }
+        if (writer.overflow)
+        {
+            return 0;
+        }
+    }
+    writer.Flush();
+    if (writer.overflow)
+    {
+        return 0;
+    }
+    return LOCO_HEADER_SIZE + static_cast<int>(writer.position);
+}
+
+inline int LocoDecode(const uint8_t *input, int32_t inputLength, uint8_t *output, int32_t outputLength,
+                      uint8_t /*meta*/, blosc2_dparams * /*dparams*/, const void * /*chunk*/)
+{
+    if (inputLength < LOCO_HEADER_SIZE || input[0] != LOCO_FORMAT_VERSION)
+    {
+        return BLOSC2_ERROR_DATA;
+    }
+    const uint8_t mosaicWidth = input[1];
+    const uint8_t mosaicHeight = input[2];
+    const uint32_t width = ReadLocoUInt32(input + 4);
+    const size_t nPixels = ReadLocoUInt32(input + 8);
+    if (width == 0 || mosaicWidth == 0 || mosaicHeight == 0 || nPixels * 2 != static_cast<size_t>(outputLength))
+    {
+        return BLOSC2_ERROR_DATA;
+    }
+
+    thread_local std::vector<uint16_t> pixels;
+    pixels.resize(nPixels);
+    LocoBitReader reader{input + LOCO_HEADER_SIZE, static_cast<size_t>(inputLength - LOCO_HEADER_SIZE)};
+    LocoContexts contexts;
+    for (size_t start = 0, row = 0; start < nPixels; start += width, row++)
+    {
+        const size_t length = std::min<size_t>(width, nPixels - start);
+        uint16_t *current = pixels.data() + start;
+        const uint16_t *up = row >= mosaicHeight ? current - static_cast<size_t>(mosaicHeight) * width : nullptr;
+        for (size_t col = 0; col < length; col++)
+        {
+            uint32_t activity;
+            int32_t prediction = PredictLocoPixel(current, up, col, mosaicWidth, activity);
+            int context = GetLocoActivityContext(activity);
+            int k = contexts.GetRiceParameter(context);
+            uint32_t quotient = reader.ReadUnary(LOCO_ESCAPE_LENGTH);
+            uint32_t mapped = quotient == LOCO_ESCAPE_LENGTH ? reader.Read(LOCO_RESIDUAL_BITS)
+                                                             : (quotient << k) | reader.Read(k);
+            int32_t residual =
+                (mapped & 1) ? -static_cast<int32_t>((mapped + 1) >> 1) : static_cast<int32_t>(mapped >> 1);
+            current[col] = static_cast<uint16_t>(prediction + residual);
+            contexts.Update(context, mapped);
+        }
+        if (reader.overflow)
+        {
+            return BLOSC2_ERROR_DATA;
+        }
+    }
+    std::memcpy(output, pixels.data(), nPixels * 2);
+    return outputLength;
+}
+
+inline void RegisterLocoCodec()
+{
+    blosc2_codec codec;
+    codec.compcode = LOCO_CODEC_ID;
+    codec.compname = const_cast<char *>(LOCO_CODEC_NAME);
+    codec.complib = LOCO_CODEC_ID;
+    codec.version = LOCO_FORMAT_VERSION;
+    codec.encoder = LocoEncode;
+    codec.decoder = LocoDecode;
+    // registering the codec again fails, which is fine as long as the registered codec is this one
+    if (blosc2_register_codec(&codec) < 0)
+    {
+        const char *name = nullptr;
+        if (blosc2_compcode_to_compname(LOCO_CODEC_ID, &name) < 0 || name == nullptr ||
+            std::strcmp(name, LOCO_CODEC_NAME) != 0)
+        {
+            throw std::runtime_error("Could not register the LOCO codec.");
+        }
+    }
+}
+
+inline blosc2_cparams CreateLocoCParams(const LocoCodecParams *params)
+{
+    blosc2_cparams cparams = BLOSC2_CPARAMS_DEFAULTS;
+    cparams.typesize = sizeof(uint16_t);
+    cparams.compcode = LOCO_CODEC_ID;
+    // the codec has no levels, but level 0 disables compression in blosc2
+    cparams.clevel = 5;
+    std::fill(cparams.filters, cparams.filters + BLOSC2_MAX_FILTERS, BLOSC_NOFILTER);
+    cparams.splitmode = BLOSC_NEVER_SPLIT;
+    cparams.codec_params = const_cast<LocoCodecParams *>(params);
+    return cparams;
+}
+
+#endif // XILENS_LOCO_CODEC_H
@@ -6,14 +6,17 @@
 #include <QDateTime>
 #include <QDir>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QGraphicsItem>
 #include <QGraphicsScene>
 #include <QMessageBox>
 #include <QTextStream>
+#include <algorithm>
 #include <b2nd.h>
 #include <boost/chrono.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread.hpp>
+#include <cmath>
 #include <iostream>
 #include <opencv2/core/types_c.h>
 #include <string>
@@ -28,22 +31,58 @@
 #include "util.h"
 #include "xiAPIWrapper.h"
 
+/**
+ * Thresholds of the thermal governor given through the command line.
+ */
+static ThermalGovernorOptions GetThermalGovernorOptions()
+{
+    ThermalGovernorOptions options;
+    options.limitC = g_commandLineArguments.thermal_limit;
+    options.hysteresisC = g_commandLineArguments.thermal_hysteresis;
+    return options;
+}
+
 MainWindow::MainWindow(QWidget *parent, const std::shared_ptr<XiAPIWrapper> &xiAPIWrapper)
     : QMainWindow(parent), ui(new Ui::MainWindow), m_IOService(), m_temperatureIOService(),
       m_temperatureIOWork(new boost::asio::io_service::work(m_temperatureIOService)), m_cameraInterface(),
-      m_recordedCount(0), m_testMode(g_commandLineArguments.test_mode), m_imageCounter(0), m_skippedCounter(0),
-      m_elapsedTimeTextStream(&m_elapsedTimeText), m_elapsedTime(0), m_viewerThreadRunning(true),
-      m_viewerThread(&MainWindow::ViewerWorkerThreadFunc, this)
+      m_thermalGovernor(GetThermalGovernorOptions()), m_recordedCount(0), m_testMode(g_commandLineArguments.test_mode),
+      m_imageCounter(0), m_skippedCounter(0), m_elapsedTimeTextStream(&m_elapsedTimeText), m_elapsedTime(0),
+      m_viewerThreadRunning(true), m_viewerThread(&MainWindow::ViewerWorkerThreadFunc, this)
 {
     this->m_xiAPIWrapper = xiAPIWrapper == nullptr ? this->m_xiAPIWrapper : xiAPIWrapper;
     m_cameraInterface.Initialize(this->m_xiAPIWrapper);
     m_imageContainer.Initialize(this->m_xiAPIWrapper);
+    m_imageContainer.SetRecoveryHandler([this] { return m_cameraRecovery.Recover(); });
+    m_compressionOptions.adaptive = g_commandLineArguments.adaptive_compression;
+    m_compressionOptions.locoCodec = g_commandLineArguments.codec == "loco";
+    m_compressionOptions.columnarMetadata = g_commandLineArguments.columnar_metadata;
+    m_daemonSocket = g_commandLineArguments.daemon_socket;
+    if (!g_commandLineArguments.rois.empty())
+    {
+        std::vector<cv::Rect> rois;
+        for (const auto &roi : g_commandLineArguments.rois)
+        {
+            rois.push_back(ParseRoi(roi));
+        }
+        RoiTrackingOptions roiTrackingOptions;
+        roiTrackingOptions.budgetMilliseconds = g_commandLineArguments.roi_budget;
+        m_roiTracking = std::make_unique<RoiTrackingWorker>(rois, roiTrackingOptions);
+    }
+    if (!g_commandLineArguments.white_balance.empty())
+    {
+        WhiteBalanceOptions whiteBalanceOptions;
+        whiteBalanceOptions.method = ParseWhiteBalanceMethod(g_commandLineArguments.white_balance);
+        m_whiteBalance = std::make_unique<WhiteBalanceEstimator>(whiteBalanceOptions);
+    }
+    this->RegisterMetadataProviders("");
     m_updateFPSDisplayTimer = new QTimer(this);
+    m_updateTelemetryTimer = new QTimer(this);
     ui->setupUi(this);
     this->SetUpCustomUiComponents();
 
     // Initialize BLOSC2
     blosc2_init();
+    RegisterLocoCodec();
 
     // Display needs to be instantiated before changing the camera list because
     // calling setCurrentIndex on the list.
@@ -54,6 +93,22 @@ MainWindow::MainWindow(QWidget *parent, const std::shared_ptr<XiAPIWrapper> &xiA
     this->HandleReloadCamerasPushButtonClicked();
     ui->cameraListComboBox->setCurrentIndex(0);
 
+    // record to a fast staging folder and migrate recordings to the base folder in the background
+    if (!g_commandLineArguments.staging_folder.empty())
+    {
+        auto bandwidth = static_cast<uint64_t>(g_commandLineArguments.archive_bandwidth * 1e6);
+        m_archiveMigrator = std::make_unique<ArchiveMigrator>(g_commandLineArguments.staging_folder, bandwidth,
+                                                              g_commandLineArguments.archive_clevel);
+        if (g_commandLineArguments.archive_noise_tolerance > 0)
+        {
+            SensorNoiseModel noiseModel;
+            noiseModel.readNoise = g_commandLineArguments.read_noise;
+            noiseModel.gain = g_commandLineArguments.sensor_gain;
+            m_archiveMigrator->EnableNearLossless(noiseModel, g_commandLineArguments.archive_noise_tolerance);
+        }
+        m_archiveMigrator->Start();
+    }
+
     // set the base folder path
     m_baseFolderPath = QDir::cleanPath(QDir::homePath());
     ui->baseFolderLineEdit->insert(this->GetBaseFolder());
@@ -66,7 +121,14 @@ MainWindow::MainWindow(QWidget *parent, const std::shared_ptr<XiAPIWrapper> &xiA
 
     LOG_XILENS(info) << "test mode (recording everything to same file) is set to: " << m_testMode << "\n";
     this->SetUpConnections();
+    this->PublishUiSettings();
     EnableUi(false);
+    if (this->IsAttachedToDaemon())
+    {
+        m_daemonIOWork = std::make_unique<boost::asio::io_service::work>(m_daemonIOService);
+        m_daemonThread = boost::thread([this] { m_daemonIOService.run(); });
+        this->RestoreDaemonState();
+    }
 }
 
 void MainWindow::SetUpConnections()
@@ -119,6 +181,70 @@ void MainWindow::SetUpConnections()
         QObject::connect(m_display, &Displayer::ImageReadyToUpdateRaw, this, &MainWindow::UpdateRawImage));
     HANDLE_CONNECTION_RESULT(QObject::connect(m_display, &Displayer::SaturationPercentageReady, this,
                                               &MainWindow::UpdateSaturationPercentageLCDDisplays));
+    HANDLE_CONNECTION_RESULT(
+        QObject::connect(m_display, &Displayer::NoiseEstimateReady, this, &MainWindow::UpdateNoiseDisplay));
+    // keep the snapshot of UI values read by worker threads up to date
+    HANDLE_CONNECTION_RESULT(
+        QObject::connect(ui->bandSlider, &QSlider::valueChanged, this, &MainWindow::PublishUiSettings));
+    HANDLE_CONNECTION_RESULT(
+        QObject::connect(ui->rgbNormSlider, &QSlider::valueChanged, this, &MainWindow::PublishUiSettings));
+    HANDLE_CONNECTION_RESULT(
+        QObject::connect(ui->normalizeCheckbox, &QCheckBox::toggled, this, &MainWindow::PublishUiSettings));
+    HANDLE_CONNECTION_RESULT(
+        QObject::connect(ui->stabilizeCheckbox, &QCheckBox::toggled, this, &MainWindow::PublishUiSettings));
+    HANDLE_CONNECTION_RESULT(
+        QObject::connect(ui->trueColorCheckbox, &QCheckBox::toggled, this, &MainWindow::PublishUiSettings));
+    HANDLE_CONNECTION_RESULT(
+        QObject::connect(ui->classifyCheckbox, &QCheckBox::toggled, this, &MainWindow::PublishUiSettings));
+    HANDLE_CONNECTION_RESULT(
+        QObject::connect(ui->lockWhiteBalanceCheckbox, &QCheckBox::toggled, this, &MainWindow::PublishUiSettings));
+    HANDLE_CONNECTION_RESULT(
+        QObject::connect(ui->saturationToolButton, &QToolButton::toggled, this, &MainWindow::PublishUiSettings));
+    HANDLE_CONNECTION_RESULT(
+        QObject::connect(ui->nSnapshotsSpinBox, &QSpinBox::valueChanged, this, &MainWindow::PublishUiSettings));
+}
+
+void MainWindow::PublishUiSettings()
+{
+    UiSettings settings;
+    settings.band = ui->bandSlider->value();
+    settings.normalize = ui->normalizeCheckbox->isChecked();
+    settings.bgrNorm = ui->rgbNormSlider->value();
+    settings.saturationOverlay = ui->saturationToolButton->isChecked();
+    settings.stabilize = ui->stabilizeCheckbox->isChecked();
+    settings.trueColor = ui->trueColorCheckbox->isChecked();
+    settings.classify = ui->classifyCheckbox->isChecked();
+    settings.lockWhiteBalance = ui->lockWhiteBalanceCheckbox->isChecked();
+    settings.skipFrames = ui->skipFramesSpinBox->value();
+    settings.nSnapshots = ui->nSnapshotsSpinBox->value();
+    settings.snapshotsFileName = ui->fileNameSnapshotsLineEdit->text();
+    settings.baseFolder = ui->baseFolderLineEdit->text();
+    m_uiSettings.Publish(settings);
+}
+
+std::shared_ptr<const UiSettings> MainWindow::GetUiSettings() const
+{
+    return m_uiSettings.Get();
+}
+
+ClassMapRecorder &MainWindow::GetClassMapRecorder()
+{
+    return m_classMapRecorder;
+}
+
+RoiTrackingWorker *MainWindow::GetRoiTracking()
+{
+    return m_roiTracking.get();
+}
+
+std::shared_ptr<TemporalNoiseEstimator> MainWindow::GetNoiseEstimator() const
+{
+    return std::atomic_load(&m_noiseEstimator);
+}
+
+WhiteBalanceEstimator *MainWindow::GetWhiteBalance()
+{
+    return m_whiteBalance.get();
 }
 
 void MainWindow::HandleConnectionResult(bool status, const char *file, int line, const char *func)
@@ -135,13 +261,32 @@ void MainWindow::StartImageAcquisition(QString cameraIdentifier)
     try
     {
         this->m_display->StartDisplayer();
+        if (this->IsAttachedToDaemon())
+        {
+            // the daemon keeps acquiring when the camera it already acquires from is opened again
+            SendControlRequest(m_daemonSocket, "open " + cameraIdentifier.toStdString());
+            auto status = ParseControlStatus(SendControlRequest(m_daemonSocket, "status"));
+            m_daemonExposureMs = QString::fromStdString(status["exposure"]).toInt();
+            int bitDepth = QString::fromStdString(status["bit_depth"]).toInt();
+            // daemons that do not report the bit depth acquire from cameras of the default bit depth
+            this->m_display->SetBitDepth(bitDepth != 0 ? bitDepth : DEFAULT_BIT_DEPTH);
+            this->UpdateExposure();
+            this->StartPreviewThread();
+            return;
+        }
         m_cameraInterface.StartAcquisition(std::move(cameraIdentifier));
+        this->m_display->SetBitDepth(m_cameraInterface.m_camera->GetDataBitDepth());
+        m_cameraRecovery.Reset();
+        m_thermalGovernor.Reset();
         this->StartPollingThread();
         this->StartTemperatureThread();
 
-        // when a new image arrives, display it
-        HANDLE_CONNECTION_RESULT(
-            QObject::connect(&(this->m_imageContainer), &ImageContainer::NewImage, this, &MainWindow::Display));
+        // when a new image arrives, display it. The slot runs on the polling thread, it only hands the image over to
+        // the displayer thread, so no event is posted to the GUI thread for each image.
+        HANDLE_CONNECTION_RESULT(QObject::connect(&(this->m_imageContainer), &ImageContainer::NewImage, this,
+                                                  &MainWindow::Display, Qt::DirectConnection));
+        HANDLE_CONNECTION_RESULT(QObject::connect(&(this->m_imageContainer), &ImageContainer::NewImage, this,
+                                                  &MainWindow::NotifyCaptureScheduler, Qt::DirectConnection));
     }
     catch (std::runtime_error &error)
     {
@@ -153,12 +298,23 @@ void MainWindow::StartImageAcquisition(QString cameraIdentifier)
 void MainWindow::StopImageAcquisition()
 {
     this->m_display->StopDisplayer();
+    if (this->IsAttachedToDaemon())
+    {
+        // the daemon keeps acquiring and recording, only the previews are no longer displayed
+        this->StopPreviewThread();
+        LOG_XILENS(info) << "Detached from acquisition daemon previews";
+        return;
+    }
     this->StopPollingThread();
     this->StopTemperatureThread();
+    // no frames arrive anymore, the sequences waiting for them are cancelled
+    this->CancelCaptureSequences();
     m_cameraInterface.StopAcquisition();
     // disconnect slots for image display
     HANDLE_CONNECTION_RESULT(
         QObject::disconnect(&(this->m_imageContainer), &ImageContainer::NewImage, this, &MainWindow::Display));
+    HANDLE_CONNECTION_RESULT(QObject::disconnect(&(this->m_imageContainer), &ImageContainer::NewImage, this,
+                                                 &MainWindow::NotifyCaptureScheduler));
     LOG_XILENS(info) << "Stopped Image Acquisition";
 }
 
@@ -189,6 +345,10 @@ void MainWindow::EnableUi(bool enable)
     SetGraphicsViewScene();
     this->ui->exposureSlider->setEnabled(enable);
     this->ui->logTextLineEdit->setEnabled(enable);
+    if (enable && this->IsAttachedToDaemon())
+    {
+        this->DisableLocalAcquisitionWidgets();
+    }
 }
 
 void MainWindow::SetUpCustomUiComponents()
@@ -224,11 +384,18 @@ void MainWindow::Display()
     }
 }
 
+void MainWindow::NotifyCaptureScheduler()
+{
+    // the pixels are only copied when a sequence waits for the image
+    m_captureScheduler.NotifyFrame(m_imageContainer.GetCurrentImage());
+}
+
 MainWindow::~MainWindow()
 {
     m_IOService.stop();
     m_temperatureIOService.stop();
     m_threadGroup.join_all();
+    this->StopPreviewThread();
 
     {
         boost::lock_guard<boost::mutex> lock(m_mutexImageViewer);
@@ -241,23 +408,107 @@ MainWindow::~MainWindow()
     }
 
     this->StopTemperatureThread();
-    this->StopSnapshotsThread();
-    this->StopReferenceRecordingThread();
+    // the sequences still running are cancelled, they close their files and restore the exposure time
+    m_captureScheduler.Stop();
+
+    // the requests posted to the daemon are still sent, e.g. to stop its recording, each of them times out
+    m_daemonIOWork.reset();
+    if (m_daemonThread.joinable())
+    {
+        m_daemonThread.join();
+    }
 
     HANDLE_CONNECTION_RESULT(
         QObject::disconnect(&(this->m_imageContainer), &ImageContainer::NewImage, this, &MainWindow::Display));
+    HANDLE_CONNECTION_RESULT(QObject::disconnect(&(this->m_imageContainer), &ImageContainer::NewImage, this,
+                                                 &MainWindow::NotifyCaptureScheduler));
 
     blosc2_destroy();
     delete ui;
 }
 
+void MainWindow::RegisterMetadataProviders(const QString &cameraModel)
+{
+    auto metadataProviders = std::make_shared<MetadataProviderRegistry>();
+    metadataProviders->Register(std::make_shared<ImageMetadataProvider>());
+    metadataProviders->Register(std::make_shared<CameraTemperatureProvider>(&m_cameraInterface.m_cameraFamily));
+    metadataProviders->Register(std::make_shared<AcquisitionSegmentProvider>(&m_cameraRecovery));
+    metadataProviders->Register(std::make_shared<ThermalGovernorProvider>(&m_thermalGovernor));
+    if (m_roiTracking != nullptr)
+    {
+        metadataProviders->Register(std::make_shared<RoiTrackingProvider>(m_roiTracking.get()));
+    }
+    if (m_whiteBalance != nullptr && getCameraMapper().value(cameraModel).cameraType == CAMERA_TYPE_RGB)
+    {
+        // the light seen by the new camera is estimated from scratch, unless the gains are locked
+        if (!m_whiteBalance->IsLocked())
+        {
+            m_whiteBalance->Reset();
+        }
+        metadataProviders->Register(std::make_shared<WhiteBalanceProvider>(m_whiteBalance.get()));
+    }
+    // the camera reports its bit depth once opened, the default is assumed before
+    int sensorBitDepth = DEFAULT_BIT_DEPTH;
+    int dataBitDepth = DEFAULT_BIT_DEPTH;
+    if (m_cameraInterface.m_camera != nullptr)
+    {
+        sensorBitDepth = m_cameraInterface.m_camera->GetSensorBitDepth();
+        dataBitDepth = m_cameraInterface.m_camera->GetDataBitDepth();
+    }
+    metadataProviders->Register(std::make_shared<BitDepthProvider>(sensorBitDepth, dataBitDepth));
+    auto frameStatistics = FrameStatisticsProvider::FromCameraData(getCameraMapper().value(cameraModel), dataBitDepth);
+    metadataProviders->Register(frameStatistics);
+    m_compressionOptions.mosaicWidth = frameStatistics->GetMosaicWidth();
+    m_compressionOptions.mosaicHeight = frameStatistics->GetMosaicHeight();
+    if (g_commandLineArguments.noise_window > 0)
+    {
+        // the bands of the new camera are estimated from scratch
+        NoiseEstimatorOptions noiseOptions;
+        noiseOptions.windowSize = std::max(2, g_commandLineArguments.noise_window);
+        auto noiseEstimator = std::make_shared<TemporalNoiseEstimator>(
+            frameStatistics->GetMosaicWidth(), frameStatistics->GetMosaicHeight(), noiseOptions);
+        std::atomic_store(&m_noiseEstimator, noiseEstimator);
+        metadataProviders->Register(std::make_shared<NoiseEstimateProvider>(noiseEstimator));
+    }
+    std::atomic_store(&m_metadataProviders, std::shared_ptr<const MetadataProviderRegistry>(metadataProviders));
+}
+
+/**
+ * Logs why a capture sequence did not complete, if it did not.
+ */
+static void LogCaptureError(const std::exception_ptr &error, const std::string &sequence)
+{
+    if (error == nullptr)
+    {
+        return;
+    }
+    try
+    {
+        std::rethrow_exception(error);
+    }
+    catch (const CaptureCancelledError &)
+    {
+        LOG_XILENS(info) << "Cancelled recording of " << sequence;
+    }
+    catch (const std::exception &e)
+    {
+        LOG_XILENS(error) << "Could not record " << sequence << ": " << e.what();
+    }
+}
+
 void MainWindow::RecordSnapshots()
 {
-    int nr_images = ui->nSnapshotsSpinBox->value();
+    if (m_capturingSnapshots.exchange(true))
+    {
+        LOG_XILENS(warning) << "Snapshots are already being recorded";
+        return;
+    }
+    auto settings = this->GetUiSettings();
+    int nr_images = settings->nSnapshots;
     QMetaObject::invokeMethod(ui->nSnapshotsSpinBox, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, false));
     QMetaObject::invokeMethod(ui->fileNameSnapshotsLineEdit, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, false));
 
-    std::string fileName = ui->fileNameSnapshotsLineEdit->text().toUtf8().constData();
+    std::string fileName = settings->snapshotsFileName.toUtf8().constData();
 
     if (fileName.empty())
     {
@@ -265,28 +516,44 @@ void MainWindow::RecordSnapshots()
     }
     QString filePath = GetFullFilenameStandardFormat(std::move(fileName), ".b2nd", "");
     auto image = m_imageContainer.GetCurrentImage();
-    FileImage snapshotsFile(filePath.toStdString().c_str(), image.height, image.width);
-
-    for (int i = 0; i < nr_images; i++)
-    {
-        int exp_time = m_cameraInterface.m_camera->GetExposureMs();
-        int waitTime = 2 * exp_time;
-        WaitMilliseconds(waitTime);
-        image = m_imageContainer.GetCurrentImage();
-        snapshotsFile.WriteImageData(image, GetCameraTemperature());
-        int progress = static_cast<int>((static_cast<float>(i + 1) / static_cast<float>(nr_images)) * 100);
-        QMetaObject::invokeMethod(ui->progressBar, "setValue", Qt::QueuedConnection, Q_ARG(int, progress));
-    }
-    snapshotsFile.AppendMetadata();
-    LOG_XILENS(info) << "Closed snapshot recording file";
-    QMetaObject::invokeMethod(ui->progressBar, "setValue", Qt::QueuedConnection, Q_ARG(int, 0));
-    QMetaObject::invokeMethod(ui->nSnapshotsSpinBox, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, true));
-    QMetaObject::invokeMethod(ui->fileNameSnapshotsLineEdit, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, true));
+    // the providers are registered again when the camera changes, the sequence keeps those it started with
+    auto metadataProviders = std::atomic_load(&m_metadataProviders);
+    auto snapshotsFile = std::make_shared<FileImage>(filePath.toStdString().c_str(), image.height, image.width,
+                                                     metadataProviders->GetSchema());
+    FrameMetadataRecord record = metadataProviders->GetSchema().CreateRecord();
+
+    // consecutive frames are recorded as they arrive instead of waiting two exposure times for each of them
+    CaptureSequenceOptions options;
+    options.apiWrapper = m_xiAPIWrapper;
+    options.cameraHandle = &m_cameraInterface.m_cameraHandle;
+    options.cameraHandleMutex = &m_cameraInterface.m_mutexCameraHandle;
+    options.nFrames = nr_images;
+    FileImage *file = snapshotsFile.get();
+    m_snapshotsCapture = CaptureSequence::Start(
+        m_captureScheduler, options,
+        [this, file, metadataProviders, record, nr_images](int index, const XI_IMG &frame) mutable {
+            metadataProviders->Sample(frame, record);
+            file->WriteImageData(frame, record);
+            int progress = static_cast<int>((static_cast<float>(index + 1) / static_cast<float>(nr_images)) * 100);
+            QMetaObject::invokeMethod(ui->progressBar, "setValue", Qt::QueuedConnection, Q_ARG(int, progress));
+        },
+        [this, snapshotsFile, filePath](std::exception_ptr error) mutable {
+            LogCaptureError(error, "snapshots");
+            snapshotsFile->AppendMetadata();
+            snapshotsFile = nullptr;
+            LOG_XILENS(info) << "Closed snapshot recording file";
+            this->ArchiveRecording(filePath.toStdString());
+            QMetaObject::invokeMethod(ui->progressBar, "setValue", Qt::QueuedConnection, Q_ARG(int, 0));
+            QMetaObject::invokeMethod(ui->nSnapshotsSpinBox, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, true));
+            QMetaObject::invokeMethod(ui->fileNameSnapshotsLineEdit, "setEnabled", Qt::QueuedConnection,
+                                      Q_ARG(bool, true));
+            m_capturingSnapshots = false;
+        });
 }
 
 void MainWindow::HandleSnapshotButtonClicked()
 {
-    m_snapshotsThread = boost::thread(&MainWindow::RecordSnapshots, this);
+    this->RecordSnapshots();
 }
 
 QMap<QString, float> MainWindow::GetCameraTemperature() const
@@ -319,8 +586,16 @@ void MainWindow::HandleTemperatureTimer(const boost::system::error_code &error)
         return;
     }
 
-    m_cameraInterface.m_camera->m_cameraFamily->get()->UpdateCameraTemperature();
-    this->DisplayCameraTemperature();
+    {
+        boost::lock_guard<boost::mutex> guard(m_cameraInterface.m_mutexCameraHandle);
+        // the camera is being reopened when its handle is invalid, the temperature is updated at the next interval
+        if (m_cameraInterface.m_cameraHandle != INVALID_HANDLE_VALUE)
+        {
+            m_cameraInterface.m_camera->m_cameraFamily->get()->UpdateCameraTemperature();
+            this->DisplayCameraTemperature();
+            GovernFrameRate(m_thermalGovernor, *m_cameraInterface.m_camera);
+        }
+    }
 
     // Reset timer
     m_temperatureThreadTimer->expires_after(std::chrono::seconds(TEMP_LOG_INTERVAL));
@@ -360,25 +635,43 @@ void MainWindow::StopTemperatureThread()
     }
 }
 
-void MainWindow::StopSnapshotsThread()
+void MainWindow::CancelCaptureSequences()
 {
-    if (m_snapshotsThread.joinable())
-    {
-        m_snapshotsThread.join();
-    }
+    m_captureScheduler.Cancel(m_snapshotsCapture);
+    m_captureScheduler.Cancel(m_referenceCapture);
 }
 
-void MainWindow::StopReferenceRecordingThread()
+void MainWindow::HandleExposureValueChanged(int value)
 {
-    if (m_referenceRecordingThread.joinable())
+    if (this->IsAttachedToDaemon())
+    {
+        m_pendingDaemonExposureRequests++;
+        this->PostDaemonRequest(
+            "exposure " + std::to_string(value),
+            [this](const std::string &exposure) {
+                m_daemonExposureMs = QString::fromStdString(exposure).toInt();
+                // the slider is only moved to the exposure time applied by the daemon once it stopped moving
+                if (--m_pendingDaemonExposureRequests == 0)
+                {
+                    this->UpdateExposure();
+                }
+            },
+            [this](const std::string &message) {
+                m_pendingDaemonExposureRequests--;
+                LOG_XILENS(error) << "Could not set exposure time of acquisition daemon: " << message;
+            });
+        return;
+    }
+    else
     {
-        m_referenceRecordingThread.join();
+        boost::lock_guard<boost::mutex> guard(m_cameraInterface.m_mutexCameraHandle);
+        if (m_cameraInterface.m_cameraHandle == INVALID_HANDLE_VALUE)
+        {
+            LOG_XILENS(warning) << "Exposure time not set, the camera is being reopened";
+            return;
+        }
+        m_cameraInterface.m_camera->SetExposureMs(value);
     }
-}
-
-void MainWindow::HandleExposureValueChanged(int value)
-{
-    m_cameraInterface.m_camera->SetExposureMs(value);
     UpdateExposure();
 }
 
@@ -393,27 +686,31 @@ void MainWindow::HandleViewerImageSliderValueChanged(int value)
 
 void MainWindow::ProcessViewerImageSliderValueChanged(int value)
 {
-    std::array<int64_t, B2ND_MAX_DIM> slice_start = {0};
-    std::array<int64_t, B2ND_MAX_DIM> slice_stop = {0};
-    std::array<int64_t, B2ND_MAX_DIM> slice_shape = {0};
-    for (int i = 0; i < this->m_viewerNDArray->ndim; i++)
+    std::shared_ptr<RecordingReader> session;
+    int bitDepth;
     {
-        slice_start[i] = i == 0 ? value : 0;
-        slice_stop[i] = i == 0 ? value + 1 : this->m_viewerNDArray->shape[i];
-        slice_shape[i] = slice_stop[i] - slice_start[i];
+        boost::lock_guard<boost::mutex> lock(m_mutexImageViewer);
+        session = this->m_viewerSession;
+        bitDepth = this->m_viewerBitDepth;
+    }
+    if (!session)
+    {
+        return;
+    }
+    std::vector<uint16_t> buffer;
+    try
+    {
+        session->ReadFrame(value, buffer);
+    }
+    catch (const std::exception &e)
+    {
+        LOG_XILENS(error) << "Could not read frame " << value << ": " << e.what();
+        return;
     }
-    auto buffer_size =
-        static_cast<int64_t>(this->m_viewerNDArray->shape[1] * this->m_viewerNDArray->shape[2] * sizeof(uint16_t));
-    std::vector<uint16_t> buffer(this->m_viewerNDArray->shape[1] * this->m_viewerNDArray->shape[2]);
-    b2nd_get_slice_cbuffer(this->m_viewerNDArray, slice_start.data(), slice_stop.data(), buffer.data(),
-                           slice_shape.data(), buffer_size);
 
-    // Get image dimensions, dimensions are transposed compared to what OpenCv expects.
-    auto width = static_cast<int>(slice_shape[1]);
-    auto height = static_cast<int>(slice_shape[2]);
-    cv::Mat mat(width, height, CV_16UC1, buffer.data());
-    mat /= 4;
-    mat.convertTo(mat, CV_8UC1);
+    cv::Mat mat(static_cast<int>(session->GetHeight()), static_cast<int>(session->GetWidth()), CV_16UC1,
+                buffer.data());
+    ConvertTo8Bit(mat, mat, bitDepth);
 
     // Indicate that processing is finished.
     auto viewerQImage = GetQImageFromMatrix(mat, QImage::Format_Grayscale8);
@@ -456,7 +753,7 @@ void MainWindow::UpdateExposure()
     // lock ui elements before updating them
     const QSignalBlocker exposureSliderLock(ui->exposureSlider);
     const QSignalBlocker exposureSpinBoxLock(ui->exposureSpinBox);
-    int exp_ms = m_cameraInterface.m_camera->GetExposureMs();
+    int exp_ms = this->GetExposureMs();
     // update the estimated framerate
     int n_skip_frames = ui->skipFramesSpinBox->value();
     ui->hzLabel->setText(QString::number((double)(1000.0 / (exp_ms * (n_skip_frames + 1))), 'g', 2));
@@ -477,7 +774,16 @@ void MainWindow::HandleRecordButtonClicked(bool clicked)
                              .arg(this->m_cameraInterface.m_cameraIdentifier, this->m_cameraInterface.m_cameraSN),
                          LOG_FILE_NAME, true);
         this->m_elapsedTimer.start();
-        this->StartRecording();
+        try
+        {
+            this->StartRecording();
+        }
+        catch (const std::runtime_error &e)
+        {
+            LOG_XILENS(error) << "Could not start recording: " << e.what();
+            ui->recordButton->setChecked(false);
+            return;
+        }
         this->HandleElementsWhileRecording(clicked);
         original_colour = ui->recordButton->styleSheet();
         original_button_text = ui->recordButton->text();
@@ -515,15 +821,21 @@ void MainWindow::HandleElementsWhileRecording(bool recordingInProgress)
         QMetaObject::invokeMethod(ui->darkCorrectionButton, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, true));
         QMetaObject::invokeMethod(ui->reloadCamerasPushButton, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, true));
         QMetaObject::invokeMethod(ui->baseFolderLineEdit, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, true));
+        if (this->IsAttachedToDaemon())
+        {
+            this->DisableLocalAcquisitionWidgets();
+        }
     }
 }
 
 void MainWindow::closeEvent(QCloseEvent *event)
 {
-    if (this->ui->recordButton->isChecked())
+    // an acquisition daemon keeps recording after the GUI is closed
+    if (this->ui->recordButton->isChecked() && !this->IsAttachedToDaemon())
     {
         HandleRecordButtonClicked(false);
     }
+    this->StopPreviewThread();
     this->StopPollingThread();
     QMainWindow::closeEvent(event);
 }
@@ -544,6 +856,7 @@ void MainWindow::HandleBaseFolderButtonClicked()
                 m_baseFolderPath = baseFolderPath;
                 ui->baseFolderLineEdit->clear();
                 ui->baseFolderLineEdit->insert(this->GetBaseFolder());
+                this->PublishUiSettings();
                 this->WriteLogHeader();
             }
         }
@@ -552,7 +865,7 @@ void MainWindow::HandleBaseFolderButtonClicked()
 
 void MainWindow::HandleViewerFileButtonClicked()
 {
-    QString filePath = QFileDialog::getOpenFileName(this, tr("Open File"), "", tr("NDArrays (*.b2nd)"));
+    QString filePath = QFileDialog::getOpenFileName(this, tr("Open File"), "", tr("Recordings (*.b2nd *.xilens.json)"));
     if (QFile(filePath).exists())
     {
         if (!filePath.isEmpty())
@@ -568,12 +881,41 @@ void MainWindow::HandleViewerFileButtonClicked()
 
 void MainWindow::OpenFileInViewer(const QString &filePath)
 {
-    char *path = strdup(filePath.toUtf8().constData());
-    b2nd_open(path, &this->m_viewerNDArray);
-    auto n_images = static_cast<int>(this->m_viewerNDArray->shape[0] - 1);
+    std::shared_ptr<RecordingReader> session;
+    try
+    {
+        session = std::make_shared<RecordingReader>(filePath.toStdString());
+    }
+    catch (const std::exception &e)
+    {
+        LOG_XILENS(error) << "Could not open recording in viewer: " << e.what();
+        return;
+    }
+    int bitDepth = DEFAULT_BIT_DEPTH;
+    try
+    {
+        // recordings made before the bit depth was stored hold values of the default bit depth
+        if (session->GetNumberOfFrames() > 0 && session->HasMetadata(DATA_BIT_DEPTH_KEY))
+        {
+            bitDepth = static_cast<int>(session->GetMetadata<int64_t>(DATA_BIT_DEPTH_KEY).front());
+            GetDisplayShift(bitDepth);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        LOG_XILENS(warning) << "Could not read bit depth of recording, assuming " << DEFAULT_BIT_DEPTH
+                            << " bit: " << e.what();
+        bitDepth = DEFAULT_BIT_DEPTH;
+    }
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutexImageViewer);
+        this->m_viewerSession = session;
+        this->m_viewerBitDepth = bitDepth;
+    }
+    auto n_images = static_cast<int>(session->GetNumberOfFrames() - 1);
     int defaultIndex = 0;
     // only enable slider when more than one image is in the file
-    if (n_images != 0)
+    if (n_images > 0)
     {
         this->ui->viewerImageSlider->setEnabled(true);
         this->ui->viewerImageSlider->setMaximum(n_images);
@@ -617,17 +959,17 @@ QString MainWindow::LogMessage(const QString &message, const QString &logFile, b
 
 bool MainWindow::GetNormalize() const
 {
-    return this->ui->normalizeCheckbox->isChecked();
+    return this->GetUiSettings()->normalize;
 }
 
 unsigned MainWindow::GetBand() const
 {
-    return this->ui->bandSlider->value();
+    return this->GetUiSettings()->band;
 }
 
 unsigned MainWindow::GetBGRNorm() const
 {
-    return this->ui->rgbNormSlider->value();
+    return this->GetUiSettings()->bgrNorm;
 }
 
 QString MainWindow::GetBaseFolder() const
@@ -637,7 +979,11 @@ QString MainWindow::GetBaseFolder() const
 
 void MainWindow::ThreadedRecordImage()
 {
-    this->m_IOService.post([this] { RecordImage(false); });
+    m_pendingRecordTasks++;
+    this->m_IOService.post([this] {
+        RecordImage(false);
+        m_pendingRecordTasks--;
+    });
 }
 
 void MainWindow::InitializeImageFileRecorder(std::string subFolder, std::string fileName)
@@ -646,46 +992,68 @@ void MainWindow::InitializeImageFileRecorder(std::string subFolder, std::string
     {
         fileName = m_fileName.toUtf8().constData();
     }
-    QString fullPath = GetFullFilenameStandardFormat(std::move(fileName), ".b2nd", std::move(subFolder));
-    this->m_imageContainer.InitializeFile(fullPath.toStdString().c_str());
+    RecordingOptions options;
+    options.stripeFolders = g_commandLineArguments.stripe_folders;
+    options.compression = m_compressionOptions;
+    std::string extension = options.stripeFolders.empty() ? ".b2nd" : RECORDING_MANIFEST_EXTENSION;
+    QString fullPath = GetFullFilenameStandardFormat(std::move(fileName), extension, std::move(subFolder));
+    if (!g_commandLineArguments.mirror_folder.empty())
+    {
+        // the mirror keeps the same folder structure as the writing folder
+        QString relativePath = QDir(GetWritingFolder()).relativeFilePath(fullPath);
+        QString mirrorFile = QDir::cleanPath(QString::fromStdString(g_commandLineArguments.mirror_folder) +
+                                             QDir::separator() + relativePath);
+        MainWindow::CreateFolderIfNecessary(QFileInfo(mirrorFile).absolutePath());
+        options.mirrorFilePath = mirrorFile.toStdString();
+    }
+    auto metadataProviders = std::atomic_load(&m_metadataProviders);
+    this->m_imageContainer.InitializeFile(fullPath.toStdString().c_str(), metadataProviders->GetSchema(), options);
 }
 
 void MainWindow::RecordImage(bool ignoreSkipping)
 {
     boost::this_thread::interruption_point();
-    XI_IMG image = m_imageContainer.GetCurrentImage();
-    boost::lock_guard<boost::mutex> guard(this->m_mutexImageRecording);
-    static long lastImageID = image.acq_nframe;
-    int nSkipFrames = ui->skipFramesSpinBox->value();
-    if (MainWindow::ImageShouldBeRecorded(nSkipFrames, image.acq_nframe) || ignoreSkipping)
+    this->RecordImage(m_imageContainer.GetCurrentImage(), ignoreSkipping);
+}
+
+void MainWindow::RecordImage(const XI_IMG &image, bool ignoreSkipping)
+{
+    int nSkipFrames = this->GetUiSettings()->skipFrames;
+    if (!MainWindow::ImageShouldBeRecorded(nSkipFrames, image.acq_nframe) && !ignoreSkipping)
     {
-        try
-        {
-            this->m_imageContainer.m_imageFile->WriteImageData(image, GetCameraTemperature());
-            m_recordedCount++;
-        }
-        catch (const std::runtime_error &e)
-        {
-            LOG_XILENS(error) << "Error while saving image: %s\n" << e.what();
-        }
-        this->DisplayRecordCount();
-        // register image recorded time and emit signal
-        RegisterTimeImageRecorded();
+        m_skippedCounter++;
+        return;
     }
-    else
+
+    // the metadata, including the frame statistics computed over the whole frame, is sampled before the recording
+    // mutex is taken so that concurrent record tasks only wait for each other while writing
+    auto metadataProviders = std::atomic_load(&m_metadataProviders);
+    thread_local std::shared_ptr<const MetadataProviderRegistry> recordProviders;
+    thread_local FrameMetadataRecord record;
+    if (recordProviders != metadataProviders)
     {
-        m_skippedCounter++;
+        record = metadataProviders->GetSchema().CreateRecord();
+        recordProviders = metadataProviders;
     }
-    lastImageID = image.acq_nframe;
-}
+    metadataProviders->Sample(image, record);
 
-void MainWindow::RegisterTimeImageRecorded()
-{
-    auto now = std::chrono::steady_clock::now();
-    m_recordedTimestamps.push_back(now);
-    if (m_recordedTimestamps.size() > MAX_FRAMES_TO_COMPUTE_FPS)
+    boost::lock_guard<boost::mutex> guard(this->m_mutexImageRecording);
+    if (metadataProviders != std::atomic_load(&m_metadataProviders))
+    {
+        // the camera changed while sampling, the schema of the file does not match the record anymore
+        LOG_XILENS(warning) << "Dropped image " << image.acq_nframe << " sampled before the camera changed";
+        return;
+    }
+    try
     {
-        m_recordedTimestamps.pop_front();
+        double backlog = static_cast<double>(m_pendingRecordTasks.load()) / RECORDING_BACKLOG_CAPACITY;
+        this->m_imageContainer.m_imageFile->SetQueueFill(std::min(backlog, 1.0));
+        this->m_imageContainer.m_imageFile->WriteImageData(image, record);
+        m_recordedCount++;
+    }
+    catch (const std::runtime_error &e)
+    {
+        LOG_XILENS(error) << "Error while saving image: %s\n" << e.what();
     }
 }
 
@@ -728,50 +1096,107 @@ void MainWindow::StopTimer()
     ui->timerLCDNumber->display(0);
 }
 
-void MainWindow::CountImages()
+void MainWindow::UpdateTelemetryDisplays()
 {
-    m_imageCounter++;
+    this->DisplayRecordCount();
+    this->UpdateTimer();
 }
 
 void MainWindow::StartRecording()
 {
-    // create thread for running the tasks posted to the IO service
-    this->InitializeImageFileRecorder();
-    this->m_IOService.reset();
-    this->m_IOWork = std::make_unique<boost::asio::io_service::work>(this->m_IOService);
-    for (int i = 0; i < 4; i++) // put 2 threads in thread pool
+    if (this->IsAttachedToDaemon())
     {
-        m_threadGroup.create_thread([&] { return m_IOService.run(); });
+        // the daemon may already be recording when the GUI attaches to it, see MainWindow::RestoreDaemonState
+        if (!m_daemonRecording)
+        {
+            // the daemon adds the extension matching the layout of its recordings
+            QString filePath = this->GetFullFilenameStandardFormat(m_fileName.toStdString(), "", "");
+            this->PostDaemonRequest(
+                "record " + filePath.toStdString(),
+                [this](const std::string &recordingPath) { m_daemonRecordingPath = recordingPath; },
+                [this](const std::string &message) {
+                    LOG_XILENS(error) << "Could not start recording of acquisition daemon: " << message;
+                    if (m_daemonRecording)
+                    {
+                        ui->recordButton->setChecked(false);
+                        this->HandleRecordButtonClicked(false);
+                    }
+                });
+            m_recordedCount = 0;
+        }
+        m_daemonRecording = true;
     }
-    HANDLE_CONNECTION_RESULT(
-        QObject::connect(&(this->m_imageContainer), &ImageContainer::NewImage, this, &MainWindow::ThreadedRecordImage));
-    HANDLE_CONNECTION_RESULT(
-        QObject::connect(&(this->m_imageContainer), &ImageContainer::NewImage, this, &MainWindow::CountImages));
-    HANDLE_CONNECTION_RESULT(
-        QObject::connect(&(this->m_imageContainer), &ImageContainer::NewImage, this, &MainWindow::UpdateTimer));
+    else
+    {
+        // create thread for running the tasks posted to the IO service
+        this->InitializeImageFileRecorder();
+        if (g_commandLineArguments.record_class_maps)
+        {
+            m_classMapRecorder.Start(GetClassMapFilePath(m_imageContainer.m_imageFile->GetFilePath()));
+        }
+        this->m_IOService.reset();
+        this->m_IOWork = std::make_unique<boost::asio::io_service::work>(this->m_IOService);
+        for (int i = 0; i < 4; i++) // put 2 threads in thread pool
+        {
+            m_threadGroup.create_thread([&] { return m_IOService.run(); });
+        }
+        // posting the recording task to the IO service is thread safe, it is done directly from the polling thread
+        HANDLE_CONNECTION_RESULT(QObject::connect(&(this->m_imageContainer), &ImageContainer::NewImage, this,
+                                                  &MainWindow::ThreadedRecordImage, Qt::DirectConnection));
+    }
+    m_receivedImageCountAtStart = m_imageContainer.GetReceivedImageCount();
+    m_recordedCountAtLastFPSUpdate = m_recordedCount.load();
+    m_lastFPSUpdateTime = std::chrono::steady_clock::now();
     HANDLE_CONNECTION_RESULT(
         QObject::connect(m_updateFPSDisplayTimer, &QTimer::timeout, this, &MainWindow::UpdateFPSLCDDisplay));
+    HANDLE_CONNECTION_RESULT(
+        QObject::connect(m_updateTelemetryTimer, &QTimer::timeout, this, &MainWindow::UpdateTelemetryDisplays));
     m_updateFPSDisplayTimer->start(UPDATE_RATE_MS_FPS_TIMER);
+    m_updateTelemetryTimer->start(UPDATE_RATE_MS_TELEMETRY_TIMER);
 }
 
 void MainWindow::StopRecording()
 {
-    HANDLE_CONNECTION_RESULT(QObject::disconnect(&(this->m_imageContainer), &ImageContainer::NewImage, this,
-                                                 &MainWindow::ThreadedRecordImage));
-    HANDLE_CONNECTION_RESULT(
-        QObject::disconnect(&(this->m_imageContainer), &ImageContainer::NewImage, this, &MainWindow::CountImages));
-    HANDLE_CONNECTION_RESULT(
-        QObject::disconnect(&(this->m_imageContainer), &ImageContainer::NewImage, this, &MainWindow::UpdateTimer));
+    if (!this->IsAttachedToDaemon())
+    {
+        HANDLE_CONNECTION_RESULT(QObject::disconnect(&(this->m_imageContainer), &ImageContainer::NewImage, this,
+                                                     &MainWindow::ThreadedRecordImage));
+    }
+    m_updateFPSDisplayTimer->stop();
+    m_updateTelemetryTimer->stop();
     HANDLE_CONNECTION_RESULT(
         QObject::disconnect(m_updateFPSDisplayTimer, &QTimer::timeout, this, &MainWindow::UpdateFPSLCDDisplay));
+    HANDLE_CONNECTION_RESULT(
+        QObject::disconnect(m_updateTelemetryTimer, &QTimer::timeout, this, &MainWindow::UpdateTelemetryDisplays));
     QMetaObject::invokeMethod(this->ui->fpsLCDNumber, "display", Qt::QueuedConnection, Q_ARG(QString, ""));
     this->StopTimer();
+    if (this->IsAttachedToDaemon())
+    {
+        m_daemonRecording = false;
+        // the daemon replies once it wrote the backlog of the recording, the GUI is not blocked meanwhile
+        this->PostDaemonRequest(
+            "stop",
+            [this](const std::string &filePath) {
+                m_daemonRecordingPath.clear();
+                this->ArchiveRecording(filePath);
+                this->DisplayRecordCount();
+                LOG_XILENS(info) << "Total of frames recorded by acquisition daemon: " << m_recordedCount;
+            },
+            [this](const std::string &message) {
+                m_daemonRecordingPath.clear();
+                LOG_XILENS(error) << "Could not stop recording of acquisition daemon: " << message;
+            });
+        return;
+    }
     this->m_IOWork.reset();
     this->m_IOWork = nullptr;
     this->m_IOService.stop();
     this->m_threadGroup.interrupt_all();
     this->m_threadGroup.join_all();
-    this->m_imageContainer.CloseFile();
+    this->ArchiveRecording(this->m_imageContainer.CloseFile());
+    this->ArchiveRecording(m_classMapRecorder.Stop());
+    m_imageCounter += m_imageContainer.GetReceivedImageCount() - m_receivedImageCountAtStart;
+    this->DisplayRecordCount();
     LOG_XILENS(info) << "Total of frames recorded: " << m_recordedCount;
     LOG_XILENS(info) << "Total of frames dropped : " << m_imageCounter - m_recordedCount;
     LOG_XILENS(info) << "Estimate for frames skipped: " << m_skippedCounter;
@@ -779,11 +1204,25 @@ void MainWindow::StopRecording()
 
 QString MainWindow::GetWritingFolder()
 {
-    QString writeFolder = GetBaseFolder();
+    // this is also called from the snapshot and reference threads, so it can not rely on m_baseFolderPath
+    QString writeFolder = m_archiveMigrator ? QString::fromStdString(g_commandLineArguments.staging_folder)
+                                            : this->GetUiSettings()->baseFolder;
     writeFolder += QDir::separator();
     return QDir::cleanPath(writeFolder);
 }
 
+void MainWindow::ArchiveRecording(const std::string &filePath)
+{
+    if (!m_archiveMigrator || filePath.empty())
+    {
+        return;
+    }
+    QDir stagingDir(QString::fromStdString(g_commandLineArguments.staging_folder));
+    QString relativePath = stagingDir.relativeFilePath(QString::fromStdString(filePath));
+    QString destination = QDir::cleanPath(this->GetUiSettings()->baseFolder + QDir::separator() + relativePath);
+    m_archiveMigrator->Enqueue(filePath, destination.toStdString());
+}
+
 void MainWindow::CreateFolderIfNecessary(const QString &folder)
 {
     QDir folderDir(folder);
@@ -835,6 +1274,148 @@ void MainWindow::StopPollingThread()
     m_imageContainerThread.join();
 }
 
+bool MainWindow::IsAttachedToDaemon() const
+{
+    return !m_daemonSocket.empty();
+}
+
+void MainWindow::PostDaemonRequest(std::string request, std::function<void(const std::string &result)> onReply,
+                                   std::function<void(const std::string &message)> onError)
+{
+    m_daemonIOService.post([this, request = std::move(request), onReply = std::move(onReply),
+                            onError = std::move(onError)] {
+        try
+        {
+            std::string result = SendControlRequest(m_daemonSocket, request);
+            QMetaObject::invokeMethod(this, [onReply, result] { onReply(result); }, Qt::QueuedConnection);
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::string message = e.what();
+            QMetaObject::invokeMethod(this, [onError, message] { onError(message); }, Qt::QueuedConnection);
+        }
+    });
+}
+
+QStringList MainWindow::GetAvailableCameraIdentifiers()
+{
+    if (!this->IsAttachedToDaemon())
+    {
+        return m_cameraInterface.GetAvailableCameraIdentifiers();
+    }
+    try
+    {
+        QString cameras = QString::fromStdString(SendControlRequest(m_daemonSocket, "cameras"));
+        return cameras.split(",", Qt::SkipEmptyParts);
+    }
+    catch (const std::runtime_error &e)
+    {
+        LOG_XILENS(error) << "Could not query cameras of acquisition daemon: " << e.what();
+        return {};
+    }
+}
+
+int MainWindow::GetExposureMs()
+{
+    return this->IsAttachedToDaemon() ? m_daemonExposureMs : m_cameraInterface.m_camera->GetExposureMs();
+}
+
+void MainWindow::StartPreviewThread()
+{
+    this->StopPreviewThread();
+    m_previewThreadRunning = true;
+    m_previewThread = boost::thread(&MainWindow::PreviewThreadFunc, this);
+}
+
+void MainWindow::StopPreviewThread()
+{
+    m_previewThreadRunning = false;
+    if (m_previewThread.joinable())
+    {
+        m_previewThread.interrupt();
+        m_previewThread.join();
+    }
+}
+
+void MainWindow::PreviewThreadFunc()
+{
+    // the displayer keeps a pointer to the last image until it processes it, so the previews rotate through several
+    // buffers instead of overwriting the one that is displayed
+    const size_t nBuffers = 3;
+    std::vector<uint16_t> buffers[nBuffers];
+    size_t nextBuffer = 0;
+    PreviewFrameInfo info;
+    std::unique_ptr<PreviewSubscriber> subscriber;
+    while (m_previewThreadRunning)
+    {
+        try
+        {
+            if (!subscriber)
+            {
+                subscriber = std::make_unique<PreviewSubscriber>(SendControlRequest(m_daemonSocket, "preview"));
+            }
+            if (subscriber->ReadLatest(info, buffers[nextBuffer]))
+            {
+                if (info.recording)
+                {
+                    m_recordedCount = info.recordedFrames;
+                }
+                XI_IMG image = PreviewFrameToImage(info, buffers[nextBuffer]);
+                this->m_display->Display(image);
+                nextBuffer = (nextBuffer + 1) % nBuffers;
+            }
+        }
+        catch (const std::runtime_error &e)
+        {
+            // the daemon restarted or is not running, attach again after a while
+            LOG_XILENS(warning) << "Could not read previews of acquisition daemon: " << e.what();
+            subscriber = nullptr;
+            boost::this_thread::sleep_for(boost::chrono::seconds(1));
+        }
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    }
+}
+
+void MainWindow::RestoreDaemonState()
+{
+    std::map<std::string, std::string> status;
+    try
+    {
+        status = ParseControlStatus(SendControlRequest(m_daemonSocket, "status"));
+    }
+    catch (const std::runtime_error &e)
+    {
+        LOG_XILENS(error) << "Could not query state of acquisition daemon: " << e.what();
+        return;
+    }
+    int index = ui->cameraListComboBox->findText(QString::fromStdString(status["camera"]));
+    if (index <= 0)
+    {
+        return;
+    }
+    if (status["recording"] == "1")
+    {
+        m_daemonRecordingPath = status["file"];
+        m_daemonRecording = true;
+    }
+    // selecting the camera the daemon acquires from attaches to its previews without interrupting it
+    ui->cameraListComboBox->setCurrentIndex(index);
+    if (m_daemonRecording)
+    {
+        LOG_XILENS(info) << "Acquisition daemon is recording to " << m_daemonRecordingPath;
+        ui->recordButton->setChecked(true);
+        this->HandleRecordButtonClicked(true);
+    }
+}
+
+void MainWindow::DisableLocalAcquisitionWidgets()
+{
+    QMetaObject::invokeMethod(ui->snapshotButton, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, false));
+    QMetaObject::invokeMethod(ui->whiteBalanceButton, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, false));
+    QMetaObject::invokeMethod(ui->darkCorrectionButton, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, false));
+    QMetaObject::invokeMethod(ui->autoexposureCheckbox, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, false));
+}
+
 void MainWindow::HandleAutoexposureCheckboxClicked(bool setAutoexposure)
 {
     this->m_cameraInterface.m_camera->AutoExposure(setAutoexposure);
@@ -845,24 +1426,21 @@ void MainWindow::HandleAutoexposureCheckboxClicked(bool setAutoexposure)
 
 void MainWindow::HandleWhiteBalanceButtonClicked()
 {
-    if (m_referenceRecordingThread.joinable())
-    {
-        m_referenceRecordingThread.join();
-    }
-    m_referenceRecordingThread = boost::thread(&MainWindow::RecordReferenceImages, this, "white");
+    this->RecordReferenceImages("white");
 }
 
 void MainWindow::HandleDarkCorrectionButtonClicked()
 {
-    if (m_referenceRecordingThread.joinable())
-    {
-        m_referenceRecordingThread.join();
-    }
-    m_referenceRecordingThread = boost::thread(&MainWindow::RecordReferenceImages, this, "dark");
+    this->RecordReferenceImages("dark");
 }
 
 void MainWindow::RecordReferenceImages(const QString &referenceType)
 {
+    if (m_capturingReferences.exchange(true))
+    {
+        LOG_XILENS(warning) << "References are already being recorded";
+        return;
+    }
     QMetaObject::invokeMethod(ui->recordButton, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, false));
     if (referenceType == "white")
     {
@@ -873,7 +1451,7 @@ void MainWindow::RecordReferenceImages(const QString &referenceType)
         QMetaObject::invokeMethod(ui->whiteBalanceButton, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, false));
     }
 
-    QString baseFolder = ui->baseFolderLineEdit->text();
+    QString baseFolder = this->GetUiSettings()->baseFolder;
     QDir dir(baseFolder);
     QStringList nameFilters;
     nameFilters << referenceType + "*";
@@ -900,26 +1478,35 @@ void MainWindow::RecordReferenceImages(const QString &referenceType)
         filename = referenceType.toStdString();
     }
     this->InitializeImageFileRecorder("", filename);
-    for (int i = 0; i < NR_REFERENCE_IMAGES_TO_RECORD; i++)
-    {
-        int exp_time = m_cameraInterface.m_camera->GetExposureMs();
-        int waitTime = 2 * exp_time;
-        WaitMilliseconds(waitTime);
-        this->RecordImage(true);
-        int progress = static_cast<int>((static_cast<float>(i + 1) / NR_REFERENCE_IMAGES_TO_RECORD) * 100);
-        QMetaObject::invokeMethod(ui->progressBar, "setValue", Qt::QueuedConnection, Q_ARG(int, progress));
-    }
-    this->m_imageContainer.CloseFile();
-    QMetaObject::invokeMethod(ui->progressBar, "setValue", Qt::QueuedConnection, Q_ARG(int, 0));
-    QMetaObject::invokeMethod(ui->recordButton, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, true));
-    if (referenceType == "white")
-    {
-        QMetaObject::invokeMethod(ui->darkCorrectionButton, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, true));
-    }
-    else if (referenceType == "dark")
-    {
-        QMetaObject::invokeMethod(ui->whiteBalanceButton, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, true));
-    }
+    CaptureSequenceOptions options;
+    options.apiWrapper = m_xiAPIWrapper;
+    options.cameraHandle = &m_cameraInterface.m_cameraHandle;
+    options.cameraHandleMutex = &m_cameraInterface.m_mutexCameraHandle;
+    options.nFrames = NR_REFERENCE_IMAGES_TO_RECORD;
+    m_referenceCapture = CaptureSequence::Start(
+        m_captureScheduler, options,
+        [this](int index, const XI_IMG &image) {
+            this->RecordImage(image, true);
+            int progress = static_cast<int>((static_cast<float>(index + 1) / NR_REFERENCE_IMAGES_TO_RECORD) * 100);
+            QMetaObject::invokeMethod(ui->progressBar, "setValue", Qt::QueuedConnection, Q_ARG(int, progress));
+        },
+        [this, referenceType](std::exception_ptr error) {
+            LogCaptureError(error, referenceType.toStdString() + " references");
+            this->ArchiveRecording(this->m_imageContainer.CloseFile());
+            QMetaObject::invokeMethod(ui->progressBar, "setValue", Qt::QueuedConnection, Q_ARG(int, 0));
+            QMetaObject::invokeMethod(ui->recordButton, "setEnabled", Qt::QueuedConnection, Q_ARG(bool, true));
+            if (referenceType == "white")
+            {
+                QMetaObject::invokeMethod(ui->darkCorrectionButton, "setEnabled", Qt::QueuedConnection,
+                                          Q_ARG(bool, true));
+            }
+            else if (referenceType == "dark")
+            {
+                QMetaObject::invokeMethod(ui->whiteBalanceButton, "setEnabled", Qt::QueuedConnection,
+                                          Q_ARG(bool, true));
+            }
+            m_capturingReferences = false;
+        });
 }
 
 void MainWindow::UpdateComponentEditedStyle(QLineEdit *lineEdit, const QString &newString,
@@ -994,6 +1581,7 @@ void MainWindow::HandleFileNameSnapshotsLineEditTextEdited(const QString &newTex
         return;
     }
     m_snapshotsFileName = ui->fileNameSnapshotsLineEdit->text();
+    this->PublishUiSettings();
 }
 
 void MainWindow::HandleLogTextLineEditTextEdited(const QString &newText)
@@ -1004,6 +1592,7 @@ void MainWindow::HandleLogTextLineEditTextEdited(const QString &newText)
 void MainWindow::HandleBaseFolderLineEditTextEdited(const QString &newText)
 {
     m_baseFolderPath = ui->baseFolderLineEdit->text();
+    this->PublishUiSettings();
 }
 
 void MainWindow::HandleViewerFileLineEditTextEdited(const QString &newText)
@@ -1026,10 +1615,11 @@ void MainWindow::HandleSkipFramesSpinBoxValueChanged()
 {
     // spin boxes do not have a returnPressed slot in Qt, which is why the value
     // is always updated upon changes
-    int exp_ms = m_cameraInterface.m_camera->GetExposureMs();
+    int exp_ms = this->GetExposureMs();
     int nSkipFrames = ui->skipFramesSpinBox->value();
     const QSignalBlocker blocker_label(ui->hzLabel);
     ui->hzLabel->setText(QString::number((double)(1000.0 / (exp_ms * (nSkipFrames + 1))), 'g', 2));
+    this->PublishUiSettings();
 }
 
 void MainWindow::HandleCameraListComboBoxCurrentIndexChanged(int index)
@@ -1061,6 +1651,9 @@ void MainWindow::HandleCameraListComboBoxCurrentIndexChanged(int index)
                 m_display->SetCameraProperties(cameraModel);
                 m_cameraInterface.SetCameraProperties(cameraModel);
                 this->StartImageAcquisition(cameraIdentifier);
+                // the providers depend on the bit depth queried when the camera is opened, no frame is recorded
+                // before they are registered since the recording mutex is held
+                this->RegisterMetadataProviders(cameraModel);
             }
             catch (std::runtime_error &e)
             {
@@ -1068,6 +1661,7 @@ void MainWindow::HandleCameraListComboBoxCurrentIndexChanged(int index)
                 // restore camera type and index
                 m_display->SetCameraProperties(originalCameraIdentifier);
                 m_cameraInterface.SetCameraProperties(originalCameraIdentifier);
+                this->RegisterMetadataProviders(originalCameraIdentifier.split("@").at(0));
                 const QSignalBlocker blocker_spinbox(ui->cameraListComboBox);
                 ui->cameraListComboBox->setCurrentIndex(m_cameraInterface.m_cameraIndex);
                 return;
@@ -1103,7 +1697,7 @@ void MainWindow::HandleReloadCamerasPushButtonClicked()
     ui->reloadCamerasPushButton->setDown(true);
     QCoreApplication::processEvents();
 
-    QStringList cameraList = m_cameraInterface.GetAvailableCameraIdentifiers();
+    QStringList cameraList = this->GetAvailableCameraIdentifiers();
     // Only add new camera models
     for (const QString &camera : cameraList)
     {
@@ -1142,17 +1736,29 @@ void MainWindow::UpdateSaturationPercentageLCDDisplays(double percentageBelowThr
                               Q_ARG(QString, displayValue));
 }
 
+void MainWindow::UpdateNoiseDisplay(double snr, double readNoise) const
+{
+    QString text = "SNR: " + QString::number(snr, 'f', 1);
+    if (std::isfinite(readNoise))
+    {
+        text += " Read noise: " + QString::number(readNoise, 'f', 2);
+    }
+    QMetaObject::invokeMethod(ui->noiseLabel, "setText", Qt::QueuedConnection, Q_ARG(QString, text));
+}
+
 void MainWindow::UpdateFPSLCDDisplay()
 {
-    using namespace std::chrono;
-    if (this->m_recordedTimestamps.size() < 2)
+    auto now = std::chrono::steady_clock::now();
+    unsigned long recordedCount = m_recordedCount.load();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastFPSUpdateTime).count();
+    if (duration <= 0)
     {
         return;
     }
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(this->m_recordedTimestamps.back() -
-                                                                          this->m_recordedTimestamps.front())
-                        .count();
-    double fps = (static_cast<double>(this->m_recordedTimestamps.size()) - 1) * 1000.0 / static_cast<double>(duration);
+    double fps = static_cast<double>(recordedCount - m_recordedCountAtLastFPSUpdate) * 1000.0 /
+                 static_cast<double>(duration);
+    m_recordedCountAtLastFPSUpdate = recordedCount;
+    m_lastFPSUpdateTime = now;
     QString displayValue = QString::number(fps, 'f', 1);
     QMetaObject::invokeMethod(this->ui->fpsLCDNumber, "display", Qt::QueuedConnection, Q_ARG(QString, displayValue));
 }
@@ -1197,7 +1803,7 @@ void MainWindow::SetGraphicsViewScene()
 
 bool MainWindow::IsSaturationButtonChecked()
 {
-    return this->ui->saturationToolButton->isChecked();
+    return this->GetUiSettings()->saturationOverlay;
 }
 
 void MainWindow::SetRecordedCount(int count)
@@ -17,8 +17,23 @@
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 
+#include "archiveMigrator.h"
+#include "bitDepth.h"
 #include "cameraInterface.h"
+#include "cameraRecovery.h"
+#include "captureScheduler.h"
+#include "daemonControl.h"
 #include "display.h"
+#include "frameStatistics.h"
+#include "metadataProviders.h"
+#include "noiseEstimator.h"
+#include "previewChannel.h"
+#include "roiTracker.h"
+#include "spectralClassifier.h"
+#include "stripedRecording.h"
+#include "thermalGovernor.h"
+#include "uiSettings.h"
+#include "whiteBalance.h"
 #include "xiAPIWrapper.h"
 
 /**
@@ -72,6 +87,42 @@ class MainWindow : public QMainWindow
      */
     unsigned GetBGRNorm() const;
 
+    /**
+     * Queries the most recent snapshot of the UI values. This is the only way worker threads should access values
+     * set through the UI, it does not call into any Qt widget.
+     *
+     * @return immutable snapshot of the UI values.
+     */
+    std::shared_ptr<const UiSettings> GetUiSettings() const;
+
+    /**
+     * Queries the recorder of the class maps computed by the displayer, it records while a recording is running and
+     * `--record-class-maps` is given.
+     */
+    ClassMapRecorder &GetClassMapRecorder();
+
+    /**
+     * Queries the tracker of the regions of interest given with `--roi`, fed by the displayer.
+     *
+     * @return tracker of the regions, null when no region was given.
+     */
+    RoiTrackingWorker *GetRoiTracking();
+
+    /**
+     * Queries the estimator of the temporal noise enabled with `--noise-window`, fed by the displayer. It is replaced
+     * when the camera changes.
+     *
+     * @return estimator of the noise of the current camera, null when the estimation is disabled.
+     */
+    std::shared_ptr<TemporalNoiseEstimator> GetNoiseEstimator() const;
+
+    /**
+     * Queries the automatic white balance of RGB cameras given with `--white-balance`, fed by the displayer.
+     *
+     * @return estimator of the white balance gains, null when no white balance was given.
+     */
+    WhiteBalanceEstimator *GetWhiteBalance();
+
     /**
      * Enables the UI elements.
      *
@@ -150,14 +201,16 @@ class MainWindow : public QMainWindow
     void HandleTemperatureTimer(const boost::system::error_code &error);
 
     /**
-     * Stops thread in charge of recording snapshot images.
+     * Updates the frames per second that are stored to file on the UI. The value is computed from the change of the
+     * recorded images counter since the last update.
      */
-    void StopSnapshotsThread();
+    void UpdateFPSLCDDisplay();
 
     /**
-     * Updates the frames per second that are stored to file on the UI.
+     * Refreshes all recording telemetry displayed in the UI (recorded images and elapsed time) from the counters kept
+     * by the recording pipeline. Triggered by a timer at a fixed rate, independent of the camera frame rate.
      */
-    void UpdateFPSLCDDisplay();
+    void UpdateTelemetryDisplays();
 
     /**
      * Updates the raw image displayed in the viewer tab.
@@ -221,9 +274,16 @@ class MainWindow : public QMainWindow
     Ui::MainWindow *ui;
 
     /**
-     * This is the NDArray structure that holds the connection to the data viewed in the Viewer tab of the application.
+     * Recording viewed in the Viewer tab of the application, either a single file or a striped recording. It is
+     * replaced under MainWindow::m_mutexImageViewer while the viewer thread may still read from the previous one.
      */
-    b2nd_array_t *m_viewerNDArray = nullptr;
+    std::shared_ptr<RecordingReader> m_viewerSession;
+
+    /**
+     * Bit depth of the raw values of the recording viewed, DEFAULT_BIT_DEPTH for recordings that do not store it.
+     * Replaced together with MainWindow::m_viewerSession.
+     */
+    int m_viewerBitDepth = DEFAULT_BIT_DEPTH;
 
     /**
      * @brief Event handler for the close event of the main window.
@@ -270,6 +330,14 @@ class MainWindow : public QMainWindow
      */
     void UpdateSaturationPercentageLCDDisplays(double percentageBelowThreshold, double percentageAboveThreshold) const;
 
+    /**
+     * Qt slot that updates the temporal noise shown in the status bar.
+     *
+     * @param snr temporal signal to noise ratio of the displayed band.
+     * @param readNoise read noise in raw values, NaN when it can not be estimated from the scene.
+     */
+    void UpdateNoiseDisplay(double snr, double readNoise) const;
+
   private slots:
 
     /**
@@ -404,6 +472,20 @@ class MainWindow : public QMainWindow
      */
     void SetUpConnections();
 
+    /**
+     * Reads the UI values needed by worker threads and publishes them as a new snapshot. Must be called from the GUI
+     * thread every time one of those values changes.
+     */
+    void PublishUiSettings();
+
+    /**
+     * Registers the providers of the per-frame metadata stored with each recorded image. Must be called with
+     * MainWindow::m_mutexImageRecording locked or before recording threads start.
+     *
+     * @param cameraModel model of the selected camera, used to configure the frame statistics.
+     */
+    void RegisterMetadataProviders(const QString &cameraModel);
+
     /**
      * Handles the result emanating from a Qt connection attempt.
      *
@@ -415,17 +497,13 @@ class MainWindow : public QMainWindow
     static void HandleConnectionResult(bool status, const char *file, int line, const char *func);
 
     /**
-     * Records the white reference to a folder called "white".
+     * Records the white reference to a folder called "white". The images are recorded by a sequence on the capture
+     * scheduler, the method returns right away.
      *
      * @param referenceType type of reference `white` or `dark`.
      */
     void RecordReferenceImages(const QString &referenceType);
 
-    /**
-     * Stops the thread responsible for recording the reference images (white and dark).
-     */
-    void StopReferenceRecordingThread();
-
     /**
      * Updates the stile of a Qt LineEdit component.
      *
@@ -448,6 +526,16 @@ class MainWindow : public QMainWindow
      */
     void Display();
 
+    /**
+     * Hands a new image to the capture scheduler, called on the polling thread while the image is valid.
+     */
+    void NotifyCaptureScheduler();
+
+    /**
+     * Cancels the recording of snapshots and reference images, e.g. when the acquisition stops.
+     */
+    void CancelCaptureSequences();
+
     /**
      * Starts the recording process.
      */
@@ -468,6 +556,61 @@ class MainWindow : public QMainWindow
      */
     void StopPollingThread();
 
+    /**
+     * Queries if the GUI is attached to an acquisition daemon, in which case the daemon acquires and records the
+     * images and the GUI only displays its previews, see AcquisitionDaemon.
+     */
+    bool IsAttachedToDaemon() const;
+
+    /**
+     * Sends a request to the acquisition daemon on the daemon request thread, such that the GUI does not wait for the
+     * reply, e.g. while the daemon writes the backlog of a stopped recording. Requests are sent in the order they are
+     * posted.
+     *
+     * @param request line of the request, see SendControlRequest
+     * @param onReply called on the GUI thread with the result of the request
+     * @param onError called on the GUI thread with the description of the failure
+     */
+    void PostDaemonRequest(std::string request, std::function<void(const std::string &result)> onReply,
+                           std::function<void(const std::string &message)> onError);
+
+    /**
+     * Queries the identifiers of the available cameras, from the acquisition daemon when attached to one.
+     */
+    QStringList GetAvailableCameraIdentifiers();
+
+    /**
+     * Queries the exposure time of the camera, from the last value set on the acquisition daemon when attached to one.
+     */
+    int GetExposureMs();
+
+    /**
+     * Starts the thread that displays the previews published by the acquisition daemon.
+     */
+    void StartPreviewThread();
+
+    /**
+     * Stops the thread that displays the previews published by the acquisition daemon.
+     */
+    void StopPreviewThread();
+
+    /**
+     * Loop of the preview thread, it also mirrors the number of frames recorded by the daemon.
+     */
+    void PreviewThreadFunc();
+
+    /**
+     * Restores the selected camera and the recording state of the acquisition daemon, e.g. after the GUI was restarted
+     * while the daemon kept recording.
+     */
+    void RestoreDaemonState();
+
+    /**
+     * Disables the widgets that acquire images in the GUI process: snapshots, reference images and auto-exposure are
+     * not available when attached to an acquisition daemon.
+     */
+    void DisableLocalAcquisitionWidgets();
+
     /**
      * Creates a folder if it does not exist.
      *
@@ -475,6 +618,14 @@ class MainWindow : public QMainWindow
      */
     static void CreateFolderIfNecessary(const QString &folder);
 
+    /**
+     * Hands a closed recording over to the archive migrator when a staging folder is used. The recording is moved to
+     * the same path relative to the base folder as it had relative to the staging folder.
+     *
+     * @param filePath path of the closed recording in the staging folder, ignored if empty.
+     */
+    void ArchiveRecording(const std::string &filePath);
+
     /**
      * Records image to specified sub folder and using specified file name.
      *
@@ -483,6 +634,14 @@ class MainWindow : public QMainWindow
      */
     void RecordImage(bool ignoreSkipping);
 
+    /**
+     * Records the given image to the current file.
+     *
+     * @param image image to record
+     * @param ignoreSkipping ignores the number of frames to skip and stores the image anyways.
+     */
+    void RecordImage(const XI_IMG &image, bool ignoreSkipping);
+
     /**
      * Starts IO service in a thread in charge of saving the images to files.
      */
@@ -507,11 +666,6 @@ class MainWindow : public QMainWindow
      */
     static bool ImageShouldBeRecorded(int nSkipFrames, long ImageID);
 
-    /**
-     * Updates image counter.
-     */
-    void CountImages();
-
     /**
      * Updates timer displayed on the UI when recordings are started.
      */
@@ -523,7 +677,8 @@ class MainWindow : public QMainWindow
     void StopTimer();
 
     /**
-     * @brief MEthod used to record singe snapshot images while recording.
+     * @brief MEthod used to record singe snapshot images while recording. The snapshots are consecutive frames
+     * recorded by a sequence on the capture scheduler, the method returns right away.
      */
     void RecordSnapshots();
 
@@ -543,7 +698,7 @@ class MainWindow : public QMainWindow
 
     /**
      * @brief MainWindow::GetWritingFolder returns the folder there the image
-     * files are written to.
+     * files are written to. This is the staging folder when one is configured, otherwise the base folder.
      *
      * @return folder where data is to be stored.
      */
@@ -614,11 +769,6 @@ class MainWindow : public QMainWindow
      */
     void SetGraphicsViewScene();
 
-    /**
-     * Appends the current time to que of recorded time stamps that can be used to calculate the frames per second.
-     */
-    void RegisterTimeImageRecorded();
-
     /**
      * The file name where videos are to be stored.
      */
@@ -689,6 +839,11 @@ class MainWindow : public QMainWindow
      */
     QString m_maxSao2;
 
+    /**
+     * Publisher of the UI values that are read from worker threads.
+     */
+    UiSettingsPublisher m_uiSettings;
+
     /**
      * Image container where each new image from the camera is stored.
      */
@@ -699,6 +854,38 @@ class MainWindow : public QMainWindow
      */
     CameraInterface m_cameraInterface;
 
+    /**
+     * Reopens the camera when it drops out, such that the acquisition and recording resume.
+     */
+    CameraRecovery m_cameraRecovery{&m_cameraInterface};
+
+    /**
+     * Reduces the frame rate of the camera while it runs too hot, fed by the temperature thread.
+     */
+    ThermalGovernor m_thermalGovernor;
+
+    /**
+     * Records the class maps of the displayed images next to the recording, see GetClassMapRecorder.
+     */
+    ClassMapRecorder m_classMapRecorder;
+
+    /**
+     * Tracks the regions of interest on the displayed images, null when no region was given, see GetRoiTracking.
+     */
+    std::unique_ptr<RoiTrackingWorker> m_roiTracking;
+
+    /**
+     * Estimates the temporal noise of the displayed images, null when the estimation is disabled, see
+     * GetNoiseEstimator.
+     */
+    std::shared_ptr<TemporalNoiseEstimator> m_noiseEstimator;
+
+    /**
+     * Estimates the white balance of the displayed images of RGB cameras, null when no white balance was given, see
+     * GetWhiteBalance.
+     */
+    std::unique_ptr<WhiteBalanceEstimator> m_whiteBalance;
+
     /**
      * Wrapper to xiAPI, useful for mocking during testing.
      */
@@ -776,20 +963,53 @@ class MainWindow : public QMainWindow
      */
     boost::mutex m_mutexImageRecording;
 
+    /**
+     * Providers of the per-frame metadata stored with each recorded image. Registered again when a new camera is
+     * selected, the schema of the recordings is fixed afterwards. Replaced atomically, such that record tasks can
+     * sample the metadata without locking MainWindow::m_mutexImageRecording.
+     */
+    std::shared_ptr<const MetadataProviderRegistry> m_metadataProviders;
+
+    /**
+     * Compression settings of the recordings, the mosaic shape is updated when a new camera is selected.
+     */
+    CompressionOptions m_compressionOptions;
+
+    /**
+     * Moves recordings from the staging folder to the base folder in the background, only set when a staging folder
+     * is configured through the command line.
+     */
+    std::unique_ptr<ArchiveMigrator> m_archiveMigrator;
+
     /**
      * Camera temperature recording thread.
      */
     boost::thread m_temperatureThread;
 
     /**
-     * Snapshot image recording thread.
+     * Runs the sequences recording snapshots and white and dark references on the frame stream.
      */
-    boost::thread m_snapshotsThread;
+    CaptureScheduler m_captureScheduler;
 
     /**
-     * thread where white and dark references are recorded.
+     * Token of the sequence recording snapshots.
      */
-    boost::thread m_referenceRecordingThread;
+    CaptureToken m_snapshotsCapture;
+
+    /**
+     * Token of the sequence recording white or dark references.
+     */
+    CaptureToken m_referenceCapture;
+
+    /**
+     * Whether snapshots are being recorded, reset when the sequence completes.
+     */
+    std::atomic<bool> m_capturingSnapshots{false};
+
+    /**
+     * Whether references are being recorded, reset when the sequence completes.
+     */
+    std::atomic<bool> m_capturingReferences{false};
 
     /**
      * Thread containing the timer for temperature recording at certain intervals.
@@ -806,15 +1026,32 @@ class MainWindow : public QMainWindow
      */
     std::atomic<unsigned long> m_imageCounter;
 
+    /**
+     * Number of images received by the image container when the recording started. Used to compute how many images
+     * arrived during a recording.
+     */
+    unsigned long m_receivedImageCountAtStart = 0;
+
     /**
      * Counts how many images were skipped during the recording process.
      */
     std::atomic<unsigned long> m_skippedCounter;
 
     /**
-     * Container to store the time stamps when a new image is recorded. This is used to calculate the FPS.
+     * Number of record tasks posted to the IO service and not finished yet, reported to the recording file as the fill
+     * of its queue.
+     */
+    std::atomic<int> m_pendingRecordTasks{0};
+
+    /**
+     * Number of recorded images at the last update of the frames per second display.
      */
-    std::deque<std::chrono::steady_clock::time_point> m_recordedTimestamps;
+    unsigned long m_recordedCountAtLastFPSUpdate = 0;
+
+    /**
+     * Time of the last update of the frames per second display.
+     */
+    std::chrono::steady_clock::time_point m_lastFPSUpdateTime;
 
     /**
      * Smart pointer to the RGB scene where the RGB images will be displayed.
@@ -850,6 +1087,63 @@ class MainWindow : public QMainWindow
      * Timer that sets the rate of updates for the FPS LCD Display in the UI.
      */
     QTimer *m_updateFPSDisplayTimer;
+
+    /**
+     * Timer that sets the rate of updates for the recording telemetry (recorded images and elapsed time) in the UI.
+     */
+    QTimer *m_updateTelemetryTimer;
+
+    /**
+     * Control socket of the acquisition daemon the GUI is attached to, empty when the GUI acquires images itself.
+     */
+    std::string m_daemonSocket;
+
+    /**
+     * Path of the recording written by the acquisition daemon, empty when it is not recording.
+     */
+    std::string m_daemonRecordingPath;
+
+    /**
+     * Last exposure time set on the acquisition daemon.
+     */
+    int m_daemonExposureMs = 0;
+
+    /**
+     * Whether the GUI requested the acquisition daemon to record, the daemon confirms it later. Only accessed on the
+     * GUI thread.
+     */
+    bool m_daemonRecording = false;
+
+    /**
+     * Number of exposure requests sent to the acquisition daemon that were not answered yet, the exposure displayed is
+     * only updated from the reply of the last one. Only accessed on the GUI thread.
+     */
+    int m_pendingDaemonExposureRequests = 0;
+
+    /**
+     * Runs the requests to the acquisition daemon posted with MainWindow::PostDaemonRequest.
+     */
+    boost::asio::io_service m_daemonIOService;
+
+    /**
+     * Keeps the daemon request thread running while no request is pending.
+     */
+    std::unique_ptr<boost::asio::io_service::work> m_daemonIOWork;
+
+    /**
+     * Thread sending the requests to the acquisition daemon.
+     */
+    boost::thread m_daemonThread;
+
+    /**
+     * Thread in charge of displaying the previews published by the acquisition daemon.
+     */
+    boost::thread m_previewThread;
+
+    /**
+     * Indicates if the preview thread should keep running.
+     */
+    std::atomic<bool> m_previewThreadRunning{false};
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,162 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "metadataCodec.h"
+
+#include <unordered_map>
+
+/**
+ * Run-length encoding of a column, `values[i]` repeats `runs[i]` times
+ */
+template <typename T> struct Runs
+{
+    std::vector<T> values;
+    std::vector<int64_t> runs;
+};
+
+template <typename T> static Runs<T> EncodeRuns(const std::vector<T> &values)
+{
+    Runs<T> encoded;
+    for (size_t i = 0; i < values.size();)
+    {
+        size_t end = i + 1;
+        while (end < values.size() && values[end] == values[i])
+        {
+            end++;
+        }
+        encoded.values.push_back(values[i]);
+        encoded.runs.push_back(static_cast<int64_t>(end - i));
+        i = end;
+    }
+    return encoded;
+}
+
+template <typename T>
+static void PackRuns(msgpack::packer<msgpack::sbuffer> &packer, const Runs<T> &encoded, const char *encoding)
+{
+    packer.pack(std::string("encoding"));
+    packer.pack(std::string(encoding));
+    packer.pack(std::string("values"));
+    packer.pack(encoded.values);
+    packer.pack(std::string("runs"));
+    packer.pack(encoded.runs);
+}
+
+template <typename T> static void PackPlain(msgpack::packer<msgpack::sbuffer> &packer, const std::vector<T> &values)
+{
+    packer.pack_map(2);
+    packer.pack(std::string("encoding"));
+    packer.pack(std::string("plain"));
+    packer.pack(std::string("values"));
+    packer.pack(values);
+}
+
+void PackIntColumn(msgpack::packer<msgpack::sbuffer> &packer, const std::vector<int64_t> &values)
+{
+    Runs<int64_t> valueRuns = EncodeRuns(values);
+    std::vector<int64_t> deltas(values.empty() ? 0 : values.size() - 1);
+    for (size_t i = 1; i < values.size(); i++)
+    {
+        deltas[i - 1] = values[i] - values[i - 1];
+    }
+    Runs<int64_t> deltaRuns = EncodeRuns(deltas);
+
+    // each run stores two values, the delta encoding stores one more for the first value
+    const size_t rleSize = 2 * valueRuns.runs.size();
+    const size_t deltaSize = 2 * deltaRuns.runs.size() + 1;
+    if (values.size() <= std::min(rleSize, deltaSize))
+    {
+        PackPlain(packer, values);
+    }
+    else if (rleSize <= deltaSize)
+    {
+        packer.pack_map(3);
+        PackRuns(packer, valueRuns, "rle");
+    }
+    else
+    {
+        packer.pack_map(4);
+        PackRuns(packer, deltaRuns, "delta");
+        packer.pack(std::string("first"));
+        packer.pack(values.front());
+    }
+}
+
+void PackFloatColumn(msgpack::packer<msgpack::sbuffer> &packer, const std::vector<float> &values)
+{
+    Runs<float> valueRuns = EncodeRuns(values);
+    if (values.size() <= 2 * valueRuns.runs.size())
+    {
+        PackPlain(packer, values);
+        return;
+    }
+    packer.pack_map(3);
+    PackRuns(packer, valueRuns, "rle");
+}
+
+/**
+ * Packs a dictionary column from the distinct values, in order of appearance, and the index of each value
+ */
+static void PackDictionary(msgpack::packer<msgpack::sbuffer> &packer, const std::vector<std::string> &dictionary,
+                           const std::vector<int64_t> &indices)
+{
+    packer.pack_map(3);
+    packer.pack(std::string("encoding"));
+    packer.pack(std::string("dictionary"));
+    packer.pack(std::string("dictionary"));
+    packer.pack(dictionary);
+    packer.pack(std::string("indices"));
+    PackIntColumn(packer, indices);
+}
+
+void PackStringColumn(msgpack::packer<msgpack::sbuffer> &packer, const std::vector<std::string> &values)
+{
+    std::vector<std::string> dictionary;
+    std::unordered_map<std::string, int64_t> lookup;
+    std::vector<int64_t> indices;
+    indices.reserve(values.size());
+    for (const std::string &value : values)
+    {
+        auto inserted = lookup.emplace(value, static_cast<int64_t>(dictionary.size()));
+        if (inserted.second)
+        {
+            dictionary.push_back(value);
+        }
+        indices.push_back(inserted.first->second);
+    }
+    PackDictionary(packer, dictionary, indices);
+}
+
+void PackFormattedColumn(msgpack::packer<msgpack::sbuffer> &packer, const std::vector<int64_t> &values,
+                         const std::function<std::string(int64_t)> &formatter)
+{
+    std::vector<std::string> dictionary;
+    std::unordered_map<int64_t, int64_t> lookup;
+    std::vector<int64_t> indices;
+    indices.reserve(values.size());
+    for (int64_t value : values)
+    {
+        auto inserted = lookup.emplace(value, static_cast<int64_t>(dictionary.size()));
+        if (inserted.second)
+        {
+            if (dictionary.size() == METADATA_DICTIONARY_MAX_ENTRIES)
+            {
+                PackIntColumn(packer, values);
+                return;
+            }
+            dictionary.push_back(formatter(value));
+        }
+        indices.push_back(inserted.first->second);
+    }
+    PackDictionary(packer, dictionary, indices);
+}
+
+void PackColumnsHeader(msgpack::packer<msgpack::sbuffer> &packer, size_t width)
+{
+    packer.pack_map(2);
+    packer.pack(std::string("encoding"));
+    packer.pack(std::string("columns"));
+    packer.pack(std::string("columns"));
+    packer.pack_array(static_cast<uint32_t>(width));
+}
@@ -0,0 +1,331 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_METADATA_CODEC_H
+#define XILENS_METADATA_CODEC_H
+
+#include <b2nd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <msgpack.hpp>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Largest number of distinct values of a formatted column that is stored with a dictionary, columns with more
+ * distinct values, e.g. time stamps, are stored as integers.
+ */
+constexpr size_t METADATA_DICTIONARY_MAX_ENTRIES = 256;
+
+/**
+ * @brief Columnar encoding of per-frame metadata.
+ *
+ * Most per-frame metadata barely changes during a recording: frame counters grow by one, the exposure time only
+ * changes when the user changes it and the color filter array is the same for all frames. Instead of storing one value
+ * per frame, columns are stored as a msgpack map whose `encoding` entry selects the layout:
+ *  - `plain`: `values` holds all values.
+ *  - `rle`: the value `values[i]` repeats `runs[i]` times.
+ *  - `delta`: the column starts at `first`, the difference between consecutive values is run-length encoded in
+ *    `values` and `runs`. Counters and time stamps with a steady frame rate compress to a few runs.
+ *  - `dictionary`: the column holds `dictionary[i]` for each index `i` of `indices`, an integer column itself.
+ *  - `columns`: fields with several values per frame, `columns[j]` is the encoded column of the j-th value.
+ *
+ * Readers should use DecodeMetadataColumn or ReadMetadataColumn, which also accept plain msgpack arrays as written
+ * without the columnar encoding. Decoding is implemented in this header, such that the reader library does not depend
+ * on the xilens library, see xilensReader.h.
+ */
+
+/**
+ * Packs an integer column with the encoding that needs the fewest values: plain, `rle` or `delta`.
+ *
+ * @param packer destination of the encoded column
+ * @param values one value per frame
+ */
+void PackIntColumn(msgpack::packer<msgpack::sbuffer> &packer, const std::vector<int64_t> &values);
+
+/**
+ * Packs a floating point column, run-length encoded when values repeat.
+ *
+ * @param packer destination of the encoded column
+ * @param values one value per frame
+ */
+void PackFloatColumn(msgpack::packer<msgpack::sbuffer> &packer, const std::vector<float> &values);
+
+/**
+ * Packs a string column as a dictionary of its distinct values, in order of appearance.
+ *
+ * @param packer destination of the encoded column
+ * @param values one value per frame
+ */
+void PackStringColumn(msgpack::packer<msgpack::sbuffer> &packer, const std::vector<std::string> &values);
+
+/**
+ * Packs an integer column that is converted to strings for storage. Columns with at most
+ * METADATA_DICTIONARY_MAX_ENTRIES distinct values are stored as a dictionary of the formatted values, other columns
+ * are stored as integers.
+ *
+ * @param packer destination of the encoded column
+ * @param values one value per frame
+ * @param formatter conversion of the values to strings
+ */
+void PackFormattedColumn(msgpack::packer<msgpack::sbuffer> &packer, const std::vector<int64_t> &values,
+                         const std::function<std::string(int64_t)> &formatter);
+
+/**
+ * Starts a field with several values per frame, followed by one packed column per value.
+ *
+ * @param packer destination of the encoded field
+ * @param width number of values per frame
+ */
+void PackColumnsHeader(msgpack::packer<msgpack::sbuffer> &packer, size_t width);
+
+/**
+ * Decodes a column packed with any of the encodings above, or stored as a plain msgpack array.
+ *
+ * @tparam T value type of the column: int64_t, float or std::string
+ * @param object unpacked column
+ * @return one value per frame
+ * @throws std::runtime_error if the column is not a valid encoding of values of type T
+ */
+template <typename T> std::vector<T> DecodeMetadataColumn(const msgpack::object &object);
+
+/**
+ * Decodes a field with several values per frame, packed with PackColumnsHeader or stored as a plain msgpack array
+ * of arrays.
+ *
+ * @tparam T value type of the field: int64_t, float or std::string
+ * @param object unpacked field
+ * @return one array of values per frame
+ * @throws std::runtime_error if the field is not a valid encoding of values of type T
+ */
+template <typename T> std::vector<std::vector<T>> DecodeMetadataColumns(const msgpack::object &object);
+
+/**
+ * Reads and decodes a metadata column of a recording, see DecodeMetadataColumn.
+ *
+ * @param src BLOSC n-dimensional array where the metadata is stored
+ * @param key name of the metadata variable
+ * @throws std::runtime_error if the key does not exist or can not be decoded
+ */
+template <typename T> std::vector<T> ReadMetadataColumn(b2nd_array_t *src, const char *key);
+
+/**
+ * Reads and decodes a metadata field with several values per frame, see DecodeMetadataColumns.
+ *
+ * @param src BLOSC n-dimensional array where the metadata is stored
+ * @param key name of the metadata variable
+ * @throws std::runtime_error if the key does not exist or can not be decoded
+ */
+template <typename T> std::vector<std::vector<T>> ReadMetadataColumns(b2nd_array_t *src, const char *key);
+
+/**
+ * Expands a run-length encoded column, `values[i]` repeats `runs[i]` times
+ */
+template <typename T>
+inline std::vector<T> ExpandMetadataRuns(const std::vector<T> &values, const std::vector<int64_t> &runs)
+{
+    if (values.size() != runs.size())
+    {
+        throw std::runtime_error("Run-length encoded metadata has a different number of values and runs.");
+    }
+    int64_t total = 0;
+    for (int64_t run : runs)
+    {
+        if (run < 0)
+        {
+            throw std::runtime_error("Run-length encoded metadata has a negative run.");
+        }
+        total += run;
+    }
+    std::vector<T> expanded(static_cast<size_t>(total));
+    auto position = expanded.begin();
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        position = std::fill_n(position, runs[i], values[i]);
+    }
+    return expanded;
+}
+
+/**
+ * Looks up an entry of an encoded column
+ */
+inline const msgpack::object &GetMetadataEntry(const msgpack::object &map, const char *key)
+{
+    for (uint32_t i = 0; i < map.via.map.size; i++)
+    {
+        const msgpack::object_kv &entry = map.via.map.ptr[i];
+        if (entry.key.type == msgpack::type::STR && entry.key.via.str.size == std::char_traits<char>::length(key) &&
+            std::equal(entry.key.via.str.ptr, entry.key.via.str.ptr + entry.key.via.str.size, key))
+        {
+            return entry.val;
+        }
+    }
+    throw std::runtime_error(std::string("Encoded metadata column without entry: ") + key);
+}
+
+/**
+ * Decodes a delta encoded column, only integer columns are delta encoded
+ */
+inline std::vector<int64_t> DecodeMetadataDelta(const msgpack::object &map, std::vector<int64_t> *)
+{
+    std::vector<int64_t> deltas = ExpandMetadataRuns(GetMetadataEntry(map, "values").as<std::vector<int64_t>>(),
+                                                     GetMetadataEntry(map, "runs").as<std::vector<int64_t>>());
+    std::vector<int64_t> values(deltas.size() + 1);
+    values[0] = GetMetadataEntry(map, "first").as<int64_t>();
+    std::copy(deltas.begin(), deltas.end(), values.begin() + 1);
+    std::partial_sum(values.begin(), values.end(), values.begin());
+    return values;
+}
+
+template <typename T> inline std::vector<T> DecodeMetadataDelta(const msgpack::object &, std::vector<T> *)
+{
+    throw std::runtime_error("Delta encoded metadata can only be decoded as integers.");
+}
+
+/**
+ * Decodes a dictionary encoded column, only string columns are dictionary encoded
+ */
+inline std::vector<std::string> DecodeMetadataDictionary(const msgpack::object &map, std::vector<std::string> *)
+{
+    auto dictionary = GetMetadataEntry(map, "dictionary").as<std::vector<std::string>>();
+    std::vector<int64_t> indices = DecodeMetadataColumn<int64_t>(GetMetadataEntry(map, "indices"));
+    std::vector<std::string> values;
+    values.reserve(indices.size());
+    for (int64_t index : indices)
+    {
+        if (index < 0 || static_cast<size_t>(index) >= dictionary.size())
+        {
+            throw std::runtime_error("Dictionary encoded metadata has an index out of range.");
+        }
+        values.push_back(dictionary[static_cast<size_t>(index)]);
+    }
+    return values;
+}
+
+template <typename T> inline std::vector<T> DecodeMetadataDictionary(const msgpack::object &, std::vector<T> *)
+{
+    throw std::runtime_error("Dictionary encoded metadata can only be decoded as strings.");
+}
+
+/**
+ * Reads the name of the encoding of a column
+ */
+inline std::string GetMetadataEncoding(const msgpack::object &object)
+{
+    if (object.type != msgpack::type::MAP)
+    {
+        throw std::runtime_error("Unexpected type of encoded metadata column.");
+    }
+    return GetMetadataEntry(object, "encoding").as<std::string>();
+}
+
+template <typename T> inline std::vector<T> DecodeMetadataColumn(const msgpack::object &object)
+{
+    if (object.type == msgpack::type::ARRAY)
+    {
+        return object.as<std::vector<T>>();
+    }
+    std::string encoding = GetMetadataEncoding(object);
+    if (encoding == "plain")
+    {
+        return GetMetadataEntry(object, "values").as<std::vector<T>>();
+    }
+    if (encoding == "rle")
+    {
+        return ExpandMetadataRuns(GetMetadataEntry(object, "values").as<std::vector<T>>(),
+                                  GetMetadataEntry(object, "runs").as<std::vector<int64_t>>());
+    }
+    if (encoding == "delta")
+    {
+        return DecodeMetadataDelta(object, static_cast<std::vector<T> *>(nullptr));
+    }
+    if (encoding == "dictionary")
+    {
+        return DecodeMetadataDictionary(object, static_cast<std::vector<T> *>(nullptr));
+    }
+    throw std::runtime_error("Unknown encoding of metadata column: " + encoding);
+}
+
+template <typename T> inline std::vector<std::vector<T>> DecodeMetadataColumns(const msgpack::object &object)
+{
+    if (object.type == msgpack::type::ARRAY)
+    {
+        return object.as<std::vector<std::vector<T>>>();
+    }
+    if (GetMetadataEncoding(object) != "columns")
+    {
+        throw std::runtime_error("Metadata field with several values per frame was expected.");
+    }
+    const msgpack::object &columns = GetMetadataEntry(object, "columns");
+    if (columns.type != msgpack::type::ARRAY)
+    {
+        throw std::runtime_error("Unexpected type of encoded metadata columns.");
+    }
+    std::vector<std::vector<T>> frames;
+    for (uint32_t j = 0; j < columns.via.array.size; j++)
+    {
+        std::vector<T> column = DecodeMetadataColumn<T>(columns.via.array.ptr[j]);
+        if (j == 0)
+        {
+            frames.resize(column.size(), std::vector<T>(columns.via.array.size));
+        }
+        else if (column.size() != frames.size())
+        {
+            throw std::runtime_error("Encoded metadata columns have different lengths.");
+        }
+        for (size_t i = 0; i < column.size(); i++)
+        {
+            frames[i][j] = column[i];
+        }
+    }
+    return frames;
+}
+
+/**
+ * Reads and unpacks variable length metadata without depending on the xilens library
+ */
+inline msgpack::object_handle ReadMetadataObject(b2nd_array_t *src, const char *key)
+{
+    if (blosc2_vlmeta_exists(src->sc, key) < 0)
+    {
+        throw std::runtime_error(std::string("Metadata not found: ") + key);
+    }
+    uint8_t *content = nullptr;
+    int32_t contentLength = 0;
+    if (blosc2_vlmeta_get(src->sc, key, &content, &contentLength) < 0)
+    {
+        throw std::runtime_error(std::string("Could not read metadata: ") + key);
+    }
+    msgpack::object_handle handle;
+    try
+    {
+        handle = msgpack::unpack(reinterpret_cast<const char *>(content), contentLength);
+    }
+    catch (...)
+    {
+        free(content);
+        throw;
+    }
+    free(content);
+    return handle;
+}
+
+template <typename T> inline std::vector<T> ReadMetadataColumn(b2nd_array_t *src, const char *key)
+{
+    msgpack::object_handle handle = ReadMetadataObject(src, key);
+    return DecodeMetadataColumn<T>(handle.get());
+}
+
+template <typename T> inline std::vector<std::vector<T>> ReadMetadataColumns(b2nd_array_t *src, const char *key)
+{
+    msgpack::object_handle handle = ReadMetadataObject(src, key);
+    return DecodeMetadataColumns<T>(handle.get());
+}
+
+#endif // XILENS_METADATA_CODEC_H
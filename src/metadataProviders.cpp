@@ -0,0 +1,129 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "metadataProviders.h"
+
+#include <QDateTime>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+
+#include "constants.h"
+#include "util.h"
+
+size_t MetadataSchema::AddIntField(const std::string &key, size_t width, std::function<std::string(int64_t)> formatter)
+{
+    return AddField(key, MetadataFieldType::Int64, width, std::move(formatter));
+}
+
+size_t MetadataSchema::AddFloatField(const std::string &key, size_t width)
+{
+    return AddField(key, MetadataFieldType::Float32, width, nullptr);
+}
+
+size_t MetadataSchema::AddField(const std::string &key, MetadataFieldType type, size_t width,
+                                std::function<std::string(int64_t)> formatter)
+{
+    if (this->Contains(key))
+    {
+        throw std::invalid_argument("Metadata field already declared: " + key);
+    }
+    if (width == 0)
+    {
+        throw std::invalid_argument("Metadata field width must be larger than zero: " + key);
+    }
+    size_t &size = type == MetadataFieldType::Int64 ? m_intSize : m_floatSize;
+    size_t offset = size;
+    size += width;
+    m_fields.push_back({key, type, offset, width, std::move(formatter)});
+    return offset;
+}
+
+const std::vector<MetadataField> &MetadataSchema::GetFields() const
+{
+    return m_fields;
+}
+
+FrameMetadataRecord MetadataSchema::CreateRecord() const
+{
+    FrameMetadataRecord record;
+    record.intValues.assign(m_intSize, 0);
+    record.floatValues.assign(m_floatSize, 0.f);
+    return record;
+}
+
+bool MetadataSchema::Contains(const std::string &key) const
+{
+    for (const auto &field : m_fields)
+    {
+        if (field.key == key)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MetadataProviderRegistry::Register(std::shared_ptr<MetadataProvider> provider)
+{
+    provider->DeclareFields(m_schema);
+    m_providers.push_back(std::move(provider));
+}
+
+const MetadataSchema &MetadataProviderRegistry::GetSchema() const
+{
+    return m_schema;
+}
+
+void MetadataProviderRegistry::Sample(const XI_IMG &image, FrameMetadataRecord &record) const
+{
+    for (const auto &provider : m_providers)
+    {
+        provider->Sample(image, record);
+    }
+}
+
+void ImageMetadataProvider::DeclareFields(MetadataSchema &schema)
+{
+    m_exposureOffset = schema.AddIntField(EXPOSURE_KEY);
+    m_frameNumberOffset = schema.AddIntField(FRAME_NUMBER_KEY);
+    m_colorFilterArrayOffset = schema.AddIntField(COLOR_FILTER_ARRAY_FORMAT_KEY, 1, [](int64_t value) {
+        return ColorFilterToString(static_cast<XI_COLOR_FILTER_ARRAY>(value));
+    });
+    m_timeStampOffset = schema.AddIntField(TIME_STAMP_KEY, 1, FormatTimeStampMilliseconds);
+}
+
+void ImageMetadataProvider::Sample(const XI_IMG &image, FrameMetadataRecord &record) const
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    record.intValues[m_exposureOffset] = image.exposure_time_us;
+    record.intValues[m_frameNumberOffset] = image.acq_nframe;
+    record.intValues[m_colorFilterArrayOffset] = image.color_filter_array;
+    record.intValues[m_timeStampOffset] = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+}
+
+void CameraTemperatureProvider::DeclareFields(MetadataSchema &schema)
+{
+    m_offsets.clear();
+    for (const QString &key : TEMPERATURE_KEYS)
+    {
+        m_offsets.push_back(schema.AddFloatField(key.toStdString()));
+    }
+}
+
+void CameraTemperatureProvider::Sample(const XI_IMG &image, FrameMetadataRecord &record) const
+{
+    (void)image;
+    const CameraFamily *family = m_cameraFamily->get();
+    for (size_t i = 0; i < m_offsets.size(); i++)
+    {
+        record.floatValues[m_offsets[i]] = family != nullptr ? family->GetLatestTemperature(i)
+                                                             : std::numeric_limits<float>::quiet_NaN();
+    }
+}
+
+std::string FormatTimeStampMilliseconds(int64_t millisecondsSinceEpoch)
+{
+    return QDateTime::fromMSecsSinceEpoch(millisecondsSinceEpoch).toString("yyyyMMdd_hh-mm-ss-zzz").toStdString();
+}
@@ -0,0 +1,282 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_METADATA_PROVIDERS_H
+#define XILENS_METADATA_PROVIDERS_H
+
+#include <xiApi.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+
+/**
+ * @brief Storage type of a per-frame metadata field.
+ */
+enum class MetadataFieldType
+{
+    Int64,
+    Float32
+};
+
+/**
+ * @brief Description of a single per-frame metadata field.
+ *
+ * Each field stores `width` values per frame, e.g. one value for the exposure time or one value per band for the
+ * band means. Integer fields can provide a formatter that converts each value to a string when the metadata is written
+ * to file, this allows storing enumerations and time stamps as integers while recording.
+ */
+struct MetadataField
+{
+    /**
+     * Key used to identify the field in the variable length metadata of the recording.
+     */
+    std::string key;
+
+    /**
+     * Storage type of the field.
+     */
+    MetadataFieldType type;
+
+    /**
+     * Offset of the first value of the field inside FrameMetadataRecord::intValues or FrameMetadataRecord::floatValues
+     * depending on the type of the field.
+     */
+    size_t offset;
+
+    /**
+     * Number of values stored per frame.
+     */
+    size_t width;
+
+    /**
+     * Optional formatter used to convert integer values to strings when the metadata is written to file.
+     */
+    std::function<std::string(int64_t)> formatter;
+};
+
+/**
+ * @brief Pre-allocated container for the metadata of a single frame.
+ *
+ * Instances are created once through MetadataSchema::CreateRecord and reused for every frame, such that sampling the
+ * metadata of a frame does not allocate memory.
+ */
+struct FrameMetadataRecord
+{
+    /**
+     * Values of all integer fields.
+     */
+    std::vector<int64_t> intValues;
+
+    /**
+     * Values of all floating point fields.
+     */
+    std::vector<float> floatValues;
+};
+
+/**
+ * @brief Fixed set of per-frame metadata fields declared at the start of a recording.
+ */
+class MetadataSchema
+{
+  public:
+    /**
+     * Declares a new integer field.
+     *
+     * @param key key used to identify the field in the metadata of the recording.
+     * @param width number of values stored per frame.
+     * @param formatter optional function used to store the values as strings.
+     * @return offset of the field inside FrameMetadataRecord::intValues.
+     * @throws std::invalid_argument if the key was already declared.
+     */
+    size_t AddIntField(const std::string &key, size_t width = 1,
+                       std::function<std::string(int64_t)> formatter = nullptr);
+
+    /**
+     * Declares a new floating point field.
+     *
+     * @param key key used to identify the field in the metadata of the recording.
+     * @param width number of values stored per frame.
+     * @return offset of the field inside FrameMetadataRecord::floatValues.
+     * @throws std::invalid_argument if the key was already declared.
+     */
+    size_t AddFloatField(const std::string &key, size_t width = 1);
+
+    /**
+     * Queries all declared fields in order of declaration.
+     */
+    const std::vector<MetadataField> &GetFields() const;
+
+    /**
+     * Creates a record with enough space for all declared fields.
+     */
+    FrameMetadataRecord CreateRecord() const;
+
+    /**
+     * Checks if a field with the given key was declared.
+     *
+     * @param key key to look for.
+     */
+    bool Contains(const std::string &key) const;
+
+  private:
+    /**
+     * Appends a new field after validating that the key is unique.
+     */
+    size_t AddField(const std::string &key, MetadataFieldType type, size_t width,
+                    std::function<std::string(int64_t)> formatter);
+
+    /**
+     * Declared fields.
+     */
+    std::vector<MetadataField> m_fields;
+
+    /**
+     * Number of integer values stored per frame.
+     */
+    size_t m_intSize = 0;
+
+    /**
+     * Number of floating point values stored per frame.
+     */
+    size_t m_floatSize = 0;
+};
+
+/**
+ * @brief Base class of all per-frame metadata providers.
+ *
+ * Providers declare their fields once through MetadataProvider::DeclareFields and remember the offsets returned by the
+ * schema. For every recorded frame MetadataProvider::Sample is called, implementations must only write to their own
+ * offsets of the record and must not allocate memory. Sampling can happen from several threads at the same time, each
+ * with its own record.
+ */
+class MetadataProvider
+{
+  public:
+    virtual ~MetadataProvider() = default;
+
+    /**
+     * Declares the fields written by this provider.
+     *
+     * @param schema schema where the fields are declared.
+     */
+    virtual void DeclareFields(MetadataSchema &schema) = 0;
+
+    /**
+     * Writes the metadata of a frame to the record.
+     *
+     * @param image image for which the metadata is sampled.
+     * @param record pre-allocated record where values are written.
+     */
+    virtual void Sample(const XI_IMG &image, FrameMetadataRecord &record) const = 0;
+};
+
+/**
+ * @brief Registry of the metadata providers used for recordings.
+ *
+ * Providers are registered once, typically when the application starts, and the schema of the recordings is built
+ * incrementally on registration. Providers can not be added while a recording is running.
+ */
+class MetadataProviderRegistry
+{
+  public:
+    /**
+     * Registers a provider and declares its fields in the schema.
+     *
+     * @param provider provider to register.
+     */
+    void Register(std::shared_ptr<MetadataProvider> provider);
+
+    /**
+     * Queries the schema built from all registered providers.
+     */
+    const MetadataSchema &GetSchema() const;
+
+    /**
+     * Samples the metadata of a frame from all registered providers.
+     *
+     * @param image image for which the metadata is sampled.
+     * @param record record created through MetadataSchema::CreateRecord of this registry's schema.
+     */
+    void Sample(const XI_IMG &image, FrameMetadataRecord &record) const;
+
+  private:
+    /**
+     * Registered providers.
+     */
+    std::vector<std::shared_ptr<MetadataProvider>> m_providers;
+
+    /**
+     * Schema built from all registered providers.
+     */
+    MetadataSchema m_schema;
+};
+
+/**
+ * @brief Provides the metadata contained in the XIMEA image: exposure time, frame number, color filter array and the
+ * time stamp when the image was recorded.
+ */
+class ImageMetadataProvider : public MetadataProvider
+{
+  public:
+    void DeclareFields(MetadataSchema &schema) override;
+
+    void Sample(const XI_IMG &image, FrameMetadataRecord &record) const override;
+
+  private:
+    size_t m_exposureOffset = 0;
+    size_t m_frameNumberOffset = 0;
+    size_t m_colorFilterArrayOffset = 0;
+    size_t m_timeStampOffset = 0;
+};
+
+/**
+ * @brief Provides the latest camera temperature values queried by the temperature thread.
+ *
+ * Temperature is not queried from the camera for every frame, instead the values cached by
+ * CameraFamily::UpdateCameraTemperature are used. Temperatures the camera family does not report
+ * are recorded as NaN.
+ */
+class CameraTemperatureProvider : public MetadataProvider
+{
+  public:
+    /**
+     * Constructs the provider.
+     *
+     * @param family pointer to the camera family of the camera interface. The pointed family can change when a new
+     * camera is selected.
+     */
+    explicit CameraTemperatureProvider(std::unique_ptr<CameraFamily> *family) : m_cameraFamily(family)
+    {
+    }
+
+    void DeclareFields(MetadataSchema &schema) override;
+
+    void Sample(const XI_IMG &image, FrameMetadataRecord &record) const override;
+
+  private:
+    /**
+     * Camera family used to query the temperature.
+     */
+    std::unique_ptr<CameraFamily> *m_cameraFamily;
+
+    /**
+     * Offset of the first temperature value in the record.
+     */
+    std::vector<size_t> m_offsets;
+};
+
+/**
+ * Formats a time stamp in milliseconds since epoch with the format `yyyyMMdd_hh-mm-ss-zzz` in local time.
+ *
+ * @param millisecondsSinceEpoch time stamp to format.
+ * @return formatted time stamp.
+ */
+std::string FormatTimeStampMilliseconds(int64_t millisecondsSinceEpoch);
+
+#endif // XILENS_METADATA_PROVIDERS_H
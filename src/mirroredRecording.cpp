@@ -0,0 +1,161 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "mirroredRecording.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "logger.h"
+
+MirroredFileImage::MirroredFileImage(const std::vector<std::string> &filePaths, unsigned int imageHeight,
+                                     unsigned int imageWidth, const MetadataSchema &schema,
+                                     const CompressionOptions &compression, size_t queueCapacity, int maxLagMs)
+    : m_filePaths(filePaths), m_compressor(imageHeight, imageWidth, compression), m_maxLag(maxLagMs)
+{
+    if (filePaths.empty())
+    {
+        throw std::invalid_argument("A mirrored recording needs at least one destination.");
+    }
+    if (compression.adaptive)
+    {
+        throw std::invalid_argument("Mirrored recordings can not adapt their compression, the images are compressed "
+                                    "once for all destinations.");
+    }
+    for (const auto &filePath : filePaths)
+    {
+        auto file = std::make_unique<FileImage>(filePath.c_str(), imageHeight, imageWidth, schema);
+        if (compression.columnarMetadata)
+        {
+            file->EnableColumnarMetadata();
+        }
+        if (compression.locoCodec)
+        {
+            // the chunks are compressed by m_compressor, the destinations store the mosaic to be reopened
+            file->UseLocoCodec(compression.mosaicWidth, compression.mosaicHeight);
+        }
+        // the slots only hold compressed images, they are allocated on first use
+        m_mirrors.push_back(std::make_unique<WriterQueue>(std::move(file), queueCapacity, 0, 0));
+    }
+    m_healthy.assign(filePaths.size(), true);
+    m_errors.resize(filePaths.size());
+}
+
+MirroredFileImage::~MirroredFileImage()
+{
+    for (size_t i = 0; i < m_mirrors.size(); i++)
+    {
+        if (!m_healthy[i])
+        {
+            // the writer thread of a hung destination may never return, it is not waited for
+            std::shared_ptr<WriterQueue> mirror(std::move(m_mirrors[i]));
+            boost::thread([mirror]() mutable { mirror.reset(); }).detach();
+        }
+    }
+}
+
+void MirroredFileImage::WriteImageData(const XI_IMG &image, const FrameMetadataRecord &record)
+{
+    CheckHealthyMirrors();
+    m_compressor.Compress(image, m_chunk);
+    for (size_t i = 0; i < m_mirrors.size(); i++)
+    {
+        if (!m_healthy[i])
+        {
+            continue;
+        }
+        try
+        {
+            if (i == 0)
+            {
+                m_mirrors[i]->WriteCompressedImageData(m_chunk, record);
+            }
+            else if (!m_mirrors[i]->TryWriteCompressedImageData(m_chunk, record, m_maxLag))
+            {
+                MarkFailed(i, "the destination lags more than " + std::to_string(m_maxLag.count()) +
+                                  " ms behind the recording");
+            }
+        }
+        catch (const std::exception &e)
+        {
+            MarkFailed(i, e.what());
+        }
+    }
+    CheckHealthyMirrors();
+}
+
+void MirroredFileImage::AppendMetadata()
+{
+    for (size_t i = 0; i < m_mirrors.size(); i++)
+    {
+        if (!m_healthy[i])
+        {
+            continue;
+        }
+        try
+        {
+            m_mirrors[i]->AppendMetadata();
+        }
+        catch (const std::exception &e)
+        {
+            MarkFailed(i, e.what());
+        }
+    }
+    for (const auto &status : GetMirrorStatus())
+    {
+        std::stringstream checksum;
+        checksum << std::hex << std::setw(8) << std::setfill('0') << status.checksum;
+        LOG_XILENS(info) << "Mirror " << status.filePath << ": " << (status.healthy ? "healthy" : "failed") << ", "
+                         << status.writtenImages << " images, CRC32 " << checksum.str();
+    }
+    CheckHealthyMirrors();
+}
+
+std::string MirroredFileImage::GetFilePath() const
+{
+    return m_filePaths.front();
+}
+
+std::vector<MirrorStatus> MirroredFileImage::GetMirrorStatus()
+{
+    std::vector<MirrorStatus> mirrorStatus;
+    for (size_t i = 0; i < m_mirrors.size(); i++)
+    {
+        WriterQueueStatus queueStatus = m_mirrors[i]->GetStatus();
+        MirrorStatus status;
+        status.filePath = m_filePaths[i];
+        status.healthy = m_healthy[i] && !queueStatus.failed;
+        status.pendingImages = queueStatus.pendingImages;
+        status.writtenImages = queueStatus.writtenImages;
+        status.checksum = queueStatus.checksum;
+        status.error = m_errors[i].empty() ? queueStatus.error : m_errors[i];
+        mirrorStatus.push_back(status);
+    }
+    return mirrorStatus;
+}
+
+bool MirroredFileImage::HasIncident() const
+{
+    return std::find(m_healthy.begin(), m_healthy.end(), false) != m_healthy.end();
+}
+
+void MirroredFileImage::MarkFailed(size_t index, const std::string &error)
+{
+    m_healthy[index] = false;
+    m_errors[index] = error;
+    // the images still queued are not written, the copy of this destination is incomplete anyway
+    m_mirrors[index]->Discard();
+    LOG_XILENS(error) << "Mirror " << m_filePaths[index]
+                      << " failed, the recording continues on the remaining mirrors: " << error;
+}
+
+void MirroredFileImage::CheckHealthyMirrors() const
+{
+    if (std::find(m_healthy.begin(), m_healthy.end(), true) == m_healthy.end())
+    {
+        throw std::runtime_error("All mirrors of recording " + m_filePaths.front() + " failed.");
+    }
+}
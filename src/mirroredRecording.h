@@ -0,0 +1,141 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_MIRRORED_RECORDING_H
+#define XILENS_MIRRORED_RECORDING_H
+
+#include <xiApi.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "recordingFile.h"
+#include "util.h"
+#include "writerQueue.h"
+
+/**
+ * @brief Health of one destination of a mirrored recording.
+ */
+struct MirrorStatus
+{
+    std::string filePath;
+
+    /**
+     * Whether the destination is still written, a destination that failed once is not written again.
+     */
+    bool healthy = true;
+
+    /**
+     * Images queued for this destination and not written yet.
+     */
+    size_t pendingImages = 0;
+
+    size_t writtenImages = 0;
+
+    /**
+     * CRC32 of the compressed images written to this destination, equal for all healthy destinations.
+     */
+    uint32_t checksum = 0;
+
+    /**
+     * Description of the failure, empty for healthy destinations.
+     */
+    std::string error;
+};
+
+/**
+ * @brief Recording written to several destinations at acquisition time, e.g. for studies that require two copies.
+ *
+ * Each image is compressed once with FrameCompressor and the same chunk is queued to one WriterQueue per destination,
+ * such that mirroring does not compress images twice. A destination that fails is dropped and the recording continues
+ * on the remaining ones, the incident is logged and reported by MirroredFileImage::HasIncident.
+ *
+ * Only the first destination applies back-pressure to the acquisition. The other ones are mirrors: a mirror whose
+ * queue stays full for longer than the allowed lag, e.g. a slow or hung network share, is dropped like a failed one.
+ */
+class MirroredFileImage : public RecordingFile
+{
+  public:
+    /**
+     * Opens one `.b2nd` file per destination.
+     *
+     * @param filePaths paths of the files, the first one identifies the recording.
+     * @param imageHeight height of the images.
+     * @param imageWidth width of the images.
+     * @param schema per-frame metadata fields recorded with each image.
+     * @param compression compression settings of the destinations, the codec of the shared chunks and the encoding of
+     * the metadata are applied to each of them.
+     * @param queueCapacity number of images that can wait in the queue of each destination.
+     * @param maxLagMs time in milliseconds a mirror can block the recording while its queue is full.
+     * @throws std::invalid_argument if no path is given or if adaptive compression is requested.
+     */
+    MirroredFileImage(const std::vector<std::string> &filePaths, unsigned int imageHeight, unsigned int imageWidth,
+                      const MetadataSchema &schema, const CompressionOptions &compression = CompressionOptions(),
+                      size_t queueCapacity = WRITER_QUEUE_CAPACITY, int maxLagMs = MIRROR_MAX_LAG_MS);
+
+    /**
+     * Waits for the healthy destinations to write their queued images. Dropped mirrors are released on a background
+     * thread, such that a hung destination does not block closing the recording.
+     */
+    ~MirroredFileImage() override;
+
+    /**
+     * Compresses the image and queues it to all healthy destinations.
+     *
+     * @param image Ximea image where data is stored
+     * @param record metadata of the image
+     * @throws std::runtime_error if all destinations failed.
+     */
+    void WriteImageData(const XI_IMG &image, const FrameMetadataRecord &record) override;
+
+    /**
+     * Waits for all destinations to be written, appends their metadata and logs the status of each destination.
+     *
+     * @throws std::runtime_error if all destinations failed.
+     */
+    void AppendMetadata() override;
+
+    /**
+     * Queries the path of the first destination.
+     */
+    std::string GetFilePath() const override;
+
+    /**
+     * Queries the health, lag and checksum of each destination. Needs to be called from the thread writing the images
+     * or while it is not writing.
+     */
+    std::vector<MirrorStatus> GetMirrorStatus();
+
+    /**
+     * Whether any destination failed during the recording.
+     */
+    bool HasIncident() const;
+
+  private:
+    /**
+     * Drops a destination from the recording and flags the incident.
+     */
+    void MarkFailed(size_t index, const std::string &error);
+
+    /**
+     * Throws if no destination is healthy.
+     */
+    void CheckHealthyMirrors() const;
+
+    std::vector<std::string> m_filePaths;
+    std::vector<std::unique_ptr<WriterQueue>> m_mirrors;
+    std::vector<bool> m_healthy;
+    std::vector<std::string> m_errors;
+    FrameCompressor m_compressor;
+    boost::chrono::milliseconds m_maxLag;
+
+    /**
+     * Compressed image reused for all frames
+     */
+    std::vector<uint8_t> m_chunk;
+};
+
+#endif // XILENS_MIRRORED_RECORDING_H
@@ -0,0 +1,144 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "nearLossless.h"
+
+#include <b2nd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+
+#include "constants.h"
+#include "util.h"
+
+double SensorNoiseModel::GetNoise(double value) const
+{
+    return std::sqrt(readNoise * readNoise + gain * std::max(value, 0.0));
+}
+
+NearLosslessQuantizer::NearLosslessQuantizer(const SensorNoiseModel &noiseModel, double tolerance)
+    : m_noiseModel(noiseModel), m_tolerance(tolerance), m_values(UINT16_MAX + 1), m_droppedBits(UINT16_MAX + 1)
+{
+    if (tolerance < 0 || noiseModel.readNoise < 0 || noiseModel.gain < 0)
+    {
+        throw std::invalid_argument("The noise model and tolerance of the near-lossless mode can not be negative.");
+    }
+    for (uint32_t value = 0; value <= UINT16_MAX; value++)
+    {
+        const double allowedError = tolerance * noiseModel.GetNoise(value);
+        unsigned int bits = 0;
+        while (bits < 15 && static_cast<double>(1u << bits) <= allowedError)
+        {
+            bits++;
+        }
+        m_droppedBits[value] = static_cast<uint8_t>(bits);
+        // the dropped bits are replaced by the center of the quantization step
+        m_values[value] = static_cast<uint16_t>(bits == 0 ? value : ((value >> bits) << bits) | (1u << (bits - 1)));
+    }
+}
+
+unsigned int NearLosslessQuantizer::Quantize(uint16_t *pixels, size_t nPixels) const
+{
+    unsigned int maxBits = 0;
+    for (size_t i = 0; i < nPixels; i++)
+    {
+        maxBits = std::max<unsigned int>(maxBits, m_droppedBits[pixels[i]]);
+        pixels[i] = m_values[pixels[i]];
+    }
+    return maxBits == 0 ? 0 : 1u << (maxBits - 1);
+}
+
+unsigned int NearLosslessQuantizer::GetMaxError(uint16_t value) const
+{
+    return m_droppedBits[value] == 0 ? 0 : 1u << (m_droppedBits[value] - 1);
+}
+
+const SensorNoiseModel &NearLosslessQuantizer::GetNoiseModel() const
+{
+    return m_noiseModel;
+}
+
+double NearLosslessQuantizer::GetTolerance() const
+{
+    return m_tolerance;
+}
+
+/**
+ * Reads a frame of an array of 16 bit images
+ */
+static void ReadFrame(b2nd_array_t *src, int64_t index, std::vector<uint16_t> &frame)
+{
+    int64_t frameShape[] = {1, src->shape[1], src->shape[2]};
+    frame.resize(static_cast<size_t>(src->shape[1] * src->shape[2]));
+    int64_t start[] = {index, 0, 0};
+    int64_t stop[] = {index + 1, src->shape[1], src->shape[2]};
+    int result = b2nd_get_slice_cbuffer(src, start, stop, frame.data(), frameShape,
+                                        static_cast<int64_t>(frame.size() * sizeof(uint16_t)));
+    HandleBLOSCResult(result, "b2nd_get_slice_cbuffer");
+}
+
+NearLosslessReport VerifyNearLossless(const std::string &originalPath, const std::string &copyPath)
+{
+    b2nd_array_t *original;
+    int result = b2nd_open(originalPath.c_str(), &original);
+    HandleBLOSCResult(result, "b2nd_open");
+    b2nd_array_t *copy;
+    result = b2nd_open(copyPath.c_str(), &copy);
+    if (result != 0)
+    {
+        b2nd_free(original);
+        HandleBLOSCResult(result, "b2nd_open");
+    }
+
+    NearLosslessReport report;
+    try
+    {
+        if (original->ndim != 3 || copy->ndim != 3 || original->sc->typesize != sizeof(uint16_t) ||
+            !std::equal(original->shape, original->shape + 3, copy->shape))
+        {
+            throw std::runtime_error("the copy does not have the shape of the original");
+        }
+        auto parameters = GetBLOSCVLMetadata(copy, NEAR_LOSSLESS_KEY).get().as<std::map<std::string, double>>();
+        SensorNoiseModel noiseModel;
+        noiseModel.readNoise = parameters.at("read_noise");
+        noiseModel.gain = parameters.at("gain");
+        NearLosslessQuantizer quantizer(noiseModel, parameters.at("tolerance"));
+
+        std::vector<uint16_t> originalFrame;
+        std::vector<uint16_t> copyFrame;
+        for (int64_t i = 0; i < original->shape[0]; i++)
+        {
+            ReadFrame(original, i, originalFrame);
+            ReadFrame(copy, i, copyFrame);
+            for (size_t j = 0; j < originalFrame.size(); j++)
+            {
+                auto error = static_cast<unsigned int>(std::abs(static_cast<int>(copyFrame[j]) - originalFrame[j]));
+                unsigned int bound = quantizer.GetMaxError(originalFrame[j]);
+                report.maxError = std::max(report.maxError, error);
+                report.maxBound = std::max(report.maxBound, bound);
+                report.violations += error > bound;
+            }
+            report.frames++;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        b2nd_free(original);
+        b2nd_free(copy);
+        throw std::runtime_error("Could not verify " + copyPath + ": " + e.what());
+    }
+    b2nd_free(original);
+    b2nd_free(copy);
+    return report;
+}
+
+void WriteNearLosslessReport(const NearLosslessReport &report, std::ostream &stream)
+{
+    stream << "frames: " << report.frames << "\n";
+    stream << "max error: " << report.maxError << "\n";
+    stream << "max bound: " << report.maxBound << "\n";
+    stream << "pixels exceeding the bound: " << report.violations << "\n";
+}
@@ -0,0 +1,121 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_NEAR_LOSSLESS_H
+#define XILENS_NEAR_LOSSLESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Noise of the raw values of a sensor, the sum of read noise and shot noise.
+ */
+struct SensorNoiseModel
+{
+    /**
+     * Standard deviation of the read noise in digital numbers (DN).
+     */
+    double readNoise = 0;
+
+    /**
+     * Conversion gain in DN per electron, the variance of the shot noise of a value `x` is `gain * x`.
+     */
+    double gain = 0;
+
+    /**
+     * Computes the standard deviation of the noise of a raw value.
+     */
+    double GetNoise(double value) const;
+};
+
+/**
+ * @brief Quantizes raw values with a step below the noise of the sensor.
+ *
+ * Each value drops the `b` least significant bits for which half of the quantization step, `2^(b - 1)`, stays within
+ * `tolerance` times the noise of the value, and is reconstructed at the center of the step. The absolute error of a
+ * value is therefore bounded by `2^(b - 1) <= tolerance * noise`. Bright values, dominated by shot noise, lose more
+ * bits than dark ones. The dropped bits are constant, which makes the bit planes after bit shuffle highly compressible.
+ */
+class NearLosslessQuantizer
+{
+  public:
+    /**
+     * Computes the quantization of all 16 bit values.
+     *
+     * @param noiseModel noise of the sensor.
+     * @param tolerance maximum error as a fraction of the standard deviation of the noise.
+     * @throws std::invalid_argument if the tolerance or the noise model is negative.
+     */
+    NearLosslessQuantizer(const SensorNoiseModel &noiseModel, double tolerance);
+
+    /**
+     * Quantizes the pixels of an image in place.
+     *
+     * @return maximum error bound of the quantized pixels.
+     */
+    unsigned int Quantize(uint16_t *pixels, size_t nPixels) const;
+
+    /**
+     * Queries the maximum absolute error of a value after quantization.
+     */
+    unsigned int GetMaxError(uint16_t value) const;
+
+    const SensorNoiseModel &GetNoiseModel() const;
+
+    double GetTolerance() const;
+
+  private:
+    SensorNoiseModel m_noiseModel;
+    double m_tolerance;
+
+    /**
+     * Quantized value and number of dropped bits of each 16 bit value.
+     */
+    std::vector<uint16_t> m_values;
+    std::vector<uint8_t> m_droppedBits;
+};
+
+/**
+ * @brief Result of the comparison of a near-lossless copy with its original.
+ */
+struct NearLosslessReport
+{
+    int64_t frames = 0;
+
+    /**
+     * Largest absolute error found in the copy.
+     */
+    unsigned int maxError = 0;
+
+    /**
+     * Largest error allowed by the noise model stored in the copy.
+     */
+    unsigned int maxBound = 0;
+
+    /**
+     * Number of pixels whose error exceeds the bound of their original value.
+     */
+    uint64_t violations = 0;
+};
+
+/**
+ * Compares a near-lossless copy of a `.b2nd` file with the original, the error of each pixel is checked against the
+ * bound computed from the noise model stored in the metadata of the copy under NEAR_LOSSLESS_KEY.
+ *
+ * @param originalPath path to the original file.
+ * @param copyPath path to the near-lossless copy.
+ * @throws std::runtime_error if the files can not be read, do not have the same shape or the copy is not
+ * near-lossless.
+ */
+NearLosslessReport VerifyNearLossless(const std::string &originalPath, const std::string &copyPath);
+
+/**
+ * Writes a summary of a NearLosslessReport.
+ */
+void WriteNearLosslessReport(const NearLosslessReport &report, std::ostream &stream);
+
+#endif // XILENS_NEAR_LOSSLESS_H
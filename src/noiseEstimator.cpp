@@ -0,0 +1,196 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "noiseEstimator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "recordingFormat.h"
+
+TemporalNoiseEstimator::TemporalNoiseEstimator(unsigned int mosaicWidth, unsigned int mosaicHeight,
+                                               NoiseEstimatorOptions options)
+    : m_mosaicWidth(mosaicWidth), m_mosaicHeight(mosaicHeight), m_options(options)
+{
+    if (mosaicWidth == 0 || mosaicHeight == 0 || options.windowSize < 2 || options.gridStep < 1)
+    {
+        throw std::invalid_argument("The noise is estimated over at least 2 frames of a non-empty mosaic.");
+    }
+    m_estimate.bandMean.assign(GetNumberOfBands(), std::numeric_limits<float>::quiet_NaN());
+    m_estimate.bandNoise = m_estimate.bandMean;
+    m_estimate.bandSnr = m_estimate.bandMean;
+}
+
+void TemporalNoiseEstimator::Update(const cv::Mat &frame)
+{
+    if (frame.type() != CV_16UC1 || frame.cols < static_cast<int>(m_mosaicWidth) ||
+        frame.rows < static_cast<int>(m_mosaicHeight))
+    {
+        throw std::invalid_argument("The noise is estimated on raw frames of type CV_16UC1.");
+    }
+    if (frame.size() != m_frameSize)
+    {
+        m_frameSize = frame.size();
+        // only complete superpixels are sampled
+        m_gridRows = (frame.rows / static_cast<int>(m_mosaicHeight) + m_options.gridStep - 1) / m_options.gridStep;
+        m_gridCols = (frame.cols / static_cast<int>(m_mosaicWidth) + m_options.gridStep - 1) / m_options.gridStep;
+        const size_t nSamples = GetNumberOfBands() * m_gridRows * m_gridCols;
+        m_window.create(m_options.windowSize, static_cast<int>(nSamples), CV_32F);
+        m_samples.resize(nSamples);
+        m_mean.resize(nSamples);
+        m_m2.resize(nSamples);
+        this->Reset();
+    }
+    this->Gather(frame, m_samples.data());
+
+    const size_t nSamples = m_samples.size();
+    const float *incoming = m_samples.data();
+    float *outgoing = m_window.ptr<float>(m_head);
+    double *mean = m_mean.data();
+    double *m2 = m_m2.data();
+    if (m_count < m_options.windowSize)
+    {
+        // Welford update while the window fills up
+        m_count++;
+        const double n = m_count;
+        for (size_t i = 0; i < nSamples; i++)
+        {
+            const double delta = incoming[i] - mean[i];
+            mean[i] += delta / n;
+            m2[i] += delta * (incoming[i] - mean[i]);
+        }
+    }
+    else
+    {
+        // the incoming frame replaces the outgoing frame, the number of frames stays the same
+        const double n = m_count;
+        for (size_t i = 0; i < nSamples; i++)
+        {
+            const double difference = static_cast<double>(incoming[i]) - outgoing[i];
+            const double oldMean = mean[i];
+            mean[i] += difference / n;
+            m2[i] = std::max(0., m2[i] + difference * (incoming[i] - mean[i] + outgoing[i] - oldMean));
+        }
+    }
+    std::copy(incoming, incoming + nSamples, outgoing);
+    m_head = (m_head + 1) % m_options.windowSize;
+    this->Publish();
+}
+
+void TemporalNoiseEstimator::Reset()
+{
+    m_head = 0;
+    m_count = 0;
+    std::fill(m_mean.begin(), m_mean.end(), 0.);
+    std::fill(m_m2.begin(), m_m2.end(), 0.);
+    this->Publish();
+}
+
+NoiseEstimate TemporalNoiseEstimator::GetEstimate() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_estimate;
+}
+
+void TemporalNoiseEstimator::WriteEstimate(float *bandNoise, float *bandSnr, float &readNoise) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    std::copy(m_estimate.bandNoise.begin(), m_estimate.bandNoise.end(), bandNoise);
+    std::copy(m_estimate.bandSnr.begin(), m_estimate.bandSnr.end(), bandSnr);
+    readNoise = m_estimate.readNoise;
+}
+
+size_t TemporalNoiseEstimator::GetNumberOfBands() const
+{
+    return static_cast<size_t>(m_mosaicWidth) * m_mosaicHeight;
+}
+
+void TemporalNoiseEstimator::Gather(const cv::Mat &frame, float *samples) const
+{
+    const size_t gridSize = static_cast<size_t>(m_gridRows) * m_gridCols;
+    const int rowStep = m_options.gridStep * static_cast<int>(m_mosaicHeight);
+    const int colStep = m_options.gridStep * static_cast<int>(m_mosaicWidth);
+    for (unsigned int bandRow = 0; bandRow < m_mosaicHeight; bandRow++)
+    {
+        for (unsigned int bandCol = 0; bandCol < m_mosaicWidth; bandCol++)
+        {
+            float *bandSamples = samples + (bandRow * m_mosaicWidth + bandCol) * gridSize;
+            for (int gridRow = 0; gridRow < m_gridRows; gridRow++)
+            {
+                const auto *line = frame.ptr<uint16_t>(gridRow * rowStep + static_cast<int>(bandRow));
+                for (int gridCol = 0; gridCol < m_gridCols; gridCol++)
+                {
+                    *bandSamples++ = line[gridCol * colStep + static_cast<int>(bandCol)];
+                }
+            }
+        }
+    }
+}
+
+void TemporalNoiseEstimator::Publish()
+{
+    const size_t nBands = GetNumberOfBands();
+    const size_t gridSize = static_cast<size_t>(m_gridRows) * m_gridCols;
+    NoiseEstimate estimate;
+    estimate.frames = m_count;
+    estimate.bandMean.assign(nBands, std::numeric_limits<float>::quiet_NaN());
+    estimate.bandNoise = estimate.bandMean;
+    estimate.bandSnr = estimate.bandMean;
+    // sums of the photon transfer fit, variance over mean
+    double n = 0, sumMean = 0, sumVariance = 0, sumMeanSquared = 0, sumProduct = 0;
+    if (m_count >= 2 && gridSize > 0)
+    {
+        for (size_t band = 0; band < nBands; band++)
+        {
+            double bandMean = 0;
+            double bandVariance = 0;
+            for (size_t i = band * gridSize; i < (band + 1) * gridSize; i++)
+            {
+                const double variance = m_m2[i] / (m_count - 1);
+                bandMean += m_mean[i];
+                bandVariance += variance;
+                if (variance > 0)
+                {
+                    n++;
+                    sumMean += m_mean[i];
+                    sumVariance += variance;
+                    sumMeanSquared += m_mean[i] * m_mean[i];
+                    sumProduct += m_mean[i] * variance;
+                }
+            }
+            bandMean /= static_cast<double>(gridSize);
+            const double bandNoise = std::sqrt(bandVariance / static_cast<double>(gridSize));
+            estimate.bandMean[band] = static_cast<float>(bandMean);
+            estimate.bandNoise[band] = static_cast<float>(bandNoise);
+            estimate.bandSnr[band] = bandNoise > 0 ? static_cast<float>(bandMean / bandNoise)
+                                                   : std::numeric_limits<float>::infinity();
+        }
+    }
+    // the fit needs a range of signals, at least the spread of a noise free signal of a single raw value
+    const double meanSpread = n > 1 ? sumMeanSquared / n - (sumMean / n) * (sumMean / n) : 0;
+    if (meanSpread > 1)
+    {
+        const double slope = (sumProduct / n - (sumMean / n) * (sumVariance / n)) / meanSpread;
+        const double intercept = sumVariance / n - slope * sumMean / n;
+        estimate.conversionGain = static_cast<float>(slope);
+        estimate.readNoise = static_cast<float>(std::sqrt(std::max(0., intercept)));
+    }
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_estimate = std::move(estimate);
+}
+
+void NoiseEstimateProvider::DeclareFields(MetadataSchema &schema)
+{
+    m_noiseOffset = schema.AddFloatField(TEMPORAL_NOISE_KEY, m_estimator->GetNumberOfBands());
+    m_snrOffset = schema.AddFloatField(TEMPORAL_SNR_KEY, m_estimator->GetNumberOfBands());
+    m_readNoiseOffset = schema.AddFloatField(READ_NOISE_KEY);
+}
+
+void NoiseEstimateProvider::Sample(const XI_IMG &image, FrameMetadataRecord &record) const
+{
+    (void)image;
+    m_estimator->WriteEstimate(record.floatValues.data() + m_noiseOffset, record.floatValues.data() + m_snrOffset,
+                               record.floatValues[m_readNoiseOffset]);
+}
@@ -0,0 +1,204 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_NOISE_ESTIMATOR_H
+#define XILENS_NOISE_ESTIMATOR_H
+
+#include <boost/thread.hpp>
+#include <limits>
+#include <memory>
+#include <opencv2/core/core.hpp>
+#include <utility>
+#include <vector>
+
+#include "metadataProviders.h"
+
+/**
+ * @brief Options of the temporal noise estimation.
+ */
+struct NoiseEstimatorOptions
+{
+    /**
+     * Number of frames over which the temporal mean and variance of each sampled pixel are computed.
+     */
+    int windowSize = 16;
+
+    /**
+     * Distance in superpixels between two sampled superpixels, along the rows and the columns.
+     */
+    int gridStep = 4;
+};
+
+/**
+ * @brief Temporal noise of each band over the frames of the window, see TemporalNoiseEstimator.
+ *
+ * Values that can not be estimated yet are NaN.
+ */
+struct NoiseEstimate
+{
+    /**
+     * Number of frames in the window.
+     */
+    int frames = 0;
+
+    /**
+     * Mean raw value of each band.
+     */
+    std::vector<float> bandMean;
+
+    /**
+     * Temporal standard deviation of the raw values of each band, the root of the mean temporal variance of its
+     * pixels.
+     */
+    std::vector<float> bandNoise;
+
+    /**
+     * Temporal signal to noise ratio of each band, the mean divided by the temporal noise.
+     */
+    std::vector<float> bandSnr;
+
+    /**
+     * Read noise in raw values, the temporal noise extrapolated to a signal of 0.
+     */
+    float readNoise = std::numeric_limits<float>::quiet_NaN();
+
+    /**
+     * Conversion gain in raw values per electron, the increase of the temporal variance with the signal.
+     */
+    float conversionGain = std::numeric_limits<float>::quiet_NaN();
+};
+
+/**
+ * @brief Estimates the temporal noise of each band of a stream of frames, such that exposure and averaging can be
+ * tuned on measured noise.
+ *
+ * The estimator samples the pixels of every NoiseEstimatorOptions::gridStep superpixel of each frame and keeps the
+ * samples of the last NoiseEstimatorOptions::windowSize frames in a ring. The running mean and variance of each sample
+ * are updated with Welford's method when a frame enters the window and downdated when it leaves it, in a single pass
+ * over the samples of the two frames, such that the window is never scanned again. The read noise and conversion gain
+ * are the intercept and slope of the photon transfer curve, the line fitted to the temporal variance of the samples
+ * over their mean. They need a scene with a range of brightness, e.g. a gray ramp; samples that do not vary, like
+ * saturated pixels, are left out of the fit.
+ *
+ * The noise is the temporal noise of a static scene, motion in the scene adds to it. TemporalNoiseEstimator::Update
+ * must be called from a single thread, the estimate can be queried from any thread.
+ */
+class TemporalNoiseEstimator
+{
+  public:
+    /**
+     * @param mosaicWidth width of the mosaic pattern of the sensor, 1 for sensors without filter array.
+     * @param mosaicHeight height of the mosaic pattern of the sensor, 1 for sensors without filter array.
+     * @param options options of the estimation.
+     * @throws std::invalid_argument if the mosaic is empty or the window has less than 2 frames.
+     */
+    TemporalNoiseEstimator(unsigned int mosaicWidth, unsigned int mosaicHeight,
+                           NoiseEstimatorOptions options = NoiseEstimatorOptions());
+
+    /**
+     * Adds a frame to the window, the oldest frame leaves the window once it is full. The window starts again when
+     * the size of the frames changes.
+     *
+     * @param frame raw frame of type CV_16UC1.
+     * @throws std::invalid_argument if the frame is not of type CV_16UC1 or smaller than a superpixel.
+     */
+    void Update(const cv::Mat &frame);
+
+    /**
+     * Empties the window.
+     */
+    void Reset();
+
+    /**
+     * Queries the estimate of the frames in the window.
+     */
+    NoiseEstimate GetEstimate() const;
+
+    /**
+     * Writes the estimate without allocating memory.
+     *
+     * @param bandNoise temporal noise of each band.
+     * @param bandSnr temporal signal to noise ratio of each band.
+     * @param readNoise read noise.
+     */
+    void WriteEstimate(float *bandNoise, float *bandSnr, float &readNoise) const;
+
+    /**
+     * Queries the number of bands of the mosaic.
+     */
+    size_t GetNumberOfBands() const;
+
+  private:
+    /**
+     * Copies the sampled pixels of a frame, grouped by band.
+     */
+    void Gather(const cv::Mat &frame, float *samples) const;
+
+    /**
+     * Computes the estimate from the running mean and variance of the samples and publishes it.
+     */
+    void Publish();
+
+    unsigned int m_mosaicWidth;
+    unsigned int m_mosaicHeight;
+    NoiseEstimatorOptions m_options;
+    cv::Size m_frameSize;
+    int m_gridRows = 0;
+    int m_gridCols = 0;
+
+    /**
+     * Samples of the frames in the window, a row per frame, of type CV_32F.
+     */
+    cv::Mat m_window;
+
+    /**
+     * Row of the window replaced by the next frame.
+     */
+    int m_head = 0;
+    int m_count = 0;
+    std::vector<float> m_samples;
+    std::vector<double> m_mean;
+
+    /**
+     * Sum of the squared differences to the mean of each sample, the variance times the number of frames minus 1.
+     */
+    std::vector<double> m_m2;
+
+    mutable boost::mutex m_mutex;
+
+    /**
+     * Estimate published by the updating thread.
+     */
+    NoiseEstimate m_estimate;
+};
+
+/**
+ * @brief Provides the temporal noise of each band and the read noise estimated over the last displayed frames, such
+ * that they are stored with the recording.
+ */
+class NoiseEstimateProvider : public MetadataProvider
+{
+  public:
+    /**
+     * Constructs the provider.
+     *
+     * @param estimator estimator fed with the displayed frames.
+     */
+    explicit NoiseEstimateProvider(std::shared_ptr<const TemporalNoiseEstimator> estimator)
+        : m_estimator(std::move(estimator))
+    {
+    }
+
+    void DeclareFields(MetadataSchema &schema) override;
+
+    void Sample(const XI_IMG &image, FrameMetadataRecord &record) const override;
+
+  private:
+    std::shared_ptr<const TemporalNoiseEstimator> m_estimator;
+    size_t m_noiseOffset = 0;
+    size_t m_snrOffset = 0;
+    size_t m_readNoiseOffset = 0;
+};
+
+#endif // XILENS_NOISE_ESTIMATOR_H
@@ -0,0 +1,142 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "previewChannel.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace bip = boost::interprocess;
+
+constexpr uint32_t PREVIEW_CHANNEL_MAGIC = 0x56504c58; // "XLPV"
+constexpr uint32_t PREVIEW_CHANNEL_VERSION = 1;
+
+/**
+ * Number of times a subscriber retries to copy a frame that the publisher overwrote during the copy
+ */
+constexpr int PREVIEW_CHANNEL_READ_ATTEMPTS = 3;
+
+/**
+ * Offset of the pixels from the start of the shared memory, aligned to a cache line
+ */
+static size_t GetPixelsOffset()
+{
+    return (sizeof(PreviewChannelHeader) + 63) / 64 * 64;
+}
+
+PreviewPublisher::PreviewPublisher(std::string name, uint64_t capacity) : m_name(std::move(name))
+{
+    bip::shared_memory_object::remove(m_name.c_str());
+    m_sharedMemory = bip::shared_memory_object(bip::create_only, m_name.c_str(), bip::read_write);
+    m_sharedMemory.truncate(static_cast<bip::offset_t>(GetPixelsOffset() + capacity * sizeof(uint16_t)));
+    m_region = bip::mapped_region(m_sharedMemory, bip::read_write);
+    auto *address = static_cast<char *>(m_region.get_address());
+    m_header = new (address) PreviewChannelHeader();
+    m_header->magic = PREVIEW_CHANNEL_MAGIC;
+    m_header->version = PREVIEW_CHANNEL_VERSION;
+    m_header->capacity = capacity;
+    m_header->sequence.store(0, std::memory_order_release);
+    m_pixels = reinterpret_cast<uint16_t *>(address + GetPixelsOffset());
+}
+
+PreviewPublisher::~PreviewPublisher()
+{
+    bip::shared_memory_object::remove(m_name.c_str());
+}
+
+bool PreviewPublisher::Publish(const XI_IMG &image, bool recording, uint64_t recordedFrames)
+{
+    const uint64_t nPixels = static_cast<uint64_t>(image.width) * image.height;
+    if (nPixels > m_header->capacity || image.bp == nullptr)
+    {
+        return false;
+    }
+    const uint64_t sequence = m_header->sequence.load(std::memory_order_relaxed);
+    m_header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->info.width = image.width;
+    m_header->info.height = image.height;
+    m_header->info.frameNumber = image.acq_nframe;
+    m_header->info.exposureUs = image.exposure_time_us;
+    m_header->info.colorFilterArray = static_cast<int32_t>(image.color_filter_array);
+    m_header->info.recording = recording ? 1 : 0;
+    m_header->info.recordedFrames = recordedFrames;
+    std::memcpy(m_pixels, image.bp, nPixels * sizeof(uint16_t));
+    m_header->sequence.store(sequence + 2, std::memory_order_release);
+    return true;
+}
+
+const std::string &PreviewPublisher::GetName() const
+{
+    return m_name;
+}
+
+PreviewSubscriber::PreviewSubscriber(const std::string &name)
+{
+    try
+    {
+        m_sharedMemory = bip::shared_memory_object(bip::open_only, name.c_str(), bip::read_only);
+        m_region = bip::mapped_region(m_sharedMemory, bip::read_only);
+    }
+    catch (const bip::interprocess_exception &e)
+    {
+        throw std::runtime_error("Could not open preview channel " + name + ": " + e.what());
+    }
+    const auto *address = static_cast<const char *>(m_region.get_address());
+    m_header = reinterpret_cast<const PreviewChannelHeader *>(address);
+    if (m_region.get_size() < GetPixelsOffset() || m_header->magic != PREVIEW_CHANNEL_MAGIC ||
+        m_header->version != PREVIEW_CHANNEL_VERSION ||
+        m_region.get_size() < GetPixelsOffset() + m_header->capacity * sizeof(uint16_t))
+    {
+        throw std::runtime_error("Shared memory is not a preview channel: " + name);
+    }
+    m_pixels = reinterpret_cast<const uint16_t *>(address + GetPixelsOffset());
+}
+
+bool PreviewSubscriber::ReadLatest(PreviewFrameInfo &info, std::vector<uint16_t> &pixels)
+{
+    for (int attempt = 0; attempt < PREVIEW_CHANNEL_READ_ATTEMPTS; attempt++)
+    {
+        const uint64_t before = m_header->sequence.load(std::memory_order_acquire);
+        if (before == m_lastSequence)
+        {
+            return false;
+        }
+        if (before % 2 == 1)
+        {
+            continue;
+        }
+        info = m_header->info;
+        const uint64_t nPixels = static_cast<uint64_t>(info.width) * info.height;
+        if (nPixels > m_header->capacity)
+        {
+            continue;
+        }
+        pixels.resize(nPixels);
+        std::memcpy(pixels.data(), m_pixels, nPixels * sizeof(uint16_t));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_header->sequence.load(std::memory_order_relaxed) == before)
+        {
+            m_lastSequence = before;
+            return true;
+        }
+    }
+    return false;
+}
+
+XI_IMG PreviewFrameToImage(const PreviewFrameInfo &info, std::vector<uint16_t> &pixels)
+{
+    XI_IMG image;
+    std::memset(&image, 0, sizeof(image));
+    image.size = sizeof(XI_IMG);
+    image.width = info.width;
+    image.height = info.height;
+    image.acq_nframe = info.frameNumber;
+    image.exposure_time_us = info.exposureUs;
+    image.color_filter_array = static_cast<XI_COLOR_FILTER_ARRAY>(info.colorFilterArray);
+    image.frm = XI_MONO16;
+    image.bp = pixels.data();
+    image.bp_size = static_cast<DWORD>(pixels.size() * sizeof(uint16_t));
+    return image;
+}
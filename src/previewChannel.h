@@ -0,0 +1,159 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_PREVIEW_CHANNEL_H
+#define XILENS_PREVIEW_CHANNEL_H
+
+#include <xiApi.h>
+
+#include <atomic>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Name of the shared memory object used by default to publish previews of the acquisition daemon.
+ */
+constexpr const char *PREVIEW_CHANNEL_DEFAULT_NAME = "xilens-preview";
+
+/**
+ * Largest number of pixels of a preview, enough for the sensors supported by xilens. The shared memory is only backed
+ * by physical memory once it is written, so smaller sensors do not pay for the unused capacity.
+ */
+constexpr uint64_t PREVIEW_CHANNEL_MAX_PIXELS = 4096 * 3072;
+
+/**
+ * @brief Description of the latest frame published through a preview channel.
+ */
+struct PreviewFrameInfo
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    /**
+     * Frame number assigned by the camera, `acq_nframe`.
+     */
+    uint32_t frameNumber = 0;
+    uint32_t exposureUs = 0;
+
+    /**
+     * Color filter array of the sensor, `XI_COLOR_FILTER_ARRAY`.
+     */
+    int32_t colorFilterArray = 0;
+
+    /**
+     * Whether the publisher is recording, and the number of frames it has recorded so far.
+     */
+    uint32_t recording = 0;
+    uint64_t recordedFrames = 0;
+};
+
+/**
+ * @brief Layout of the shared memory of a preview channel, followed by the pixels of the latest frame.
+ *
+ * The frame is guarded by a sequence lock: the publisher makes the sequence odd before it writes the frame and even
+ * again afterwards. Subscribers copy the frame and retry if the sequence was odd or changed during the copy, such that
+ * the publisher never waits for a subscriber.
+ */
+struct PreviewChannelHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    std::atomic<uint64_t> sequence;
+    PreviewFrameInfo info;
+};
+
+/**
+ * @brief Publishes the latest frame of the acquisition to other processes through shared memory.
+ *
+ * The publisher owns the shared memory object, it is created when the publisher is constructed and removed when it is
+ * destroyed. Publishing copies the frame once and never blocks, frames that no subscriber reads are overwritten.
+ */
+class PreviewPublisher
+{
+  public:
+    /**
+     * Creates the shared memory object, replacing any object with the same name left behind by a crashed publisher.
+     *
+     * @param name name of the shared memory object
+     * @param capacity largest number of pixels of a frame
+     * @throws boost::interprocess::interprocess_exception if the shared memory can not be created
+     */
+    explicit PreviewPublisher(std::string name, uint64_t capacity = PREVIEW_CHANNEL_MAX_PIXELS);
+
+    /**
+     * Removes the shared memory object, subscribers that mapped it keep the last frame.
+     */
+    ~PreviewPublisher();
+
+    PreviewPublisher(const PreviewPublisher &) = delete;
+    PreviewPublisher &operator=(const PreviewPublisher &) = delete;
+
+    /**
+     * Publishes a frame, replacing the previous one.
+     *
+     * @param image frame to publish, 16 bit pixels
+     * @param recording whether the frame is being recorded
+     * @param recordedFrames number of frames recorded so far
+     * @return false if the frame is larger than the capacity of the channel and was not published
+     */
+    bool Publish(const XI_IMG &image, bool recording, uint64_t recordedFrames);
+
+    /**
+     * Queries the name of the shared memory object.
+     */
+    const std::string &GetName() const;
+
+  private:
+    std::string m_name;
+    boost::interprocess::shared_memory_object m_sharedMemory;
+    boost::interprocess::mapped_region m_region;
+    PreviewChannelHeader *m_header;
+    uint16_t *m_pixels;
+};
+
+/**
+ * @brief Reads the latest frame published by a PreviewPublisher in another process.
+ */
+class PreviewSubscriber
+{
+  public:
+    /**
+     * Attaches to a preview channel.
+     *
+     * @param name name of the shared memory object
+     * @throws std::runtime_error if the channel does not exist or was not created by a PreviewPublisher
+     */
+    explicit PreviewSubscriber(const std::string &name);
+
+    /**
+     * Copies the latest frame if it is newer than the last frame read.
+     *
+     * @param info description of the frame
+     * @param pixels pixels of the frame, resized to its width times its height
+     * @return false if no new frame was published since the last call, or the publisher kept writing while copying
+     */
+    bool ReadLatest(PreviewFrameInfo &info, std::vector<uint16_t> &pixels);
+
+  private:
+    boost::interprocess::shared_memory_object m_sharedMemory;
+    boost::interprocess::mapped_region m_region;
+    const PreviewChannelHeader *m_header;
+    const uint16_t *m_pixels;
+    uint64_t m_lastSequence = 0;
+};
+
+/**
+ * Wraps a frame read from a preview channel as a Ximea image, such that it can be handed to the displayers.
+ *
+ * @param info description of the frame
+ * @param pixels pixels of the frame, referenced by the image
+ * @return image whose buffer points to `pixels`
+ */
+XI_IMG PreviewFrameToImage(const PreviewFrameInfo &info, std::vector<uint16_t> &pixels);
+
+#endif // XILENS_PREVIEW_CHANNEL_H
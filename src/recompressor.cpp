@@ -0,0 +1,519 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "recompressor.h"
+
+#include <b2nd.h>
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+
+#include "archiveMigrator.h"
+#include "locoCodec.h"
+#include "util.h"
+
+/**
+ * Number of chunks held in memory per thread, bounds the memory used independently of the size of the recording.
+ */
+static const size_t CHUNKS_PER_THREAD = 2;
+
+/**
+ * Stage of the chunk held by a slot of the RecompressionPipeline
+ */
+enum class RecompressionStage
+{
+    Free,
+    Read,
+    Recompressing,
+    Recompressed
+};
+
+/**
+ * A chunk on its way from the original to the copy
+ */
+struct RecompressionSlot
+{
+    std::vector<uint8_t> original;
+    std::vector<uint8_t> decompressed;
+    std::vector<uint8_t> recompressed;
+    std::string error;
+    RecompressionStage stage = RecompressionStage::Free;
+};
+
+/**
+ * Copies a compressed chunk of a super-chunk
+ */
+static void ReadChunk(blosc2_schunk *schunk, int64_t index, std::vector<uint8_t> &chunk)
+{
+    uint8_t *data = nullptr;
+    bool needsFree = false;
+    int cbytes = blosc2_schunk_get_chunk(schunk, index, &data, &needsFree);
+    if (cbytes < 0)
+    {
+        throw std::runtime_error("could not read chunk " + std::to_string(index) + ": " + std::to_string(cbytes));
+    }
+    chunk.assign(data, data + cbytes);
+    if (needsFree)
+    {
+        free(data);
+    }
+}
+
+/**
+ * Decompresses a chunk and compresses it again, errors are stored in the slot as this runs on worker threads
+ */
+static void RecompressChunk(blosc2_context *dctx, blosc2_context *cctx, RecompressionSlot &slot)
+{
+    int32_t nbytes = 0;
+    int32_t cbytes = 0;
+    int32_t blocksize = 0;
+    if (blosc2_cbuffer_sizes(slot.original.data(), &nbytes, &cbytes, &blocksize) < 0)
+    {
+        slot.error = "invalid chunk";
+        return;
+    }
+    slot.decompressed.resize(static_cast<size_t>(nbytes));
+    int result = blosc2_decompress_ctx(dctx, slot.original.data(), static_cast<int32_t>(slot.original.size()),
+                                       slot.decompressed.data(), nbytes);
+    if (result != nbytes)
+    {
+        slot.error = "could not decompress chunk: " + std::to_string(result);
+        return;
+    }
+    slot.recompressed.resize(static_cast<size_t>(nbytes) + BLOSC2_MAX_OVERHEAD);
+    result = blosc2_compress_ctx(cctx, slot.decompressed.data(), nbytes, slot.recompressed.data(),
+                                 static_cast<int32_t>(slot.recompressed.size()));
+    if (result <= 0)
+    {
+        slot.error = "could not compress chunk: " + std::to_string(result);
+        return;
+    }
+    slot.recompressed.resize(static_cast<size_t>(result));
+    slot.error.clear();
+}
+
+/**
+ * Recompresses the chunks of a super-chunk into another one. A reader thread, one worker thread per compression
+ * context and the writing thread run for the whole copy, such that reading and writing the files overlaps with the
+ * compression. Chunks pass through a ring of slots in order, which bounds the memory used independently of the size of
+ * the recording.
+ */
+class RecompressionPipeline
+{
+  public:
+    RecompressionPipeline(blosc2_schunk *src, blosc2_schunk *dst, const std::vector<blosc2_context *> &dctxs,
+                          const std::vector<blosc2_context *> &cctxs, size_t nSlots)
+        : m_src(src), m_dst(dst), m_dctxs(dctxs), m_cctxs(cctxs), m_slots(nSlots), m_nChunks(src->nchunks)
+    {
+    }
+
+    /**
+     * Recompresses all chunks, the calling thread writes them to the destination.
+     *
+     * @throws std::runtime_error if a chunk can not be read, recompressed or written.
+     */
+    void Run()
+    {
+        boost::thread_group threads;
+        threads.create_thread([this]() { this->ReadChunks(); });
+        for (size_t t = 0; t < m_cctxs.size(); t++)
+        {
+            threads.create_thread([this, t]() { this->RecompressChunks(t); });
+        }
+        this->WriteChunks();
+        threads.join_all();
+        if (!m_error.empty())
+        {
+            throw std::runtime_error(m_error);
+        }
+    }
+
+  private:
+    RecompressionSlot &GetSlot(int64_t index)
+    {
+        return m_slots[static_cast<size_t>(index) % m_slots.size()];
+    }
+
+    /**
+     * Stops all stages, only the first error is kept
+     */
+    void Fail(const std::string &error)
+    {
+        boost::lock_guard<boost::mutex> guard(m_mutex);
+        if (m_error.empty())
+        {
+            m_error = error;
+        }
+        m_stageChanged.notify_all();
+    }
+
+    /**
+     * Waits until the slot of a chunk reaches a stage, the lock is held on return
+     *
+     * @return false if the pipeline failed
+     */
+    bool WaitForStage(boost::unique_lock<boost::mutex> &lock, int64_t index, RecompressionStage stage)
+    {
+        m_stageChanged.wait(lock, [&]() { return !m_error.empty() || this->GetSlot(index).stage == stage; });
+        return m_error.empty();
+    }
+
+    void SetStage(int64_t index, RecompressionStage stage)
+    {
+        boost::lock_guard<boost::mutex> guard(m_mutex);
+        this->GetSlot(index).stage = stage;
+        m_stageChanged.notify_all();
+    }
+
+    /**
+     * Reads the chunks in order, reading a file is not thread safe
+     */
+    void ReadChunks()
+    {
+        for (int64_t i = 0; i < m_nChunks; i++)
+        {
+            {
+                boost::unique_lock<boost::mutex> lock(m_mutex);
+                if (!this->WaitForStage(lock, i, RecompressionStage::Free))
+                {
+                    return;
+                }
+            }
+            try
+            {
+                ReadChunk(m_src, i, this->GetSlot(i).original);
+            }
+            catch (const std::runtime_error &e)
+            {
+                this->Fail(e.what());
+                return;
+            }
+            this->SetStage(i, RecompressionStage::Read);
+        }
+    }
+
+    /**
+     * Claims the next chunk that was read and recompresses it with the contexts of a worker, until all chunks are
+     * claimed
+     */
+    void RecompressChunks(size_t worker)
+    {
+        while (true)
+        {
+            int64_t index;
+            {
+                boost::unique_lock<boost::mutex> lock(m_mutex);
+                m_stageChanged.wait(lock, [this]() {
+                    return !m_error.empty() || m_nextToRecompress == m_nChunks ||
+                           this->GetSlot(m_nextToRecompress).stage == RecompressionStage::Read;
+                });
+                if (!m_error.empty() || m_nextToRecompress == m_nChunks)
+                {
+                    return;
+                }
+                index = m_nextToRecompress++;
+                this->GetSlot(index).stage = RecompressionStage::Recompressing;
+            }
+            RecompressChunk(m_dctxs[worker], m_cctxs[worker], this->GetSlot(index));
+            this->SetStage(index, RecompressionStage::Recompressed);
+        }
+    }
+
+    /**
+     * Writes the recompressed chunks in order and hands their slots back to the reader
+     */
+    void WriteChunks()
+    {
+        for (int64_t i = 0; i < m_nChunks; i++)
+        {
+            {
+                boost::unique_lock<boost::mutex> lock(m_mutex);
+                if (!this->WaitForStage(lock, i, RecompressionStage::Recompressed))
+                {
+                    return;
+                }
+            }
+            RecompressionSlot &slot = this->GetSlot(i);
+            if (!slot.error.empty())
+            {
+                this->Fail(slot.error);
+                return;
+            }
+            int64_t nUpdated = blosc2_schunk_update_chunk(m_dst, i, slot.recompressed.data(), true);
+            if (nUpdated < 0)
+            {
+                this->Fail("Error after blosc2_schunk_update_chunk " + std::to_string(nUpdated));
+                return;
+            }
+            this->SetStage(i, RecompressionStage::Free);
+        }
+    }
+
+    blosc2_schunk *m_src;
+    blosc2_schunk *m_dst;
+    const std::vector<blosc2_context *> &m_dctxs;
+    const std::vector<blosc2_context *> &m_cctxs;
+    std::vector<RecompressionSlot> m_slots;
+    const int64_t m_nChunks;
+    int64_t m_nextToRecompress = 0;
+    std::string m_error;
+    boost::mutex m_mutex;
+    boost::condition_variable m_stageChanged;
+};
+
+/**
+ * Creates the compression parameters of a profile for the chunks of an array
+ */
+static blosc2_cparams CreateProfileCParams(const RecompressionProfile &profile, const LocoCodecParams *locoParams,
+                                           const b2nd_array_t *src)
+{
+    blosc2_cparams cparams;
+    if (profile.compcode == LOCO_CODEC_ID)
+    {
+        cparams = CreateLocoCParams(locoParams);
+    }
+    else
+    {
+        cparams = CreateRecordingCParams();
+        cparams.compcode = static_cast<uint8_t>(profile.compcode);
+        cparams.clevel = static_cast<uint8_t>(profile.clevel);
+    }
+    cparams.typesize = src->sc->typesize;
+    cparams.blocksize = src->sc->blocksize;
+    // chunks are recompressed in parallel, each of them by a single thread
+    cparams.nthreads = 1;
+    return cparams;
+}
+
+/**
+ * Writes the recompressed chunks of an array to a new file with the same shape and metalayers
+ */
+static void WriteRecompressedCopy(b2nd_array_t *src, const std::string &filePath, const RecompressionProfile &profile,
+                                  unsigned int nThreads)
+{
+    if (profile.compcode == LOCO_CODEC_ID &&
+        (src->ndim != 3 || src->chunkshape[0] != 1 || src->chunkshape[1] != src->shape[1] ||
+         src->chunkshape[2] != src->shape[2] || src->sc->typesize != sizeof(uint16_t)))
+    {
+        throw std::runtime_error("the LOCO codec needs one 16 bit image per chunk");
+    }
+    LocoCodecParams locoParams{static_cast<uint32_t>(src->ndim > 0 ? src->shape[src->ndim - 1] : 0),
+                               static_cast<uint8_t>(profile.mosaicWidth), static_cast<uint8_t>(profile.mosaicHeight)};
+    blosc2_cparams cparams = CreateProfileCParams(profile, &locoParams, src);
+
+    // the b2nd metalayer is created from the shape, the other ones are copied as they are
+    std::vector<blosc2_metalayer> metalayers;
+    for (int i = 0; i < src->sc->nmetalayers; i++)
+    {
+        if (std::strcmp(src->sc->metalayers[i]->name, "b2nd") != 0)
+        {
+            metalayers.push_back(*src->sc->metalayers[i]);
+        }
+    }
+    blosc2_storage storage = BLOSC2_STORAGE_DEFAULTS;
+    storage.contiguous = true;
+    storage.cparams = &cparams;
+    std::vector<char> urlpath(filePath.begin(), filePath.end());
+    urlpath.push_back('\0');
+    storage.urlpath = urlpath.data();
+    blosc2_remove_urlpath(filePath.c_str());
+    b2nd_context_t *ctx =
+        b2nd_create_ctx(&storage, src->ndim, src->shape, src->chunkshape, src->blockshape, src->dtype,
+                        src->dtype_format, metalayers.data(), static_cast<int32_t>(metalayers.size()));
+    b2nd_array_t *dst;
+    int result = b2nd_uninit(ctx, &dst);
+    if (result != 0)
+    {
+        b2nd_free_ctx(ctx);
+        HandleBLOSCResult(result, "b2nd_uninit");
+    }
+
+    std::vector<blosc2_context *> cctxs;
+    std::vector<blosc2_context *> dctxs;
+    blosc2_dparams dparams = BLOSC2_DPARAMS_DEFAULTS;
+    dparams.nthreads = 1;
+    for (unsigned int i = 0; i < nThreads; i++)
+    {
+        cctxs.push_back(blosc2_create_cctx(cparams));
+        dctxs.push_back(blosc2_create_dctx(dparams));
+    }
+    try
+    {
+        RecompressionPipeline pipeline(src->sc, dst->sc, dctxs, cctxs, nThreads * CHUNKS_PER_THREAD);
+        pipeline.Run();
+
+        // variable length metadata is copied byte for byte
+        std::vector<char *> names(static_cast<size_t>(src->sc->nvlmetalayers));
+        int nNames = blosc2_vlmeta_get_names(src->sc, names.data());
+        for (int i = 0; i < nNames; i++)
+        {
+            uint8_t *content = nullptr;
+            int32_t contentLength = 0;
+            result = blosc2_vlmeta_get(src->sc, names[i], &content, &contentLength);
+            if (result >= 0)
+            {
+                result = blosc2_vlmeta_add(dst->sc, names[i], content, contentLength, nullptr);
+                free(content);
+            }
+            if (result < 0)
+            {
+                throw std::runtime_error("could not copy the metadata: " + std::to_string(result));
+            }
+        }
+        if (profile.compcode == LOCO_CODEC_ID)
+        {
+            WriteLocoCodecParams(dst, locoParams);
+        }
+    }
+    catch (const std::exception &)
+    {
+        for (unsigned int i = 0; i < nThreads; i++)
+        {
+            blosc2_free_ctx(cctxs[i]);
+            blosc2_free_ctx(dctxs[i]);
+        }
+        b2nd_free(dst);
+        b2nd_free_ctx(ctx);
+        blosc2_remove_urlpath(filePath.c_str());
+        throw;
+    }
+    for (unsigned int i = 0; i < nThreads; i++)
+    {
+        blosc2_free_ctx(cctxs[i]);
+        blosc2_free_ctx(dctxs[i]);
+    }
+    b2nd_free(dst);
+    b2nd_free_ctx(ctx);
+}
+
+/**
+ * Reads the variable length metadata of a file as raw bytes
+ */
+static std::map<std::string, std::vector<uint8_t>> ReadRawVLMetadata(const std::string &filePath)
+{
+    b2nd_array_t *src;
+    int result = b2nd_open(filePath.c_str(), &src);
+    HandleBLOSCResult(result, "b2nd_open");
+    std::map<std::string, std::vector<uint8_t>> metadata;
+    std::vector<char *> names(static_cast<size_t>(src->sc->nvlmetalayers));
+    int nNames = blosc2_vlmeta_get_names(src->sc, names.data());
+    for (int i = 0; i < nNames; i++)
+    {
+        uint8_t *content = nullptr;
+        int32_t contentLength = 0;
+        if (blosc2_vlmeta_get(src->sc, names[i], &content, &contentLength) >= 0)
+        {
+            metadata[names[i]].assign(content, content + contentLength);
+            free(content);
+        }
+    }
+    b2nd_free(src);
+    return metadata;
+}
+
+RecompressionResult RecompressRecording(const std::string &source, const std::string &destination,
+                                        const RecompressionProfile &profile, unsigned int nThreads)
+{
+    RecompressionResult recompression;
+    recompression.source = source;
+    recompression.destination = destination;
+    recompression.originalBytes = boost::filesystem::file_size(source);
+    nThreads = std::max(nThreads, 1u);
+
+    b2nd_array_t *src;
+    int result = b2nd_open(source.c_str(), &src);
+    HandleBLOSCResult(result, "b2nd_open");
+    std::string partialPath = destination + ".part";
+    try
+    {
+        WriteRecompressedCopy(src, partialPath, profile, nThreads);
+    }
+    catch (const std::exception &e)
+    {
+        b2nd_free(src);
+        throw std::runtime_error("Could not recompress " + source + ": " + e.what());
+    }
+    b2nd_free(src);
+
+    if (ComputeB2NDDataCRC32(source) != ComputeB2NDDataCRC32(partialPath) ||
+        ReadRawVLMetadata(source) != ReadRawVLMetadata(partialPath))
+    {
+        boost::filesystem::remove(partialPath);
+        throw std::runtime_error("Recompressed copy of " + source + " does not match the original");
+    }
+    // rename is atomic, the destination is either the previous file or the verified copy
+    boost::filesystem::rename(partialPath, destination);
+    recompression.recompressedBytes = boost::filesystem::file_size(destination);
+    return recompression;
+}
+
+std::string GetRecompressedPath(const std::string &source)
+{
+    boost::filesystem::path path(source);
+    return (path.parent_path() / (path.stem().string() + RECOMPRESSED_FILE_SUFFIX)).string();
+}
+
+std::vector<std::string> FindRecordings(const std::vector<std::string> &paths, const std::string &skipSuffix)
+{
+    auto isCopy = [&skipSuffix](const std::string &name) {
+        return !skipSuffix.empty() && name.size() >= skipSuffix.size() &&
+               name.compare(name.size() - skipSuffix.size(), skipSuffix.size(), skipSuffix) == 0;
+    };
+    std::vector<std::string> recordings;
+    for (const auto &path : paths)
+    {
+        if (boost::filesystem::is_directory(path))
+        {
+            for (const auto &entry : boost::filesystem::recursive_directory_iterator(path))
+            {
+                std::string name = entry.path().filename().string();
+                if (boost::filesystem::is_regular_file(entry.path()) && entry.path().extension() == ".b2nd" &&
+                    !isCopy(name))
+                {
+                    recordings.push_back(entry.path().string());
+                }
+            }
+        }
+        else if (boost::filesystem::is_regular_file(path))
+        {
+            recordings.push_back(path);
+        }
+        else
+        {
+            throw std::runtime_error("No such file or directory: " + path);
+        }
+    }
+    std::sort(recordings.begin(), recordings.end());
+    recordings.erase(std::unique(recordings.begin(), recordings.end()), recordings.end());
+    return recordings;
+}
+
+void WriteRecompressionReport(const std::vector<RecompressionResult> &results, std::ostream &stream)
+{
+    std::ios::fmtflags flags = stream.flags();
+    std::streamsize precision = stream.precision();
+    stream << std::fixed << std::setprecision(2);
+    uintmax_t originalBytes = 0;
+    uintmax_t recompressedBytes = 0;
+    auto writeSavings = [&stream](uintmax_t before, uintmax_t after) {
+        double saved = before > 0 ? 100.0 * (static_cast<double>(before) - static_cast<double>(after)) / before : 0;
+        stream << before / 1e6 << " MB -> " << after / 1e6 << " MB, saved " << saved << "%\n";
+    };
+    for (const auto &result : results)
+    {
+        stream << result.destination << ": ";
+        writeSavings(result.originalBytes, result.recompressedBytes);
+        originalBytes += result.originalBytes;
+        recompressedBytes += result.recompressedBytes;
+    }
+    stream << "total (" << results.size() << " files): ";
+    writeSavings(originalBytes, recompressedBytes);
+    stream.flags(flags);
+    stream.precision(precision);
+}
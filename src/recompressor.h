@@ -0,0 +1,92 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_RECOMPRESSOR_H
+#define XILENS_RECOMPRESSOR_H
+
+#include <blosc2.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Suffix that replaces the `.b2nd` extension of recordings recompressed alongside the originals.
+ */
+constexpr const char *RECOMPRESSED_FILE_SUFFIX = ".recompressed.b2nd";
+
+/**
+ * @brief Codec and compression level used to recompress recordings.
+ */
+struct RecompressionProfile
+{
+    /**
+     * blosc2 codec, BLOSC_ZSTD, BLOSC_LZ4 or LOCO_CODEC_ID.
+     */
+    int compcode = BLOSC_ZSTD;
+
+    /**
+     * blosc2 compression level, ignored by the LOCO codec.
+     */
+    int clevel = 5;
+
+    /**
+     * Shape of the mosaic of the sensor, used by the LOCO codec.
+     */
+    unsigned int mosaicWidth = 1;
+    unsigned int mosaicHeight = 1;
+};
+
+/**
+ * @brief Size of a recording before and after recompression.
+ */
+struct RecompressionResult
+{
+    std::string source;
+    std::string destination;
+    uintmax_t originalBytes = 0;
+    uintmax_t recompressedBytes = 0;
+};
+
+/**
+ * Recompresses a `.b2nd` file with another compression profile.
+ *
+ * Compressed chunks are read, recompressed in parallel and written in order, reading and writing overlap with the
+ * compression and at most a few chunks per thread are held in memory at once. The shape, fixed metalayers and variable length metadata are copied byte for byte. The copy is written to
+ * `<destination>.part` and only renamed to its destination once its data and metadata have been verified against the
+ * original, the destination can be the source itself to replace it atomically.
+ *
+ * @param source path to the original file.
+ * @param destination path of the recompressed file, overwritten if it exists.
+ * @param profile compression profile of the copy.
+ * @param nThreads number of threads used to recompress chunks.
+ * @throws std::runtime_error if the file can not be recompressed or verified, the destination is left untouched.
+ */
+RecompressionResult RecompressRecording(const std::string &source, const std::string &destination,
+                                        const RecompressionProfile &profile, unsigned int nThreads);
+
+/**
+ * Queries the path of the copy of a recording written alongside it, `<name>.b2nd` becomes
+ * `<name>RECOMPRESSED_FILE_SUFFIX`.
+ */
+std::string GetRecompressedPath(const std::string &source);
+
+/**
+ * Collects the `.b2nd` files of a list of paths, directories are searched recursively.
+ *
+ * @param paths files and directories.
+ * @param skipSuffix files whose name ends with this suffix are skipped, e.g. copies written alongside the originals.
+ * @return paths of the files, sorted.
+ * @throws std::runtime_error if a path does not exist.
+ */
+std::vector<std::string> FindRecordings(const std::vector<std::string> &paths,
+                                        const std::string &skipSuffix = RECOMPRESSED_FILE_SUFFIX);
+
+/**
+ * Writes the space saved for each recording and in total.
+ */
+void WriteRecompressionReport(const std::vector<RecompressionResult> &results, std::ostream &stream);
+
+#endif // XILENS_RECOMPRESSOR_H
@@ -0,0 +1,71 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#ifndef XILENS_RECORDING_FILE_H
+#define XILENS_RECORDING_FILE_H
+
+#include <xiApi.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "metadataProviders.h"
+
+/**
+ * @class RecordingFile
+ * @brief Destination of the images and metadata of a recording. Implementations decide how images are stored, e.g.
+ * a single `.b2nd` file (FileImage) or several files striped across storage devices (StripedFileImage).
+ */
+class RecordingFile
+{
+  public:
+    virtual ~RecordingFile() = default;
+
+    /**
+     * Writes an image and its metadata. The image data is copied or written before returning, the caller can reuse
+     * its buffer.
+     *
+     * @param image Ximea image where data is stored
+     * @param record metadata of the image, sampled with the schema used to open the recording
+     */
+    virtual void WriteImageData(const XI_IMG &image, const FrameMetadataRecord &record) = 0;
+
+    /**
+     * Writes an image that was already compressed with FrameCompressor, such that the same chunk can be written to
+     * several files without compressing it again.
+     *
+     * @param chunk compressed image
+     * @param record metadata of the image, sampled with the schema used to open the recording
+     * @throws std::logic_error if the recording does not accept compressed images
+     */
+    virtual void WriteCompressedImageData(const std::vector<uint8_t> &chunk, const FrameMetadataRecord &record)
+    {
+        throw std::logic_error("Recording " + this->GetFilePath() + " does not accept compressed images.");
+    }
+
+    /**
+     * Reports the fill level of the queue in front of the recording, used by recordings that adapt their compression
+     * to the load of the recorder. Ignored by default.
+     *
+     * @param fill fraction of the queue in use, from 0 to 1
+     */
+    virtual void SetQueueFill(double fill)
+    {
+    }
+
+    /**
+     * Appends the metadata of all written images. This method should be called before closing the recording.
+     */
+    virtual void AppendMetadata() = 0;
+
+    /**
+     * Queries the path that identifies the recording, this is the path that should be used to open it again.
+     */
+    virtual std::string GetFilePath() const = 0;
+};
+
+#endif // XILENS_RECORDING_FILE_H
@@ -0,0 +1,180 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_RECORDING_FORMAT_H
+#define XILENS_RECORDING_FORMAT_H
+
+/**
+ * Names used in the files of a recording, shared by the recorder and the header-only reader in xilensReader.h. This
+ * header must not depend on Qt or any other part of the xilens library.
+ */
+
+/**
+ * @brief Name of key to be used to store exposure time in the metadata of the arrays.
+ */
+constexpr const char *EXPOSURE_KEY = "exposure_us";
+
+/**
+ * @brief Name of key to be used to store frame number in the metadata of the arrays.
+ */
+constexpr const char *FRAME_NUMBER_KEY = "acq_nframe";
+
+/**
+ * @brief Name of key to be used to store filter array format in the metadata of the arrays.
+ */
+constexpr const char *COLOR_FILTER_ARRAY_FORMAT_KEY = "color_filter_array";
+
+/**
+ * @brief Name of key to be used to store time stamp in the metadata of the arrays.
+ */
+constexpr const char *TIME_STAMP_KEY = "time_stamp";
+
+/**
+ * @brief Name of key to be used to store the mean value of each band in the metadata of the arrays.
+ */
+constexpr const char *BAND_MEAN_KEY = "band_mean";
+
+/**
+ * @brief Name of key to be used to store the fraction of over-exposed pixels in the metadata of the arrays.
+ */
+constexpr const char *SATURATED_FRACTION_KEY = "saturated_fraction";
+
+/**
+ * @brief Name of key to be used to store the fraction of under-exposed pixels in the metadata of the arrays.
+ */
+constexpr const char *UNDEREXPOSED_FRACTION_KEY = "underexposed_fraction";
+
+/**
+ * @brief Name of key to be used to store the focus score in the metadata of the arrays.
+ */
+constexpr const char *FOCUS_SCORE_KEY = "focus_score";
+
+/**
+ * @brief Name of key to be used to store the compression level of each frame in the metadata of the arrays.
+ */
+constexpr const char *COMPRESSION_LEVEL_KEY = "compression_level";
+
+/**
+ * @brief Name of key to be used to store the compression codec of each frame in the metadata of the arrays.
+ */
+constexpr const char *COMPRESSION_CODEC_KEY = "compression_codec";
+
+/**
+ * @brief Name of key to be used to store the acquisition segment of each frame in the metadata of the arrays. A new
+ * segment starts each time the camera is reopened after it dropped out.
+ */
+constexpr const char *ACQUISITION_SEGMENT_KEY = "acquisition_segment";
+
+/**
+ * @brief Name of key to be used to store the duration in milliseconds of the dropout that preceded the acquisition
+ * segment of each frame in the metadata of the arrays, 0 for the first segment.
+ */
+constexpr const char *DROPOUT_DURATION_KEY = "dropout_ms";
+
+/**
+ * @brief Name of key to be used to store the step of the thermal governor of each frame in the metadata of the arrays,
+ * 0 while the camera runs at its full frame rate.
+ */
+constexpr const char *THERMAL_STEP_KEY = "thermal_step";
+
+/**
+ * @brief Name of key to be used to store the fraction of the full frame rate the camera runs at for each frame in the
+ * metadata of the arrays.
+ */
+constexpr const char *FRAME_RATE_FRACTION_KEY = "frame_rate_fraction";
+
+/**
+ * @brief Name of key to be used to store the x, y, width and height in pixels of each tracked region of interest for
+ * each frame in the metadata of the arrays.
+ */
+constexpr const char *ROI_RECTS_KEY = "roi_rects";
+
+/**
+ * @brief Name of key to be used to store the tracking confidence of each region of interest for each frame in the
+ * metadata of the arrays.
+ */
+constexpr const char *ROI_CONFIDENCE_KEY = "roi_confidence";
+
+/**
+ * @brief Name of key to be used to store the frame number of the frame the regions of interest were last tracked on
+ * for each frame in the metadata of the arrays, -1 before the first tracked frame.
+ */
+constexpr const char *ROI_FRAME_KEY = "roi_frame";
+
+/**
+ * @brief Name of key to be used to store the temporal noise in raw values of each band, estimated over the last
+ * displayed frames, for each frame in the metadata of the arrays.
+ */
+constexpr const char *TEMPORAL_NOISE_KEY = "temporal_noise";
+
+/**
+ * @brief Name of key to be used to store the temporal signal to noise ratio of each band for each frame in the metadata
+ * of the arrays.
+ */
+constexpr const char *TEMPORAL_SNR_KEY = "temporal_snr";
+
+/**
+ * @brief Name of key to be used to store the read noise in raw values estimated from the temporal noise for each frame
+ * in the metadata of the arrays.
+ */
+constexpr const char *READ_NOISE_KEY = "read_noise";
+
+/**
+ * @brief Name of key to be used to store the white balance gains of the red, green and blue channels applied to the
+ * displayed images for each frame in the metadata of the arrays.
+ */
+constexpr const char *WHITE_BALANCE_GAINS_KEY = "white_balance_gains";
+
+/**
+ * @brief Name of key to be used to store whether the white balance gains were locked for each frame in the metadata of
+ * the arrays, 1 if locked and 0 otherwise.
+ */
+constexpr const char *WHITE_BALANCE_LOCKED_KEY = "white_balance_locked";
+
+/**
+ * @brief Name of key to be used to store the bit depth of the values digitized by the sensor for each frame in the
+ * metadata of the arrays.
+ */
+constexpr const char *SENSOR_BIT_DEPTH_KEY = "sensor_bit_depth";
+
+/**
+ * @brief Name of key to be used to store the bit depth of the raw values of each frame in the metadata of the arrays,
+ * the values are stored as 16 bit but only reach the maximum of this bit depth.
+ */
+constexpr const char *DATA_BIT_DEPTH_KEY = "data_bit_depth";
+
+/**
+ * @brief Name of key to be used to store the noise model and error bound of near-lossless copies in the metadata of the
+ * arrays.
+ */
+constexpr const char *NEAR_LOSSLESS_KEY = "near_lossless";
+
+/**
+ * @brief Name of key to be used to store the image geometry of arrays compressed with the LOCO codec in the metadata of
+ * the arrays, see WriteLocoCodecParams.
+ */
+constexpr const char *LOCO_PARAMS_KEY = "loco_params";
+
+/**
+ * @brief Name of key to be used to store the encoding of the per-frame metadata in the metadata of the arrays, only
+ * present when the metadata is stored with the columnar encoding described in metadataCodec.h.
+ */
+constexpr const char *METADATA_ENCODING_KEY = "metadata_encoding";
+
+/**
+ * @brief Value of METADATA_ENCODING_KEY for metadata stored with the columnar encoding.
+ */
+constexpr const char *COLUMNAR_METADATA_ENCODING = "columnar";
+
+/**
+ * @brief Extension of the manifest that describes a recording striped across several files.
+ */
+constexpr const char *RECORDING_MANIFEST_EXTENSION = ".xilens.json";
+
+/**
+ * @brief Version of the format of the recording manifest.
+ */
+constexpr int RECORDING_MANIFEST_VERSION = 1;
+
+#endif // XILENS_RECORDING_FORMAT_H
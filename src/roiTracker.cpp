@@ -0,0 +1,305 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "roiTracker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <opencv2/imgproc.hpp>
+#include <sstream>
+#include <stdexcept>
+
+#include "logger.h"
+#include "recordingFormat.h"
+
+/**
+ * Smallest side in pixels of the template of a region in the decimated image.
+ */
+static const int MIN_TEMPLATE_SIZE = 4;
+
+cv::Rect ParseRoi(const std::string &value)
+{
+    std::stringstream stream(value);
+    int values[4];
+    for (int i = 0; i < 4; i++)
+    {
+        char separator = ',';
+        if (!(stream >> values[i]) || (i < 3 && !(stream >> separator)) || separator != ',')
+        {
+            throw std::invalid_argument("Region of interest is not of the form x,y,width,height: " + value);
+        }
+    }
+    if (!(stream >> std::ws).eof() || values[0] < 0 || values[1] < 0 || values[2] <= 0 || values[3] <= 0)
+    {
+        throw std::invalid_argument("Region of interest is not of the form x,y,width,height: " + value);
+    }
+    return {values[0], values[1], values[2], values[3]};
+}
+
+/**
+ * Offset of the peak of a parabola through three samples around a maximum, relative to the center sample.
+ */
+static float RefinePeak(float left, float center, float right)
+{
+    float denominator = left - 2 * center + right;
+    if (denominator >= 0)
+    {
+        return 0;
+    }
+    return std::clamp(0.5f * (left - right) / denominator, -0.5f, 0.5f);
+}
+
+RoiTracker::RoiTracker(const std::vector<cv::Rect> &rois, RoiTrackingOptions options)
+    : m_rois(rois), m_options(options), m_tracks(rois.size())
+{
+    this->Reset();
+}
+
+size_t RoiTracker::Track(const cv::Mat &frame)
+{
+    if (frame.type() != CV_16UC1 && frame.type() != CV_8UC1)
+    {
+        throw std::invalid_argument("Regions of interest are tracked on raw frames of type CV_16UC1 or CV_8UC1.");
+    }
+    if (frame.size() != m_frameSize)
+    {
+        m_frameSize = frame.size();
+        double scale = std::min(1., m_options.estimationSize / static_cast<double>(std::max(frame.cols, frame.rows)));
+        m_decimatedSize = cv::Size(std::max(1, static_cast<int>(std::lround(frame.cols * scale))),
+                                   std::max(1, static_cast<int>(std::lround(frame.rows * scale))));
+        m_scale = cv::Point2f(static_cast<float>(frame.cols) / static_cast<float>(m_decimatedSize.width),
+                              static_cast<float>(frame.rows) / static_cast<float>(m_decimatedSize.height));
+        this->Reset();
+    }
+    cv::Mat decimated;
+    cv::resize(frame, decimated, m_decimatedSize, 0, 0, cv::INTER_AREA);
+    decimated.convertTo(decimated, CV_32F);
+    if (m_templates.empty())
+    {
+        this->SetTemplates(decimated);
+        return m_tracks.size();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t updated = 0;
+    while (updated < m_tracks.size())
+    {
+        // at least one region is updated with each frame, such that all regions are updated eventually
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (updated > 0 && elapsed.count() > m_options.budgetMilliseconds)
+        {
+            break;
+        }
+        this->Update(m_next, decimated);
+        m_next = (m_next + 1) % m_tracks.size();
+        updated++;
+    }
+    return updated;
+}
+
+void RoiTracker::Reset()
+{
+    for (size_t i = 0; i < m_rois.size(); i++)
+    {
+        m_tracks[i] = TrackedRoi{cv::Rect2f(m_rois[i]), 0, false};
+    }
+    m_templates.clear();
+    m_next = 0;
+}
+
+const std::vector<TrackedRoi> &RoiTracker::GetTracks() const
+{
+    return m_tracks;
+}
+
+void RoiTracker::SetTemplates(const cv::Mat &decimated)
+{
+    cv::Rect bounds(cv::Point(0, 0), decimated.size());
+    m_templates.resize(m_rois.size());
+    for (size_t i = 0; i < m_rois.size(); i++)
+    {
+        const cv::Rect &roi = m_rois[i];
+        // small regions are tracked with the tissue around them
+        int width = std::max(MIN_TEMPLATE_SIZE, static_cast<int>(std::lround(roi.width / m_scale.x)));
+        int height = std::max(MIN_TEMPLATE_SIZE, static_cast<int>(std::lround(roi.height / m_scale.y)));
+        cv::Point2f center((roi.x + roi.width / 2.f) / m_scale.x, (roi.y + roi.height / 2.f) / m_scale.y);
+        cv::Rect rect = cv::Rect(static_cast<int>(std::lround(center.x - width / 2.f)),
+                                 static_cast<int>(std::lround(center.y - height / 2.f)), width, height) &
+                        bounds;
+        Template &regionTemplate = m_templates[i];
+        if (rect.width < MIN_TEMPLATE_SIZE || rect.height < MIN_TEMPLATE_SIZE)
+        {
+            // regions outside of the frame are never found
+            regionTemplate.pixels.release();
+            continue;
+        }
+        regionTemplate.pixels = decimated(rect).clone();
+        regionTemplate.offset = cv::Point2f(static_cast<float>(roi.x) - static_cast<float>(rect.x) * m_scale.x,
+                                            static_cast<float>(roi.y) - static_cast<float>(rect.y) * m_scale.y);
+        m_tracks[i].confidence = 1;
+        m_tracks[i].found = true;
+    }
+}
+
+void RoiTracker::Update(size_t index, const cv::Mat &decimated)
+{
+    const Template &regionTemplate = m_templates[index];
+    TrackedRoi &track = m_tracks[index];
+    if (regionTemplate.pixels.empty())
+    {
+        return;
+    }
+    const int radius = m_options.searchRadius;
+    cv::Point position(static_cast<int>(std::lround((track.rect.x - regionTemplate.offset.x) / m_scale.x)),
+                       static_cast<int>(std::lround((track.rect.y - regionTemplate.offset.y) / m_scale.y)));
+    cv::Rect search = cv::Rect(position.x - radius, position.y - radius, regionTemplate.pixels.cols + 2 * radius,
+                               regionTemplate.pixels.rows + 2 * radius) &
+                      cv::Rect(cv::Point(0, 0), decimated.size());
+    if (search.width < regionTemplate.pixels.cols || search.height < regionTemplate.pixels.rows)
+    {
+        track.confidence = 0;
+        track.found = false;
+        return;
+    }
+    cv::Mat response;
+    cv::matchTemplate(decimated(search), regionTemplate.pixels, response, cv::TM_CCOEFF_NORMED);
+    double maxResponse;
+    cv::Point peak;
+    cv::minMaxLoc(response, nullptr, &maxResponse, nullptr, &peak);
+    // flat templates have no defined correlation
+    track.confidence = std::isfinite(maxResponse) ? static_cast<float>(maxResponse) : 0.f;
+    track.found = track.confidence >= m_options.minConfidence;
+    if (!track.found)
+    {
+        return;
+    }
+    cv::Point2f refined(static_cast<float>(peak.x), static_cast<float>(peak.y));
+    if (peak.x > 0 && peak.x < response.cols - 1)
+    {
+        refined.x += RefinePeak(response.at<float>(peak.y, peak.x - 1), response.at<float>(peak),
+                                response.at<float>(peak.y, peak.x + 1));
+    }
+    if (peak.y > 0 && peak.y < response.rows - 1)
+    {
+        refined.y += RefinePeak(response.at<float>(peak.y - 1, peak.x), response.at<float>(peak),
+                                response.at<float>(peak.y + 1, peak.x));
+    }
+    track.rect.x = (static_cast<float>(search.x) + refined.x) * m_scale.x + regionTemplate.offset.x;
+    track.rect.y = (static_cast<float>(search.y) + refined.y) * m_scale.y + regionTemplate.offset.y;
+}
+
+RoiTrackingWorker::RoiTrackingWorker(const std::vector<cv::Rect> &rois, RoiTrackingOptions options)
+    : m_tracker(rois, options), m_nRois(rois.size()), m_tracks(m_tracker.GetTracks())
+{
+    m_thread = boost::thread(&RoiTrackingWorker::Run, this);
+}
+
+RoiTrackingWorker::~RoiTrackingWorker()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_frameSubmitted.notify_all();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void RoiTrackingWorker::Submit(const cv::Mat &frame, int64_t frameNumber)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        m_pendingFrame = frame;
+        m_pendingFrameNumber = frameNumber;
+    }
+    m_frameSubmitted.notify_one();
+}
+
+void RoiTrackingWorker::Reset()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_resetPending = true;
+}
+
+int64_t RoiTrackingWorker::GetTracks(std::vector<TrackedRoi> &tracks) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    tracks.assign(m_tracks.begin(), m_tracks.end());
+    return m_trackedFrameNumber;
+}
+
+int64_t RoiTrackingWorker::WriteTracks(float *rects, float *confidences) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    for (size_t i = 0; i < m_tracks.size(); i++)
+    {
+        rects[4 * i] = m_tracks[i].rect.x;
+        rects[4 * i + 1] = m_tracks[i].rect.y;
+        rects[4 * i + 2] = m_tracks[i].rect.width;
+        rects[4 * i + 3] = m_tracks[i].rect.height;
+        confidences[i] = m_tracks[i].confidence;
+    }
+    return m_trackedFrameNumber;
+}
+
+size_t RoiTrackingWorker::GetNumberOfRois() const
+{
+    return m_nRois;
+}
+
+void RoiTrackingWorker::Run()
+{
+    while (true)
+    {
+        cv::Mat frame;
+        int64_t frameNumber;
+        bool reset;
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            m_frameSubmitted.wait(lock, [this] { return !m_pendingFrame.empty() || !m_running; });
+            if (!m_running)
+            {
+                return;
+            }
+            frame = m_pendingFrame;
+            m_pendingFrame.release();
+            frameNumber = m_pendingFrameNumber;
+            reset = m_resetPending;
+            m_resetPending = false;
+        }
+        if (reset)
+        {
+            m_tracker.Reset();
+        }
+        try
+        {
+            m_tracker.Track(frame);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_XILENS(warning) << "Could not track the regions of interest: " << e.what();
+            continue;
+        }
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        m_tracks.assign(m_tracker.GetTracks().begin(), m_tracker.GetTracks().end());
+        m_trackedFrameNumber = frameNumber;
+    }
+}
+
+void RoiTrackingProvider::DeclareFields(MetadataSchema &schema)
+{
+    m_rectsOffset = schema.AddFloatField(ROI_RECTS_KEY, 4 * m_worker->GetNumberOfRois());
+    m_confidenceOffset = schema.AddFloatField(ROI_CONFIDENCE_KEY, m_worker->GetNumberOfRois());
+    m_frameOffset = schema.AddIntField(ROI_FRAME_KEY);
+}
+
+void RoiTrackingProvider::Sample(const XI_IMG &image, FrameMetadataRecord &record) const
+{
+    (void)image;
+    record.intValues[m_frameOffset] = m_worker->WriteTracks(record.floatValues.data() + m_rectsOffset,
+                                                            record.floatValues.data() + m_confidenceOffset);
+}
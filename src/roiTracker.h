@@ -0,0 +1,266 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_ROI_TRACKER_H
+#define XILENS_ROI_TRACKER_H
+
+#include <boost/thread.hpp>
+#include <cstdint>
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+
+#include "metadataProviders.h"
+
+/**
+ * @brief Options of the tracking of regions of interest.
+ */
+struct RoiTrackingOptions
+{
+    /**
+     * Longest side in pixels of the decimated image the regions are tracked on.
+     */
+    int estimationSize = 256;
+
+    /**
+     * Largest motion of a region between two tracked frames, in pixels of the decimated image.
+     */
+    int searchRadius = 12;
+
+    /**
+     * Normalized correlation below which a region is considered lost, it then keeps its last position until the
+     * tissue is found again.
+     */
+    double minConfidence = 0.5;
+
+    /**
+     * Time in milliseconds spent on the regions of a frame, the remaining regions are updated with the next frames.
+     */
+    double budgetMilliseconds = 10;
+};
+
+/**
+ * @brief Position of a tracked region of interest.
+ */
+struct TrackedRoi
+{
+    /**
+     * Region in pixels of the frame.
+     */
+    cv::Rect2f rect;
+
+    /**
+     * Normalized correlation of the region with its template at the last update, 1 for a perfect match.
+     */
+    float confidence = 0;
+
+    /**
+     * Whether the last update found the region, see RoiTrackingOptions::minConfidence.
+     */
+    bool found = false;
+};
+
+/**
+ * Parses a region of interest of the form `x,y,width,height` in pixels of the frame.
+ *
+ * @throws std::invalid_argument if the region is not of that form or is empty.
+ */
+cv::Rect ParseRoi(const std::string &value);
+
+/**
+ * @brief Follows regions of interest on moving tissue, such that the spectra of the regions stay on the same tissue.
+ *
+ * Each frame is decimated to RoiTrackingOptions::estimationSize, which also averages the bands of mosaic sensors. The
+ * first frame after RoiTracker::Reset stores the content of each region as template. The regions are then found in
+ * the next frames by normalized cross correlation of their template within RoiTrackingOptions::searchRadius of their
+ * last position, refined to sub-pixel accuracy. Comparing to the first template instead of the last match avoids that
+ * the regions drift over time. When the time spent on a frame exceeds RoiTrackingOptions::budgetMilliseconds, the
+ * remaining regions are updated first with the next frame. Not thread safe.
+ */
+class RoiTracker
+{
+  public:
+    /**
+     * @param rois regions of interest in pixels of the frame.
+     * @param options options of the tracking.
+     */
+    explicit RoiTracker(const std::vector<cv::Rect> &rois, RoiTrackingOptions options = RoiTrackingOptions());
+
+    /**
+     * Updates the positions of the regions with a new frame. The templates are stored from the first frame, and again
+     * when the size of the frames changes.
+     *
+     * @param frame raw frame of type CV_16UC1 or CV_8UC1.
+     * @return number of regions updated with this frame.
+     */
+    size_t Track(const cv::Mat &frame);
+
+    /**
+     * Moves the regions back to their initial position, the next frame becomes the new template.
+     */
+    void Reset();
+
+    /**
+     * Queries the positions of the regions.
+     */
+    const std::vector<TrackedRoi> &GetTracks() const;
+
+  private:
+    /**
+     * Template of a region in the decimated image.
+     */
+    struct Template
+    {
+        cv::Mat pixels;
+
+        /**
+         * Top left corner of the region relative to the top left corner of the template, in pixels of the frame.
+         */
+        cv::Point2f offset;
+    };
+
+    /**
+     * Stores the templates from a decimated frame.
+     */
+    void SetTemplates(const cv::Mat &decimated);
+
+    /**
+     * Finds a region in a decimated frame.
+     */
+    void Update(size_t index, const cv::Mat &decimated);
+
+    std::vector<cv::Rect> m_rois;
+    RoiTrackingOptions m_options;
+    std::vector<TrackedRoi> m_tracks;
+    std::vector<Template> m_templates;
+    cv::Size m_frameSize;
+    cv::Size m_decimatedSize;
+
+    /**
+     * Scale from pixels of the decimated image to pixels of the frame.
+     */
+    cv::Point2f m_scale;
+
+    /**
+     * Region updated first with the next frame.
+     */
+    size_t m_next = 0;
+};
+
+/**
+ * @brief Tracks regions of interest on a dedicated thread, such that neither the display nor the recording waits for
+ * the tracking.
+ *
+ * Only the latest submitted frame is kept, frames submitted while the tracker is busy replace each other. Thread safe.
+ */
+class RoiTrackingWorker
+{
+  public:
+    /**
+     * Starts the tracking thread.
+     *
+     * @param rois regions of interest in pixels of the frame.
+     * @param options options of the tracking.
+     */
+    explicit RoiTrackingWorker(const std::vector<cv::Rect> &rois, RoiTrackingOptions options = RoiTrackingOptions());
+
+    /**
+     * Stops the tracking thread.
+     */
+    ~RoiTrackingWorker();
+
+    RoiTrackingWorker(const RoiTrackingWorker &) = delete;
+    RoiTrackingWorker &operator=(const RoiTrackingWorker &) = delete;
+
+    /**
+     * Hands a frame to the tracking thread, it replaces the frame still waiting to be tracked, if any. The frame is
+     * referenced, not copied, hence it must not be modified afterwards.
+     *
+     * @param frame raw frame of type CV_16UC1 or CV_8UC1.
+     * @param frameNumber frame number of the frame, `acq_nframe`.
+     */
+    void Submit(const cv::Mat &frame, int64_t frameNumber);
+
+    /**
+     * Moves the regions back to their initial position with the next frame, e.g. when the camera changed.
+     */
+    void Reset();
+
+    /**
+     * Queries the positions of the regions.
+     *
+     * @param tracks positions of the regions, resized to the number of regions.
+     * @return frame number of the last tracked frame, -1 if no frame was tracked.
+     */
+    int64_t GetTracks(std::vector<TrackedRoi> &tracks) const;
+
+    /**
+     * Writes the positions of the regions without allocating memory.
+     *
+     * @param rects x, y, width and height of each region.
+     * @param confidences confidence of each region.
+     * @return frame number of the last tracked frame, -1 if no frame was tracked.
+     */
+    int64_t WriteTracks(float *rects, float *confidences) const;
+
+    /**
+     * Queries the number of regions.
+     */
+    size_t GetNumberOfRois() const;
+
+  private:
+    /**
+     * Loop of the tracking thread.
+     */
+    void Run();
+
+    RoiTracker m_tracker;
+    size_t m_nRois;
+
+    mutable boost::mutex m_mutex;
+    boost::condition_variable m_frameSubmitted;
+    cv::Mat m_pendingFrame;
+    int64_t m_pendingFrameNumber = -1;
+    bool m_resetPending = false;
+    bool m_running = true;
+
+    /**
+     * Positions published by the tracking thread.
+     */
+    std::vector<TrackedRoi> m_tracks;
+    int64_t m_trackedFrameNumber = -1;
+    boost::thread m_thread;
+};
+
+/**
+ * @brief Provides the positions of the tracked regions of interest, such that the trajectories of the regions are
+ * recorded.
+ *
+ * The positions are the ones of the last frame tracked when the frame is recorded, `roi_frame` holds its frame number
+ * to match the positions with the recorded frames.
+ */
+class RoiTrackingProvider : public MetadataProvider
+{
+  public:
+    /**
+     * Constructs the provider.
+     *
+     * @param worker worker tracking the regions, it has to outlive the provider
+     */
+    explicit RoiTrackingProvider(const RoiTrackingWorker *worker) : m_worker(worker)
+    {
+    }
+
+    void DeclareFields(MetadataSchema &schema) override;
+
+    void Sample(const XI_IMG &image, FrameMetadataRecord &record) const override;
+
+  private:
+    const RoiTrackingWorker *m_worker;
+    size_t m_rectsOffset = 0;
+    size_t m_confidenceOffset = 0;
+    size_t m_frameOffset = 0;
+};
+
+#endif // XILENS_ROI_TRACKER_H
@@ -0,0 +1,372 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "spectralClassifier.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/chrono.hpp>
+#include <cmath>
+#include <iomanip>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+
+#include "logger.h"
+#include "recordingFormat.h"
+
+/**
+ * Converts a JSON array of numbers to a row vector of type CV_32F.
+ */
+static cv::Mat ToRow(const QJsonArray &array)
+{
+    cv::Mat row(1, static_cast<int>(array.size()), CV_32F);
+    for (int i = 0; i < row.cols; i++)
+    {
+        row.at<float>(0, i) = static_cast<float>(array[i].toDouble());
+    }
+    return row;
+}
+
+SpectralClassifier::SpectralClassifier(std::vector<SpectralClass> classes, const cv::Mat &linear,
+                                       const std::vector<cv::Mat> &quadratic, bool normalize)
+    : m_classes(std::move(classes)), m_normalize(normalize)
+{
+    if (m_classes.empty() || m_classes.size() > 256)
+    {
+        throw std::invalid_argument("A classifier needs between 1 and 256 classes, got: " +
+                                    std::to_string(m_classes.size()));
+    }
+    if (linear.rows != static_cast<int>(m_classes.size()) || linear.cols < 2 || linear.channels() != 1)
+    {
+        throw std::invalid_argument("Expected a row of band weights and bias for each class.");
+    }
+    linear.convertTo(m_linear, CV_32F);
+    int nBands = this->GetNumberOfBands();
+    if (!quadratic.empty() && quadratic.size() != m_classes.size())
+    {
+        throw std::invalid_argument("Expected quadratic weights for each class.");
+    }
+    for (const auto &weights : quadratic)
+    {
+        if (weights.rows != nBands || weights.cols != nBands || weights.channels() != 1)
+        {
+            throw std::invalid_argument("Expected quadratic weights of size " + std::to_string(nBands) + "x" +
+                                        std::to_string(nBands));
+        }
+        cv::Mat converted;
+        weights.convertTo(converted, CV_32F);
+        m_quadratic.push_back(converted);
+    }
+    m_lut = cv::Mat::zeros(1, 256, CV_8UC3);
+    for (size_t k = 0; k < m_classes.size(); k++)
+    {
+        m_lut.at<cv::Vec3b>(0, static_cast<int>(k)) = m_classes[k].color;
+    }
+}
+
+SpectralClassifier SpectralClassifier::Load(const std::string &filePath)
+{
+    QFile file(QString::fromStdString(filePath));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        throw std::runtime_error("Could not open classifier model " + filePath);
+    }
+    QJsonParseError error{};
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || !document.isObject())
+    {
+        throw std::runtime_error("Could not parse classifier model " + filePath);
+    }
+    QJsonObject root = document.object();
+    QString model = root["model"].toString();
+    int nBands = root["bands"].toInt();
+    if ((model != "lda" && model != "qda") || nBands <= 0)
+    {
+        throw std::runtime_error("Unsupported classifier model " + filePath + ", expected an lda or qda model");
+    }
+    std::vector<SpectralClass> classes;
+    cv::Mat linear;
+    std::vector<cv::Mat> quadratic;
+    for (const auto &entry : root["classes"].toArray())
+    {
+        QJsonObject object = entry.toObject();
+        SpectralClass spectralClass;
+        spectralClass.name = object["name"].toString().toStdString();
+        QJsonArray color = object["color"].toArray();
+        for (int i = 0; i < 3 && i < color.size(); i++)
+        {
+            spectralClass.color[i] = cv::saturate_cast<uchar>(color[i].toInt());
+        }
+        cv::Mat weights = ToRow(object["weights"].toArray());
+        if (weights.cols != nBands)
+        {
+            throw std::runtime_error("Class " + spectralClass.name + " of classifier model " + filePath + " has " +
+                                     std::to_string(weights.cols) + " weights, expected " + std::to_string(nBands));
+        }
+        cv::hconcat(weights, cv::Mat(1, 1, CV_32F, cv::Scalar(object["bias"].toDouble())), weights);
+        linear.push_back(weights);
+        if (model == "qda")
+        {
+            cv::Mat weightsQuadratic;
+            for (const auto &row : object["quadratic"].toArray())
+            {
+                cv::Mat weightsRow = ToRow(row.toArray());
+                if (weightsRow.cols == nBands)
+                {
+                    weightsQuadratic.push_back(weightsRow);
+                }
+            }
+            if (weightsQuadratic.rows != nBands || object["quadratic"].toArray().size() != nBands)
+            {
+                throw std::runtime_error("Class " + spectralClass.name + " of classifier model " + filePath +
+                                         " needs quadratic weights of size " + std::to_string(nBands) + "x" +
+                                         std::to_string(nBands));
+            }
+            quadratic.push_back(weightsQuadratic);
+        }
+        classes.push_back(spectralClass);
+    }
+    try
+    {
+        return {classes, linear, quadratic, root["normalize"].toBool()};
+    }
+    catch (const std::invalid_argument &e)
+    {
+        throw std::runtime_error("Invalid classifier model " + filePath + ": " + e.what());
+    }
+}
+
+void SpectralClassifier::Classify(const cv::Mat &image, int mosaicWidth, int mosaicHeight, cv::Mat &labels) const
+{
+    int nBands = this->GetNumberOfBands();
+    if (image.type() != CV_16UC1 || mosaicWidth * mosaicHeight != nBands || image.rows < mosaicHeight ||
+        image.cols < mosaicWidth)
+    {
+        throw std::invalid_argument("Expected a mosaic image of type CV_16UC1 with " + std::to_string(nBands) +
+                                    " bands, got a " + std::to_string(mosaicWidth) + "x" +
+                                    std::to_string(mosaicHeight) + " mosaic of type " +
+                                    cv::typeToString(image.type()));
+    }
+    int rows = (image.rows + mosaicHeight - 1) / mosaicHeight;
+    int cols = (image.cols + mosaicWidth - 1) / mosaicWidth;
+    int completeRows = image.rows / mosaicHeight;
+    int completeCols = image.cols / mosaicWidth;
+    auto nClasses = static_cast<int>(m_classes.size());
+    cv::Mat classified(rows, cols, CV_8UC1);
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range &range) {
+        // spectra of a row of superpixels, the last column multiplies the bias
+        cv::Mat spectra(cols, nBands + 1, CV_32F);
+        spectra.col(nBands).setTo(1);
+        cv::Mat bands = spectra.colRange(0, nBands);
+        cv::Mat scores;
+        cv::Mat projected;
+        cv::Mat quadraticScores;
+        for (int row = range.start; row < range.end; row++)
+        {
+            int firstLine = std::min(row, completeRows - 1) * mosaicHeight;
+            for (int col = 0; col < cols; col++)
+            {
+                int firstColumn = std::min(col, completeCols - 1) * mosaicWidth;
+                auto *spectrum = spectra.ptr<float>(col);
+                int band = 0;
+                float sum = 0;
+                for (int i = 0; i < mosaicHeight; i++)
+                {
+                    const ushort *values = image.ptr<ushort>(firstLine + i) + firstColumn;
+                    for (int j = 0; j < mosaicWidth; j++, band++)
+                    {
+                        spectrum[band] = static_cast<float>(values[j]);
+                        sum += spectrum[band];
+                    }
+                }
+                if (m_normalize && sum > 0)
+                {
+                    for (band = 0; band < nBands; band++)
+                    {
+                        spectrum[band] /= sum;
+                    }
+                }
+            }
+            cv::gemm(spectra, m_linear, 1, cv::noArray(), 0, scores, cv::GEMM_2_T);
+            for (int k = 0; k < static_cast<int>(m_quadratic.size()); k++)
+            {
+                cv::gemm(bands, m_quadratic[k], 1, cv::noArray(), 0, projected);
+                cv::reduce(projected.mul(bands), quadraticScores, 1, cv::REDUCE_SUM);
+                cv::Mat classScores = scores.col(k);
+                classScores += quadraticScores;
+            }
+            auto *output = classified.ptr<uchar>(row);
+            for (int col = 0; col < cols; col++)
+            {
+                const auto *classScores = scores.ptr<float>(col);
+                output[col] = static_cast<uchar>(std::max_element(classScores, classScores + nClasses) - classScores);
+            }
+        }
+    });
+    labels = classified;
+}
+
+void SpectralClassifier::Colorize(const cv::Mat &labels, cv::Mat &overlay) const
+{
+    if (labels.type() != CV_8UC1)
+    {
+        throw std::invalid_argument("Expected a class map of type CV_8UC1, got: " + cv::typeToString(labels.type()));
+    }
+    cv::cvtColor(labels, overlay, cv::COLOR_GRAY2RGB);
+    cv::LUT(overlay, m_lut, overlay);
+}
+
+int SpectralClassifier::GetNumberOfBands() const
+{
+    return m_linear.cols - 1;
+}
+
+const std::vector<SpectralClass> &SpectralClassifier::GetClasses() const
+{
+    return m_classes;
+}
+
+bool SpectralClassifier::IsQuadratic() const
+{
+    return !m_quadratic.empty();
+}
+
+SpectralClassifier CreateRandomClassifier(int nBands, int nClasses, bool quadratic)
+{
+    cv::RNG rng(42);
+    std::vector<SpectralClass> classes;
+    for (int k = 0; k < nClasses; k++)
+    {
+        cv::Vec3b color(cv::saturate_cast<uchar>(rng.uniform(0, 256)), cv::saturate_cast<uchar>(rng.uniform(0, 256)),
+                        cv::saturate_cast<uchar>(rng.uniform(0, 256)));
+        classes.push_back({"class" + std::to_string(k), color});
+    }
+    cv::Mat linear(nClasses, nBands + 1, CV_32F);
+    rng.fill(linear, cv::RNG::NORMAL, 0, 1);
+    std::vector<cv::Mat> quadraticWeights;
+    for (int k = 0; quadratic && k < nClasses; k++)
+    {
+        cv::Mat weights(nBands, nBands, CV_32F);
+        rng.fill(weights, cv::RNG::NORMAL, 0, 1e-3);
+        quadraticWeights.push_back(weights);
+    }
+    return {classes, linear, quadraticWeights, false};
+}
+
+void WriteClassifierBenchmark(const std::vector<SpectralClassifier> &classifiers, int nFrames, int imageWidth,
+                              int imageHeight, std::ostream &stream)
+{
+    std::ios::fmtflags flags = stream.flags();
+    std::streamsize precision = stream.precision();
+    stream << "frames: " << nFrames << ", image: " << imageWidth << "x" << imageHeight << "\n";
+    stream << std::left << std::setw(8) << "model" << std::right << std::setw(8) << "bands" << std::setw(10)
+           << "classes" << std::setw(12) << "ms/frame" << std::setw(20) << "Msuperpixels/s"
+           << "\n";
+    stream << std::fixed << std::setprecision(2);
+    cv::RNG rng(42);
+    for (const auto &classifier : classifiers)
+    {
+        int nBands = classifier.GetNumberOfBands();
+        auto mosaicSide = static_cast<int>(std::lround(std::sqrt(nBands)));
+        if (mosaicSide * mosaicSide != nBands)
+        {
+            throw std::invalid_argument("Can not benchmark a classifier with " + std::to_string(nBands) +
+                                        " bands on a square mosaic.");
+        }
+        cv::Mat image(imageHeight, imageWidth, CV_16UC1);
+        rng.fill(image, cv::RNG::UNIFORM, 0, 1024);
+        cv::Mat labels;
+        // the first image is not measured, it allocates the buffers and starts the threads
+        classifier.Classify(image, mosaicSide, mosaicSide, labels);
+        auto start = boost::chrono::steady_clock::now();
+        for (int i = 0; i < nFrames; i++)
+        {
+            classifier.Classify(image, mosaicSide, mosaicSide, labels);
+        }
+        double seconds = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - start).count();
+        double superpixels = static_cast<double>(labels.total()) * nFrames;
+        stream << std::left << std::setw(8) << (classifier.IsQuadratic() ? "qda" : "lda") << std::right
+               << std::setw(8) << nBands << std::setw(10) << classifier.GetClasses().size() << std::setw(12)
+               << (nFrames > 0 ? 1e3 * seconds / nFrames : 0) << std::setw(20)
+               << (seconds > 0 ? superpixels / seconds / 1e6 : 0) << "\n";
+    }
+    stream.flags(flags);
+    stream.precision(precision);
+}
+
+std::string GetClassMapFilePath(const std::string &recordingPath)
+{
+    std::string basePath = recordingPath;
+    for (const auto &extension : {std::string(RECORDING_MANIFEST_EXTENSION), std::string(".b2nd")})
+    {
+        if (boost::algorithm::ends_with(basePath, extension))
+        {
+            basePath.resize(basePath.size() - extension.size());
+            break;
+        }
+    }
+    return basePath + "_classes.b2nd";
+}
+
+void ClassMapRecorder::Start(const std::string &filePath)
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    m_recording = true;
+    m_filePath = filePath;
+    m_file.reset();
+    m_schema = MetadataSchema();
+    m_frameNumberOffset = m_schema.AddIntField(FRAME_NUMBER_KEY);
+}
+
+void ClassMapRecorder::Write(const cv::Mat &labels, int64_t frameNumber)
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    if (!m_recording)
+    {
+        return;
+    }
+    if (!m_file)
+    {
+        m_file = std::make_unique<FileImage>(m_filePath.c_str(), labels.rows, labels.cols, m_schema);
+        m_size = labels.size();
+    }
+    else if (labels.size() != m_size)
+    {
+        LOG_XILENS(error) << "Class map of frame " << frameNumber << " does not have the size of the recorded class "
+                          << "maps, it is not recorded";
+        return;
+    }
+    cv::Mat values;
+    labels.convertTo(values, CV_16UC1);
+    XI_IMG image{};
+    image.bp = values.data;
+    image.width = values.cols;
+    image.height = values.rows;
+    FrameMetadataRecord record = m_schema.CreateRecord();
+    record.intValues[m_frameNumberOffset] = frameNumber;
+    m_file->WriteImageData(image, record);
+}
+
+std::string ClassMapRecorder::Stop()
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    m_recording = false;
+    if (!m_file)
+    {
+        return "";
+    }
+    m_file->AppendMetadata();
+    m_file.reset();
+    return m_filePath;
+}
+
+bool ClassMapRecorder::IsRecording() const
+{
+    boost::lock_guard<boost::mutex> guard(m_mutex);
+    return m_recording;
+}
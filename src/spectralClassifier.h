@@ -0,0 +1,203 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_SPECTRAL_CLASSIFIER_H
+#define XILENS_SPECTRAL_CLASSIFIER_H
+
+#include <boost/thread.hpp>
+#include <cstdint>
+#include <memory>
+#include <opencv2/core/core.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "metadataProviders.h"
+#include "util.h"
+
+/**
+ * @brief Class of a spectral classifier, e.g. a tissue type.
+ */
+struct SpectralClass
+{
+    /**
+     * Name of the class.
+     */
+    std::string name;
+
+    /**
+     * Color of the class in the class overlay, in the order red, green and blue.
+     */
+    cv::Vec3b color;
+};
+
+/**
+ * @brief Evaluates a linear or quadratic discriminant model on the spectrum of each superpixel of a spectral camera.
+ *
+ * Each class k scores a spectrum x with x^T Q_k x + w_k^T x + b_k, the class with the highest score is assigned. The
+ * quadratic term is only used by quadratic discriminant models, for linear discriminant models Q_k is zero. The models
+ * are trained elsewhere and loaded with SpectralClassifier::Load.
+ *
+ * The spectra of a row of superpixels are gathered into a matrix such that the scores of all classes are computed with
+ * a few matrix products, in parallel over the rows of superpixels.
+ */
+class SpectralClassifier
+{
+  public:
+    /**
+     * @param classes names and overlay colors of the classes.
+     * @param linear matrix with a row per class, the weights of the bands followed by the bias.
+     * @param quadratic matrix with the weights of the products of the bands of each class, empty for linear models.
+     * @param normalize whether each spectrum is divided by the sum of its bands before it is scored.
+     * @throws std::invalid_argument if the sizes of the coefficients do not match.
+     */
+    SpectralClassifier(std::vector<SpectralClass> classes, const cv::Mat &linear, const std::vector<cv::Mat> &quadratic,
+                       bool normalize);
+
+    /**
+     * Loads a model from a JSON file of the form:
+     *
+     *     {"model": "lda" or "qda", "bands": 16, "normalize": false,
+     *      "classes": [{"name": "vessel", "color": [255, 0, 0], "weights": [16 values], "bias": 0,
+     *                   "quadratic": [16 rows of 16 values, only for "qda"]}, ...]}
+     *
+     * @param filePath path of the model file.
+     * @throws std::runtime_error if the file can not be read or is not a valid model.
+     */
+    static SpectralClassifier Load(const std::string &filePath);
+
+    /**
+     * Classifies each superpixel of a mosaic image. Superpixels cut by the border of the image take the class of the
+     * last complete superpixel, such that the class map has the size of the band images.
+     *
+     * @param image mosaic image of type CV_16UC1.
+     * @param mosaicWidth number of columns of the mosaic.
+     * @param mosaicHeight number of rows of the mosaic.
+     * @param labels class index of each superpixel, of type CV_8UC1.
+     * @throws std::invalid_argument if the mosaic does not have as many bands as the model.
+     */
+    void Classify(const cv::Mat &image, int mosaicWidth, int mosaicHeight, cv::Mat &labels) const;
+
+    /**
+     * Paints each pixel of a class map with the color of its class.
+     *
+     * @param labels class map of type CV_8UC1.
+     * @param overlay colored class map of type CV_8UC3.
+     */
+    void Colorize(const cv::Mat &labels, cv::Mat &overlay) const;
+
+    /**
+     * Queries the number of bands of the spectra the model was trained on.
+     */
+    int GetNumberOfBands() const;
+
+    /**
+     * Queries the classes of the model.
+     */
+    const std::vector<SpectralClass> &GetClasses() const;
+
+    /**
+     * Indicates if the model has a quadratic term.
+     */
+    bool IsQuadratic() const;
+
+  private:
+    std::vector<SpectralClass> m_classes;
+
+    /**
+     * Row per class with the weights of the bands followed by the bias, of type CV_32F.
+     */
+    cv::Mat m_linear;
+
+    /**
+     * Quadratic weights of each class, of type CV_32F. Empty for linear models.
+     */
+    std::vector<cv::Mat> m_quadratic;
+    bool m_normalize;
+
+    /**
+     * Look up table from the class index to the color of the class.
+     */
+    cv::Mat m_lut;
+};
+
+/**
+ * Creates a model with random coefficients, used to measure the throughput of the classification.
+ *
+ * @param nBands number of bands of the spectra.
+ * @param nClasses number of classes.
+ * @param quadratic whether the model has a quadratic term.
+ */
+SpectralClassifier CreateRandomClassifier(int nBands, int nClasses, bool quadratic);
+
+/**
+ * Measures how many superpixels per second the classifiers classify on random mosaic images and writes a table with
+ * the results. Each classifier is evaluated on a square mosaic with as many bands as the model, e.g. 4x4 for 16 bands.
+ *
+ * @param classifiers classifiers to measure.
+ * @param nFrames number of images classified by each classifier.
+ * @param imageWidth width of the images in pixels, e.g. the width of the sensor.
+ * @param imageHeight height of the images in pixels.
+ * @param stream destination of the table.
+ * @throws std::invalid_argument if the number of bands of a classifier is not a square number.
+ */
+void WriteClassifierBenchmark(const std::vector<SpectralClassifier> &classifiers, int nFrames, int imageWidth,
+                              int imageHeight, std::ostream &stream);
+
+/**
+ * Derives the path of the class maps of a recording, next to the recording.
+ *
+ * @param recordingPath path of the `.b2nd` file or recording manifest.
+ * @return path of the `.b2nd` file of the class maps.
+ */
+std::string GetClassMapFilePath(const std::string &recordingPath);
+
+/**
+ * @brief Records the class maps computed during a recording to a separate `.b2nd` file.
+ *
+ * The class maps are only computed for the images that are displayed, each class map stores the frame number of the
+ * image it was computed from (`acq_nframe`) to match it with the recording. The file is created with the first class
+ * map, when its size is known. Thread safe.
+ */
+class ClassMapRecorder
+{
+  public:
+    /**
+     * Starts recording class maps, the file is created with the first class map.
+     *
+     * @param filePath path of the `.b2nd` file, see GetClassMapFilePath.
+     */
+    void Start(const std::string &filePath);
+
+    /**
+     * Writes a class map, ignored when not recording.
+     *
+     * @param labels class map of type CV_8UC1.
+     * @param frameNumber frame number of the image the class map was computed from.
+     */
+    void Write(const cv::Mat &labels, int64_t frameNumber);
+
+    /**
+     * Stops recording and closes the file.
+     *
+     * @return path of the closed file, empty if no class map was recorded.
+     */
+    std::string Stop();
+
+    /**
+     * Indicates if class maps are recorded.
+     */
+    bool IsRecording() const;
+
+  private:
+    mutable boost::mutex m_mutex;
+    bool m_recording = false;
+    std::string m_filePath;
+    std::unique_ptr<FileImage> m_file;
+    cv::Size m_size;
+    MetadataSchema m_schema;
+    size_t m_frameNumberOffset = 0;
+};
+
+#endif // XILENS_SPECTRAL_CLASSIFIER_H
@@ -0,0 +1,142 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "stripedRecording.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <stdexcept>
+
+#include "logger.h"
+#include "util.h"
+
+void WriteRecordingManifest(const std::string &filePath, const RecordingManifest &manifest)
+{
+    QJsonArray stripes;
+    for (const auto &stripe : manifest.stripes)
+    {
+        stripes.append(QString::fromStdString(stripe));
+    }
+    QJsonObject root;
+    root["version"] = RECORDING_MANIFEST_VERSION;
+    root["layout"] = "round-robin";
+    root["frames"] = static_cast<qint64>(manifest.frames);
+    root["height"] = static_cast<int>(manifest.height);
+    root["width"] = static_cast<int>(manifest.width);
+    root["stripes"] = stripes;
+
+    QSaveFile file(QString::fromStdString(filePath));
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(root).toJson()) < 0 || !file.commit())
+    {
+        throw std::runtime_error("Could not write recording manifest " + filePath);
+    }
+}
+
+RecordingManifest ReadRecordingManifest(const std::string &filePath)
+{
+    QFile file(QString::fromStdString(filePath));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        throw std::runtime_error("Could not open recording manifest " + filePath);
+    }
+    QJsonParseError error{};
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || !document.isObject())
+    {
+        throw std::runtime_error("Could not parse recording manifest " + filePath);
+    }
+    QJsonObject root = document.object();
+    if (root["version"].toInt() != RECORDING_MANIFEST_VERSION || root["layout"].toString() != "round-robin")
+    {
+        throw std::runtime_error("Unsupported recording manifest " + filePath);
+    }
+    RecordingManifest manifest;
+    manifest.frames = root["frames"].toInteger();
+    manifest.height = root["height"].toInt();
+    manifest.width = root["width"].toInt();
+    for (const auto &stripe : root["stripes"].toArray())
+    {
+        manifest.stripes.push_back(stripe.toString().toStdString());
+    }
+    if (manifest.stripes.empty())
+    {
+        throw std::runtime_error("Recording manifest without stripes " + filePath);
+    }
+    return manifest;
+}
+
+bool IsRecordingManifest(const std::string &filePath)
+{
+    return boost::algorithm::ends_with(filePath, RECORDING_MANIFEST_EXTENSION);
+}
+
+StripedFileImage::StripedFileImage(const std::string &manifestPath, const std::vector<std::string> &stripeFolders,
+                                   unsigned int imageHeight, unsigned int imageWidth, const MetadataSchema &schema,
+                                   const CompressionOptions &compression, size_t queueCapacity)
+    : m_manifestPath(manifestPath)
+{
+    if (stripeFolders.empty())
+    {
+        throw std::invalid_argument("A striped recording needs at least one folder.");
+    }
+    std::string name = boost::filesystem::path(manifestPath).filename().string();
+    if (IsRecordingManifest(name))
+    {
+        name.resize(name.size() - std::char_traits<char>::length(RECORDING_MANIFEST_EXTENSION));
+    }
+    m_manifest.height = imageHeight;
+    m_manifest.width = imageWidth;
+    std::vector<int64_t> stripeFrames;
+    for (size_t i = 0; i < stripeFolders.size(); i++)
+    {
+        boost::filesystem::create_directories(stripeFolders[i]);
+        auto stripePath = boost::filesystem::absolute(boost::filesystem::path(stripeFolders[i]) /
+                                                      (name + "_stripe" + std::to_string(i) + ".b2nd"));
+        m_manifest.stripes.push_back(stripePath.string());
+        auto file = std::make_unique<FileImage>(stripePath.string().c_str(), imageHeight, imageWidth, schema);
+        file->ConfigureCompression(compression);
+        // existing stripes are appended to, e.g. in test mode where every recording has the same name
+        stripeFrames.push_back(file->GetNumberOfFrames());
+        m_manifest.frames += stripeFrames.back();
+        m_stripes.push_back(std::make_unique<WriterQueue>(std::move(file), queueCapacity, imageHeight, imageWidth));
+    }
+    // the round-robin continues with the stripe after the last frame written, such that frame i stays in stripe i % n
+    const auto nStripes = static_cast<int64_t>(m_stripes.size());
+    for (int64_t i = 0; i < nStripes; i++)
+    {
+        if (stripeFrames[i] != (m_manifest.frames - i + nStripes - 1) / nStripes)
+        {
+            LOG_XILENS(warning) << "The stripes of " << manifestPath
+                                << " were not written round-robin, the order of the frames can not be restored";
+            break;
+        }
+    }
+    // written up-front so that the stripes can be found even if the recording is not closed properly
+    WriteRecordingManifest(m_manifestPath, m_manifest);
+}
+
+void StripedFileImage::WriteImageData(const XI_IMG &image, const FrameMetadataRecord &record)
+{
+    m_stripes[m_manifest.frames % m_stripes.size()]->WriteImageData(image, record);
+    m_manifest.frames++;
+}
+
+void StripedFileImage::AppendMetadata()
+{
+    for (auto &stripe : m_stripes)
+    {
+        stripe->AppendMetadata();
+    }
+    WriteRecordingManifest(m_manifestPath, m_manifest);
+}
+
+std::string StripedFileImage::GetFilePath() const
+{
+    return m_manifestPath;
+}
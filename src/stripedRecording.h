@@ -0,0 +1,118 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_STRIPED_RECORDING_H
+#define XILENS_STRIPED_RECORDING_H
+
+#include <b2nd.h>
+#include <xiApi.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "recordingFile.h"
+#include "util.h"
+#include "writerQueue.h"
+#include "xilensReader.h"
+
+/**
+ * @brief Content of the manifest of a striped recording.
+ *
+ * The manifest is a small JSON file that lists the files of a recording. Frame `i` of the recording is stored in
+ * stripe `i % n` at index `i / n`, where `n` is the number of stripes.
+ */
+struct RecordingManifest
+{
+    /**
+     * Number of frames of the recording, only informative, readers derive it from the stripes.
+     */
+    int64_t frames = 0;
+    unsigned int height = 0;
+    unsigned int width = 0;
+
+    /**
+     * Absolute paths of the `.b2nd` files of the recording, in round-robin order.
+     */
+    std::vector<std::string> stripes;
+};
+
+/**
+ * Writes a manifest, the file is replaced atomically.
+ *
+ * @param filePath path of the manifest.
+ * @param manifest content of the manifest.
+ * @throws std::runtime_error if the manifest can not be written.
+ */
+void WriteRecordingManifest(const std::string &filePath, const RecordingManifest &manifest);
+
+/**
+ * Reads a manifest.
+ *
+ * @param filePath path of the manifest.
+ * @return content of the manifest.
+ * @throws std::runtime_error if the manifest can not be read or its format is not supported.
+ */
+RecordingManifest ReadRecordingManifest(const std::string &filePath);
+
+/**
+ * Checks if a path refers to a recording manifest, based on its extension.
+ */
+bool IsRecordingManifest(const std::string &filePath);
+
+/**
+ * @brief Recording striped round-robin across several folders, usually on different storage devices.
+ *
+ * Each folder gets its own `.b2nd` file and its own WriterQueue, such that the files are compressed and written in
+ * parallel and the aggregated write bandwidth grows with the number of devices. Each stripe stores the per-frame
+ * metadata of its own frames. A manifest next to the recording lists the stripes, it can be opened as a single
+ * recording with RecordingReader.
+ */
+class StripedFileImage : public RecordingFile
+{
+  public:
+    /**
+     * Creates the stripe files and writes the manifest. Existing stripes of the same name are appended to, the
+     * round-robin continues after the frames they already contain.
+     *
+     * @param manifestPath path of the manifest, the stripes are named after it.
+     * @param stripeFolders folders where the stripes are stored, created if they do not exist.
+     * @param imageHeight height of the images.
+     * @param imageWidth width of the images.
+     * @param schema per-frame metadata fields recorded with each image.
+     * @param compression compression settings of each stripe, see FileImage::ConfigureCompression.
+     * @param queueCapacity number of images that can wait in the queue of each stripe.
+     * @throws std::invalid_argument if no folder is given.
+     */
+    StripedFileImage(const std::string &manifestPath, const std::vector<std::string> &stripeFolders,
+                     unsigned int imageHeight, unsigned int imageWidth, const MetadataSchema &schema,
+                     const CompressionOptions &compression = {}, size_t queueCapacity = WRITER_QUEUE_CAPACITY);
+
+    /**
+     * Queues the image in the next stripe.
+     *
+     * @param image Ximea image where data is stored
+     * @param record metadata of the image
+     */
+    void WriteImageData(const XI_IMG &image, const FrameMetadataRecord &record) override;
+
+    /**
+     * Waits for all stripes to be written, appends their metadata and updates the manifest.
+     */
+    void AppendMetadata() override;
+
+    /**
+     * Queries the path of the manifest.
+     */
+    std::string GetFilePath() const override;
+
+  private:
+    std::string m_manifestPath;
+    RecordingManifest m_manifest;
+    std::vector<std::unique_ptr<WriterQueue>> m_stripes;
+};
+
+#endif // XILENS_STRIPED_RECORDING_H
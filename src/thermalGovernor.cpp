@@ -0,0 +1,136 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "thermalGovernor.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "logger.h"
+#include "recordingFormat.h"
+
+ThermalGovernor::ThermalGovernor(ThermalGovernorOptions options) : m_options(options)
+{
+}
+
+bool ThermalGovernor::Update(double temperatureC, double timeSeconds)
+{
+    if (!this->IsEnabled())
+    {
+        return false;
+    }
+    if (!m_hasMeasurement)
+    {
+        m_hasMeasurement = true;
+    }
+    else
+    {
+        double interval = timeSeconds - m_lastTime;
+        if (interval <= 0)
+        {
+            return false;
+        }
+        double trend = (temperatureC - m_lastTemperature) / interval;
+        m_trend = TREND_SMOOTHING * trend + (1 - TREND_SMOOTHING) * m_trend;
+    }
+    m_lastTemperature = temperatureC;
+    m_lastTime = timeSeconds;
+
+    if (m_hasStep && timeSeconds - m_lastStepTime < STEP_HOLD_SECONDS)
+    {
+        return false;
+    }
+    // only a rising temperature is extrapolated, a cooling camera steps up once it is below the hysteresis
+    double predicted = temperatureC + std::max(0., m_trend) * m_options.lookaheadSeconds;
+    int step = m_step;
+    if (predicted > m_options.limitC)
+    {
+        step = std::min(MAX_STEP, step + 1);
+    }
+    else if (predicted < m_options.limitC - m_options.hysteresisC)
+    {
+        step = std::max(0, step - 1);
+    }
+    if (step == m_step)
+    {
+        return false;
+    }
+    m_step = step;
+    m_lastStepTime = timeSeconds;
+    m_hasStep = true;
+    return true;
+}
+
+void ThermalGovernor::Reset()
+{
+    m_step = 0;
+    m_trend = 0;
+    m_hasMeasurement = false;
+    m_hasStep = false;
+}
+
+bool ThermalGovernor::IsEnabled() const
+{
+    return m_options.limitC > 0;
+}
+
+int ThermalGovernor::GetStep() const
+{
+    return m_step;
+}
+
+double ThermalGovernor::GetFrameRateFraction() const
+{
+    return 1 - m_step * STEP_FRACTION;
+}
+
+double ThermalGovernor::GetTrend() const
+{
+    return m_trend;
+}
+
+double GetGovernedTemperature(const CameraFamily &family)
+{
+    double temperature = 0;
+    for (size_t i = 0; i < N_TEMPERATURE_KEYS; i++)
+    {
+        if (TEMPERATURE_KEYS[i] == CHIP_TEMP || TEMPERATURE_KEYS[i] == SENSOR_BOARD_TEMP)
+        {
+            temperature = std::max(temperature, static_cast<double>(family.GetLatestTemperature(i)));
+        }
+    }
+    return temperature;
+}
+
+bool GovernFrameRate(ThermalGovernor &governor, Camera &camera)
+{
+    if (!governor.IsEnabled())
+    {
+        return false;
+    }
+    double temperature = GetGovernedTemperature(*camera.m_cameraFamily->get());
+    auto now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch());
+    if (!governor.Update(temperature, now.count()))
+    {
+        return false;
+    }
+    LOG_XILENS(warning) << "Camera at " << temperature << "C, trend " << governor.GetTrend() * 60
+                        << "C/min: frame rate set to " << governor.GetFrameRateFraction() * 100
+                        << "% of the full frame rate";
+    camera.SetFrameRateFraction(governor.GetFrameRateFraction());
+    return true;
+}
+
+void ThermalGovernorProvider::DeclareFields(MetadataSchema &schema)
+{
+    m_stepOffset = schema.AddIntField(THERMAL_STEP_KEY);
+    m_fractionOffset = schema.AddFloatField(FRAME_RATE_FRACTION_KEY);
+}
+
+void ThermalGovernorProvider::Sample(const XI_IMG &image, FrameMetadataRecord &record) const
+{
+    (void)image;
+    record.intValues[m_stepOffset] = m_governor->GetStep();
+    record.floatValues[m_fractionOffset] = static_cast<float>(m_governor->GetFrameRateFraction());
+}
@@ -0,0 +1,164 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_THERMAL_GOVERNOR_H
+#define XILENS_THERMAL_GOVERNOR_H
+
+#include <atomic>
+
+#include "camera.h"
+#include "metadataProviders.h"
+
+/**
+ * @brief Thresholds of the thermal governor.
+ */
+struct ThermalGovernorOptions
+{
+    /**
+     * Temperature in degrees Celsius above which the frame rate is reduced, 0 disables the governor.
+     */
+    double limitC = 0;
+
+    /**
+     * Distance in degrees Celsius below ThermalGovernorOptions::limitC the camera has to cool down to before the frame
+     * rate is increased again.
+     */
+    double hysteresisC = 3;
+
+    /**
+     * Time in seconds over which a rising temperature is extrapolated, such that the frame rate is reduced before the
+     * limit is reached.
+     */
+    double lookaheadSeconds = 60;
+};
+
+/**
+ * @brief Reduces the frame rate of the camera in steps while it runs too hot, to keep its dark current and noise
+ * predictable during long acquisitions.
+ *
+ * The governor is fed with the temperature of the camera each time it is queried and tracks its trend, a moving
+ * average of the rate of change. The temperature extrapolated with a rising trend over
+ * ThermalGovernorOptions::lookaheadSeconds is compared to the thresholds:
+ *  - above ThermalGovernorOptions::limitC, the governor steps down the frame rate by ThermalGovernor::STEP_FRACTION of
+ *    the full frame rate,
+ *  - below the limit minus ThermalGovernorOptions::hysteresisC, it steps up the frame rate again until the full frame
+ *    rate is restored.
+ *
+ * Steps are at least ThermalGovernor::STEP_HOLD_SECONDS apart, such that the temperature can react to the previous
+ * step before the next one is taken.
+ */
+class ThermalGovernor
+{
+  public:
+    /**
+     * Fraction of the full frame rate removed with each step.
+     */
+    static constexpr double STEP_FRACTION = 0.2;
+
+    /**
+     * Highest step, the frame rate is not reduced below 1 - MAX_STEP * STEP_FRACTION of the full frame rate.
+     */
+    static constexpr int MAX_STEP = 4;
+
+    /**
+     * Shortest time between two steps in seconds.
+     */
+    static constexpr double STEP_HOLD_SECONDS = 30;
+
+    /**
+     * Weight of the newest measurement in the moving average of the temperature trend.
+     */
+    static constexpr double TREND_SMOOTHING = 0.3;
+
+    /**
+     * Constructs the governor, it is disabled when ThermalGovernorOptions::limitC is not positive.
+     */
+    explicit ThermalGovernor(ThermalGovernorOptions options = ThermalGovernorOptions());
+
+    /**
+     * Updates the step with a new temperature measurement.
+     *
+     * @param temperatureC temperature of the camera in degrees Celsius.
+     * @param timeSeconds time of the measurement in seconds, measurements not later than the previous one are ignored.
+     * @return true if the step changed.
+     */
+    bool Update(double temperatureC, double timeSeconds);
+
+    /**
+     * Starts again at the full frame rate without measurements, called when a new acquisition starts.
+     */
+    void Reset();
+
+    /**
+     * Queries whether the governor reduces the frame rate at all.
+     */
+    bool IsEnabled() const;
+
+    /**
+     * Queries the current step, 0 is the full frame rate. Can be called from any thread.
+     */
+    int GetStep() const;
+
+    /**
+     * Queries the fraction of the full frame rate at the current step. Can be called from any thread.
+     */
+    double GetFrameRateFraction() const;
+
+    /**
+     * Queries the moving average of the rate of change of the temperature in degrees Celsius per second.
+     */
+    double GetTrend() const;
+
+  private:
+    ThermalGovernorOptions m_options;
+    std::atomic<int> m_step{0};
+    double m_trend = 0;
+    double m_lastTemperature = 0;
+    double m_lastTime = 0;
+    double m_lastStepTime = 0;
+    bool m_hasMeasurement = false;
+    bool m_hasStep = false;
+};
+
+/**
+ * Queries the temperature the governor acts on, the hottest of the chip and sensor board temperatures last cached by
+ * CameraFamily::UpdateCameraTemperature. Cameras that do not report a temperature leave it at 0.
+ */
+double GetGovernedTemperature(const CameraFamily &family);
+
+/**
+ * Feeds the latest temperature of the camera to the governor and applies a new step to the camera, see
+ * Camera::SetFrameRateFraction. Should be called after each temperature update.
+ *
+ * @return true if the frame rate of the camera changed.
+ */
+bool GovernFrameRate(ThermalGovernor &governor, Camera &camera);
+
+/**
+ * @brief Provides the step of the thermal governor and the resulting fraction of the full frame rate of each frame,
+ * such that frame rate changes are recorded.
+ */
+class ThermalGovernorProvider : public MetadataProvider
+{
+  public:
+    /**
+     * Constructs the provider.
+     *
+     * @param governor governor of the recorded camera, it has to outlive the provider
+     */
+    explicit ThermalGovernorProvider(const ThermalGovernor *governor) : m_governor(governor)
+    {
+    }
+
+    void DeclareFields(MetadataSchema &schema) override;
+
+    void Sample(const XI_IMG &image, FrameMetadataRecord &record) const override;
+
+  private:
+    const ThermalGovernor *m_governor;
+    size_t m_stepOffset = 0;
+    size_t m_fractionOffset = 0;
+};
+
+#endif // XILENS_THERMAL_GOVERNOR_H
@@ -0,0 +1,170 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "trueColor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+/**
+ * Gaussian with different widths below and above its center.
+ */
+static double PiecewiseGaussian(double x, double center, double widthBelow, double widthAbove)
+{
+    double t = (x - center) / (x < center ? widthBelow : widthAbove);
+    return std::exp(-0.5 * t * t);
+}
+
+/**
+ * Converts XYZ to linear sRGB with the D65 white point.
+ */
+static const double XYZ_TO_RGB[3][3] = {
+    {3.2406, -1.5372, -0.4986}, {-0.9689, 1.8758, 0.0415}, {0.0557, -0.2040, 1.0570}};
+
+/**
+ * Number of entries of the lookup table that encodes linear values to 8 bit sRGB, fine enough that neighbouring
+ * entries differ by at most one level in the steep part of the transfer function near black.
+ */
+static const int SRGB_LUT_SIZE = 4096;
+
+/**
+ * Applies the sRGB transfer function to a linear value in the range [0, 1].
+ */
+static double EncodeSRGB(double linear)
+{
+    return linear <= 0.0031308 ? 12.92 * linear : 1.055 * std::pow(linear, 1 / 2.4) - 0.055;
+}
+
+cv::Vec3d GetColorMatchingFunctions(double wavelengthNm)
+{
+    double x = 1.056 * PiecewiseGaussian(wavelengthNm, 599.8, 37.9, 31.0) +
+               0.362 * PiecewiseGaussian(wavelengthNm, 442.0, 16.0, 26.7) -
+               0.065 * PiecewiseGaussian(wavelengthNm, 501.1, 20.4, 26.2);
+    double y = 0.821 * PiecewiseGaussian(wavelengthNm, 568.8, 46.9, 40.5) +
+               0.286 * PiecewiseGaussian(wavelengthNm, 530.9, 16.3, 31.1);
+    double z = 1.217 * PiecewiseGaussian(wavelengthNm, 437.0, 11.8, 36.0) +
+               0.681 * PiecewiseGaussian(wavelengthNm, 459.0, 26.0, 13.8);
+    return {x, y, z};
+}
+
+cv::Mat ComputeBandToRGBMatrix(const std::vector<float> &bandCenters)
+{
+    if (bandCenters.empty())
+    {
+        throw std::invalid_argument("No band centers to compute the color of the bands.");
+    }
+    size_t nBands = bandCenters.size();
+    std::vector<size_t> order(nBands);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return bandCenters[a] < bandCenters[b]; });
+
+    cv::Mat matrix(3, static_cast<int>(nBands), CV_64F);
+    for (size_t k = 0; k < nBands; k++)
+    {
+        // each band stands for the part of the spectrum up to halfway to its neighbours
+        double below = bandCenters[order[k > 0 ? k - 1 : k]];
+        double above = bandCenters[order[k + 1 < nBands ? k + 1 : k]];
+        double width = nBands > 1 ? (above - below) / (k > 0 && k + 1 < nBands ? 2 : 1) : 1;
+        cv::Vec3d xyz = GetColorMatchingFunctions(bandCenters[order[k]]) * width;
+        for (int row = 0; row < 3; row++)
+        {
+            matrix.at<double>(row, static_cast<int>(order[k])) =
+                XYZ_TO_RGB[row][0] * xyz[0] + XYZ_TO_RGB[row][1] * xyz[1] + XYZ_TO_RGB[row][2] * xyz[2];
+        }
+    }
+    for (int row = 0; row < 3; row++)
+    {
+        double white = cv::sum(matrix.row(row))[0];
+        if (white <= 0)
+        {
+            throw std::invalid_argument("The bands do not cover the visible range, the color of a flat spectrum is "
+                                        "undefined.");
+        }
+        matrix.row(row) /= white;
+    }
+    return matrix;
+}
+
+TrueColorRenderer::TrueColorRenderer(const std::vector<float> &bandCenters, int mosaicWidth, int mosaicHeight,
+                                     double scalingFactor)
+    : m_mosaicWidth(mosaicWidth), m_mosaicHeight(mosaicHeight)
+{
+    if (mosaicWidth <= 0 || mosaicHeight <= 0 ||
+        bandCenters.size() != static_cast<size_t>(mosaicWidth) * static_cast<size_t>(mosaicHeight))
+    {
+        throw std::invalid_argument("Expected a band center for each of the " + std::to_string(mosaicWidth) + "x" +
+                                    std::to_string(mosaicHeight) + " bands, got: " +
+                                    std::to_string(bandCenters.size()));
+    }
+    cv::Mat matrix = ComputeBandToRGBMatrix(bandCenters);
+    // the values converted to 8 bit are scaled to the range of the lookup table
+    double lutScale = (SRGB_LUT_SIZE - 1) / (255 * scalingFactor);
+    m_weights.resize(3 * bandCenters.size());
+    for (int band = 0; band < matrix.cols; band++)
+    {
+        for (int channel = 0; channel < 3; channel++)
+        {
+            m_weights[3 * band + channel] = static_cast<float>(matrix.at<double>(channel, band) * lutScale);
+        }
+    }
+    m_encoding.resize(SRGB_LUT_SIZE);
+    for (int i = 0; i < SRGB_LUT_SIZE; i++)
+    {
+        m_encoding[i] = cv::saturate_cast<uchar>(255 * EncodeSRGB(static_cast<double>(i) / (SRGB_LUT_SIZE - 1)));
+    }
+}
+
+void TrueColorRenderer::Render(const cv::Mat &image, cv::Mat &rgbImage) const
+{
+    if (image.type() != CV_16UC1 || image.rows < m_mosaicHeight || image.cols < m_mosaicWidth)
+    {
+        throw std::invalid_argument("Expected a mosaic image of type CV_16UC1 with at least one superpixel, got: " +
+                                    cv::typeToString(image.type()));
+    }
+    int rows = (image.rows + m_mosaicHeight - 1) / m_mosaicHeight;
+    int cols = (image.cols + m_mosaicWidth - 1) / m_mosaicWidth;
+    int completeRows = image.rows / m_mosaicHeight;
+    int completeCols = image.cols / m_mosaicWidth;
+    // rendered into a new matrix, such that the size of the band images is kept even if rgbImage had another size
+    cv::Mat rendered(rows, cols, CV_8UC3);
+    const uchar *encoding = m_encoding.data();
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range &range) {
+        std::vector<const ushort *> lines(m_mosaicHeight);
+        for (int row = range.start; row < range.end; row++)
+        {
+            int firstLine = std::min(row, completeRows - 1) * m_mosaicHeight;
+            for (int i = 0; i < m_mosaicHeight; i++)
+            {
+                lines[i] = image.ptr<ushort>(firstLine + i);
+            }
+            auto *output = rendered.ptr<uchar>(row);
+            for (int col = 0; col < cols; col++)
+            {
+                int firstColumn = std::min(col, completeCols - 1) * m_mosaicWidth;
+                const float *weights = m_weights.data();
+                float red = 0;
+                float green = 0;
+                float blue = 0;
+                for (int i = 0; i < m_mosaicHeight; i++)
+                {
+                    const ushort *values = lines[i] + firstColumn;
+                    for (int j = 0; j < m_mosaicWidth; j++, weights += 3)
+                    {
+                        auto value = static_cast<float>(values[j]);
+                        red += weights[0] * value;
+                        green += weights[1] * value;
+                        blue += weights[2] * value;
+                    }
+                }
+                output[3 * col] = encoding[std::clamp(cvRound(red), 0, SRGB_LUT_SIZE - 1)];
+                output[3 * col + 1] = encoding[std::clamp(cvRound(green), 0, SRGB_LUT_SIZE - 1)];
+                output[3 * col + 2] = encoding[std::clamp(cvRound(blue), 0, SRGB_LUT_SIZE - 1)];
+            }
+        }
+    });
+    rgbImage = rendered;
+}
@@ -0,0 +1,76 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_TRUE_COLOR_H
+#define XILENS_TRUE_COLOR_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+/**
+ * Evaluates the CIE 1931 2 degree color matching functions with the multi-lobe Gaussian fit of Wyman, Sloan and
+ * Shirley, accurate enough to derive colors from the bands of a spectral camera.
+ *
+ * @param wavelengthNm wavelength in nanometers.
+ * @return x, y and z color matching functions at the wavelength.
+ */
+cv::Vec3d GetColorMatchingFunctions(double wavelengthNm);
+
+/**
+ * Computes the matrix that projects the bands of a spectral camera to linear sRGB. The spectrum is sampled by the
+ * bands at their centers, each band weighted with the distance to the neighbouring band centers, and integrated with
+ * the color matching functions to XYZ. Each row is normalized such that a flat spectrum renders as neutral gray.
+ *
+ * @param bandCenters center wavelength in nanometers of each band, in the order of the bands in the mosaic.
+ * @return matrix of type CV_64F with a red, green and blue row and a column per band.
+ * @throws std::invalid_argument if the bands do not cover the visible range, e.g. for cameras in the near infrared.
+ */
+cv::Mat ComputeBandToRGBMatrix(const std::vector<float> &bandCenters);
+
+/**
+ * @brief Renders the color image of a spectral camera from all of its bands, see ComputeBandToRGBMatrix.
+ *
+ * All bands of a superpixel are projected in a single pass over the mosaic, in parallel over the rows of superpixels,
+ * to linear sRGB. The projection is scaled to the entries of a lookup table that applies the sRGB transfer function and
+ * the conversion to 8 bit, such that the displayed colors are not too dark. The rendered image has the size of the
+ * band images, superpixels cut by the border of the image take the values of the last complete superpixel.
+ */
+class TrueColorRenderer
+{
+  public:
+    /**
+     * @param bandCenters center wavelength in nanometers of each band, in the order of the bands in the mosaic.
+     * @param mosaicWidth number of columns of the mosaic.
+     * @param mosaicHeight number of rows of the mosaic.
+     * @param scalingFactor divisor that converts the values of the camera to 8 bit.
+     * @throws std::invalid_argument if the number of band centers does not match the mosaic, see also
+     * ComputeBandToRGBMatrix.
+     */
+    TrueColorRenderer(const std::vector<float> &bandCenters, int mosaicWidth, int mosaicHeight, double scalingFactor);
+
+    /**
+     * Renders the color image of a mosaic image.
+     *
+     * @param image mosaic image of type CV_16UC1.
+     * @param rgbImage rendered image of type CV_8UC3 with the channels in the order red, green and blue, as interpreted
+     * by the display.
+     */
+    void Render(const cv::Mat &image, cv::Mat &rgbImage) const;
+
+  private:
+    int m_mosaicWidth;
+    int m_mosaicHeight;
+
+    /**
+     * Red, green and blue weight of each band in the order of the mosaic, scaled to the entries of m_encoding.
+     */
+    std::vector<float> m_weights;
+
+    /**
+     * 8 bit sRGB value of each linear value, see SRGB_LUT_SIZE.
+     */
+    std::vector<uchar> m_encoding;
+};
+
+#endif // XILENS_TRUE_COLOR_H
@@ -0,0 +1,21 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "uiSettings.h"
+
+#include <atomic>
+
+UiSettingsPublisher::UiSettingsPublisher() : m_current(std::make_shared<const UiSettings>())
+{
+}
+
+void UiSettingsPublisher::Publish(const UiSettings &settings)
+{
+    std::atomic_store_explicit(&m_current, std::make_shared<const UiSettings>(settings), std::memory_order_release);
+}
+
+std::shared_ptr<const UiSettings> UiSettingsPublisher::Get() const
+{
+    return std::atomic_load_explicit(&m_current, std::memory_order_acquire);
+}
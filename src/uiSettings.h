@@ -0,0 +1,119 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_UI_SETTINGS_H
+#define XILENS_UI_SETTINGS_H
+
+#include <QString>
+#include <memory>
+
+/**
+ * @brief Immutable copy of the user interface values that are needed outside of the GUI thread.
+ *
+ * Worker threads (display, recording, snapshots, references) must never query Qt widgets directly. Instead, the GUI
+ * thread builds a new instance of this structure every time one of the values changes and publishes it through
+ * UiSettingsPublisher. Once published, an instance is never modified again.
+ */
+struct UiSettings
+{
+    /**
+     * Band number to display for spectral cameras.
+     */
+    unsigned band = 1;
+
+    /**
+     * Indicates if normalization should be applied to the displayed images.
+     */
+    bool normalize = false;
+
+    /**
+     * Normalization factor used for the RGB image.
+     */
+    unsigned bgrNorm = 1;
+
+    /**
+     * Indicates if the saturation overlay should be painted on the raw image.
+     */
+    bool saturationOverlay = false;
+
+    /**
+     * Indicates if the motion of the camera should be compensated in the displayed images, see FrameRegistration.
+     */
+    bool stabilize = false;
+
+    /**
+     * Indicates if the color image of spectral cameras should be rendered from all bands, see TrueColorRenderer.
+     */
+    bool trueColor = false;
+
+    /**
+     * Indicates if the classes of the spectral classifier should be painted on the color image, see SpectralClassifier.
+     */
+    bool classify = false;
+
+    /**
+     * Indicates if the gains of the automatic white balance of RGB cameras should be kept, see WhiteBalanceEstimator.
+     */
+    bool lockWhiteBalance = false;
+
+    /**
+     * Number of frames to skip while recording.
+     */
+    int skipFrames = 0;
+
+    /**
+     * Number of snapshot images to record when the snapshot button is pressed.
+     */
+    int nSnapshots = 0;
+
+    /**
+     * File name used for snapshot recordings.
+     */
+    QString snapshotsFileName;
+
+    /**
+     * Base folder where all data is stored.
+     */
+    QString baseFolder;
+};
+
+/**
+ * @brief Publishes UiSettings snapshots from the GUI thread to any number of reader threads.
+ *
+ * The publisher follows a read-copy-update scheme: the writer builds a complete new snapshot and swaps the shared
+ * pointer atomically, readers take the current pointer once and keep using it for as long as they need. Readers never
+ * block the writer and never observe partially updated values. Old snapshots are released automatically once the last
+ * reader drops its reference.
+ */
+class UiSettingsPublisher
+{
+  public:
+    /**
+     * Constructs the publisher with a default constructed snapshot, such that UiSettingsPublisher::Get never returns
+     * a null pointer.
+     */
+    UiSettingsPublisher();
+
+    /**
+     * Publishes a new snapshot. Should only be called from the GUI thread.
+     *
+     * @param settings values to publish.
+     */
+    void Publish(const UiSettings &settings);
+
+    /**
+     * Queries the most recently published snapshot. Safe to call from any thread.
+     *
+     * @return pointer to an immutable snapshot.
+     */
+    std::shared_ptr<const UiSettings> Get() const;
+
+  private:
+    /**
+     * Currently published snapshot. Only accessed through the atomic shared pointer operations.
+     */
+    std::shared_ptr<const UiSettings> m_current;
+};
+
+#endif // XILENS_UI_SETTINGS_H
@@ -17,10 +17,25 @@
 
 #include "constants.h"
 #include "logger.h"
+#include "metadataCodec.h"
 
 FileImage::FileImage(const char *filePath, unsigned int imageHeight, unsigned int imageWidth)
 {
-    this->m_filePath = strdup(filePath);
+    this->m_defaultProviders.Register(std::make_shared<ImageMetadataProvider>());
+    this->m_schema = this->m_defaultProviders.GetSchema();
+    this->m_defaultRecord = this->m_schema.CreateRecord();
+    this->Open(filePath, imageHeight, imageWidth);
+}
+
+FileImage::FileImage(const char *filePath, unsigned int imageHeight, unsigned int imageWidth,
+                     const MetadataSchema &schema)
+    : m_schema(schema)
+{
+    this->Open(filePath, imageHeight, imageWidth);
+}
+
+blosc2_cparams CreateRecordingCParams()
+{
     blosc2_cparams cparams = BLOSC2_CPARAMS_DEFAULTS;
     cparams.typesize = sizeof(uint16_t);
     cparams.compcode = BLOSC_ZSTD;
@@ -28,6 +43,13 @@ FileImage::FileImage(const char *filePath, unsigned int imageHeight, unsigned in
     cparams.filters[BLOSC2_MAX_FILTERS - 1] = BLOSC_SHUFFLE;
     cparams.clevel = 5;
     cparams.nthreads = 4;
+    return cparams;
+}
+
+void FileImage::Open(const char *filePath, unsigned int imageHeight, unsigned int imageWidth)
+{
+    this->m_filePath = strdup(filePath);
+    blosc2_cparams cparams = CreateRecordingCParams();
 
     blosc2_storage storage = BLOSC2_STORAGE_DEFAULTS;
     storage.contiguous = true;
@@ -51,6 +73,33 @@ FileImage::FileImage(const char *filePath, unsigned int imageHeight, unsigned in
         result = b2nd_empty(this->m_ctx, &m_src);
     }
     HandleBLOSCResult(result, "b2nd_empty || b2nd_open");
+    if (this->m_src->sc->compcode == LOCO_CODEC_ID)
+    {
+        // the compression context of opened files does not know the geometry of the images appended with the codec
+        if (!ReadLocoCodecParams(this->m_src, this->m_locoParams))
+        {
+            LOG_XILENS(warning) << "File " << this->m_filePath
+                                << " does not store the mosaic of the LOCO codec, appending without mosaic";
+            this->m_locoParams = {static_cast<uint32_t>(this->m_src->shape[2]), 1, 1};
+        }
+        this->ReplaceCompressionContext(CreateLocoCParams(&this->m_locoParams));
+    }
+
+    // reserve space for the metadata up-front, such that recording a frame does not need to re-allocate memory
+    this->m_columns.resize(this->m_schema.GetFields().size());
+    for (size_t i = 0; i < this->m_columns.size(); i++)
+    {
+        const MetadataField &field = this->m_schema.GetFields()[i];
+        size_t capacity = field.width * METADATA_RESERVED_FRAMES;
+        if (field.type == MetadataFieldType::Int64)
+        {
+            this->m_columns[i].intValues.reserve(capacity);
+        }
+        else
+        {
+            this->m_columns[i].floatValues.reserve(capacity);
+        }
+    }
 }
 
 FileImage::~FileImage()
@@ -60,13 +109,244 @@ FileImage::~FileImage()
     b2nd_free_ctx(this->m_ctx);
 }
 
+std::string FileImage::GetFilePath() const
+{
+    return this->m_filePath;
+}
+
+int64_t FileImage::GetNumberOfFrames() const
+{
+    return this->m_src->shape[0];
+}
+
+/**
+ * Packs the values of a metadata column, fields with more than one value per frame are stored as one array per frame
+ */
+template <typename T> static std::vector<std::vector<T>> SplitColumn(const std::vector<T> &values, size_t width)
+{
+    std::vector<std::vector<T>> frames;
+    frames.reserve(values.size() / width);
+    for (size_t i = 0; i + width <= values.size(); i += width)
+    {
+        frames.emplace_back(values.begin() + i, values.begin() + i + width);
+    }
+    return frames;
+}
+
+/**
+ * Packs each value of a field with several values per frame as its own column, fields with one value per frame are
+ * packed as a single column
+ */
+template <typename T, typename PackColumn>
+static void PackInterleavedColumns(msgpack::packer<msgpack::sbuffer> &packer, const std::vector<T> &values,
+                                   size_t width, PackColumn packColumn)
+{
+    if (width == 1)
+    {
+        packColumn(packer, values);
+        return;
+    }
+    PackColumnsHeader(packer, width);
+    std::vector<T> column;
+    column.reserve(values.size() / width);
+    for (size_t j = 0; j < width; j++)
+    {
+        column.clear();
+        for (size_t i = j; i + width - j <= values.size(); i += width)
+        {
+            column.push_back(values[i]);
+        }
+        packColumn(packer, column);
+    }
+}
+
+/**
+ * Reads a column stored by earlier sessions of a reopened file, interleaved like the columns of FileImage. Empty if the
+ * file does not store the column.
+ */
+template <typename T> static std::vector<T> ReadStoredColumn(b2nd_array_t *src, const std::string &key, size_t width)
+{
+    if (blosc2_vlmeta_exists(src->sc, key.c_str()) < 0)
+    {
+        return {};
+    }
+    if (width == 1)
+    {
+        return ReadMetadataColumn<T>(src, key.c_str());
+    }
+    std::vector<T> values;
+    for (const auto &frame : ReadMetadataColumns<T>(src, key.c_str()))
+    {
+        if (frame.size() != width)
+        {
+            throw std::runtime_error("Stored metadata has a different number of values per frame: " + key);
+        }
+        values.insert(values.end(), frame.begin(), frame.end());
+    }
+    return values;
+}
+
+/**
+ * Appends the values of this session to the column stored by earlier sessions of a reopened file
+ */
+template <typename T>
+static std::vector<T> ConcatenateStoredColumn(b2nd_array_t *src, const std::string &key, size_t width,
+                                              const std::vector<T> &values)
+{
+    std::vector<T> column = ReadStoredColumn<T>(src, key, width);
+    column.insert(column.end(), values.begin(), values.end());
+    return column;
+}
+
+/**
+ * Packs a formatted integer field after the values stored by earlier sessions of a reopened file. Stored values that
+ * were formatted to strings can not be converted back, the values of this session are then formatted as well.
+ */
+static void PackStoredFormattedField(msgpack::packer<msgpack::sbuffer> &packer, b2nd_array_t *src,
+                                     const std::string &key, size_t width, const std::vector<int64_t> &values,
+                                     const std::function<std::string(int64_t)> &formatter)
+{
+    std::vector<int64_t> column;
+    try
+    {
+        column = ConcatenateStoredColumn(src, key, width, values);
+    }
+    catch (const std::exception &)
+    {
+        std::vector<std::string> formatted = ReadStoredColumn<std::string>(src, key, width);
+        for (int64_t value : values)
+        {
+            formatted.push_back(formatter(value));
+        }
+        PackInterleavedColumns(packer, formatted, width, PackStringColumn);
+        return;
+    }
+    auto packFormatted = [&formatter](msgpack::packer<msgpack::sbuffer> &p, const std::vector<int64_t> &v) {
+        PackFormattedColumn(p, v, formatter);
+    };
+    PackInterleavedColumns(packer, column, width, packFormatted);
+}
+
+void FileImage::AppendColumnarMetadata()
+{
+    // the columns of a reopened file are decoded and encoded again with the values of this session appended
+    const auto &fields = this->m_schema.GetFields();
+    for (size_t i = 0; i < fields.size(); i++)
+    {
+        const MetadataField &field = fields[i];
+        const MetadataColumn &column = this->m_columns[i];
+        msgpack::sbuffer sbuf;
+        msgpack::packer<msgpack::sbuffer> packer(&sbuf);
+        if (field.type == MetadataFieldType::Float32)
+        {
+            PackInterleavedColumns(packer,
+                                   ConcatenateStoredColumn(this->m_src, field.key, field.width, column.floatValues),
+                                   field.width, PackFloatColumn);
+        }
+        else if (field.formatter)
+        {
+            PackStoredFormattedField(packer, this->m_src, field.key, field.width, column.intValues, field.formatter);
+        }
+        else
+        {
+            PackInterleavedColumns(packer,
+                                   ConcatenateStoredColumn(this->m_src, field.key, field.width, column.intValues),
+                                   field.width, PackIntColumn);
+        }
+        WriteBLOSCVLMetadata(this->m_src, field.key.c_str(), sbuf);
+    }
+    if (this->m_compressionController)
+    {
+        auto formatCodec = [](int64_t compcode) { return CompressionCodecToString(static_cast<int>(compcode)); };
+        msgpack::sbuffer codecs;
+        msgpack::packer<msgpack::sbuffer> codecPacker(&codecs);
+        PackStoredFormattedField(codecPacker, this->m_src, COMPRESSION_CODEC_KEY, 1, this->m_compressionCodecs,
+                                 formatCodec);
+        WriteBLOSCVLMetadata(this->m_src, COMPRESSION_CODEC_KEY, codecs);
+        msgpack::sbuffer levels;
+        msgpack::packer<msgpack::sbuffer> levelPacker(&levels);
+        PackIntColumn(levelPacker, ConcatenateStoredColumn(this->m_src, COMPRESSION_LEVEL_KEY, 1,
+                                                           this->m_compressionLevels));
+        WriteBLOSCVLMetadata(this->m_src, COMPRESSION_LEVEL_KEY, levels);
+    }
+    for (const QString &key : m_additionalMetadata.keys())
+    {
+        msgpack::sbuffer sbuf;
+        msgpack::packer<msgpack::sbuffer> packer(&sbuf);
+        std::string name = key.toStdString();
+        PackFloatColumn(packer, ConcatenateStoredColumn(this->m_src, name, 1, this->m_additionalMetadata[key]));
+        WriteBLOSCVLMetadata(this->m_src, name.c_str(), sbuf);
+    }
+    msgpack::sbuffer encoding;
+    msgpack::pack(encoding, std::string(COLUMNAR_METADATA_ENCODING));
+    WriteBLOSCVLMetadata(this->m_src, METADATA_ENCODING_KEY, encoding);
+    LOG_XILENS(info) << "Columnar metadata was written to file";
+}
+
 void FileImage::AppendMetadata()
 {
+    if (this->m_columnarMetadata)
+    {
+        this->AppendColumnarMetadata();
+        return;
+    }
     // pack and append metadata
-    PackAndAppendMetadata(this->m_src, EXPOSURE_KEY, this->m_exposureMetadata);
-    PackAndAppendMetadata(this->m_src, FRAME_NUMBER_KEY, this->m_acqNframeMetadata);
-    PackAndAppendMetadata(this->m_src, COLOR_FILTER_ARRAY_FORMAT_KEY, this->m_colorFilterArray);
-    PackAndAppendMetadata(this->m_src, TIME_STAMP_KEY, this->m_timeStamp);
+    const auto &fields = this->m_schema.GetFields();
+    for (size_t i = 0; i < fields.size(); i++)
+    {
+        const MetadataField &field = fields[i];
+        const MetadataColumn &column = this->m_columns[i];
+        if (field.type == MetadataFieldType::Float32)
+        {
+            if (field.width == 1)
+            {
+                PackAndAppendMetadata(this->m_src, field.key.c_str(), column.floatValues);
+            }
+            else
+            {
+                PackAndAppendMetadata(this->m_src, field.key.c_str(), SplitColumn(column.floatValues, field.width));
+            }
+        }
+        else if (field.formatter)
+        {
+            std::vector<std::string> formatted;
+            formatted.reserve(column.intValues.size());
+            for (int64_t value : column.intValues)
+            {
+                formatted.push_back(field.formatter(value));
+            }
+            if (field.width == 1)
+            {
+                PackAndAppendMetadata(this->m_src, field.key.c_str(), formatted);
+            }
+            else
+            {
+                PackAndAppendMetadata(this->m_src, field.key.c_str(), SplitColumn(formatted, field.width));
+            }
+        }
+        else
+        {
+            if (field.width == 1)
+            {
+                PackAndAppendMetadata(this->m_src, field.key.c_str(), column.intValues);
+            }
+            else
+            {
+                PackAndAppendMetadata(this->m_src, field.key.c_str(), SplitColumn(column.intValues, field.width));
+            }
+        }
+    }
+    if (this->m_compressionController)
+    {
+        std::vector<std::string> codecs;
+        codecs.reserve(this->m_compressionCodecs.size());
+        for (int64_t compcode : this->m_compressionCodecs)
+        {
+            codecs.push_back(CompressionCodecToString(static_cast<int>(compcode)));
+        }
+        PackAndAppendMetadata(this->m_src, COMPRESSION_CODEC_KEY, codecs);
+        PackAndAppendMetadata(this->m_src, COMPRESSION_LEVEL_KEY, this->m_compressionLevels);
+    }
     for (const QString &key : m_additionalMetadata.keys())
     {
         PackAndAppendMetadata(this->m_src, key.toUtf8().constData(), this->m_additionalMetadata[key]);
@@ -75,25 +355,228 @@ void FileImage::AppendMetadata()
 }
 
 void FileImage::WriteImageData(XI_IMG image, QMap<QString, float> additionalMetadata)
+{
+    if (this->m_defaultRecord.intValues.empty())
+    {
+        throw std::logic_error("Images of files with a custom metadata schema need to be written with a record.");
+    }
+    this->m_defaultProviders.Sample(image, this->m_defaultRecord);
+    this->WriteImageData(image, this->m_defaultRecord);
+    for (const QString &key : additionalMetadata.keys())
+    {
+        m_additionalMetadata[key].push_back(additionalMetadata[key]);
+    }
+}
+
+void FileImage::WriteImageData(const XI_IMG &image, const FrameMetadataRecord &record)
 {
     const size_t buffer_size = static_cast<size_t>(image.width) * static_cast<size_t>(image.height) * sizeof(uint16_t);
     if (buffer_size > static_cast<size_t>(INT64_MAX))
     {
         throw std::overflow_error("Buffer size exceeds the maximum value of int64_t.");
     }
+    auto start = boost::chrono::steady_clock::now();
     int result = b2nd_append(m_src, image.bp, static_cast<int64_t>(buffer_size), 0);
     HandleBLOSCResult(result, "b2nd_append");
-    // store metadata
-    this->m_exposureMetadata.emplace_back(image.exposure_time_us);
-    this->m_acqNframeMetadata.emplace_back(image.acq_nframe);
-    this->m_colorFilterArray.emplace_back(ColorFilterToString(image.color_filter_array));
-    this->m_timeStamp.emplace_back(GetTimeStamp().toStdString());
-    for (const QString &key : additionalMetadata.keys())
+    this->UpdateCompressionSettings(start, boost::chrono::steady_clock::now());
+    this->StoreMetadataRecord(record);
+}
+
+void FileImage::EnableAdaptiveCompression()
+{
+    if (this->m_src->sc->compcode == LOCO_CODEC_ID)
     {
-        m_additionalMetadata[key].push_back(additionalMetadata[key]);
+        throw std::logic_error("Adaptive compression can not be combined with the LOCO codec.");
+    }
+    CompressionSettings initialSettings{this->m_src->sc->compcode, this->m_src->sc->clevel};
+    this->m_compressionController = std::make_unique<CompressionController>(initialSettings);
+    this->m_compressionCodecs.reserve(METADATA_RESERVED_FRAMES);
+    this->m_compressionLevels.reserve(METADATA_RESERVED_FRAMES);
+}
+
+void FileImage::UseLocoCodec(unsigned int mosaicWidth, unsigned int mosaicHeight)
+{
+    if (this->m_compressionController)
+    {
+        throw std::logic_error("The LOCO codec can not be combined with adaptive compression.");
+    }
+    this->m_locoParams.width = static_cast<uint32_t>(this->m_src->shape[2]);
+    this->m_locoParams.mosaicWidth = static_cast<uint8_t>(mosaicWidth);
+    this->m_locoParams.mosaicHeight = static_cast<uint8_t>(mosaicHeight);
+    this->ReplaceCompressionContext(CreateLocoCParams(&this->m_locoParams));
+    WriteLocoCodecParams(this->m_src, this->m_locoParams);
+}
+
+void FileImage::EnableColumnarMetadata()
+{
+    this->m_columnarMetadata = true;
+}
+
+void FileImage::ConfigureCompression(const CompressionOptions &options)
+{
+    if (options.columnarMetadata)
+    {
+        this->EnableColumnarMetadata();
+    }
+    if (options.locoCodec)
+    {
+        this->UseLocoCodec(options.mosaicWidth, options.mosaicHeight);
+    }
+    if (options.adaptive)
+    {
+        this->EnableAdaptiveCompression();
     }
 }
 
+void FileImage::SetQueueFill(double fill)
+{
+    this->m_queueFill = fill;
+}
+
+void FileImage::UpdateCompressionSettings(boost::chrono::steady_clock::time_point start,
+                                          boost::chrono::steady_clock::time_point end)
+{
+    if (!this->m_compressionController)
+    {
+        return;
+    }
+    CompressionSettings settings = this->m_compressionController->GetSettings();
+    this->m_compressionCodecs.push_back(settings.compcode);
+    this->m_compressionLevels.push_back(settings.clevel);
+    double intervalSeconds = 0;
+    if (this->m_lastWriteTime != boost::chrono::steady_clock::time_point())
+    {
+        intervalSeconds = boost::chrono::duration<double>(start - this->m_lastWriteTime).count();
+    }
+    this->m_lastWriteTime = start;
+    double compressionSeconds = boost::chrono::duration<double>(end - start).count();
+    if (this->m_compressionController->Update(compressionSeconds, intervalSeconds, this->m_queueFill))
+    {
+        this->ApplyCompressionSettings(this->m_compressionController->GetSettings());
+    }
+}
+
+void FileImage::ApplyCompressionSettings(const CompressionSettings &settings)
+{
+    blosc2_cparams cparams;
+    int result = blosc2_ctx_get_cparams(this->m_src->sc->cctx, &cparams);
+    HandleBLOSCResult(result, "blosc2_ctx_get_cparams");
+    cparams.compcode = static_cast<uint8_t>(settings.compcode);
+    cparams.clevel = static_cast<uint8_t>(settings.clevel);
+    this->ReplaceCompressionContext(cparams);
+    LOG_XILENS(debug) << "Compression changed to " << CompressionCodecToString(settings.compcode) << " level "
+                      << settings.clevel << ", load " << this->m_compressionController->GetLoad();
+}
+
+void FileImage::ReplaceCompressionContext(blosc2_cparams cparams)
+{
+    blosc2_cparams current;
+    int result = blosc2_ctx_get_cparams(this->m_src->sc->cctx, &current);
+    HandleBLOSCResult(result, "blosc2_ctx_get_cparams");
+    cparams.blocksize = current.blocksize;
+    cparams.nthreads = current.nthreads;
+    cparams.schunk = current.schunk;
+    blosc2_context *cctx = blosc2_create_cctx(cparams);
+    if (cctx == nullptr)
+    {
+        throw std::runtime_error("Could not create compression context.");
+    }
+    blosc2_free_ctx(this->m_src->sc->cctx);
+    this->m_src->sc->cctx = cctx;
+    this->m_src->sc->compcode = cparams.compcode;
+    this->m_src->sc->clevel = cparams.clevel;
+    for (int i = 0; i < BLOSC2_MAX_FILTERS; i++)
+    {
+        this->m_src->sc->filters[i] = cparams.filters[i];
+        this->m_src->sc->filters_meta[i] = cparams.filters_meta[i];
+    }
+}
+
+void FileImage::WriteCompressedImageData(const std::vector<uint8_t> &chunk, const FrameMetadataRecord &record)
+{
+    if (this->m_compressionController)
+    {
+        throw std::logic_error("Compressed images can not be written to files with adaptive compression.");
+    }
+    // grow the array by one frame and replace the empty chunk created by the resize with the compressed image
+    int64_t newShape[] = {this->m_src->shape[0] + 1, this->m_src->shape[1], this->m_src->shape[2]};
+    int result = b2nd_resize(this->m_src, newShape, nullptr);
+    HandleBLOSCResult(result, "b2nd_resize");
+    int64_t nChunks = blosc2_schunk_update_chunk(this->m_src->sc, this->m_src->sc->nchunks - 1,
+                                                 const_cast<uint8_t *>(chunk.data()), true);
+    if (nChunks < 0)
+    {
+        throw std::runtime_error("Error after blosc2_schunk_update_chunk " + std::to_string(nChunks));
+    }
+    this->StoreMetadataRecord(record);
+}
+
+void FileImage::StoreMetadataRecord(const FrameMetadataRecord &record)
+{
+    const auto &fields = this->m_schema.GetFields();
+    for (size_t i = 0; i < fields.size(); i++)
+    {
+        const MetadataField &field = fields[i];
+        MetadataColumn &column = this->m_columns[i];
+        if (field.type == MetadataFieldType::Int64)
+        {
+            auto first = record.intValues.begin() + static_cast<std::ptrdiff_t>(field.offset);
+            column.intValues.insert(column.intValues.end(), first, first + static_cast<std::ptrdiff_t>(field.width));
+        }
+        else
+        {
+            auto first = record.floatValues.begin() + static_cast<std::ptrdiff_t>(field.offset);
+            column.floatValues.insert(column.floatValues.end(), first,
+                                      first + static_cast<std::ptrdiff_t>(field.width));
+        }
+    }
+}
+
+FrameCompressor::FrameCompressor(unsigned int imageHeight, unsigned int imageWidth,
+                                 const CompressionOptions &compression)
+    : m_imageHeight(imageHeight), m_imageWidth(imageWidth)
+{
+    blosc2_cparams cparams = CreateRecordingCParams();
+    if (compression.locoCodec)
+    {
+        this->m_locoParams = {static_cast<uint32_t>(imageWidth), static_cast<uint8_t>(compression.mosaicWidth),
+                              static_cast<uint8_t>(compression.mosaicHeight)};
+        int nthreads = cparams.nthreads;
+        cparams = CreateLocoCParams(&this->m_locoParams);
+        cparams.nthreads = nthreads;
+    }
+    // a single block per image, as FileImage uses the image shape as block shape
+    cparams.blocksize = static_cast<int32_t>(static_cast<size_t>(imageHeight) * imageWidth * sizeof(uint16_t));
+    this->m_cctx = blosc2_create_cctx(cparams);
+    if (this->m_cctx == nullptr)
+    {
+        throw std::runtime_error("Could not create compression context.");
+    }
+}
+
+FrameCompressor::~FrameCompressor()
+{
+    blosc2_free_ctx(this->m_cctx);
+}
+
+void FrameCompressor::Compress(const XI_IMG &image, std::vector<uint8_t> &chunk)
+{
+    if (static_cast<unsigned int>(image.height) != this->m_imageHeight ||
+        static_cast<unsigned int>(image.width) != this->m_imageWidth)
+    {
+        throw std::runtime_error("Image shape does not match the shape of the compressor.");
+    }
+    const auto nBytes = static_cast<int32_t>(static_cast<size_t>(image.height) * image.width * sizeof(uint16_t));
+    chunk.resize(static_cast<size_t>(nBytes) + BLOSC2_MAX_OVERHEAD);
+    int compressedBytes = blosc2_compress_ctx(this->m_cctx, image.bp, nBytes, chunk.data(),
+                                              static_cast<int32_t>(chunk.size()));
+    if (compressedBytes <= 0)
+    {
+        throw std::runtime_error("Error while compressing image: " + std::to_string(compressedBytes));
+    }
+    chunk.resize(static_cast<size_t>(compressedBytes));
+}
+
 template <typename T> void PackAndAppendMetadata(b2nd_array_t *src, const char *key, const std::vector<T> &metadata)
 {
     // pack metadata and add it to array
@@ -197,8 +680,8 @@ void AppendBLOSCVLMetadata(b2nd_array_t *src, const char *key, msgpack::sbuffer
             case msgpack::type::POSITIVE_INTEGER:
             case msgpack::type::NEGATIVE_INTEGER: {
                 // It's a vector of ints
-                auto oldData = oldoh.get().as<std::vector<int>>();
-                auto appendData = newoh.get().as<std::vector<int>>();
+                auto oldData = oldoh.get().as<std::vector<int64_t>>();
+                auto appendData = newoh.get().as<std::vector<int64_t>>();
                 oldData.insert(oldData.end(), appendData.begin(), appendData.end());
                 msgpack::pack(sbuf, oldData);
                 break;
@@ -212,6 +695,14 @@ void AppendBLOSCVLMetadata(b2nd_array_t *src, const char *key, msgpack::sbuffer
                 msgpack::pack(sbuf, oldData);
                 break;
             }
+            case msgpack::type::ARRAY: {
+                // It's a vector of arrays, one per frame, the type of the values is preserved as is
+                auto oldData = oldoh.get().as<std::vector<msgpack::object>>();
+                auto appendData = newoh.get().as<std::vector<msgpack::object>>();
+                oldData.insert(oldData.end(), appendData.begin(), appendData.end());
+                msgpack::pack(sbuf, oldData);
+                break;
+            }
             default: {
                 LOG_XILENS(error) << "Cannot handle MsgPack data type: " << oldoh.get().via.array.ptr[0].type;
                 throw std::runtime_error("Unhandled MsgPack type.");
@@ -232,6 +723,42 @@ void AppendBLOSCVLMetadata(b2nd_array_t *src, const char *key, msgpack::sbuffer
     }
 }
 
+void WriteBLOSCVLMetadata(b2nd_array_t *src, const char *key, msgpack::sbuffer &data)
+{
+    int result;
+    if (blosc2_vlmeta_exists(src->sc, key) < 0)
+    {
+        result = blosc2_vlmeta_add(src->sc, key, reinterpret_cast<uint8_t *>(data.data()), data.size(), nullptr);
+    }
+    else
+    {
+        result = blosc2_vlmeta_update(src->sc, key, reinterpret_cast<uint8_t *>(data.data()), data.size(), nullptr);
+    }
+    if (result < 0)
+    {
+        LOG_XILENS(error) << "Error while trying to write metadata for key: " << key;
+        throw std::runtime_error("Error when writing variable length metadata");
+    }
+}
+
+msgpack::object_handle GetBLOSCVLMetadata(b2nd_array_t *src, const char *key)
+{
+    if (blosc2_vlmeta_exists(src->sc, key) < 0)
+    {
+        throw std::runtime_error(std::string("Metadata not found: ") + key);
+    }
+    uint8_t *content = nullptr;
+    int32_t content_len;
+    int result = blosc2_vlmeta_get(src->sc, key, &content, &content_len);
+    if (result < 0)
+    {
+        throw std::runtime_error("Error when using blosc2_vlmeta_get");
+    }
+    msgpack::object_handle oh = msgpack::unpack(reinterpret_cast<const char *>(content), content_len);
+    free(content);
+    return oh;
+}
+
 void WaitMilliseconds(int milliseconds)
 {
     boost::this_thread::sleep_for(boost::chrono::milliseconds(milliseconds));
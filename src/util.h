@@ -10,6 +10,7 @@
 
 #include <QMap>
 #include <QString>
+#include <boost/chrono.hpp>
 #include <boost/log/trivial.hpp>
 #include <cstdio>
 #include <iostream>
@@ -18,6 +19,12 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <stdexcept>
 #include <string>
+#include <vector>
+
+#include "compressionController.h"
+#include "locoCodec.h"
+#include "metadataProviders.h"
+#include "recordingFile.h"
 
 /**
  * Handles the result from the XiAPI, shows an error message and throws a
@@ -45,34 +52,41 @@
     }
 
 /**
- * @brief Image container responsible of writing images to a file, including metadata.
- *
- * This class manges the writing of images to a file. Writing metadata to the file needs to be triggered through the
- * method FileImage::AppendMetadata.
+ * @brief Compression settings of a recording, applied with FileImage::ConfigureCompression.
  */
-class FileImage
+struct CompressionOptions
 {
-  public:
     /**
-     * exposure time in microseconds
+     * Whether the compression adapts to the load of the recorder, see FileImage::EnableAdaptiveCompression.
      */
-    std::vector<int> m_exposureMetadata;
+    bool adaptive = false;
 
     /**
-     * number of frame acquired by the camera
+     * Whether images are compressed with the predictive LOCO codec, see FileImage::UseLocoCodec.
      */
-    std::vector<int> m_acqNframeMetadata;
+    bool locoCodec = false;
 
     /**
-     * string determining the type of filter array of an RGB camera
+     * Shape of the mosaic of the sensor, used by the LOCO codec.
      */
-    std::vector<std::string> m_colorFilterArray;
+    unsigned int mosaicWidth = 1;
+    unsigned int mosaicHeight = 1;
 
     /**
-     * string determining the time stamp when images where acquired
+     * Whether the per-frame metadata is stored with the columnar encoding, see FileImage::EnableColumnarMetadata.
      */
-    std::vector<std::string> m_timeStamp;
+    bool columnarMetadata = false;
+};
 
+/**
+ * @brief Image container responsible of writing images to a file, including metadata.
+ *
+ * This class manges the writing of images to a file. Writing metadata to the file needs to be triggered through the
+ * method FileImage::AppendMetadata.
+ */
+class FileImage : public RecordingFile
+{
+  public:
     /**
      * additional metadata to append to the NDArrays. Each vector will be appended to the vl metadata of the array
      * using the key of the map as identifier.
@@ -95,29 +109,239 @@ class FileImage
     b2nd_array_t *m_src; // New member to store array
 
     /**
-     * Opens a file and throws runtime error when opening fails
+     * Opens a file and throws runtime error when opening fails. Only the metadata contained in the XIMEA image is
+     * recorded per frame, see ImageMetadataProvider.
      * @param filePath path to file to open
      */
     FileImage(const char *filePath, unsigned int imageHeight, unsigned int imageWidth);
 
+    /**
+     * Opens a file and throws runtime error when opening fails
+     * @param filePath path to file to open
+     * @param schema per-frame metadata fields recorded with each image
+     */
+    FileImage(const char *filePath, unsigned int imageHeight, unsigned int imageWidth, const MetadataSchema &schema);
+
     /**
      * Frees blosc2 context and releases the resources associated with the file.
      */
-    ~FileImage();
+    ~FileImage() override;
 
     /**
-     * Writes the content of an image into a file in UINT16 format
+     * Writes the content of an image into a file in UINT16 format. Can only be used when the file was opened without a
+     * custom metadata schema.
      * @param image Ximea image where data is stored
      * @param additionalMetadata Additional metadata to be stored in the array
+     * @throws std::logic_error if the file was opened with a custom metadata schema
      */
     void WriteImageData(XI_IMG image, QMap<QString, float> additionalMetadata);
 
+    /**
+     * Writes the content of an image into a file in UINT16 format
+     * @param image Ximea image where data is stored
+     * @param record metadata of the image, sampled with the schema of this file
+     */
+    void WriteImageData(const XI_IMG &image, const FrameMetadataRecord &record) override;
+
+    /**
+     * Appends an image compressed with FrameCompressor as a new chunk of the array
+     * @param chunk compressed image, it needs to have the shape of the images of this file
+     * @param record metadata of the image, sampled with the schema of this file
+     * @throws std::logic_error if adaptive compression is enabled
+     */
+    void WriteCompressedImageData(const std::vector<uint8_t> &chunk, const FrameMetadataRecord &record) override;
+
+    /**
+     * Lets a CompressionController choose the codec and compression level of each image, based on the time spent
+     * writing images and on the queue fill reported with FileImage::SetQueueFill. The settings used for each image are
+     * stored in the metadata under COMPRESSION_CODEC_KEY and COMPRESSION_LEVEL_KEY. Needs to be enabled before the
+     * first image is written.
+     */
+    void EnableAdaptiveCompression();
+
+    /**
+     * Compresses the following images with the predictive LOCO codec instead of ZSTD, see CreateLocoCParams. The
+     * codec needs to be registered with RegisterLocoCodec, also to read the file. Needs to be called before the first
+     * image is written. The geometry is stored in the file, such that reopened files append with the same mosaic.
+     * @param mosaicWidth width of the mosaic of the sensor, 1 for sensors without filter array
+     * @param mosaicHeight height of the mosaic of the sensor, 1 for sensors without filter array
+     * @throws std::logic_error if adaptive compression is enabled
+     */
+    void UseLocoCodec(unsigned int mosaicWidth, unsigned int mosaicHeight);
+
+    /**
+     * Stores the per-frame metadata delta, run-length and dictionary encoded, see metadataCodec.h. The metadata of
+     * long recordings shrinks to a few runs per field, it needs to be read with ReadMetadataColumn. Needs to be
+     * enabled before FileImage::AppendMetadata is called.
+     */
+    void EnableColumnarMetadata();
+
+    /**
+     * Applies the compression settings of a recording, needs to be called before the first image is written.
+     * @param options compression settings
+     * @throws std::logic_error if adaptive compression and the LOCO codec are both enabled
+     */
+    void ConfigureCompression(const CompressionOptions &options);
+
+    /**
+     * Stores the queue fill used by the adaptive compression for the next image
+     * @param fill fraction of the queue in use, from 0 to 1
+     */
+    void SetQueueFill(double fill) override;
+
     /**
      * Appends metadata to BLOSC ND array. This method should be called before
      * closing the file.
      *
      */
-    void AppendMetadata();
+    void AppendMetadata() override;
+
+    /**
+     * Queries the path of the file.
+     */
+    std::string GetFilePath() const override;
+
+    /**
+     * Queries the number of images in the file, including those written before the file was opened.
+     */
+    int64_t GetNumberOfFrames() const;
+
+  private:
+    /**
+     * Values of a single metadata field for all recorded frames
+     */
+    struct MetadataColumn
+    {
+        std::vector<int64_t> intValues;
+        std::vector<float> floatValues;
+    };
+
+    /**
+     * Opens the file and allocates the metadata columns, shared by all constructors
+     */
+    void Open(const char *filePath, unsigned int imageHeight, unsigned int imageWidth);
+
+    /**
+     * Appends the values of a record to the metadata columns
+     */
+    void StoreMetadataRecord(const FrameMetadataRecord &record);
+
+    /**
+     * Feeds the time spent writing the last image to the compression controller and applies its new settings
+     */
+    void UpdateCompressionSettings(boost::chrono::steady_clock::time_point start,
+                                   boost::chrono::steady_clock::time_point end);
+
+    /**
+     * Replaces the compression context of the array, the following images are compressed with the new settings
+     */
+    void ApplyCompressionSettings(const CompressionSettings &settings);
+
+    /**
+     * Replaces the compression context of the array, keeping the block size and number of threads of the current one
+     */
+    void ReplaceCompressionContext(blosc2_cparams cparams);
+
+    /**
+     * Writes the recorded metadata with the columnar encoding, after the metadata stored by earlier sessions of a
+     * reopened file
+     */
+    void AppendColumnarMetadata();
+
+    /**
+     * Per-frame metadata fields recorded with each image
+     */
+    MetadataSchema m_schema;
+
+    /**
+     * Recorded metadata, one column per field of FileImage::m_schema
+     */
+    std::vector<MetadataColumn> m_columns;
+
+    /**
+     * Providers used when images are written with additional metadata in a map
+     */
+    MetadataProviderRegistry m_defaultProviders;
+
+    /**
+     * Record reused by FileImage::m_defaultProviders
+     */
+    FrameMetadataRecord m_defaultRecord;
+
+    /**
+     * Controller of the compression settings, null when adaptive compression is disabled
+     */
+    std::unique_ptr<CompressionController> m_compressionController;
+    boost::chrono::steady_clock::time_point m_lastWriteTime;
+    double m_queueFill = 0;
+
+    /**
+     * Compression settings of each written image, only recorded when adaptive compression is enabled
+     */
+    std::vector<int64_t> m_compressionCodecs;
+    std::vector<int64_t> m_compressionLevels;
+
+    /**
+     * Geometry of the images used by the LOCO codec, the compression context points to it
+     */
+    LocoCodecParams m_locoParams{};
+
+    /**
+     * Whether the per-frame metadata is written with the columnar encoding
+     */
+    bool m_columnarMetadata = false;
+};
+
+/**
+ * Creates the compression parameters of the recorded images, shared by FileImage and FrameCompressor: ZSTD with
+ * bit and byte shuffle.
+ */
+blosc2_cparams CreateRecordingCParams();
+
+/**
+ * @brief Compresses images into chunks that can be appended to a FileImage with FileImage::WriteCompressedImageData.
+ *
+ * The compression parameters are the ones used by FileImage, or those of the LOCO codec if it is requested, each image
+ * is compressed into a single chunk with a single block, which is how FileImage stores images.
+ */
+class FrameCompressor
+{
+  public:
+    /**
+     * Creates the compression context.
+     * @param imageHeight height of the images
+     * @param imageWidth width of the images
+     * @param compression compression settings, only the codec and the mosaic used by the LOCO codec are applied. The
+     * files the chunks are written to need to use the same codec, see FileImage::UseLocoCodec.
+     */
+    FrameCompressor(unsigned int imageHeight, unsigned int imageWidth,
+                    const CompressionOptions &compression = CompressionOptions());
+
+    /**
+     * Frees the compression context.
+     */
+    ~FrameCompressor();
+
+    FrameCompressor(const FrameCompressor &) = delete;
+    FrameCompressor &operator=(const FrameCompressor &) = delete;
+
+    /**
+     * Compresses an image
+     * @param image Ximea image where data is stored, it needs to have the shape given to the constructor
+     * @param chunk destination of the compressed image, its memory is reused between calls
+     * @throws std::runtime_error if the image does not have the expected shape or can not be compressed
+     */
+    void Compress(const XI_IMG &image, std::vector<uint8_t> &chunk);
+
+  private:
+    blosc2_context *m_cctx;
+    unsigned int m_imageHeight;
+    unsigned int m_imageWidth;
+
+    /**
+     * Geometry of the images used by the LOCO codec, the compression context points to it
+     */
+    LocoCodecParams m_locoParams{};
 };
 
 /**
@@ -129,6 +353,25 @@ class FileImage
  */
 void AppendBLOSCVLMetadata(b2nd_array_t *src, const char *key, msgpack::sbuffer &newData);
 
+/**
+ * Stores variable length metadata in a BLOSC n-dimensional array, replacing the content of the key if it exists
+ *
+ * @param src BLOSC n-dimensional array where the metadata will be stored
+ * @param key string to be used as a key for naming the medata data variable
+ * @param data data package with `Message Pack <https://msgpack.org/>`_.
+ */
+void WriteBLOSCVLMetadata(b2nd_array_t *src, const char *key, msgpack::sbuffer &data);
+
+/**
+ * Reads and unpacks variable length metadata from a BLOSC n-dimensional array
+ *
+ * @param src BLOSC n-dimensional array where the metadata is stored
+ * @param key name of the metadata variable
+ * @return handle to the unpacked `Message Pack <https://msgpack.org/>`_ object
+ * @throws std::runtime_error if the key does not exist
+ */
+msgpack::object_handle GetBLOSCVLMetadata(b2nd_array_t *src, const char *key);
+
 /**
  * Packs and appends the metadata associated with a BLOSC NDarray
  *
@@ -171,6 +414,27 @@ struct CommandLineArguments
 {
     bool test_mode;
     bool version;
+    std::string staging_folder;
+    double archive_bandwidth;
+    int archive_clevel;
+    double archive_noise_tolerance;
+    double read_noise;
+    double sensor_gain;
+    std::vector<std::string> stripe_folders;
+    std::string mirror_folder;
+    bool adaptive_compression;
+    std::string codec;
+    bool columnar_metadata;
+    std::string daemon_socket;
+    double thermal_limit;
+    double thermal_hysteresis;
+    bool stabilize_rotation;
+    std::string classifier_model;
+    bool record_class_maps;
+    std::vector<std::string> rois;
+    double roi_budget;
+    int noise_window;
+    std::string white_balance;
 };
 
 /**
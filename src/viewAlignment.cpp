@@ -0,0 +1,264 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "viewAlignment.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <algorithm>
+#include <cmath>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+
+#include "xilensReader.h"
+
+/**
+ * Number of rows blended by each task of ViewWarper::Fuse.
+ */
+static const int FUSE_STRIPE_ROWS = 64;
+
+cv::Mat GetCalibrationImage(const cv::Mat &frame, int mosaicWidth, int mosaicHeight)
+{
+    if (frame.type() != CV_16UC1 || mosaicWidth < 1 || mosaicHeight < 1 || frame.cols < mosaicWidth ||
+        frame.rows < mosaicHeight)
+    {
+        throw std::invalid_argument("Calibration images are computed from raw frames of type CV_16UC1.");
+    }
+    cv::Size completeSize(frame.cols / mosaicWidth, frame.rows / mosaicHeight);
+    cv::Mat average;
+    cv::resize(frame(cv::Rect(0, 0, completeSize.width * mosaicWidth, completeSize.height * mosaicHeight)), average,
+               completeSize, 0, 0, cv::INTER_AREA);
+    cv::copyMakeBorder(average, average, 0, (frame.rows + mosaicHeight - 1) / mosaicHeight - completeSize.height, 0,
+                       (frame.cols + mosaicWidth - 1) / mosaicWidth - completeSize.width, cv::BORDER_REPLICATE);
+    cv::Mat image;
+    cv::normalize(average, image, 0, 255, cv::NORM_MINMAX, CV_8U);
+    return image;
+}
+
+/**
+ * Detects the inner corners of a chessboard with sub-pixel accuracy.
+ */
+static std::vector<cv::Point2f> FindChessboardCorners(const cv::Mat &image, cv::Size patternSize, const char *view)
+{
+    if (image.type() != CV_8UC1)
+    {
+        throw std::invalid_argument("The calibration target is detected on images of type CV_8UC1.");
+    }
+    std::vector<cv::Point2f> corners;
+    if (!cv::findChessboardCorners(image, patternSize, corners,
+                                   cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE))
+    {
+        throw std::runtime_error(std::string("Calibration target not found in the ") + view + " image.");
+    }
+    cv::cornerSubPix(image, corners, cv::Size(5, 5), cv::Size(-1, -1),
+                     cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.01));
+    return corners;
+}
+
+ViewAlignment EstimateViewAlignment(const cv::Mat &source, const cv::Mat &target, cv::Size patternSize,
+                                    double targetScale)
+{
+    if (patternSize.width < 3 || patternSize.height < 3 || targetScale <= 0)
+    {
+        throw std::invalid_argument("The calibration target needs at least 3x3 inner corners.");
+    }
+    std::vector<cv::Point2f> sourceCorners = FindChessboardCorners(source, patternSize, "source");
+    std::vector<cv::Point2f> targetCorners = FindChessboardCorners(target, patternSize, "target");
+    for (auto &corner : targetCorners)
+    {
+        // centers of the pixels of the target image in pixels of the target view
+        corner = (corner + cv::Point2f(0.5f, 0.5f)) * static_cast<float>(targetScale) - cv::Point2f(0.5f, 0.5f);
+    }
+    // the corners of symmetric targets may be ordered from either end, both cameras are assumed to be upright
+    if ((sourceCorners.back() - sourceCorners.front()).dot(targetCorners.back() - targetCorners.front()) < 0)
+    {
+        std::reverse(sourceCorners.begin(), sourceCorners.end());
+    }
+    cv::Mat homography = cv::findHomography(sourceCorners, targetCorners, cv::RANSAC, 3 * targetScale);
+    if (homography.empty())
+    {
+        throw std::runtime_error("Could not estimate the alignment from the calibration target.");
+    }
+
+    ViewAlignment alignment;
+    alignment.homography = cv::Matx33d(homography);
+    alignment.sourceSize = source.size();
+    alignment.targetSize = cv::Size(static_cast<int>(std::lround(target.cols * targetScale)),
+                                    static_cast<int>(std::lround(target.rows * targetScale)));
+    std::vector<cv::Point2f> mappedCorners;
+    cv::perspectiveTransform(sourceCorners, mappedCorners, homography);
+    double squaredError = 0;
+    for (size_t i = 0; i < mappedCorners.size(); i++)
+    {
+        cv::Point2f difference = mappedCorners[i] - targetCorners[i];
+        squaredError += difference.dot(difference);
+    }
+    alignment.reprojectionError = std::sqrt(squaredError / static_cast<double>(mappedCorners.size()));
+    return alignment;
+}
+
+/**
+ * Reads a frame of a recording as raw image of type CV_16UC1.
+ */
+static cv::Mat ReadCalibrationFrame(const std::string &filePath, int64_t frameIndex)
+{
+    RecordingReader reader(filePath);
+    if (frameIndex < 0 || frameIndex >= reader.GetNumberOfFrames())
+    {
+        throw std::runtime_error("Frame " + std::to_string(frameIndex) + " not found in " + filePath);
+    }
+    std::vector<uint16_t> buffer;
+    reader.ReadFrame(frameIndex, buffer);
+    return cv::Mat(static_cast<int>(reader.GetHeight()), static_cast<int>(reader.GetWidth()), CV_16UC1, buffer.data())
+        .clone();
+}
+
+ViewAlignment CalibrateViewAlignment(const std::string &sourcePath, int sourceMosaicWidth, int sourceMosaicHeight,
+                                     const std::string &targetPath, int targetMosaic, cv::Size patternSize,
+                                     int64_t frameIndex)
+{
+    cv::Mat source = GetCalibrationImage(ReadCalibrationFrame(sourcePath, frameIndex), sourceMosaicWidth,
+                                         sourceMosaicHeight);
+    cv::Mat targetFrame = ReadCalibrationFrame(targetPath, frameIndex);
+    ViewAlignment alignment = EstimateViewAlignment(
+        source, GetCalibrationImage(targetFrame, targetMosaic, targetMosaic), patternSize, targetMosaic);
+    // superpixels cut by the border of the target frame are part of the target view
+    alignment.targetSize = targetFrame.size();
+    return alignment;
+}
+
+void WriteViewAlignment(const std::string &filePath, const ViewAlignment &alignment)
+{
+    QJsonArray homography;
+    for (int i = 0; i < 9; i++)
+    {
+        homography.append(alignment.homography.val[i]);
+    }
+    QJsonObject root;
+    root["version"] = VIEW_ALIGNMENT_VERSION;
+    root["model"] = "homography";
+    root["homography"] = homography;
+    root["sourceWidth"] = alignment.sourceSize.width;
+    root["sourceHeight"] = alignment.sourceSize.height;
+    root["targetWidth"] = alignment.targetSize.width;
+    root["targetHeight"] = alignment.targetSize.height;
+    root["reprojectionError"] = alignment.reprojectionError;
+
+    QSaveFile file(QString::fromStdString(filePath));
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(root).toJson()) < 0 || !file.commit())
+    {
+        throw std::runtime_error("Could not write view alignment " + filePath);
+    }
+}
+
+ViewAlignment ReadViewAlignment(const std::string &filePath)
+{
+    QFile file(QString::fromStdString(filePath));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        throw std::runtime_error("Could not open view alignment " + filePath);
+    }
+    QJsonParseError error{};
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || !document.isObject())
+    {
+        throw std::runtime_error("Could not parse view alignment " + filePath);
+    }
+    QJsonObject root = document.object();
+    QJsonArray homography = root["homography"].toArray();
+    if (root["version"].toInt() != VIEW_ALIGNMENT_VERSION || root["model"].toString() != "homography" ||
+        homography.size() != 9)
+    {
+        throw std::runtime_error("Unsupported view alignment " + filePath);
+    }
+    ViewAlignment alignment;
+    for (int i = 0; i < 9; i++)
+    {
+        alignment.homography.val[i] = homography[i].toDouble();
+    }
+    alignment.sourceSize = cv::Size(root["sourceWidth"].toInt(), root["sourceHeight"].toInt());
+    alignment.targetSize = cv::Size(root["targetWidth"].toInt(), root["targetHeight"].toInt());
+    alignment.reprojectionError = root["reprojectionError"].toDouble();
+    return alignment;
+}
+
+ViewWarper::ViewWarper(const ViewAlignment &alignment) : m_alignment(alignment)
+{
+    if (alignment.sourceSize.empty() || alignment.targetSize.empty())
+    {
+        throw std::invalid_argument("The view alignment has no image sizes.");
+    }
+    cv::Matx33d inverse;
+    if (cv::invert(alignment.homography, inverse) == 0)
+    {
+        throw std::invalid_argument("The homography of the view alignment can not be inverted.");
+    }
+    // source position of the center of each target pixel
+    cv::Mat grid(alignment.targetSize, CV_32FC2);
+    for (int row = 0; row < grid.rows; row++)
+    {
+        auto *point = grid.ptr<cv::Point2f>(row);
+        for (int col = 0; col < grid.cols; col++)
+        {
+            point[col] = cv::Point2f(static_cast<float>(col), static_cast<float>(row));
+        }
+    }
+    cv::perspectiveTransform(grid, grid, inverse);
+    cv::convertMaps(grid, cv::noArray(), m_map1, m_map2, CV_16SC2);
+
+    cv::Mat seen(alignment.sourceSize, CV_8UC1, cv::Scalar(255));
+    cv::remap(seen, m_coverage, m_map1, m_map2, cv::INTER_NEAREST, cv::BORDER_CONSTANT, cv::Scalar(0));
+}
+
+void ViewWarper::Warp(const cv::Mat &src, cv::Mat &dst) const
+{
+    if (src.size() != m_alignment.sourceSize)
+    {
+        throw std::invalid_argument("The image does not have the size of the source view.");
+    }
+    cv::remap(src, dst, m_map1, m_map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+}
+
+void ViewWarper::Fuse(const cv::Mat &target, const cv::Mat &src, double opacity, cv::Mat &fused) const
+{
+    if (target.type() != CV_8UC3 || src.type() != CV_8UC3 || target.size() != m_alignment.targetSize)
+    {
+        throw std::invalid_argument("Only images of type CV_8UC3 with the size of the target view can be fused.");
+    }
+    cv::Mat warped;
+    this->Warp(src, warped);
+    fused.create(target.size(), target.type());
+    // fixed point weights, such that the blend vectorizes on integers
+    const int alpha = static_cast<int>(std::lround(std::clamp(opacity, 0., 1.) * 256));
+    cv::parallel_for_(
+        cv::Range(0, target.rows),
+        [&](const cv::Range &range) {
+            for (int row = range.start; row < range.end; row++)
+            {
+                const uchar *targetRow = target.ptr<uchar>(row);
+                const uchar *warpedRow = warped.ptr<uchar>(row);
+                const uchar *coverageRow = m_coverage.ptr<uchar>(row);
+                uchar *fusedRow = fused.ptr<uchar>(row);
+                for (int col = 0; col < target.cols; col++)
+                {
+                    const int weight = coverageRow[col] ? alpha : 0;
+                    for (int channel = 3 * col; channel < 3 * col + 3; channel++)
+                    {
+                        fusedRow[channel] = static_cast<uchar>(
+                            (targetRow[channel] * (256 - weight) + warpedRow[channel] * weight + 128) >> 8);
+                    }
+                }
+            }
+        },
+        std::max(1, target.rows / FUSE_STRIPE_ROWS));
+}
+
+const cv::Mat &ViewWarper::GetCoverage() const
+{
+    return m_coverage;
+}
@@ -0,0 +1,161 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_VIEW_ALIGNMENT_H
+#define XILENS_VIEW_ALIGNMENT_H
+
+#include <cstdint>
+#include <opencv2/core/core.hpp>
+#include <string>
+
+/**
+ * @brief Version of the files written by WriteViewAlignment.
+ */
+constexpr int VIEW_ALIGNMENT_VERSION = 1;
+
+/**
+ * @brief Spatial relation between the views of two cameras looking at the same scene, e.g. a spectral camera whose
+ * maps are overlaid on the images of an RGB camera.
+ */
+struct ViewAlignment
+{
+    /**
+     * Maps pixel coordinates of the source view, e.g. the band images of a spectral camera, to pixel coordinates of
+     * the target view.
+     */
+    cv::Matx33d homography = cv::Matx33d::eye();
+
+    /**
+     * Size of the images of the source view.
+     */
+    cv::Size sourceSize;
+
+    /**
+     * Size of the images of the target view.
+     */
+    cv::Size targetSize;
+
+    /**
+     * Root mean square distance in target pixels between the corners of the calibration target and their mapped
+     * positions.
+     */
+    double reprojectionError = 0;
+};
+
+/**
+ * Converts a raw frame to the 8 bit gray image the calibration target is detected on, by averaging each superpixel of
+ * the mosaic. Superpixels cut by the border of the image take the values of the last complete superpixel, such that
+ * the image has the size of the band images.
+ *
+ * @param frame raw frame of type CV_16UC1.
+ * @param mosaicWidth number of columns of the mosaic, 1 for cameras without mosaic.
+ * @param mosaicHeight number of rows of the mosaic, 1 for cameras without mosaic.
+ * @return image of type CV_8UC1 stretched to the full range.
+ */
+cv::Mat GetCalibrationImage(const cv::Mat &frame, int mosaicWidth, int mosaicHeight);
+
+/**
+ * Estimates the alignment of two views from a chessboard target seen by both cameras. The inner corners are detected
+ * in both images, refined to sub-pixel accuracy and related by a homography with RANSAC. The homography is exact for a
+ * planar scene and a good approximation when the cameras are close to each other compared to their distance to the
+ * scene. The cameras are assumed to be roughly upright with respect to each other, which resolves the ambiguous
+ * orientation of symmetric targets.
+ *
+ * @param source gray image of the source view of type CV_8UC1.
+ * @param target gray image of the target view of type CV_8UC1.
+ * @param patternSize number of inner corners per row and column of the chessboard.
+ * @param targetScale size of a pixel of the target image in pixels of the target view, e.g. 2 when the target image
+ * averages the 2x2 Bayer superpixels of an RGB camera.
+ * @return alignment from the source image to the target view.
+ * @throws std::runtime_error if the target is not found in both images.
+ */
+ViewAlignment EstimateViewAlignment(const cv::Mat &source, const cv::Mat &target, cv::Size patternSize,
+                                    double targetScale = 1);
+
+/**
+ * Estimates the alignment of two recordings of the same calibration target, see EstimateViewAlignment. The target is
+ * detected on the mosaic averages of a frame of each recording, the alignment maps the band images of the source
+ * camera to the full frames of the target camera.
+ *
+ * @param sourcePath path of the `.b2nd` file or recording manifest of the source camera, e.g. a spectral camera.
+ * @param sourceMosaicWidth number of columns of the mosaic of the source camera.
+ * @param sourceMosaicHeight number of rows of the mosaic of the source camera.
+ * @param targetPath path of the `.b2nd` file or recording manifest of the target camera, e.g. an RGB camera.
+ * @param targetMosaic size of the square mosaic of the target camera, e.g. 2 for a Bayer pattern.
+ * @param patternSize number of inner corners per row and column of the chessboard.
+ * @param frameIndex index of the frame of both recordings the target is detected on.
+ * @throws std::runtime_error if the recordings can not be read or the target is not found.
+ */
+ViewAlignment CalibrateViewAlignment(const std::string &sourcePath, int sourceMosaicWidth, int sourceMosaicHeight,
+                                     const std::string &targetPath, int targetMosaic, cv::Size patternSize,
+                                     int64_t frameIndex);
+
+/**
+ * Writes an alignment to a JSON file.
+ *
+ * @throws std::runtime_error if the file can not be written.
+ */
+void WriteViewAlignment(const std::string &filePath, const ViewAlignment &alignment);
+
+/**
+ * Reads an alignment written with WriteViewAlignment.
+ *
+ * @throws std::runtime_error if the file can not be read or its format is not supported.
+ */
+ViewAlignment ReadViewAlignment(const std::string &filePath);
+
+/**
+ * @brief Warps images of the source view onto the target view and fuses them with the images of the target camera.
+ *
+ * The source position of each target pixel is computed once from the alignment and stored in the fixed-point format
+ * that cv::remap applies fastest, together with the mask of the target pixels seen by the source camera. Each frame
+ * then only costs a remap and a blend with integer weights, in parallel over strips of rows, which is cheap enough for
+ * a live overlay.
+ */
+class ViewWarper
+{
+  public:
+    /**
+     * @param alignment alignment of the views, see EstimateViewAlignment.
+     * @throws std::invalid_argument if the alignment can not be inverted or has empty sizes.
+     */
+    explicit ViewWarper(const ViewAlignment &alignment);
+
+    /**
+     * Warps an image of the source view onto the target view, target pixels not seen by the source camera are black.
+     *
+     * @param src image with the size of the source view, e.g. a class map or true color image.
+     * @param dst warped image with the size of the target view.
+     * @throws std::invalid_argument if the image does not have the size of the source view.
+     */
+    void Warp(const cv::Mat &src, cv::Mat &dst) const;
+
+    /**
+     * Blends an image of the source view onto an image of the target view, where the source camera sees the scene.
+     *
+     * @param target image of the target view of type CV_8UC3.
+     * @param src image of the source view of type CV_8UC3.
+     * @param opacity weight of the source image, from 0 to 1.
+     * @param fused blended image with the size of the target view.
+     * @throws std::invalid_argument if the sizes or types of the images do not match the alignment.
+     */
+    void Fuse(const cv::Mat &target, const cv::Mat &src, double opacity, cv::Mat &fused) const;
+
+    /**
+     * Queries the mask of the target pixels seen by the source camera, of type CV_8UC1.
+     */
+    const cv::Mat &GetCoverage() const;
+
+  private:
+    ViewAlignment m_alignment;
+
+    /**
+     * Fixed-point remap tables, see cv::convertMaps.
+     */
+    cv::Mat m_map1;
+    cv::Mat m_map2;
+    cv::Mat m_coverage;
+};
+
+#endif // XILENS_VIEW_ALIGNMENT_H
@@ -0,0 +1,240 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "whiteBalance.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "recordingFormat.h"
+
+/**
+ * Number of bins of the histograms of WhiteBalanceMethod::WhitePatch, spread over the unsaturated raw values.
+ */
+static const int WHITE_PATCH_BINS = 256;
+
+/**
+ * Largest gain of a channel relative to the green channel, or its inverse the smallest gain.
+ */
+static const float MAX_GAIN = 8;
+
+WhiteBalanceMethod ParseWhiteBalanceMethod(const std::string &name)
+{
+    if (name == "gray-world")
+    {
+        return WhiteBalanceMethod::GrayWorld;
+    }
+    if (name == "white-patch")
+    {
+        return WhiteBalanceMethod::WhitePatch;
+    }
+    throw std::invalid_argument("Unknown white balance method: " + name);
+}
+
+/**
+ * Channel, 0 for red, 1 for green and 2 for blue, of the first two pixels of the first two rows of a Bayer mosaic.
+ */
+static std::array<int, 4> GetBayerChannels(int filterArrayType)
+{
+    switch (filterArrayType)
+    {
+    case XI_CFA_BAYER_RGGB:
+        return {0, 1, 1, 2};
+    case XI_CFA_BAYER_BGGR:
+        return {2, 1, 1, 0};
+    case XI_CFA_BAYER_GRBG:
+        return {1, 0, 2, 1};
+    case XI_CFA_BAYER_GBRG:
+        return {1, 2, 0, 1};
+    default:
+        throw std::invalid_argument("The white balance is estimated on Bayer mosaics only.");
+    }
+}
+
+WhiteBalanceEstimator::WhiteBalanceEstimator(WhiteBalanceOptions options) : m_options(options)
+{
+    if (options.smoothing <= 0 || options.smoothing > 1 || options.whitePatchFraction <= 0 ||
+        options.whitePatchFraction > 1 || options.gridStep < 1)
+    {
+        throw std::invalid_argument("Invalid options of the white balance.");
+    }
+}
+
+void WhiteBalanceEstimator::Update(const cv::Mat &frame, int filterArrayType, int bitDepth)
+{
+    if (frame.type() != CV_16UC1)
+    {
+        throw std::invalid_argument("The white balance is estimated on raw frames of type CV_16UC1.");
+    }
+    if (bitDepth < MIN_BIT_DEPTH || bitDepth > MAX_BIT_DEPTH)
+    {
+        throw std::invalid_argument("Unsupported bit depth of the white balance: " + std::to_string(bitDepth));
+    }
+    if (this->IsLocked())
+    {
+        return;
+    }
+    cv::Vec3f gains;
+    if (!this->ComputeGains(frame, filterArrayType, bitDepth, gains))
+    {
+        return;
+    }
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (m_locked)
+    {
+        return;
+    }
+    if (!m_initialized)
+    {
+        m_gains = gains;
+        m_initialized = true;
+        return;
+    }
+    m_gains += static_cast<float>(m_options.smoothing) * (gains - m_gains);
+}
+
+void WhiteBalanceEstimator::SetLocked(bool locked)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_locked = locked;
+}
+
+bool WhiteBalanceEstimator::IsLocked() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_locked;
+}
+
+void WhiteBalanceEstimator::Reset()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_gains = cv::Vec3f(1, 1, 1);
+    m_initialized = false;
+}
+
+cv::Vec3f WhiteBalanceEstimator::GetGains() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_gains;
+}
+
+bool WhiteBalanceEstimator::ComputeGains(const cv::Mat &frame, int filterArrayType, int bitDepth,
+                                         cv::Vec3f &gains) const
+{
+    const std::array<int, 4> channels = GetBayerChannels(filterArrayType);
+    const unsigned int saturationValue = (1u << bitDepth) - 1;
+    const bool whitePatch = m_options.method == WhiteBalanceMethod::WhitePatch;
+    std::array<double, 3> sums{};
+    std::array<double, 3> counts{};
+    std::vector<int> histograms(whitePatch ? 3 * WHITE_PATCH_BINS : 0, 0);
+    const int step = 2 * m_options.gridStep;
+    for (int row = 0; row + 1 < frame.rows; row += step)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            const auto *line = frame.ptr<uint16_t>(row + i);
+            for (int col = 0; col + 1 < frame.cols; col += step)
+            {
+                for (int j = 0; j < 2; j++)
+                {
+                    const unsigned int value = line[col + j];
+                    if (value >= saturationValue)
+                    {
+                        continue;
+                    }
+                    const int channel = channels[2 * i + j];
+                    sums[channel] += value;
+                    counts[channel]++;
+                    if (whitePatch)
+                    {
+                        histograms[channel * WHITE_PATCH_BINS + value * WHITE_PATCH_BINS / saturationValue]++;
+                    }
+                }
+            }
+        }
+    }
+
+    std::array<double, 3> references{};
+    for (int channel = 0; channel < 3; channel++)
+    {
+        if (counts[channel] == 0)
+        {
+            return false;
+        }
+        if (!whitePatch)
+        {
+            references[channel] = sums[channel] / counts[channel];
+            continue;
+        }
+        // mean of the brightest pixels, at the centers of their bins
+        const int *histogram = histograms.data() + channel * WHITE_PATCH_BINS;
+        double remaining = std::max(1., m_options.whitePatchFraction * counts[channel]);
+        double patchCount = 0;
+        double patchSum = 0;
+        for (int bin = WHITE_PATCH_BINS - 1; bin >= 0 && remaining > 0; bin--)
+        {
+            double taken = std::min(remaining, static_cast<double>(histogram[bin]));
+            patchSum += taken * (bin + 0.5) * saturationValue / WHITE_PATCH_BINS;
+            patchCount += taken;
+            remaining -= taken;
+        }
+        references[channel] = patchSum / patchCount;
+    }
+    if (references[0] < 1 || references[1] < 1 || references[2] < 1)
+    {
+        return false;
+    }
+    for (int channel = 0; channel < 3; channel++)
+    {
+        gains[channel] = std::clamp(static_cast<float>(references[1] / references[channel]), 1 / MAX_GAIN, MAX_GAIN);
+    }
+    return true;
+}
+
+void ApplyWhiteBalance(const cv::Mat &image, cv::Mat &balanced, const cv::Vec3f &gains, double scale)
+{
+    if (image.type() != CV_16UC3)
+    {
+        throw std::invalid_argument("The white balance is applied to demosaiced images of type CV_16UC3.");
+    }
+    // converted into a new matrix, such that the image can be replaced by the balanced image
+    cv::Mat converted(image.size(), CV_8UC3);
+    const float factors[3] = {static_cast<float>(gains[0] * scale), static_cast<float>(gains[1] * scale),
+                              static_cast<float>(gains[2] * scale)};
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range &range) {
+        for (int row = range.start; row < range.end; row++)
+        {
+            const auto *input = image.ptr<uint16_t>(row);
+            auto *output = converted.ptr<uchar>(row);
+            for (int col = 0; col < image.cols; col++, input += 3, output += 3)
+            {
+                output[0] = cv::saturate_cast<uchar>(factors[0] * input[0]);
+                output[1] = cv::saturate_cast<uchar>(factors[1] * input[1]);
+                output[2] = cv::saturate_cast<uchar>(factors[2] * input[2]);
+            }
+        }
+    });
+    balanced = converted;
+}
+
+void WhiteBalanceProvider::DeclareFields(MetadataSchema &schema)
+{
+    m_gainsOffset = schema.AddFloatField(WHITE_BALANCE_GAINS_KEY, 3);
+    m_lockedOffset = schema.AddIntField(WHITE_BALANCE_LOCKED_KEY);
+}
+
+void WhiteBalanceProvider::Sample(const XI_IMG &image, FrameMetadataRecord &record) const
+{
+    (void)image;
+    const cv::Vec3f gains = m_estimator->GetGains();
+    for (int channel = 0; channel < 3; channel++)
+    {
+        record.floatValues[m_gainsOffset + channel] = gains[channel];
+    }
+    record.intValues[m_lockedOffset] = m_estimator->IsLocked() ? 1 : 0;
+}
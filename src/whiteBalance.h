@@ -0,0 +1,170 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_WHITE_BALANCE_H
+#define XILENS_WHITE_BALANCE_H
+
+#include <boost/thread.hpp>
+#include <opencv2/core/core.hpp>
+#include <string>
+
+#include "metadataProviders.h"
+
+/**
+ * @brief Reference of the automatic white balance, the color that is assumed to be neutral.
+ */
+enum class WhiteBalanceMethod
+{
+    /**
+     * The mean color of the scene is neutral.
+     */
+    GrayWorld,
+
+    /**
+     * The brightest pixels of each channel are neutral, see WhiteBalanceOptions::whitePatchFraction.
+     */
+    WhitePatch
+};
+
+/**
+ * Parses the name of a white balance method as given on the command line.
+ *
+ * @param name `gray-world` or `white-patch`.
+ * @throws std::invalid_argument if the name is unknown.
+ */
+WhiteBalanceMethod ParseWhiteBalanceMethod(const std::string &name);
+
+/**
+ * @brief Options of the automatic white balance.
+ */
+struct WhiteBalanceOptions
+{
+    WhiteBalanceMethod method = WhiteBalanceMethod::GrayWorld;
+
+    /**
+     * Weight of the gains of a new frame in the smoothed gains, between 0 and 1. Smaller values react slower to a
+     * change of the light source but do not flicker with the content of the scene.
+     */
+    double smoothing = 0.1;
+
+    /**
+     * Fraction of the brightest unsaturated pixels of each channel whose mean is the white reference of
+     * WhiteBalanceMethod::WhitePatch.
+     */
+    double whitePatchFraction = 0.02;
+
+    /**
+     * Distance in superpixels between two sampled superpixels, along the rows and the columns.
+     */
+    int gridStep = 2;
+};
+
+/**
+ * @brief Estimates the gains that make the light source of the scene appear white in the images of RGB cameras.
+ *
+ * The statistics of the red, green and blue pixels are gathered in a single pass over a sparse grid of the Bayer
+ * mosaic, before demosaicing: their means for WhiteBalanceMethod::GrayWorld, or a histogram for
+ * WhiteBalanceMethod::WhitePatch. The gain of each channel brings its reference to the reference of the green channel,
+ * whose gain is always 1, and is smoothed over the frames. The gains can be locked once the light source is set up,
+ * such that the colors of a recording are comparable.
+ *
+ * The gains are updated by a single thread and can be queried from any thread.
+ */
+class WhiteBalanceEstimator
+{
+  public:
+    /**
+     * @param options options of the estimation.
+     * @throws std::invalid_argument if the options are out of range.
+     */
+    explicit WhiteBalanceEstimator(WhiteBalanceOptions options = WhiteBalanceOptions());
+
+    /**
+     * Updates the gains with a frame, unless they are locked. Frames too dark to tell the color of the light leave the
+     * gains unchanged.
+     *
+     * @param frame raw Bayer frame of type CV_16UC1.
+     * @param filterArrayType layout of the Bayer mosaic, one of XI_CFA_BAYER_RGGB, XI_CFA_BAYER_BGGR,
+     * XI_CFA_BAYER_GRBG or XI_CFA_BAYER_GBRG.
+     * @param bitDepth bit depth of the raw values, pixels at the maximum of the bit depth are saturated and do not show
+     * the color of the light.
+     * @throws std::invalid_argument if the frame is not of type CV_16UC1, the layout is not a Bayer mosaic or the bit
+     * depth is out of range.
+     */
+    void Update(const cv::Mat &frame, int filterArrayType, int bitDepth);
+
+    /**
+     * Locks or unlocks the gains, locked gains are not updated.
+     */
+    void SetLocked(bool locked);
+
+    /**
+     * Queries if the gains are locked.
+     */
+    bool IsLocked() const;
+
+    /**
+     * Sets the gains back to 1, the next frame sets them without smoothing. The lock is kept.
+     */
+    void Reset();
+
+    /**
+     * Queries the gains of the red, green and blue channels.
+     */
+    cv::Vec3f GetGains() const;
+
+  private:
+    /**
+     * Computes the gains of a single frame.
+     *
+     * @return false if the frame has no unsaturated pixels of a channel or a channel is black.
+     */
+    bool ComputeGains(const cv::Mat &frame, int filterArrayType, int bitDepth, cv::Vec3f &gains) const;
+
+    WhiteBalanceOptions m_options;
+    mutable boost::mutex m_mutex;
+    cv::Vec3f m_gains{1, 1, 1};
+    bool m_initialized = false;
+    bool m_locked = false;
+};
+
+/**
+ * Converts a demosaiced image to 8 bit and applies the white balance in the same pass.
+ *
+ * @param image demosaiced image of type CV_16UC3 with the channels in the order red, green and blue, as interpreted by
+ * the display.
+ * @param balanced balanced image of type CV_8UC3, can be the same matrix as the image.
+ * @param gains gains of the red, green and blue channels, see WhiteBalanceEstimator::GetGains.
+ * @param scale factor that converts the raw values to 8 bit.
+ * @throws std::invalid_argument if the image is not of type CV_16UC3.
+ */
+void ApplyWhiteBalance(const cv::Mat &image, cv::Mat &balanced, const cv::Vec3f &gains, double scale);
+
+/**
+ * @brief Provides the white balance gains applied to the displayed images and whether they were locked, such that the
+ * colors of a recording can be reproduced.
+ */
+class WhiteBalanceProvider : public MetadataProvider
+{
+  public:
+    /**
+     * Constructs the provider.
+     *
+     * @param estimator estimator of the gains, must outlive the provider.
+     */
+    explicit WhiteBalanceProvider(const WhiteBalanceEstimator *estimator) : m_estimator(estimator)
+    {
+    }
+
+    void DeclareFields(MetadataSchema &schema) override;
+
+    void Sample(const XI_IMG &image, FrameMetadataRecord &record) const override;
+
+  private:
+    const WhiteBalanceEstimator *m_estimator;
+    size_t m_gainsOffset = 0;
+    size_t m_lockedOffset = 0;
+};
+
+#endif // XILENS_WHITE_BALANCE_H
@@ -0,0 +1,221 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#include "writerQueue.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "logger.h"
+
+WriterQueue::WriterQueue(std::unique_ptr<RecordingFile> file, size_t capacity, unsigned int imageHeight,
+                         unsigned int imageWidth)
+    : m_file(std::move(file))
+{
+    if (capacity == 0)
+    {
+        throw std::invalid_argument("The capacity of a writer queue needs to be larger than 0.");
+    }
+    m_slots.resize(capacity);
+    for (auto &slot : m_slots)
+    {
+        slot.pixels.resize(static_cast<size_t>(imageHeight) * imageWidth);
+    }
+    m_thread = boost::thread(&WriterQueue::Run, this);
+}
+
+WriterQueue::~WriterQueue()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_slotFilled.notify_all();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+WriterQueue::Slot &WriterQueue::AcquireSlot()
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_slotReleased.wait(lock, [this] { return m_count < m_slots.size() || m_writerError; });
+    RethrowWriterError();
+    // the writer thread never touches slots that are not queued, they can be filled without the lock
+    return m_slots[(m_head + m_count) % m_slots.size()];
+}
+
+WriterQueue::Slot *WriterQueue::TryAcquireSlot(boost::chrono::milliseconds timeout)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    if (!m_slotReleased.wait_for(lock, timeout, [this] { return m_count < m_slots.size() || m_writerError; }))
+    {
+        return nullptr;
+    }
+    RethrowWriterError();
+    return &m_slots[(m_head + m_count) % m_slots.size()];
+}
+
+void WriterQueue::QueueSlot(Slot &slot, const FrameMetadataRecord &record)
+{
+    slot.record.intValues.assign(record.intValues.begin(), record.intValues.end());
+    slot.record.floatValues.assign(record.floatValues.begin(), record.floatValues.end());
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        m_count++;
+    }
+    m_slotFilled.notify_one();
+}
+
+void WriterQueue::WriteImageData(const XI_IMG &image, const FrameMetadataRecord &record)
+{
+    Slot &slot = AcquireSlot();
+    const size_t nPixels = static_cast<size_t>(image.width) * image.height;
+    slot.pixels.resize(nPixels);
+    const auto *pixels = static_cast<const uint16_t *>(image.bp);
+    std::copy(pixels, pixels + nPixels, slot.pixels.begin());
+    slot.image = image;
+    slot.image.bp = slot.pixels.data();
+    slot.image.bp_size = static_cast<DWORD>(nPixels * sizeof(uint16_t));
+    slot.isCompressed = false;
+    QueueSlot(slot, record);
+}
+
+void WriterQueue::WriteCompressedImageData(const std::vector<uint8_t> &chunk, const FrameMetadataRecord &record)
+{
+    Slot &slot = AcquireSlot();
+    slot.chunk.assign(chunk.begin(), chunk.end());
+    slot.isCompressed = true;
+    QueueSlot(slot, record);
+}
+
+bool WriterQueue::TryWriteCompressedImageData(const std::vector<uint8_t> &chunk, const FrameMetadataRecord &record,
+                                              boost::chrono::milliseconds timeout)
+{
+    Slot *slot = TryAcquireSlot(timeout);
+    if (slot == nullptr)
+    {
+        return false;
+    }
+    slot->chunk.assign(chunk.begin(), chunk.end());
+    slot->isCompressed = true;
+    QueueSlot(*slot, record);
+    return true;
+}
+
+void WriterQueue::Discard()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_discard = true;
+}
+
+void WriterQueue::AppendMetadata()
+{
+    this->Flush();
+    m_file->AppendMetadata();
+}
+
+std::string WriterQueue::GetFilePath() const
+{
+    return m_file->GetFilePath();
+}
+
+void WriterQueue::Flush()
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_slotReleased.wait(lock, [this] { return m_count == 0; });
+    RethrowWriterError();
+}
+
+size_t WriterQueue::GetPendingImages()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_count;
+}
+
+WriterQueueStatus WriterQueue::GetStatus()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    WriterQueueStatus status;
+    status.pendingImages = m_count;
+    status.writtenImages = m_writtenImages;
+    status.checksum = m_writtenChecksum;
+    status.failed = static_cast<bool>(m_writerError);
+    status.error = m_writerErrorMessage;
+    return status;
+}
+
+void WriterQueue::RethrowWriterError()
+{
+    if (m_writerError)
+    {
+        std::rethrow_exception(m_writerError);
+    }
+}
+
+void WriterQueue::Run()
+{
+    while (true)
+    {
+        Slot *slot;
+        bool discard;
+        double fill;
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            m_slotFilled.wait(lock, [this] { return m_count > 0 || !m_running; });
+            if (m_count == 0)
+            {
+                return;
+            }
+            slot = &m_slots[m_head];
+            discard = m_discard || static_cast<bool>(m_writerError);
+            fill = static_cast<double>(m_count) / static_cast<double>(m_slots.size());
+        }
+        bool written = false;
+        if (!discard)
+        {
+            try
+            {
+                m_file->SetQueueFill(fill);
+                if (slot->isCompressed)
+                {
+                    m_file->WriteCompressedImageData(slot->chunk, slot->record);
+                }
+                else
+                {
+                    m_file->WriteImageData(slot->image, slot->record);
+                }
+                // only the writer thread touches the running checksum
+                if (slot->isCompressed)
+                {
+                    m_checksum.process_bytes(slot->chunk.data(), slot->chunk.size());
+                }
+                else
+                {
+                    m_checksum.process_bytes(slot->pixels.data(), slot->pixels.size() * sizeof(uint16_t));
+                }
+                written = true;
+            }
+            catch (const std::exception &e)
+            {
+                LOG_XILENS(error) << "Error while writing image to " << m_file->GetFilePath() << ": " << e.what();
+                boost::lock_guard<boost::mutex> lock(m_mutex);
+                m_writerError = std::current_exception();
+                m_writerErrorMessage = e.what();
+            }
+        }
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+            if (written)
+            {
+                m_writtenImages++;
+                m_writtenChecksum = m_checksum.checksum();
+            }
+            m_head = (m_head + 1) % m_slots.size();
+            m_count--;
+        }
+        m_slotReleased.notify_all();
+    }
+}
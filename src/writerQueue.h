@@ -0,0 +1,217 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_WRITER_QUEUE_H
+#define XILENS_WRITER_QUEUE_H
+
+#include <xiApi.h>
+
+#include <boost/crc.hpp>
+#include <boost/thread.hpp>
+#include <exception>
+#include <memory>
+#include <vector>
+
+#include "recordingFile.h"
+
+/**
+ * @brief Health of a WriterQueue.
+ */
+struct WriterQueueStatus
+{
+    /**
+     * Images waiting to be written, including the one being written.
+     */
+    size_t pendingImages = 0;
+
+    /**
+     * Images written successfully.
+     */
+    size_t writtenImages = 0;
+
+    /**
+     * CRC32 of the bytes of all images written successfully, compressed images are checksummed in compressed form.
+     */
+    uint32_t checksum = 0;
+
+    /**
+     * Whether writing an image failed, images queued after the failure are discarded.
+     */
+    bool failed = false;
+
+    /**
+     * Description of the failure, empty if no image failed.
+     */
+    std::string error;
+};
+
+/**
+ * @brief Writes the images of a recording file on a dedicated thread.
+ *
+ * Images are copied into a bounded ring of pre-allocated slots and written to the wrapped file by the writer thread.
+ * When all slots are in use, WriterQueue::WriteImageData blocks until the writer thread frees one, this applies
+ * back-pressure to the acquisition instead of growing memory without bounds. Errors of the writer thread are re-thrown
+ * by the next call to WriterQueue::WriteImageData, WriterQueue::Flush or WriterQueue::AppendMetadata. The fill level of
+ * the queue is reported to the wrapped file before each image is written, see RecordingFile::SetQueueFill.
+ */
+class WriterQueue : public RecordingFile
+{
+  public:
+    /**
+     * Starts the writer thread.
+     *
+     * @param file file where the images are written, owned by the queue.
+     * @param capacity number of images that can be waiting to be written.
+     * @param imageHeight height of the images, used to pre-allocate the slots, 0 allocates them on first use.
+     * @param imageWidth width of the images, used to pre-allocate the slots, 0 allocates them on first use.
+     * @throws std::invalid_argument if the capacity is 0.
+     */
+    WriterQueue(std::unique_ptr<RecordingFile> file, size_t capacity, unsigned int imageHeight,
+                unsigned int imageWidth);
+
+    /**
+     * Writes the images still in the queue and stops the writer thread.
+     */
+    ~WriterQueue() override;
+
+    WriterQueue(const WriterQueue &) = delete;
+    WriterQueue &operator=(const WriterQueue &) = delete;
+
+    /**
+     * Copies the image and its metadata into a free slot, blocks while all slots are in use. Images need to be written
+     * from a single thread.
+     *
+     * @param image Ximea image where data is stored
+     * @param record metadata of the image
+     */
+    void WriteImageData(const XI_IMG &image, const FrameMetadataRecord &record) override;
+
+    /**
+     * Copies the compressed image and its metadata into a free slot, blocks while all slots are in use. Images need to
+     * be written from a single thread.
+     *
+     * @param chunk compressed image
+     * @param record metadata of the image
+     */
+    void WriteCompressedImageData(const std::vector<uint8_t> &chunk, const FrameMetadataRecord &record) override;
+
+    /**
+     * Copies the compressed image and its metadata into a free slot, gives up if no slot is freed within the timeout.
+     * Images need to be written from a single thread.
+     *
+     * @param chunk compressed image
+     * @param record metadata of the image
+     * @param timeout longest time to wait for a free slot
+     * @return false if the image was not queued because all slots stayed in use.
+     */
+    bool TryWriteCompressedImageData(const std::vector<uint8_t> &chunk, const FrameMetadataRecord &record,
+                                     boost::chrono::milliseconds timeout);
+
+    /**
+     * Discards the images still in the queue and all images queued afterwards, the image being written is finished.
+     */
+    void Discard();
+
+    /**
+     * Waits until the queue is empty and appends the metadata to the wrapped file.
+     */
+    void AppendMetadata() override;
+
+    /**
+     * Queries the path of the wrapped file.
+     */
+    std::string GetFilePath() const override;
+
+    /**
+     * Blocks until all queued images are written.
+     */
+    void Flush();
+
+    /**
+     * Queries the number of images waiting to be written, including the one being written.
+     */
+    size_t GetPendingImages();
+
+    /**
+     * Queries the number of written images, their checksum and whether the writer thread failed.
+     */
+    WriterQueueStatus GetStatus();
+
+  private:
+    /**
+     * Pre-allocated copy of an image and its metadata
+     */
+    struct Slot
+    {
+        XI_IMG image;
+        std::vector<uint16_t> pixels;
+        std::vector<uint8_t> chunk;
+        bool isCompressed;
+        FrameMetadataRecord record;
+    };
+
+    /**
+     * Loop of the writer thread.
+     */
+    void Run();
+
+    /**
+     * Waits for a free slot, the slot is not queued until WriterQueue::QueueSlot is called.
+     */
+    Slot &AcquireSlot();
+
+    /**
+     * Waits for a free slot at most for the timeout, the slot is not queued until WriterQueue::QueueSlot is called.
+     *
+     * @return the free slot, null if no slot was freed in time.
+     */
+    Slot *TryAcquireSlot(boost::chrono::milliseconds timeout);
+
+    /**
+     * Copies the metadata into the acquired slot and hands it over to the writer thread.
+     */
+    void QueueSlot(Slot &slot, const FrameMetadataRecord &record);
+
+    /**
+     * Re-throws the error of the writer thread, if any. Needs to be called with WriterQueue::m_mutex locked.
+     */
+    void RethrowWriterError();
+
+    std::unique_ptr<RecordingFile> m_file;
+
+    /**
+     * Ring of slots, the first WriterQueue::m_count slots starting at WriterQueue::m_head are waiting to be written.
+     * The slot at the head is not released until it is written.
+     */
+    std::vector<Slot> m_slots;
+    size_t m_head = 0;
+    size_t m_count = 0;
+
+    /**
+     * First error of the writer thread, images queued after it are discarded.
+     */
+    std::exception_ptr m_writerError;
+    std::string m_writerErrorMessage;
+
+    size_t m_writtenImages = 0;
+    uint32_t m_writtenChecksum = 0;
+
+    /**
+     * Set by WriterQueue::Discard, queued images are released without being written.
+     */
+    bool m_discard = false;
+
+    /**
+     * Running checksum of the written images, only used by the writer thread.
+     */
+    boost::crc_32_type m_checksum;
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_slotFilled;
+    boost::condition_variable m_slotReleased;
+    bool m_running = true;
+    boost::thread m_thread;
+};
+
+#endif // XILENS_WRITER_QUEUE_H
@@ -0,0 +1,780 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+#ifndef XILENS_READER_H
+#define XILENS_READER_H
+
+#include <b2nd.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "locoCodec.h"
+#include "metadataCodec.h"
+#include "recordingFormat.h"
+
+/**
+ * @brief Version of the API of the reader, incremented when a declaration of this header changes in an incompatible
+ * way.
+ *
+ * The reader is header-only and only depends on blosc2 and msgpack, such that recordings can be read outside xilens
+ * by linking the `xilens_reader` CMake target. Applications need to call `blosc2_init` before opening a recording, the
+ * LOCO codec is registered by the reader.
+ */
+constexpr int XILENS_READER_API_VERSION = 1;
+
+/**
+ * Reads a JSON string starting at `position`, which is left after the closing quote
+ */
+inline std::string ParseManifestString(const std::string &text, size_t &position)
+{
+    if (position >= text.size() || text[position] != '"')
+    {
+        throw std::runtime_error("String expected in recording manifest.");
+    }
+    std::string value;
+    for (position++; position < text.size(); position++)
+    {
+        char character = text[position];
+        if (character == '"')
+        {
+            position++;
+            return value;
+        }
+        if (character != '\\')
+        {
+            value.push_back(character);
+            continue;
+        }
+        if (++position >= text.size())
+        {
+            break;
+        }
+        switch (text[position])
+        {
+        case 'b':
+            value.push_back('\b');
+            break;
+        case 'f':
+            value.push_back('\f');
+            break;
+        case 'n':
+            value.push_back('\n');
+            break;
+        case 'r':
+            value.push_back('\r');
+            break;
+        case 't':
+            value.push_back('\t');
+            break;
+        case 'u': {
+            if (position + 4 >= text.size())
+            {
+                throw std::runtime_error("Invalid escape sequence in recording manifest.");
+            }
+            unsigned long code = std::stoul(text.substr(position + 1, 4), nullptr, 16);
+            position += 4;
+            // code points of the basic multilingual plane as UTF-8, surrogate pairs are not used in file paths
+            if (code < 0x80)
+            {
+                value.push_back(static_cast<char>(code));
+            }
+            else if (code < 0x800)
+            {
+                value.push_back(static_cast<char>(0xC0 | (code >> 6)));
+                value.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            }
+            else
+            {
+                value.push_back(static_cast<char>(0xE0 | (code >> 12)));
+                value.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                value.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            }
+            break;
+        }
+        default:
+            value.push_back(text[position]);
+        }
+    }
+    throw std::runtime_error("Unterminated string in recording manifest.");
+}
+
+/**
+ * Reads the paths of the stripes of a recording from its manifest, see RecordingManifest. Only the fields needed to
+ * read the recording are parsed, such that the reader does not depend on a JSON library.
+ *
+ * @param filePath path of the manifest.
+ * @return paths of the `.b2nd` files of the recording, in round-robin order.
+ * @throws std::runtime_error if the manifest can not be read or its format is not supported.
+ */
+inline std::vector<std::string> ReadManifestStripes(const std::string &filePath)
+{
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Could not open recording manifest " + filePath);
+    }
+    const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    auto skipWhitespace = [&text](size_t &position) {
+        while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position])))
+        {
+            position++;
+        }
+    };
+
+    std::vector<std::string> stripes;
+    std::string layout;
+    long version = 0;
+    try
+    {
+        size_t position = 0;
+        skipWhitespace(position);
+        if (position >= text.size() || text[position++] != '{')
+        {
+            throw std::runtime_error("Object expected.");
+        }
+        skipWhitespace(position);
+        while (position < text.size() && text[position] != '}')
+        {
+            std::string key = ParseManifestString(text, position);
+            skipWhitespace(position);
+            if (position >= text.size() || text[position++] != ':')
+            {
+                throw std::runtime_error("Colon expected.");
+            }
+            skipWhitespace(position);
+            if (position < text.size() && text[position] == '[')
+            {
+                for (position++, skipWhitespace(position); position < text.size() && text[position] != ']';)
+                {
+                    std::string value = ParseManifestString(text, position);
+                    if (key == "stripes")
+                    {
+                        stripes.push_back(value);
+                    }
+                    skipWhitespace(position);
+                    if (position < text.size() && text[position] == ',')
+                    {
+                        position++;
+                        skipWhitespace(position);
+                    }
+                }
+                position++;
+            }
+            else if (position < text.size() && text[position] == '"')
+            {
+                std::string value = ParseManifestString(text, position);
+                if (key == "layout")
+                {
+                    layout = value;
+                }
+            }
+            else
+            {
+                size_t end = text.find_first_of(",}", position);
+                if (key == "version")
+                {
+                    version = std::stol(text.substr(position, end - position));
+                }
+                position = end;
+            }
+            skipWhitespace(position);
+            if (position < text.size() && text[position] == ',')
+            {
+                position++;
+                skipWhitespace(position);
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        throw std::runtime_error("Could not parse recording manifest " + filePath + ": " + e.what());
+    }
+    if (version != RECORDING_MANIFEST_VERSION || layout != "round-robin")
+    {
+        throw std::runtime_error("Unsupported recording manifest " + filePath);
+    }
+    if (stripes.empty())
+    {
+        throw std::runtime_error("Recording manifest without stripes " + filePath);
+    }
+    return stripes;
+}
+
+/**
+ * Converts a time stamp formatted as `yyyyMMdd_hh-mm-ss-zzz` in local time, as written by the recorder, to milliseconds
+ * since epoch.
+ *
+ * @throws std::runtime_error if the time stamp does not have the expected format.
+ */
+inline int64_t ParseTimeStampMilliseconds(const std::string &timeStamp)
+{
+    std::tm time{};
+    int milliseconds = 0;
+    if (std::sscanf(timeStamp.c_str(), "%4d%2d%2d_%2d-%2d-%2d-%3d", &time.tm_year, &time.tm_mon, &time.tm_mday,
+                    &time.tm_hour, &time.tm_min, &time.tm_sec, &milliseconds) != 7)
+    {
+        throw std::runtime_error("Unexpected time stamp format: " + timeStamp);
+    }
+    time.tm_year -= 1900;
+    time.tm_mon -= 1;
+    time.tm_isdst = -1;
+    return static_cast<int64_t>(std::mktime(&time)) * 1000 + milliseconds;
+}
+
+/**
+ * Rearranges a frame of a mosaic sensor into a cube of bands. Band `b` holds the pixels at row `b / mosaicWidth` and
+ * column `b % mosaicWidth` of each mosaic, the same order as the band means of the frame statistics. Rows and columns
+ * of incomplete mosaics at the border are dropped.
+ *
+ * @param frame pixels of the frame, row by row.
+ * @param height height of the frame.
+ * @param width width of the frame.
+ * @param mosaicWidth width of the mosaic.
+ * @param mosaicHeight height of the mosaic.
+ * @param cube destination of the bands, one after the other with `height / mosaicHeight` rows of
+ * `width / mosaicWidth` pixels each. Resized to the size of the cube.
+ * @throws std::invalid_argument if the mosaic shape is empty or the frame does not have the given shape.
+ */
+inline void ExtractBandCube(const std::vector<uint16_t> &frame, int64_t height, int64_t width, unsigned int mosaicWidth,
+                            unsigned int mosaicHeight, std::vector<uint16_t> &cube)
+{
+    if (mosaicWidth == 0 || mosaicHeight == 0 || height < 0 || width < 0 ||
+        frame.size() != static_cast<size_t>(height * width))
+    {
+        throw std::invalid_argument("Unexpected frame or mosaic shape for band extraction.");
+    }
+    const int64_t bandHeight = height / mosaicHeight;
+    const int64_t bandWidth = width / mosaicWidth;
+    cube.resize(static_cast<size_t>(bandHeight * bandWidth) * mosaicWidth * mosaicHeight);
+    uint16_t *destination = cube.data();
+    for (unsigned int mosaicRow = 0; mosaicRow < mosaicHeight; mosaicRow++)
+    {
+        for (unsigned int mosaicCol = 0; mosaicCol < mosaicWidth; mosaicCol++)
+        {
+            for (int64_t row = 0; row < bandHeight; row++)
+            {
+                const uint16_t *source = frame.data() + (row * mosaicHeight + mosaicRow) * width + mosaicCol;
+                for (int64_t col = 0; col < bandWidth; col++)
+                {
+                    *destination++ = source[col * mosaicWidth];
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Read access to a recording, either a single `.b2nd` file or the stripes listed in a manifest.
+ *
+ * Frame `i` of a recording with `n` stripes is stored in stripe `i % n` at index `i / n`. Metadata accessors return one
+ * value per frame in recording order, for plain and columnar metadata alike. Reading from the same reader is not
+ * thread safe, threads should open their own reader, as done by FramePrefetcher.
+ */
+class RecordingReader
+{
+  public:
+    /**
+     * Opens a recording.
+     *
+     * @param filePath path to a `.b2nd` file or to a manifest.
+     * @throws std::runtime_error if any of the files can not be opened or their shapes do not match.
+     */
+    explicit RecordingReader(const std::string &filePath)
+        : RecordingReader(IsManifestPath(filePath) ? ReadManifestStripes(filePath) : std::vector<std::string>{filePath})
+    {
+    }
+
+    /**
+     * Opens the stripes of a recording.
+     *
+     * @param stripePaths paths of the `.b2nd` files of the recording, in round-robin order.
+     * @throws std::runtime_error if any of the files can not be opened or their shapes do not match.
+     */
+    explicit RecordingReader(std::vector<std::string> stripePaths) : m_paths(std::move(stripePaths))
+    {
+        const auto nStripes = static_cast<int64_t>(m_paths.size());
+        if (nStripes == 0)
+        {
+            throw std::runtime_error("A recording needs at least one file.");
+        }
+        // recordings may be compressed with the LOCO codec, which blosc2 does not know
+        RegisterLocoCodec();
+        m_nFrames = std::numeric_limits<int64_t>::max();
+        for (int64_t i = 0; i < nStripes; i++)
+        {
+            b2nd_array_t *stripe;
+            if (b2nd_open(m_paths[i].c_str(), &stripe) != 0)
+            {
+                this->Close();
+                throw std::runtime_error("Could not open " + m_paths[i]);
+            }
+            m_stripes.push_back(stripe);
+            if (stripe->ndim != 3 || (i > 0 && (stripe->shape[1] != m_height || stripe->shape[2] != m_width)))
+            {
+                this->Close();
+                throw std::runtime_error("Unexpected image shape in " + m_paths[i]);
+            }
+            m_height = stripe->shape[1];
+            m_width = stripe->shape[2];
+            // frame `n * k + i` exists only if stripe i holds at least k + 1 frames
+            m_nFrames = std::min(m_nFrames, stripe->shape[0] * nStripes + i);
+        }
+    }
+
+    /**
+     * Releases the files of the recording.
+     */
+    ~RecordingReader()
+    {
+        this->Close();
+    }
+
+    RecordingReader(const RecordingReader &) = delete;
+    RecordingReader &operator=(const RecordingReader &) = delete;
+
+    /**
+     * Queries the paths of the `.b2nd` files of the recording, in round-robin order.
+     */
+    const std::vector<std::string> &GetStripePaths() const
+    {
+        return m_paths;
+    }
+
+    /**
+     * Queries the number of frames that can be read. For striped recordings that were not closed properly, only the
+     * frames that were written to all previous stripes are counted.
+     */
+    int64_t GetNumberOfFrames() const
+    {
+        return m_nFrames;
+    }
+
+    int64_t GetHeight() const
+    {
+        return m_height;
+    }
+
+    int64_t GetWidth() const
+    {
+        return m_width;
+    }
+
+    /**
+     * Reads a frame.
+     *
+     * @param index index of the frame in the recording.
+     * @param buffer destination of the pixels, resized to the size of a frame.
+     * @throws std::out_of_range if the index is not smaller than the number of frames.
+     * @throws std::runtime_error if the frame can not be read.
+     */
+    void ReadFrame(int64_t index, std::vector<uint16_t> &buffer) const
+    {
+        if (index < 0 || index >= m_nFrames)
+        {
+            throw std::out_of_range("Frame index out of range: " + std::to_string(index));
+        }
+        const auto nStripes = static_cast<int64_t>(m_stripes.size());
+        const int64_t localIndex = index / nStripes;
+        std::array<int64_t, B2ND_MAX_DIM> sliceStart = {localIndex, 0, 0};
+        std::array<int64_t, B2ND_MAX_DIM> sliceStop = {localIndex + 1, m_height, m_width};
+        std::array<int64_t, B2ND_MAX_DIM> sliceShape = {1, m_height, m_width};
+        buffer.resize(static_cast<size_t>(m_height * m_width));
+        int result = b2nd_get_slice_cbuffer(m_stripes[index % nStripes], sliceStart.data(), sliceStop.data(),
+                                            buffer.data(), sliceShape.data(),
+                                            static_cast<int64_t>(buffer.size() * sizeof(uint16_t)));
+        if (result < 0)
+        {
+            throw std::runtime_error("Could not read frame " + std::to_string(index) + ": " +
+                                     blosc2_error_string(result));
+        }
+    }
+
+    /**
+     * Reads a frame of a mosaic sensor as a cube of bands, see ExtractBandCube.
+     *
+     * @param index index of the frame in the recording.
+     * @param mosaicWidth width of the mosaic.
+     * @param mosaicHeight height of the mosaic.
+     * @param cube destination of the bands, resized to the size of the cube.
+     * @throws std::out_of_range if the index is not smaller than the number of frames.
+     * @throws std::runtime_error if the frame can not be read.
+     */
+    void ReadBandCube(int64_t index, unsigned int mosaicWidth, unsigned int mosaicHeight,
+                      std::vector<uint16_t> &cube) const
+    {
+        std::vector<uint16_t> frame;
+        this->ReadFrame(index, frame);
+        ExtractBandCube(frame, m_height, m_width, mosaicWidth, mosaicHeight, cube);
+    }
+
+    /**
+     * Queries whether all files of the recording hold a metadata field.
+     */
+    bool HasMetadata(const std::string &key) const
+    {
+        for (auto *stripe : m_stripes)
+        {
+            if (blosc2_vlmeta_exists(stripe->sc, key.c_str()) < 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Reads a metadata field with one value per frame.
+     *
+     * @tparam T value type of the field: int64_t, float or std::string
+     * @param key name of the field, e.g. EXPOSURE_KEY
+     * @return one value per frame, in recording order
+     * @throws std::runtime_error if the field does not exist, has another type or has fewer values than frames.
+     */
+    template <typename T> std::vector<T> GetMetadata(const std::string &key) const
+    {
+        std::vector<std::vector<T>> columns;
+        for (auto *stripe : m_stripes)
+        {
+            columns.push_back(ReadMetadataColumn<T>(stripe, key.c_str()));
+        }
+        return this->InterleaveStripes(columns, key);
+    }
+
+    /**
+     * Reads a metadata field with several values per frame, e.g. BAND_MEAN_KEY.
+     *
+     * @tparam T value type of the field: int64_t, float or std::string
+     * @param key name of the field
+     * @return one array of values per frame, in recording order
+     * @throws std::runtime_error if the field does not exist, has another type or has fewer values than frames.
+     */
+    template <typename T> std::vector<std::vector<T>> GetMetadataArrays(const std::string &key) const
+    {
+        std::vector<std::vector<std::vector<T>>> columns;
+        for (auto *stripe : m_stripes)
+        {
+            columns.push_back(ReadMetadataColumns<T>(stripe, key.c_str()));
+        }
+        return this->InterleaveStripes(columns, key);
+    }
+
+    /**
+     * Reads the time stamp of each frame in milliseconds since epoch, stored either as formatted local time or, with
+     * columnar metadata, as integers.
+     *
+     * @throws std::runtime_error if the recording has no time stamps.
+     */
+    std::vector<int64_t> GetTimeStamps() const
+    {
+        std::vector<std::vector<int64_t>> columns;
+        for (auto *stripe : m_stripes)
+        {
+            msgpack::object_handle handle = ReadMetadataObject(stripe, TIME_STAMP_KEY);
+            if (!IsStringColumn(handle.get()))
+            {
+                columns.push_back(DecodeMetadataColumn<int64_t>(handle.get()));
+                continue;
+            }
+            std::vector<int64_t> timeStamps;
+            for (const std::string &timeStamp : DecodeMetadataColumn<std::string>(handle.get()))
+            {
+                timeStamps.push_back(ParseTimeStampMilliseconds(timeStamp));
+            }
+            columns.push_back(std::move(timeStamps));
+        }
+        return this->InterleaveStripes(columns, TIME_STAMP_KEY);
+    }
+
+    /**
+     * Finds the first frame recorded at or after a point in time.
+     *
+     * @param millisecondsSinceEpoch point in time
+     * @return index of the frame
+     * @throws std::out_of_range if all frames were recorded before that time.
+     */
+    int64_t FindFrameAtTime(int64_t millisecondsSinceEpoch) const
+    {
+        std::vector<int64_t> timeStamps = this->GetTimeStamps();
+        auto found = std::lower_bound(timeStamps.begin(), timeStamps.end(), millisecondsSinceEpoch);
+        if (found == timeStamps.end())
+        {
+            throw std::out_of_range("No frame recorded at or after " + std::to_string(millisecondsSinceEpoch));
+        }
+        return static_cast<int64_t>(found - timeStamps.begin());
+    }
+
+    /**
+     * Finds a frame by the frame number assigned by the camera, stored under FRAME_NUMBER_KEY.
+     *
+     * @param frameNumber frame number of the camera
+     * @return index of the frame
+     * @throws std::out_of_range if no frame has that number.
+     */
+    int64_t FindFrameByNumber(int64_t frameNumber) const
+    {
+        std::vector<int64_t> frameNumbers = this->GetMetadata<int64_t>(FRAME_NUMBER_KEY);
+        auto found = std::find(frameNumbers.begin(), frameNumbers.end(), frameNumber);
+        if (found == frameNumbers.end())
+        {
+            throw std::out_of_range("No frame with frame number " + std::to_string(frameNumber));
+        }
+        return static_cast<int64_t>(found - frameNumbers.begin());
+    }
+
+  private:
+    static bool IsManifestPath(const std::string &filePath)
+    {
+        const std::string extension = RECORDING_MANIFEST_EXTENSION;
+        return filePath.size() >= extension.size() &&
+               filePath.compare(filePath.size() - extension.size(), extension.size(), extension) == 0;
+    }
+
+    /**
+     * Queries whether a metadata column holds strings, either as a plain array or dictionary encoded
+     */
+    static bool IsStringColumn(const msgpack::object &object)
+    {
+        if (object.type == msgpack::type::ARRAY)
+        {
+            return object.via.array.size > 0 && object.via.array.ptr[0].type == msgpack::type::STR;
+        }
+        return GetMetadataEncoding(object) == "dictionary";
+    }
+
+    /**
+     * Merges the columns of each stripe into one value per frame in recording order
+     */
+    template <typename T>
+    std::vector<T> InterleaveStripes(std::vector<std::vector<T>> &columns, const std::string &key) const
+    {
+        const size_t nStripes = columns.size();
+        std::vector<T> values(static_cast<size_t>(m_nFrames));
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            std::vector<T> &column = columns[i % nStripes];
+            if (i / nStripes >= column.size())
+            {
+                throw std::runtime_error("Metadata " + key + " has fewer values than frames.");
+            }
+            values[i] = std::move(column[i / nStripes]);
+        }
+        return values;
+    }
+
+    /**
+     * Releases the files opened so far.
+     */
+    void Close()
+    {
+        for (auto *stripe : m_stripes)
+        {
+            b2nd_free(stripe);
+        }
+        m_stripes.clear();
+    }
+
+    std::vector<std::string> m_paths;
+    std::vector<b2nd_array_t *> m_stripes;
+    int64_t m_nFrames = 0;
+    int64_t m_height = 0;
+    int64_t m_width = 0;
+};
+
+/**
+ * @brief Frame handed out by FramePrefetcher.
+ */
+struct PrefetchedFrame
+{
+    /**
+     * Index of the frame in the recording.
+     */
+    int64_t index = -1;
+
+    /**
+     * Pixels of the frame, row by row.
+     */
+    std::vector<uint16_t> pixels;
+};
+
+/**
+ * @brief Iterates over a range of frames of a recording, decompressing the following frames ahead on a pool of
+ * threads.
+ *
+ * Each thread opens its own RecordingReader, such that frames are decompressed in parallel. Frames are handed out in
+ * order, at most `depth` frames are decompressed ahead of the last one handed out. Errors of the threads are thrown
+ * by FramePrefetcher::Next when the frame that failed is reached.
+ */
+class FramePrefetcher
+{
+  public:
+    /**
+     * Starts decompressing the first frames of the range.
+     *
+     * @param reader recording to read, only its paths are used and it can be released afterwards.
+     * @param first index of the first frame.
+     * @param last index after the last frame, clamped to the number of frames of the recording.
+     * @param nThreads number of decompression threads, 0 uses the number of cores.
+     * @param depth maximum number of frames decompressed ahead, 0 uses twice the number of threads.
+     */
+    FramePrefetcher(const RecordingReader &reader, int64_t first, int64_t last, unsigned int nThreads = 0,
+                    size_t depth = 0)
+        : m_paths(reader.GetStripePaths()), m_next(std::max<int64_t>(first, 0)), m_consumed(m_next),
+          m_last(std::min(last, reader.GetNumberOfFrames()))
+    {
+        if (nThreads == 0)
+        {
+            nThreads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        m_slots.resize(depth > 0 ? depth : 2 * nThreads);
+        for (unsigned int i = 0; i < nThreads; i++)
+        {
+            m_workers.emplace_back(&FramePrefetcher::Work, this);
+        }
+    }
+
+    /**
+     * Stops the threads, frames not handed out yet are discarded.
+     */
+    ~FramePrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_slotFreed.notify_all();
+        for (auto &worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    FramePrefetcher(const FramePrefetcher &) = delete;
+    FramePrefetcher &operator=(const FramePrefetcher &) = delete;
+
+    /**
+     * Hands out the next frame, waiting until it is decompressed.
+     *
+     * @param frame destination of the frame, its pixel buffer is recycled by the prefetcher.
+     * @return false once all frames of the range were handed out.
+     * @throws std::runtime_error if the frame could not be read.
+     */
+    bool Next(PrefetchedFrame &frame)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_consumed >= m_last)
+        {
+            return false;
+        }
+        Slot &slot = m_slots[static_cast<size_t>(m_consumed) % m_slots.size()];
+        m_slotReady.wait(lock, [this, &slot] { return m_openError || (slot.ready && slot.index == m_consumed); });
+        if (slot.ready && slot.error)
+        {
+            std::rethrow_exception(slot.error);
+        }
+        if (!slot.ready)
+        {
+            std::rethrow_exception(m_openError);
+        }
+        frame.index = m_consumed;
+        frame.pixels.swap(slot.pixels);
+        slot.ready = false;
+        m_consumed++;
+        lock.unlock();
+        m_slotFreed.notify_all();
+        return true;
+    }
+
+  private:
+    /**
+     * Frame being decompressed or waiting to be handed out
+     */
+    struct Slot
+    {
+        int64_t index = -1;
+        bool ready = false;
+        std::vector<uint16_t> pixels;
+        std::exception_ptr error;
+    };
+
+    /**
+     * Loop of the decompression threads
+     */
+    void Work()
+    {
+        std::unique_ptr<RecordingReader> reader;
+        try
+        {
+            reader.reset(new RecordingReader(m_paths));
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_openError = std::current_exception();
+            m_slotReady.notify_all();
+            return;
+        }
+        while (true)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_slotFreed.wait(lock, [this] {
+                return m_stopping || m_next >= m_last || m_next - m_consumed < static_cast<int64_t>(m_slots.size());
+            });
+            if (m_stopping || m_next >= m_last)
+            {
+                return;
+            }
+            const int64_t index = m_next++;
+            Slot &slot = m_slots[static_cast<size_t>(index) % m_slots.size()];
+            lock.unlock();
+
+            // the slot is not touched by other threads until it is marked as ready
+            std::exception_ptr error;
+            try
+            {
+                reader->ReadFrame(index, slot.pixels);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            lock.lock();
+            slot.index = index;
+            slot.error = error;
+            slot.ready = true;
+            lock.unlock();
+            m_slotReady.notify_all();
+        }
+    }
+
+    std::vector<std::string> m_paths;
+    int64_t m_next;
+    int64_t m_consumed;
+    int64_t m_last;
+    std::vector<Slot> m_slots;
+    std::exception_ptr m_openError;
+    bool m_stopping = false;
+    std::mutex m_mutex;
+    std::condition_variable m_slotReady;
+    std::condition_variable m_slotFreed;
+    std::vector<std::thread> m_workers;
+};
+
+#endif // XILENS_READER_H
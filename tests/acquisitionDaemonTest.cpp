@@ -0,0 +1,64 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include "mocks.h"
+#include "src/acquisitionDaemon.h"
+
+static DaemonOptions CreateTestOptions()
+{
+    DaemonOptions options;
+    options.socketPath =
+        (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("xilens-%%%%-%%%%.sock")).string();
+    options.previewName = boost::filesystem::unique_path("xilens-preview-test-%%%%-%%%%").string();
+    return options;
+}
+
+TEST(AcquisitionDaemon, CommandsWithoutCamera)
+{
+    AcquisitionDaemon daemon(CreateTestOptions(), std::make_shared<MockXiAPIWrapper>());
+    auto status = ParseControlStatus(daemon.HandleCommand("status", ""));
+    ASSERT_EQ(status["camera"], "none");
+    ASSERT_EQ(status["recording"], "0");
+    ASSERT_EQ(daemon.HandleCommand("cameras", ""), "");
+    ASSERT_THROW(daemon.HandleCommand("record", "/tmp/recording"), std::runtime_error);
+    ASSERT_THROW(daemon.HandleCommand("stop", ""), std::runtime_error);
+    ASSERT_THROW(daemon.HandleCommand("exposure", "10"), std::runtime_error);
+    ASSERT_THROW(daemon.HandleCommand("open", "unknown@123"), std::runtime_error);
+    ASSERT_THROW(daemon.HandleCommand("unknown", ""), std::runtime_error);
+    ASSERT_NO_THROW(daemon.HandleCommand("close", ""));
+}
+
+TEST(AcquisitionDaemon, ServesControlSocketUntilShutdown)
+{
+    DaemonOptions options = CreateTestOptions();
+    AcquisitionDaemon daemon(options, std::make_shared<MockXiAPIWrapper>());
+    boost::thread runner([&daemon] { daemon.Run(); });
+    std::string previewName;
+    for (int attempt = 0; attempt < 100 && previewName.empty(); attempt++)
+    {
+        try
+        {
+            previewName = SendControlRequest(options.socketPath, "preview");
+        }
+        catch (const std::runtime_error &)
+        {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+        }
+    }
+    ASSERT_EQ(previewName, options.previewName);
+    ASSERT_NO_THROW(PreviewSubscriber subscriber(previewName));
+    // clients come and go without affecting the daemon
+    ASSERT_EQ(ParseControlStatus(SendControlRequest(options.socketPath, "status"))["camera"], "none");
+    ASSERT_THROW(SendControlRequest(options.socketPath, "stop"), std::runtime_error);
+    SendControlRequest(options.socketPath, "shutdown");
+    runner.join();
+    ASSERT_FALSE(boost::filesystem::exists(options.socketPath));
+    ASSERT_THROW(PreviewSubscriber subscriber(previewName), std::runtime_error);
+}
@@ -0,0 +1,194 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <blosc2.h>
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+#include "src/archiveMigrator.h"
+#include "src/constants.h"
+#include "src/util.h"
+
+class ArchiveMigratorTest : public ::testing::Test
+{
+  protected:
+    boost::filesystem::path m_root;
+    boost::filesystem::path m_staging;
+    boost::filesystem::path m_archive;
+
+    void SetUp() override
+    {
+        m_root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("xilens-%%%%-%%%%");
+        m_staging = m_root / "staging";
+        m_archive = m_root / "archive";
+        boost::filesystem::create_directories(m_staging);
+    }
+
+    void TearDown() override
+    {
+        boost::filesystem::remove_all(m_root);
+    }
+
+    static void WriteTextFile(const boost::filesystem::path &path, const std::string &content)
+    {
+        std::ofstream file(path.string(), std::ios::binary);
+        file << content;
+    }
+
+    static std::string ReadTextFile(const boost::filesystem::path &path)
+    {
+        std::ifstream file(path.string(), std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+};
+
+TEST_F(ArchiveMigratorTest, FileCRC32)
+{
+    WriteTextFile(m_staging / "check.txt", "123456789");
+    ASSERT_EQ(ComputeFileCRC32((m_staging / "check.txt").string()), 0xCBF43926);
+    EXPECT_THROW(ComputeFileCRC32((m_staging / "missing.txt").string()), std::runtime_error);
+}
+
+TEST_F(ArchiveMigratorTest, MigrateFile)
+{
+    WriteTextFile(m_staging / "recording.txt", "recorded data");
+    ArchiveMigrator migrator(m_staging.string(), 0, 0);
+    migrator.Start();
+    migrator.Enqueue((m_staging / "recording.txt").string(), (m_archive / "day1" / "recording.txt").string());
+    migrator.WaitUntilIdle();
+    migrator.Stop();
+
+    ASSERT_EQ(ReadTextFile(m_archive / "day1" / "recording.txt"), "recorded data");
+    ASSERT_FALSE(boost::filesystem::exists(m_staging / "recording.txt"));
+    ASSERT_FALSE(boost::filesystem::exists(m_archive / "day1" / "recording.txt.part"));
+    ASSERT_NE(ReadTextFile(migrator.GetJournalPath()).find("DONE"), std::string::npos);
+}
+
+TEST_F(ArchiveMigratorTest, ResumeJobsFromJournal)
+{
+    WriteTextFile(m_staging / "first.txt", "first");
+    WriteTextFile(m_staging / "second.txt", "second");
+    std::string first = (m_staging / "first.txt").string();
+    std::string second = (m_staging / "second.txt").string();
+    // the first job was finished before the crash, the second one was interrupted
+    WriteTextFile(m_staging / ".xilens_archive_journal",
+                  "PENDING\t" + first + "\t" + (m_archive / "first.txt").string() + "\n" + "PENDING\t" + second + "\t" +
+                      (m_archive / "second.txt").string() + "\n" + "DONE\t" + first + "\t" +
+                      (m_archive / "first.txt").string() + "\n");
+
+    ArchiveMigrator migrator(m_staging.string(), 0, 0);
+    migrator.Start();
+    migrator.WaitUntilIdle();
+    migrator.Stop();
+
+    ASSERT_FALSE(boost::filesystem::exists(m_archive / "first.txt"));
+    ASSERT_TRUE(boost::filesystem::exists(m_staging / "first.txt"));
+    ASSERT_EQ(ReadTextFile(m_archive / "second.txt"), "second");
+}
+
+TEST_F(ArchiveMigratorTest, ReplayFinishedJobs)
+{
+    WriteTextFile(m_archive / "moved.txt", "moved");
+    WriteTextFile(m_staging / "renamed.txt", "renamed");
+    WriteTextFile(m_archive / "renamed.txt", "renamed");
+    std::string moved = (m_staging / "moved.txt").string();
+    std::string renamed = (m_staging / "renamed.txt").string();
+    // the first job was interrupted after removing the staged file, the second one after the rename
+    WriteTextFile(m_staging / ".xilens_archive_journal",
+                  "PENDING\t" + moved + "\t" + (m_archive / "moved.txt").string() + "\n" + "PENDING\t" + renamed +
+                      "\t" + (m_archive / "renamed.txt").string() + "\n");
+
+    ArchiveMigrator migrator(m_staging.string(), 0, 0);
+    migrator.Start();
+    migrator.WaitUntilIdle();
+    migrator.Stop();
+
+    ASSERT_EQ(ReadTextFile(m_archive / "moved.txt"), "moved");
+    ASSERT_EQ(ReadTextFile(m_archive / "renamed.txt"), "renamed");
+    ASSERT_FALSE(boost::filesystem::exists(m_staging / "renamed.txt"));
+    ASSERT_EQ(ReadTextFile(migrator.GetJournalPath()).find(moved), std::string::npos);
+}
+
+TEST_F(ArchiveMigratorTest, NeverOverwriteArchive)
+{
+    std::string destination = (m_archive / "test.txt").string();
+    ArchiveMigrator migrator(m_staging.string(), 0, 0);
+    migrator.Start();
+    // test mode writes every recording to the same file name
+    for (const std::string &content : {"first", "second", "third"})
+    {
+        WriteTextFile(m_staging / "test.txt", content);
+        migrator.Enqueue((m_staging / "test.txt").string(), destination);
+        migrator.WaitUntilIdle();
+    }
+    migrator.Stop();
+
+    ASSERT_EQ(ReadTextFile(m_archive / "test.txt"), "first");
+    ASSERT_EQ(ReadTextFile(m_archive / "test_1.txt"), "second");
+    ASSERT_EQ(ReadTextFile(m_archive / "test_2.txt"), "third");
+
+    // a job interrupted after the rename is not finished if the archive holds a different file
+    WriteTextFile(m_staging / "test.txt", "fourth");
+    WriteTextFile(m_staging / ".xilens_archive_journal",
+                  "PENDING\t" + (m_staging / "test.txt").string() + "\t" + destination + "\n");
+    ArchiveMigrator resumed(m_staging.string(), 0, 0);
+    resumed.Start();
+    resumed.WaitUntilIdle();
+    resumed.Stop();
+    ASSERT_EQ(ReadTextFile(m_archive / "test.txt"), "first");
+    ASSERT_TRUE(boost::filesystem::exists(m_staging / "test.txt"));
+}
+
+TEST_F(ArchiveMigratorTest, NearLosslessNeedsNoiseModel)
+{
+    ArchiveMigrator migrator(m_staging.string(), 0, 0);
+    ASSERT_THROW(migrator.EnableNearLossless(SensorNoiseModel(), 1), std::invalid_argument);
+    SensorNoiseModel noiseModel;
+    noiseModel.readNoise = 2;
+    ASSERT_NO_THROW(migrator.EnableNearLossless(noiseModel, 1));
+}
+
+TEST_F(ArchiveMigratorTest, RecompressRecording)
+{
+    XI_IMG xiImage;
+    xiImage.width = 32;
+    xiImage.height = 32;
+    xiImage.exposure_time_us = 40000;
+    std::vector<uint16_t> data(static_cast<size_t>(xiImage.width) * xiImage.height);
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = static_cast<uint16_t>(i % 1024);
+    }
+    xiImage.bp = data.data();
+    std::string source = (m_staging / "recording.b2nd").string();
+    std::string destination = (m_archive / "recording.b2nd").string();
+
+    blosc2_init();
+    {
+        FileImage fileImage(source.c_str(), xiImage.height, xiImage.width);
+        for (int i = 0; i < 3; i++)
+        {
+            fileImage.WriteImageData(xiImage, QMap<QString, float>());
+        }
+        fileImage.AppendMetadata();
+    }
+    uint32_t originalCRC = ComputeB2NDDataCRC32(source);
+
+    ArchiveMigrator migrator(m_staging.string(), 0, 9);
+    migrator.Start();
+    migrator.Enqueue(source, destination);
+    migrator.WaitUntilIdle();
+    migrator.Stop();
+
+    ASSERT_FALSE(boost::filesystem::exists(source));
+    ASSERT_EQ(ComputeB2NDDataCRC32(destination), originalCRC);
+    b2nd_array_t *archived;
+    ASSERT_EQ(b2nd_open(destination.c_str(), &archived), 0);
+    ASSERT_GE(blosc2_vlmeta_exists(archived->sc, EXPOSURE_KEY), 0);
+    b2nd_free(archived);
+    blosc2_destroy();
+}
@@ -0,0 +1,120 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+#include "mocks.h"
+#include "src/bitDepth.h"
+#include "src/recordingFormat.h"
+
+/**
+ * Camera with a full frame rate of 80fps that reports the same bit depth for its sensor and its images.
+ */
+class BitDepthXiAPIWrapper : public MockXiAPIWrapper
+{
+  public:
+    explicit BitDepthXiAPIWrapper(int bitDepth) : m_bitDepth(bitDepth)
+    {
+    }
+
+    int xiGetParamInt(IN HANDLE hDevice, const char *prm, int *val) override
+    {
+        bool bitDepth =
+            std::strcmp(prm, XI_PRM_SENSOR_DATA_BIT_DEPTH) == 0 || std::strcmp(prm, XI_PRM_IMAGE_DATA_BIT_DEPTH) == 0;
+        *val = bitDepth ? m_bitDepth : 80;
+        return XI_OK;
+    }
+
+  private:
+    int m_bitDepth;
+};
+
+/**
+ * Converts a single raw value to 8 bit.
+ */
+static uchar ConvertValue(uint16_t value, int bitDepth)
+{
+    cv::Mat image(1, 1, CV_16UC1, cv::Scalar(value));
+    cv::Mat converted;
+    ConvertTo8Bit(image, converted, bitDepth);
+    return converted.at<uchar>(0, 0);
+}
+
+TEST(BitDepthTest, ShiftsToDisplayRange)
+{
+    ASSERT_EQ(GetDisplayShift(8), 0);
+    ASSERT_EQ(GetDisplayShift(10), 2);
+    ASSERT_EQ(GetDisplayShift(12), 4);
+    ASSERT_EQ(GetDisplayShift(16), 8);
+    ASSERT_THROW(GetDisplayShift(7), std::invalid_argument);
+    ASSERT_THROW(GetDisplayShift(17), std::invalid_argument);
+}
+
+TEST(BitDepthTest, ConvertsEachBitDepthTo8Bit)
+{
+    ASSERT_EQ(ConvertValue(200, 8), 200);
+    ASSERT_EQ(ConvertValue(300, 8), 255);
+    ASSERT_EQ(ConvertValue(3, 10), 0);
+    ASSERT_EQ(ConvertValue(4, 10), 1);
+    ASSERT_EQ(ConvertValue(1023, 10), 255);
+    // values above the maximum of the bit depth saturate
+    ASSERT_EQ(ConvertValue(4000, 10), 255);
+    ASSERT_EQ(ConvertValue(2048, 12), 128);
+    ASSERT_EQ(ConvertValue(4095, 12), 255);
+    ASSERT_EQ(ConvertValue(64, 14), 1);
+    ASSERT_EQ(ConvertValue(16383, 14), 255);
+    ASSERT_EQ(ConvertValue(256, 16), 1);
+    ASSERT_EQ(ConvertValue(65535, 16), 255);
+}
+
+TEST(BitDepthTest, ConvertsColorImagesInPlace)
+{
+    cv::Mat image(4, 6, CV_16UC3, cv::Scalar(400, 800, 4000));
+    ConvertTo8Bit(image, image, 10);
+    ASSERT_EQ(image.type(), CV_8UC3);
+    ASSERT_EQ(image.size(), cv::Size(6, 4));
+    ASSERT_EQ(image.at<cv::Vec3b>(3, 5), cv::Vec3b(100, 200, 255));
+
+    cv::Mat converted;
+    ASSERT_THROW(ConvertTo8Bit(cv::Mat::zeros(4, 4, CV_8UC1), converted, 8), std::invalid_argument);
+    ASSERT_THROW(ConvertTo8Bit(cv::Mat::zeros(4, 4, CV_16UC1), converted, 4), std::invalid_argument);
+}
+
+TEST(BitDepthTest, CameraQueriesBitDepth)
+{
+    HANDLE handle = nullptr;
+    auto apiWrapper = std::make_shared<BitDepthXiAPIWrapper>(12);
+    std::unique_ptr<CameraFamily> family = std::make_unique<XiSpecFamily>(&handle);
+    family->m_apiWrapper = apiWrapper;
+    SpectralCamera camera(&family, &handle);
+    camera.m_apiWrapper = apiWrapper;
+    ASSERT_EQ(camera.GetDataBitDepth(), DEFAULT_BIT_DEPTH);
+    camera.InitializeCamera();
+    ASSERT_EQ(camera.GetSensorBitDepth(), 12);
+    ASSERT_EQ(camera.GetDataBitDepth(), 12);
+
+    // cameras that do not report a valid bit depth deliver the default bit depth
+    auto invalidWrapper = std::make_shared<BitDepthXiAPIWrapper>(20);
+    family->m_apiWrapper = invalidWrapper;
+    camera.m_apiWrapper = invalidWrapper;
+    camera.InitializeCamera();
+    ASSERT_EQ(camera.GetSensorBitDepth(), DEFAULT_BIT_DEPTH);
+    ASSERT_EQ(camera.GetDataBitDepth(), DEFAULT_BIT_DEPTH);
+}
+
+TEST(BitDepthTest, ProvidesBitDepthToMetadata)
+{
+    MetadataProviderRegistry registry;
+    registry.Register(std::make_shared<BitDepthProvider>(12, 10));
+    ASSERT_TRUE(registry.GetSchema().Contains(SENSOR_BIT_DEPTH_KEY));
+    ASSERT_TRUE(registry.GetSchema().Contains(DATA_BIT_DEPTH_KEY));
+    FrameMetadataRecord record = registry.GetSchema().CreateRecord();
+    XI_IMG image{};
+    registry.Sample(image, record);
+    ASSERT_EQ(record.intValues[0], 12);
+    ASSERT_EQ(record.intValues[1], 10);
+}
@@ -0,0 +1,191 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <boost/thread.hpp>
+#include <cstring>
+
+#include "mocks.h"
+#include "src/cameraRecovery.h"
+#include "src/imageContainer.h"
+
+/**
+ * Camera delivering a frame every 2ms that can be unplugged. Its frame counter and exposure time are reset when it is
+ * opened again, like after a power cycle.
+ */
+class SimulatedCamera : public MockXiAPIWrapper
+{
+  public:
+    std::atomic<bool> m_connected{true};
+    std::atomic<bool> m_acquiring{false};
+    std::atomic<int> m_exposureUs{10000};
+    std::atomic<DWORD> m_frameNumber{0};
+    std::vector<uint16_t> m_pixels = std::vector<uint16_t>(16, 100);
+
+    int xiGetParamInt(IN HANDLE hDevice, const char *prm, int *val) override
+    {
+        *val = m_exposureUs;
+        return XI_OK;
+    }
+
+    int xiSetParamInt(IN HANDLE hDevice, const char *prm, const int val) override
+    {
+        if (std::strcmp(prm, XI_PRM_EXPOSURE) == 0)
+        {
+            m_exposureUs = val;
+        }
+        return XI_OK;
+    }
+
+    int xiOpenDevice(IN DWORD DevId, OUT PHANDLE hDevice) override
+    {
+        if (!m_connected)
+        {
+            return XI_INVALID_HANDLE;
+        }
+        *hDevice = this;
+        m_exposureUs = 10000;
+        m_frameNumber = 0;
+        return XI_OK;
+    }
+
+    int xiGetNumberDevices(OUT PDWORD pNumberDevices) override
+    {
+        *pNumberDevices = m_connected ? 1 : 0;
+        return XI_OK;
+    }
+
+    int xiStartAcquisition(IN HANDLE hDevice) override
+    {
+        m_acquiring = m_connected.load();
+        return m_acquiring ? XI_OK : XI_INVALID_HANDLE;
+    }
+
+    int xiStopAcquisition(IN HANDLE hDevice) override
+    {
+        m_acquiring = false;
+        return XI_OK;
+    }
+
+    int xiGetImage(IN HANDLE hDevice, IN DWORD timeout, OUT LPXI_IMG img) override
+    {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(2));
+        if (!m_connected || !m_acquiring)
+        {
+            return XI_TIMEOUT;
+        }
+        img->width = 4;
+        img->height = 4;
+        img->bp = m_pixels.data();
+        img->exposure_time_us = m_exposureUs;
+        img->acq_nframe = ++m_frameNumber;
+        return XI_OK;
+    }
+
+    void Unplug()
+    {
+        m_connected = false;
+        m_acquiring = false;
+    }
+};
+
+class CameraRecoveryTest : public ::testing::Test
+{
+  protected:
+    std::shared_ptr<SimulatedCamera> m_camera = std::make_shared<SimulatedCamera>();
+    CameraInterface m_cameraInterface;
+
+    void SetUp() override
+    {
+        QString cameraIdentifier = "MockDeviceModel@MockSensorSN";
+        m_cameraInterface.Initialize(m_camera);
+        m_cameraInterface.SetCameraProperties("MQ022HG-IM-SM4X4-VIS3");
+        m_cameraInterface.SetCamera(m_cameraInterface.m_cameraType, m_cameraInterface.m_cameraFamilyName);
+        ASSERT_TRUE(m_cameraInterface.GetAvailableCameraIdentifiers().contains(cameraIdentifier));
+        m_cameraInterface.m_cameraIdentifier = cameraIdentifier;
+        m_cameraInterface.StartAcquisition(cameraIdentifier);
+        m_cameraInterface.m_camera->SetExposure(20000);
+    }
+
+    static bool WaitFor(const std::function<bool()> &condition)
+    {
+        for (int i = 0; i < 2000 && !condition(); i++)
+        {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+        }
+        return condition();
+    }
+};
+
+TEST_F(CameraRecoveryTest, AcquisitionResumesAfterDropout)
+{
+    CameraRecovery recovery(&m_cameraInterface);
+    ImageContainer imageContainer;
+    imageContainer.Initialize(m_camera);
+    imageContainer.SetRecoveryHandler([&recovery] { return recovery.Recover(); });
+    bool pollingFailed = false;
+    boost::thread polling([&] {
+        try
+        {
+            imageContainer.PollImage(&m_cameraInterface.m_cameraHandle, 1);
+        }
+        catch (const std::runtime_error &)
+        {
+            pollingFailed = true;
+        }
+    });
+    ASSERT_TRUE(WaitFor([&imageContainer] { return imageContainer.GetReceivedImageCount() > 10; }));
+
+    m_camera->Unplug();
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+    m_camera->m_connected = true;
+    ASSERT_TRUE(WaitFor([&recovery] { return recovery.GetSegment() == 1; }));
+    unsigned long receivedAfterRecovery = imageContainer.GetReceivedImageCount();
+    ASSERT_TRUE(WaitFor([&] { return imageContainer.GetReceivedImageCount() > receivedAfterRecovery + 10; }));
+    imageContainer.StopPolling();
+    polling.join();
+
+    ASSERT_FALSE(pollingFailed);
+    ASSERT_GE(recovery.GetLastDropoutMs(), 100);
+    ASSERT_LT(recovery.GetLastDropoutMs(), 1000);
+    // the configuration of the camera is applied again after it was reopened
+    ASSERT_EQ(imageContainer.GetCurrentImage().exposure_time_us, 20000);
+
+    recovery.Reset();
+    ASSERT_EQ(recovery.GetSegment(), 0);
+    ASSERT_EQ(recovery.GetLastDropoutMs(), 0);
+}
+
+TEST_F(CameraRecoveryTest, GivesUpWhenCameraDoesNotComeBack)
+{
+    CameraRecovery recovery(&m_cameraInterface, 50, 5);
+    ImageContainer imageContainer;
+    imageContainer.Initialize(m_camera);
+    imageContainer.SetRecoveryHandler([&recovery] { return recovery.Recover(); });
+    m_camera->Unplug();
+    ASSERT_THROW(imageContainer.PollImage(&m_cameraInterface.m_cameraHandle, 1), std::runtime_error);
+    ASSERT_FALSE(imageContainer.m_PollImage);
+    ASSERT_EQ(recovery.GetSegment(), 0);
+    ASSERT_EQ(m_cameraInterface.m_cameraHandle, INVALID_HANDLE_VALUE);
+}
+
+TEST_F(CameraRecoveryTest, SegmentIsRecordedWithEachFrame)
+{
+    CameraRecovery recovery(&m_cameraInterface);
+    MetadataProviderRegistry registry;
+    registry.Register(std::make_shared<AcquisitionSegmentProvider>(&recovery));
+    ASSERT_TRUE(registry.GetSchema().Contains(ACQUISITION_SEGMENT_KEY));
+    ASSERT_TRUE(registry.GetSchema().Contains(DROPOUT_DURATION_KEY));
+    FrameMetadataRecord record = registry.GetSchema().CreateRecord();
+    XI_IMG image{};
+    registry.Sample(image, record);
+    ASSERT_EQ(record.intValues, std::vector<int64_t>({0, 0}));
+
+    ASSERT_TRUE(recovery.Recover());
+    registry.Sample(image, record);
+    ASSERT_EQ(record.intValues[0], 1);
+    ASSERT_EQ(record.intValues[1], recovery.GetLastDropoutMs());
+}
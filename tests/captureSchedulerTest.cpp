@@ -0,0 +1,211 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <boost/thread.hpp>
+#include <future>
+
+#include "mocks.h"
+#include "src/captureScheduler.h"
+
+/**
+ * Camera that applies exposure times in steps of 10us.
+ */
+class ExposureXiAPIWrapper : public MockXiAPIWrapper
+{
+  public:
+    std::atomic<int> m_exposureUs{40000};
+    std::vector<int> m_setExposures;
+
+    int xiGetParamInt(IN HANDLE hDevice, const char *prm, int *val) override
+    {
+        *val = m_exposureUs;
+        return XI_OK;
+    }
+
+    int xiSetParamInt(IN HANDLE hDevice, const char *prm, const int val) override
+    {
+        m_setExposures.push_back(val);
+        m_exposureUs = val - val % 10;
+        return XI_OK;
+    }
+};
+
+class CaptureSchedulerTest : public ::testing::Test
+{
+  protected:
+    std::shared_ptr<ExposureXiAPIWrapper> m_apiWrapper = std::make_shared<ExposureXiAPIWrapper>();
+    // the mock does not use the handle, it only needs to be valid
+    HANDLE m_cameraHandle = m_apiWrapper.get();
+    boost::mutex m_mutexCameraHandle;
+    CaptureScheduler m_scheduler;
+    std::promise<std::exception_ptr> m_completed;
+    std::vector<XI_IMG> m_frames;
+    std::vector<uint16_t> m_firstPixels;
+
+    CaptureSequenceOptions CreateOptions(int nFrames, int exposureUs)
+    {
+        CaptureSequenceOptions options;
+        options.apiWrapper = m_apiWrapper;
+        options.cameraHandle = &m_cameraHandle;
+        options.cameraHandleMutex = &m_mutexCameraHandle;
+        options.nFrames = nFrames;
+        options.exposureUs = exposureUs;
+        return options;
+    }
+
+    CaptureToken StartSequence(int nFrames, int exposureUs)
+    {
+        return CaptureSequence::Start(
+            m_scheduler, CreateOptions(nFrames, exposureUs),
+            [this](int index, const XI_IMG &image) {
+                m_frames.push_back(image);
+                m_firstPixels.push_back(static_cast<const uint16_t *>(image.bp)[0]);
+            },
+            [this](std::exception_ptr error) { m_completed.set_value(error); });
+    }
+
+    /**
+     * Streams frames until the sequence completes, every other frame is exposed with the initial exposure time as if
+     * the camera applied new exposure times late.
+     */
+    std::exception_ptr StreamFrames()
+    {
+        std::future<std::exception_ptr> completed = m_completed.get_future();
+        std::vector<uint16_t> pixels(16);
+        XI_IMG image{};
+        image.width = 4;
+        image.height = 4;
+        image.bp = pixels.data();
+        for (DWORD n = 1; completed.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready; n++)
+        {
+            std::fill(pixels.begin(), pixels.end(), static_cast<uint16_t>(n));
+            image.acq_nframe = n;
+            image.exposure_time_us = n % 2 == 0 ? 40000 : m_apiWrapper->m_exposureUs.load();
+            m_scheduler.NotifyFrame(image);
+        }
+        return completed.get();
+    }
+};
+
+TEST_F(CaptureSchedulerTest, CapturesConsecutiveFrames)
+{
+    StartSequence(5, 0);
+    ASSERT_EQ(StreamFrames(), nullptr);
+    ASSERT_EQ(m_frames.size(), 5);
+    for (size_t i = 1; i < m_frames.size(); i++)
+    {
+        ASSERT_EQ(m_frames[i].acq_nframe, m_frames[i - 1].acq_nframe + 1);
+        // the pixels are copied before the buffer of the camera is reused
+        ASSERT_EQ(m_firstPixels[i], m_frames[i].acq_nframe);
+    }
+    ASSERT_TRUE(m_apiWrapper->m_setExposures.empty());
+}
+
+TEST_F(CaptureSchedulerTest, CapturesWithExposureAndRestoresIt)
+{
+    StartSequence(4, 10005);
+    ASSERT_EQ(StreamFrames(), nullptr);
+    ASSERT_EQ(m_frames.size(), 4);
+    for (const XI_IMG &image : m_frames)
+    {
+        // frames exposed before the exposure time took effect are skipped
+        ASSERT_EQ(image.exposure_time_us, 10000);
+    }
+    ASSERT_EQ(m_apiWrapper->m_setExposures, std::vector<int>({10005, 40000}));
+    ASSERT_EQ(m_apiWrapper->m_exposureUs, 40000);
+}
+
+TEST_F(CaptureSchedulerTest, CancelRestoresExposure)
+{
+    CaptureToken token = StartSequence(1000000, 10000);
+    std::future<std::exception_ptr> completed = m_completed.get_future();
+    m_scheduler.Cancel(token);
+    ASSERT_THROW(std::rethrow_exception(completed.get()), CaptureCancelledError);
+    ASSERT_EQ(m_apiWrapper->m_exposureUs, 40000);
+    ASSERT_TRUE(m_frames.empty());
+}
+
+TEST_F(CaptureSchedulerTest, FailsWhileCameraIsReopened)
+{
+    m_cameraHandle = INVALID_HANDLE_VALUE;
+    std::future<std::exception_ptr> completed = m_completed.get_future();
+    StartSequence(4, 10000);
+    ASSERT_THROW(std::rethrow_exception(completed.get()), std::runtime_error);
+    ASSERT_TRUE(m_apiWrapper->m_setExposures.empty());
+    ASSERT_TRUE(m_frames.empty());
+}
+
+TEST_F(CaptureSchedulerTest, FailingCallbackStopsSequence)
+{
+    CaptureSequence::Start(
+        m_scheduler, CreateOptions(10, 20000),
+        [this](int index, const XI_IMG &image) {
+            m_frames.push_back(image);
+            throw std::runtime_error("disk full");
+        },
+        [this](std::exception_ptr error) { m_completed.set_value(error); });
+    std::exception_ptr error = StreamFrames();
+    ASSERT_EQ(m_frames.size(), 1);
+    ASSERT_THROW(std::rethrow_exception(error), std::runtime_error);
+    ASSERT_EQ(m_apiWrapper->m_exposureUs, 40000);
+}
+
+TEST_F(CaptureSchedulerTest, WaitTimesOut)
+{
+    std::promise<std::exception_ptr> timedOut;
+    m_scheduler.AsyncWaitFrame(AnyFrame(), 10, nullptr,
+                               [&timedOut](std::exception_ptr error, const XI_IMG &) { timedOut.set_value(error); });
+    std::exception_ptr error = timedOut.get_future().get();
+    ASSERT_NE(error, nullptr);
+    try
+    {
+        std::rethrow_exception(error);
+    }
+    catch (const CaptureCancelledError &)
+    {
+        FAIL() << "timeouts are not cancellations";
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+}
+
+/**
+ * Awaits a frame that is never streamed, the error of the wait is thrown by `co_await`.
+ */
+static CaptureTask AwaitMissingFrame(CaptureScheduler &scheduler, std::promise<std::exception_ptr> &completed)
+{
+    try
+    {
+        co_await scheduler.WaitFrame(AnyFrame(), 10, nullptr);
+        completed.set_value(nullptr);
+    }
+    catch (...)
+    {
+        completed.set_value(std::current_exception());
+    }
+}
+
+TEST_F(CaptureSchedulerTest, AwaitedWaitThrowsTimeout)
+{
+    std::promise<std::exception_ptr> completed;
+    m_scheduler.Spawn(AwaitMissingFrame(m_scheduler, completed));
+    std::exception_ptr error = completed.get_future().get();
+    ASSERT_NE(error, nullptr);
+    ASSERT_THROW(std::rethrow_exception(error), std::runtime_error);
+}
+
+TEST_F(CaptureSchedulerTest, StopCancelsPendingWaits)
+{
+    std::promise<std::exception_ptr> cancelled;
+    m_scheduler.AsyncWaitFrame(FrameWithExposure(1000), CAPTURE_FRAME_TIMEOUT_MS, nullptr,
+                               [&cancelled](std::exception_ptr error, const XI_IMG &) { cancelled.set_value(error); });
+    m_scheduler.Stop();
+    ASSERT_THROW(std::rethrow_exception(cancelled.get_future().get()), CaptureCancelledError);
+    // stopping again has no effect
+    ASSERT_NO_THROW(m_scheduler.Stop());
+}
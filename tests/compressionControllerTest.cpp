@@ -0,0 +1,108 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <blosc2.h>
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include "src/compressionController.h"
+#include "src/util.h"
+
+TEST(CompressionControllerTest, StepsDownWhenOverloaded)
+{
+    CompressionController controller({BLOSC_ZSTD, 5});
+    // compressing takes as long as the time between images
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_TRUE(controller.Update(0.01, 0.01, 0));
+    }
+    ASSERT_EQ(controller.GetSettings(), (CompressionSettings{BLOSC_ZSTD, 1}));
+    ASSERT_TRUE(controller.Update(0.01, 0.01, 0));
+    ASSERT_EQ(controller.GetSettings(), (CompressionSettings{BLOSC_LZ4, 1}));
+    ASSERT_FALSE(controller.Update(0.01, 0.01, 0));
+    ASSERT_EQ(controller.GetSettings(), (CompressionSettings{BLOSC_LZ4, 1}));
+}
+
+TEST(CompressionControllerTest, StepsDownWhenQueueFills)
+{
+    CompressionController controller({BLOSC_ZSTD, 5});
+    ASSERT_TRUE(controller.Update(0.001, 0.01, 0.9));
+    ASSERT_EQ(controller.GetSettings(), (CompressionSettings{BLOSC_ZSTD, 4}));
+}
+
+TEST(CompressionControllerTest, StepsUpSlowly)
+{
+    CompressionController controller({BLOSC_ZSTD, 5}, 6);
+    for (int i = 0; i < CompressionController::STEP_UP_HOLD - 1; i++)
+    {
+        ASSERT_FALSE(controller.Update(0.001, 0.01, 0));
+    }
+    ASSERT_TRUE(controller.Update(0.001, 0.01, 0));
+    ASSERT_EQ(controller.GetSettings(), (CompressionSettings{BLOSC_ZSTD, 6}));
+    // the maximum level is not exceeded
+    for (int i = 0; i < 2 * CompressionController::STEP_UP_HOLD; i++)
+    {
+        ASSERT_FALSE(controller.Update(0.001, 0.01, 0));
+    }
+    ASSERT_EQ(controller.GetSettings(), (CompressionSettings{BLOSC_ZSTD, 6}));
+}
+
+TEST(CompressionControllerTest, IgnoresFirstImage)
+{
+    CompressionController controller({BLOSC_ZSTD, 5});
+    ASSERT_FALSE(controller.Update(1, 0, 1));
+    ASSERT_EQ(controller.GetSettings(), (CompressionSettings{BLOSC_ZSTD, 5}));
+    ASSERT_EQ(controller.GetLoad(), 0);
+}
+
+TEST(CompressionControllerTest, CodecNames)
+{
+    ASSERT_EQ(CompressionCodecToString(BLOSC_ZSTD), "zstd");
+    ASSERT_EQ(CompressionCodecToString(BLOSC_LZ4), "lz4");
+}
+
+TEST(CompressionControllerTest, AdaptiveFileImage)
+{
+    auto filePath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("xilens-%%%%.b2nd");
+    XI_IMG image{};
+    image.width = 64;
+    image.height = 64;
+    std::vector<uint16_t> pixels(static_cast<size_t>(image.width) * image.height, 100);
+    image.bp = pixels.data();
+    blosc2_init();
+    {
+        FileImage fileImage(filePath.string().c_str(), image.height, image.width);
+        fileImage.EnableAdaptiveCompression();
+        // a full queue forces the controller to step down after each image
+        fileImage.SetQueueFill(1);
+        for (int i = 0; i < 7; i++)
+        {
+            fileImage.WriteImageData(image, QMap<QString, float>());
+        }
+        std::vector<uint8_t> chunk;
+        ASSERT_THROW(fileImage.WriteCompressedImageData(chunk, FrameMetadataRecord()), std::logic_error);
+        fileImage.AppendMetadata();
+    }
+    b2nd_array_t *src;
+    ASSERT_EQ(b2nd_open(filePath.string().c_str(), &src), 0);
+    auto levels = GetBLOSCVLMetadata(src, COMPRESSION_LEVEL_KEY).get().as<std::vector<int64_t>>();
+    auto codecs = GetBLOSCVLMetadata(src, COMPRESSION_CODEC_KEY).get().as<std::vector<std::string>>();
+    // the first image has no interval to measure the load
+    ASSERT_EQ(levels, std::vector<int64_t>({5, 5, 4, 3, 2, 1, 1}));
+    ASSERT_EQ(codecs, std::vector<std::string>({"zstd", "zstd", "zstd", "zstd", "zstd", "zstd", "lz4"}));
+    // all images are decompressed correctly regardless of their codec
+    std::vector<uint16_t> buffer(pixels.size());
+    int64_t start[] = {6, 0, 0};
+    int64_t stop[] = {7, image.height, image.width};
+    int64_t shape[] = {1, image.height, image.width};
+    ASSERT_EQ(b2nd_get_slice_cbuffer(src, start, stop, buffer.data(), shape,
+                                     static_cast<int64_t>(buffer.size() * sizeof(uint16_t))),
+              0);
+    ASSERT_EQ(buffer, pixels);
+    b2nd_free(src);
+    blosc2_destroy();
+    boost::filesystem::remove(filePath);
+}
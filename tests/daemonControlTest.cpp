@@ -0,0 +1,121 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+#include "src/daemonControl.h"
+
+class DaemonControlTest : public ::testing::Test
+{
+  protected:
+    std::string m_socketPath;
+
+    void SetUp() override
+    {
+        m_socketPath =
+            (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("xilens-%%%%-%%%%.sock"))
+                .string();
+    }
+
+    void TearDown() override
+    {
+        boost::filesystem::remove(m_socketPath);
+    }
+
+    static std::string Echo(const std::string &command, const std::string &argument)
+    {
+        if (command == "echo")
+        {
+            return argument;
+        }
+        if (command == "fail")
+        {
+            throw std::runtime_error("failed\nrequest");
+        }
+        if (command == "sleep")
+        {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(std::stoi(argument)));
+        }
+        return "";
+    }
+};
+
+TEST_F(DaemonControlTest, ParseRequest)
+{
+    std::string command;
+    std::string argument;
+    ParseControlRequest("record /data/my recording", command, argument);
+    ASSERT_EQ(command, "record");
+    ASSERT_EQ(argument, "/data/my recording");
+    ParseControlRequest("status", command, argument);
+    ASSERT_EQ(command, "status");
+    ASSERT_TRUE(argument.empty());
+
+    ASSERT_EQ(HandleControlRequest(Echo, "echo hello"), "ok hello");
+    ASSERT_EQ(HandleControlRequest(Echo, "nothing"), "ok");
+    ASSERT_EQ(HandleControlRequest(Echo, "fail"), "error failed request");
+}
+
+TEST_F(DaemonControlTest, ParseStatus)
+{
+    auto status = ParseControlStatus("camera=MQ022HG-IM-SM4X4-VIS3@123 recording=1 file=/data/my recording.b2nd");
+    ASSERT_EQ(status.size(), 3);
+    ASSERT_EQ(status["camera"], "MQ022HG-IM-SM4X4-VIS3@123");
+    ASSERT_EQ(status["recording"], "1");
+    ASSERT_EQ(status["file"], "/data/my recording.b2nd");
+    ASSERT_TRUE(ParseControlStatus("").empty());
+}
+
+TEST_F(DaemonControlTest, RequestsAreServedAcrossConnections)
+{
+    ControlServer server(m_socketPath, Echo);
+    ASSERT_EQ(SendControlRequest(m_socketPath, "echo first"), "first");
+    ASSERT_EQ(SendControlRequest(m_socketPath, "echo second"), "second");
+    try
+    {
+        SendControlRequest(m_socketPath, "fail");
+        FAIL() << "error replies should throw";
+    }
+    catch (const std::runtime_error &e)
+    {
+        ASSERT_STREQ(e.what(), "failed request");
+    }
+    // another server can not take over the socket while the first one is listening
+    ASSERT_THROW(ControlServer other(m_socketPath, Echo), std::runtime_error);
+}
+
+TEST_F(DaemonControlTest, StaleSocketIsReplaced)
+{
+    {
+        ControlServer server(m_socketPath, Echo);
+    }
+    ASSERT_FALSE(boost::filesystem::exists(m_socketPath));
+    ASSERT_THROW(SendControlRequest(m_socketPath, "echo"), std::runtime_error);
+
+    // a file left behind by a daemon that crashed
+    std::ofstream(m_socketPath) << "";
+    ControlServer server(m_socketPath, Echo);
+    ASSERT_EQ(SendControlRequest(m_socketPath, "echo again"), "again");
+}
+
+TEST_F(DaemonControlTest, OnlyOwnerCanConnect)
+{
+    ControlServer server(m_socketPath, Echo);
+    auto permissions = boost::filesystem::status(m_socketPath).permissions();
+    ASSERT_EQ(permissions, boost::filesystem::owner_read | boost::filesystem::owner_write);
+}
+
+TEST_F(DaemonControlTest, RequestsTimeOut)
+{
+    ControlServer server(m_socketPath, Echo);
+    auto start = boost::chrono::steady_clock::now();
+    ASSERT_THROW(SendControlRequest(m_socketPath, "sleep 500", 50), std::runtime_error);
+    // the client gives up without waiting for the reply
+    ASSERT_LT(boost::chrono::steady_clock::now() - start, boost::chrono::milliseconds(400));
+    ASSERT_EQ(SendControlRequest(m_socketPath, "echo after", 1000), "after");
+}
@@ -31,6 +31,34 @@ TEST(DisplayerFunctional, DisplayImage)
     delete image;
 }
 
+/**
+ * Test that the color image of a non-square mosaic is rendered with the same superpixels as the bands
+ */
+TEST(DisplayerFunctional, TrueColorOfNonSquareMosaic)
+{
+    CameraData cameraData;
+    cameraData.cameraType = CAMERA_TYPE_SPECTRAL;
+    cameraData.cameraFamily = CAMERA_FAMILY_XISPEC;
+    // 2 rows and 4 columns
+    cameraData.mosaicShape = {2, 4};
+    for (int i = 0; i < 8; i++)
+    {
+        cameraData.bandCenters.push_back(460.f + 30.f * static_cast<float>(i));
+    }
+    QString testCameraModel = "TEST-NON-SQUARE-MOSAIC";
+    getCameraMapper().insert(testCameraModel, cameraData);
+
+    MockDisplayerFunctional df;
+    df.SetCameraProperties(testCameraModel);
+    auto renderer = df.GetTrueColorRenderer();
+    ASSERT_NE(renderer, nullptr);
+    cv::Mat image(4, 8, CV_16UC1, cv::Scalar(0));
+    cv::Mat rgbImage;
+    renderer->Render(image, rgbImage);
+    ASSERT_EQ(rgbImage.size(), cv::Size(2, 2));
+    getCameraMapper().remove(testCameraModel);
+}
+
 TEST(GetSaturationPercentagesTest, ValidInput)
 {
     cv::Mat image = (cv::Mat_<uchar>(2, 5) << 5, 5, 5, 5, 5, 250, 250, 250, 250, 250);
@@ -0,0 +1,124 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <opencv2/imgproc.hpp>
+
+#include "src/frameRegistration.h"
+
+/**
+ * Creates a smooth random texture, like tissue seen through a band of a spectral camera.
+ */
+static cv::Mat CreateTexture(cv::Size size)
+{
+    cv::Mat texture(size, CV_8UC1);
+    cv::RNG rng(42);
+    rng.fill(texture, cv::RNG::UNIFORM, 0, 256);
+    cv::GaussianBlur(texture, texture, cv::Size(0, 0), 4);
+    cv::normalize(texture, texture, 0, 255, cv::NORM_MINMAX);
+    return texture;
+}
+
+/**
+ * Moves an image as described by FrameTransform.
+ */
+static cv::Mat Move(const cv::Mat &image, double dx, double dy, double angleDeg)
+{
+    cv::Point2f center((image.cols - 1) / 2.f, (image.rows - 1) / 2.f);
+    cv::Mat matrix = cv::getRotationMatrix2D(center, angleDeg, 1);
+    matrix.at<double>(0, 2) += dx;
+    matrix.at<double>(1, 2) += dy;
+    cv::Mat moved;
+    cv::warpAffine(image, moved, matrix, image.size(), cv::INTER_LINEAR, cv::BORDER_REFLECT);
+    return moved;
+}
+
+/**
+ * Mean absolute difference of two images, without a border where pixels were moved in from outside of the image.
+ */
+static double MeanDifference(const cv::Mat &a, const cv::Mat &b, int border)
+{
+    cv::Rect inner(border, border, a.cols - 2 * border, a.rows - 2 * border);
+    cv::Mat difference;
+    cv::absdiff(a(inner), b(inner), difference);
+    return cv::mean(difference)[0];
+}
+
+TEST(FrameRegistrationTest, FirstImageIsReference)
+{
+    FrameRegistration registration;
+    cv::Mat image = CreateTexture(cv::Size(512, 272));
+    FrameTransform transform = registration.Register(image);
+    ASSERT_EQ(transform.dx, 0);
+    ASSERT_EQ(transform.dy, 0);
+    cv::Mat stabilized;
+    registration.Apply(image, stabilized);
+    ASSERT_LT(MeanDifference(image, stabilized, 0), 0.5);
+}
+
+TEST(FrameRegistrationTest, CompensatesTranslationOn2KImages)
+{
+    FrameRegistration registration;
+    cv::Mat reference = CreateTexture(cv::Size(2048, 1088));
+    registration.Register(reference);
+    cv::Mat moved = Move(reference, 24.5, -16, 0);
+    FrameTransform transform = registration.Register(moved);
+    ASSERT_NEAR(transform.dx, 24.5, 1);
+    ASSERT_NEAR(transform.dy, -16, 1);
+    ASSERT_GT(registration.GetResponse(), RegistrationOptions().minResponse);
+
+    cv::Mat stabilized;
+    registration.Apply(moved, stabilized);
+    ASSERT_LT(MeanDifference(reference, stabilized, 32), MeanDifference(reference, moved, 32) / 4);
+}
+
+TEST(FrameRegistrationTest, CompensatesRotation)
+{
+    RegistrationOptions options;
+    options.estimateRotation = true;
+    for (double angle : {3., -3.})
+    {
+        FrameRegistration registration(options);
+        cv::Mat reference = CreateTexture(cv::Size(512, 512));
+        registration.Register(reference);
+        FrameTransform transform = registration.Register(Move(reference, 4, 2, angle));
+        ASSERT_NEAR(transform.angleDeg, angle, 0.5);
+        ASSERT_NEAR(transform.dx, 4, 1.5);
+        ASSERT_NEAR(transform.dy, 2, 1.5);
+    }
+}
+
+TEST(FrameRegistrationTest, ReplacesReferenceWhenSceneChanges)
+{
+    FrameRegistration registration;
+    cv::Mat reference = CreateTexture(cv::Size(512, 272));
+    registration.Register(reference);
+    registration.Register(Move(reference, 8, 0, 0));
+    // an unrelated image can not be registered, the previous motion is kept and the image becomes the reference
+    cv::Mat scene = CreateTexture(cv::Size(512, 272));
+    cv::flip(scene, scene, -1);
+    FrameTransform transform = registration.Register(scene);
+    ASSERT_LT(registration.GetResponse(), RegistrationOptions().minResponse);
+    ASSERT_NEAR(transform.dx, 8, 1);
+    // motion relative to the new reference adds up with the motion of the reference
+    transform = registration.Register(Move(scene, 0, 6, 0));
+    ASSERT_NEAR(transform.dx, 8, 1);
+    ASSERT_NEAR(transform.dy, 6, 1);
+
+    registration.Reset();
+    transform = registration.Register(scene);
+    ASSERT_EQ(transform.dx, 0);
+}
+
+TEST(FrameRegistrationTest, ApplyNeedsRegisteredSize)
+{
+    FrameRegistration registration;
+    cv::Mat stabilized;
+    ASSERT_THROW(registration.Apply(CreateTexture(cv::Size(64, 64)), stabilized), std::invalid_argument);
+    registration.Register(CreateTexture(cv::Size(64, 64)));
+    ASSERT_THROW(registration.Apply(CreateTexture(cv::Size(32, 64)), stabilized), std::invalid_argument);
+    ASSERT_THROW(registration.Register(cv::Mat::zeros(64, 64, CV_16UC1)), std::invalid_argument);
+}
@@ -0,0 +1,150 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <blosc2.h>
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include "src/constants.h"
+#include "src/frameStatistics.h"
+#include "src/util.h"
+
+/**
+ * Creates a 4x4 image with a 2x2 mosaic where band 1 is dark, band 4 is saturated and the rest are well exposed.
+ */
+static std::vector<uint16_t> CreateMosaicImage(XI_IMG &image)
+{
+    std::vector<uint16_t> data(16);
+    const uint16_t bandValues[] = {0, 100, 200, 1000};
+    for (int row = 0; row < 4; row++)
+    {
+        for (int col = 0; col < 4; col++)
+        {
+            data[row * 4 + col] = bandValues[(row % 2) * 2 + col % 2];
+        }
+    }
+    image.width = 4;
+    image.height = 4;
+    return data;
+}
+
+TEST(FrameStatisticsTest, StatisticsOfMosaicImage)
+{
+    FrameStatisticsProvider provider(2, 2, 10);
+    MetadataSchema schema;
+    provider.DeclareFields(schema);
+    auto record = schema.CreateRecord();
+    ASSERT_EQ(record.floatValues.size(), 7);
+
+    XI_IMG image;
+    auto data = CreateMosaicImage(image);
+    image.bp = data.data();
+    provider.Sample(image, record);
+
+    ASSERT_FLOAT_EQ(record.floatValues[0], 0.f);
+    ASSERT_FLOAT_EQ(record.floatValues[1], 100.f);
+    ASSERT_FLOAT_EQ(record.floatValues[2], 200.f);
+    ASSERT_FLOAT_EQ(record.floatValues[3], 1000.f);
+    ASSERT_FLOAT_EQ(record.floatValues[4], 0.25f);
+    ASSERT_FLOAT_EQ(record.floatValues[5], 0.25f);
+    // pixels of the same band are identical, so the image has no texture
+    ASSERT_FLOAT_EQ(record.floatValues[6], 0.f);
+}
+
+TEST(FrameStatisticsTest, ExposureBoundariesFollowBitDepth)
+{
+    XI_IMG image;
+    auto data = CreateMosaicImage(image);
+    image.bp = data.data();
+
+    // 12 bit values reach 4095, the brightest band is well exposed and the band at 100 is dark
+    FrameStatisticsProvider provider(2, 2, 12);
+    MetadataSchema schema;
+    provider.DeclareFields(schema);
+    auto record = schema.CreateRecord();
+    provider.Sample(image, record);
+    ASSERT_FLOAT_EQ(record.floatValues[4], 0.f);
+    ASSERT_FLOAT_EQ(record.floatValues[5], 0.5f);
+
+    EXPECT_THROW(FrameStatisticsProvider(2, 2, 7), std::invalid_argument);
+    EXPECT_THROW(FrameStatisticsProvider(2, 2, 17), std::invalid_argument);
+}
+
+TEST(FrameStatisticsTest, ProviderFromCameraData)
+{
+    CameraData spectral;
+    spectral.cameraType = CAMERA_TYPE_SPECTRAL;
+    spectral.mosaicShape = {4, 4};
+    ASSERT_EQ(FrameStatisticsProvider::FromCameraData(spectral, 10)->GetNumberOfBands(), 16);
+
+    // the mosaic shape holds the number of rows first, like in the displayer
+    CameraData nonSquare;
+    nonSquare.cameraType = CAMERA_TYPE_SPECTRAL;
+    nonSquare.mosaicShape = {2, 4};
+    auto provider = FrameStatisticsProvider::FromCameraData(nonSquare, 10);
+    ASSERT_EQ(provider->GetMosaicWidth(), 4);
+    ASSERT_EQ(provider->GetMosaicHeight(), 2);
+
+    CameraData rgb;
+    rgb.cameraType = CAMERA_TYPE_RGB;
+    rgb.mosaicShape = {0, 0};
+    ASSERT_EQ(FrameStatisticsProvider::FromCameraData(rgb, 10)->GetNumberOfBands(), 4);
+
+    ASSERT_EQ(FrameStatisticsProvider::FromCameraData(CameraData(), 10)->GetNumberOfBands(), 1);
+    EXPECT_THROW(FrameStatisticsProvider(0, 2, 10), std::invalid_argument);
+}
+
+TEST(FrameStatisticsTest, QualityReportFlagsStretches)
+{
+    FrameStatisticsSeries statistics;
+    statistics.saturatedFraction = {0, 0.5, 0.6, 0, 0.2};
+    statistics.underexposedFraction = {0.9, 0, 0, 0, 0};
+    statistics.focusScore = {1, 2, 3, 4, 5};
+    statistics.bandMean = {{1}, {2}, {3}, {4}, {5}};
+
+    std::stringstream report;
+    WriteQualityReport(statistics, 0.1, 0.5, false, report);
+    std::string text = report.str();
+    ASSERT_NE(text.find("frames: 5"), std::string::npos);
+    ASSERT_NE(text.find("saturated frames 1-2"), std::string::npos);
+    ASSERT_NE(text.find("saturated frames 4-4"), std::string::npos);
+    ASSERT_NE(text.find("saturated frames: 3 of 5"), std::string::npos);
+    ASSERT_NE(text.find("under-exposed frames: 1 of 5"), std::string::npos);
+}
+
+TEST(FrameStatisticsTest, ReadStatisticsFromRecording)
+{
+    const char *urlpath = "test_frame_statistics.b2nd";
+    blosc2_init();
+    blosc2_remove_urlpath(urlpath);
+
+    XI_IMG image;
+    auto data = CreateMosaicImage(image);
+    image.bp = data.data();
+    MetadataProviderRegistry registry;
+    registry.Register(std::make_shared<ImageMetadataProvider>());
+    registry.Register(std::make_shared<FrameStatisticsProvider>(2, 2, 10));
+    auto record = registry.GetSchema().CreateRecord();
+    {
+        FileImage fileImage(urlpath, image.height, image.width, registry.GetSchema());
+        for (int i = 0; i < 5; i++)
+        {
+            registry.Sample(image, record);
+            fileImage.WriteImageData(image, record);
+        }
+        fileImage.AppendMetadata();
+    }
+
+    FrameStatisticsSeries statistics = ReadFrameStatistics(urlpath);
+    ASSERT_EQ(statistics.saturatedFraction.size(), 5);
+    ASSERT_EQ(statistics.bandMean.size(), 5);
+    ASSERT_EQ(statistics.bandMean[4].size(), 4);
+    ASSERT_FLOAT_EQ(statistics.bandMean[4][3], 1000.f);
+    ASSERT_FLOAT_EQ(statistics.underexposedFraction[0], 0.25f);
+
+    blosc2_remove_urlpath(urlpath);
+    blosc2_destroy();
+}
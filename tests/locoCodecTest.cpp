@@ -0,0 +1,211 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <blosc2.h>
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <random>
+#include <sstream>
+
+#include "src/locoCodec.h"
+#include "src/util.h"
+#include "src/xilensReader.h"
+
+/**
+ * Creates a 10 bit image with a different offset per band of the mosaic, a gradient and sensor noise
+ */
+static std::vector<uint16_t> CreateMosaicImage(unsigned int height, unsigned int width, unsigned int mosaicWidth,
+                                               unsigned int mosaicHeight)
+{
+    std::vector<uint16_t> pixels(static_cast<size_t>(height) * width);
+    std::mt19937 generator(42);
+    std::normal_distribution<float> noise(0, 4);
+    for (unsigned int row = 0; row < height; row++)
+    {
+        for (unsigned int col = 0; col < width; col++)
+        {
+            unsigned int band = (row % mosaicHeight) * mosaicWidth + col % mosaicWidth;
+            float value = 100.f + 30.f * band + col + row / 2.f + noise(generator);
+            pixels[static_cast<size_t>(row) * width + col] =
+                static_cast<uint16_t>(std::min(std::max(value, 0.f), 1023.f));
+        }
+    }
+    return pixels;
+}
+
+class LocoCodecTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        blosc2_init();
+        RegisterLocoCodec();
+    }
+
+    void TearDown() override
+    {
+        blosc2_destroy();
+    }
+
+    /**
+     * Compresses an image with blosc2 and checks that it is decompressed unchanged
+     *
+     * @return size of the compressed image
+     */
+    static int RoundTrip(const std::vector<uint16_t> &pixels, LocoCodecParams params)
+    {
+        blosc2_cparams cparams = CreateLocoCParams(&params);
+        auto nBytes = static_cast<int32_t>(pixels.size() * sizeof(uint16_t));
+        cparams.blocksize = nBytes;
+        blosc2_context *cctx = blosc2_create_cctx(cparams);
+        std::vector<uint8_t> chunk(static_cast<size_t>(nBytes) + BLOSC2_MAX_OVERHEAD);
+        int compressedBytes =
+            blosc2_compress_ctx(cctx, pixels.data(), nBytes, chunk.data(), static_cast<int32_t>(chunk.size()));
+        blosc2_free_ctx(cctx);
+        EXPECT_GT(compressedBytes, 0);
+
+        blosc2_dparams dparams = BLOSC2_DPARAMS_DEFAULTS;
+        blosc2_context *dctx = blosc2_create_dctx(dparams);
+        std::vector<uint16_t> decompressed(pixels.size());
+        EXPECT_EQ(blosc2_decompress_ctx(dctx, chunk.data(), compressedBytes, decompressed.data(), nBytes), nBytes);
+        blosc2_free_ctx(dctx);
+        EXPECT_EQ(decompressed, pixels);
+        return compressedBytes;
+    }
+};
+
+TEST_F(LocoCodecTest, RoundTripMosaics)
+{
+    const unsigned int height = 217;
+    const unsigned int width = 409;
+    for (unsigned int mosaic : {1u, 2u, 4u, 5u})
+    {
+        auto pixels = CreateMosaicImage(height, width, mosaic, mosaic);
+        // extreme values produce residuals that need to be escaped
+        pixels[3] = 65535;
+        pixels[4] = 0;
+        pixels.back() = 65535;
+        int compressedBytes = RoundTrip(pixels, {width, static_cast<uint8_t>(mosaic), static_cast<uint8_t>(mosaic)});
+        ASSERT_LT(compressedBytes, static_cast<int>(pixels.size() * sizeof(uint16_t) / 2));
+    }
+}
+
+TEST_F(LocoCodecTest, MosaicAwarePrediction)
+{
+    auto pixels = CreateMosaicImage(128, 160, 4, 4);
+    int mosaicBytes = RoundTrip(pixels, {160, 4, 4});
+    int plainBytes = RoundTrip(pixels, {160, 1, 1});
+    ASSERT_LT(mosaicBytes, plainBytes);
+}
+
+TEST_F(LocoCodecTest, RoundTripRandomData)
+{
+    std::vector<uint16_t> pixels(3000);
+    std::mt19937 generator(7);
+    for (auto &pixel : pixels)
+    {
+        pixel = static_cast<uint16_t>(generator());
+    }
+    RoundTrip(pixels, {100, 1, 1});
+    // incompressible data does not fit into an output of the size of the input
+    std::vector<uint8_t> output(pixels.size() * sizeof(uint16_t));
+    ASSERT_EQ(LocoEncode(reinterpret_cast<const uint8_t *>(pixels.data()), static_cast<int32_t>(output.size()),
+                         output.data(), static_cast<int32_t>(output.size()), 0, nullptr, nullptr),
+              0);
+}
+
+TEST_F(LocoCodecTest, RejectsCorruptData)
+{
+    std::vector<uint8_t> input(16, 0);
+    std::vector<uint8_t> output(8);
+    ASSERT_LT(LocoDecode(input.data(), static_cast<int32_t>(input.size()), output.data(),
+                         static_cast<int32_t>(output.size()), 0, nullptr, nullptr),
+              0);
+}
+
+TEST_F(LocoCodecTest, FileImage)
+{
+    auto filePath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("xilens-%%%%.b2nd");
+    auto pixels = CreateMosaicImage(64, 80, 4, 4);
+    XI_IMG image{};
+    image.width = 80;
+    image.height = 64;
+    image.bp = pixels.data();
+    {
+        FileImage fileImage(filePath.string().c_str(), image.height, image.width);
+        fileImage.UseLocoCodec(4, 4);
+        ASSERT_THROW(fileImage.EnableAdaptiveCompression(), std::logic_error);
+        for (int i = 0; i < 3; i++)
+        {
+            fileImage.WriteImageData(image, QMap<QString, float>());
+        }
+        fileImage.AppendMetadata();
+    }
+    b2nd_array_t *src;
+    ASSERT_EQ(b2nd_open(filePath.string().c_str(), &src), 0);
+    std::vector<uint16_t> buffer(pixels.size());
+    int64_t start[] = {2, 0, 0};
+    int64_t stop[] = {3, image.height, image.width};
+    int64_t shape[] = {1, image.height, image.width};
+    ASSERT_EQ(b2nd_get_slice_cbuffer(src, start, stop, buffer.data(), shape,
+                                     static_cast<int64_t>(buffer.size() * sizeof(uint16_t))),
+              0);
+    ASSERT_EQ(buffer, pixels);
+    b2nd_free(src);
+
+    std::stringstream stream;
+    WriteCodecBenchmark(filePath.string(), 0, 4, 4, stream);
+    ASSERT_NE(stream.str().find(LOCO_CODEC_NAME), std::string::npos);
+    boost::filesystem::remove(filePath);
+}
+
+TEST_F(LocoCodecTest, ReopenedFileKeepsGeometry)
+{
+    auto filePath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("xilens-%%%%.b2nd");
+    auto pixels = CreateMosaicImage(64, 80, 4, 4);
+    XI_IMG image{};
+    image.width = 80;
+    image.height = 64;
+    image.bp = pixels.data();
+    {
+        FileImage fileImage(filePath.string().c_str(), image.height, image.width);
+        fileImage.UseLocoCodec(4, 4);
+        fileImage.WriteImageData(image, QMap<QString, float>());
+    }
+    {
+        // the reopened file appends with the mosaic stored in the file
+        FileImage fileImage(filePath.string().c_str(), image.height, image.width);
+        fileImage.WriteImageData(image, QMap<QString, float>());
+    }
+    b2nd_array_t *src;
+    ASSERT_EQ(b2nd_open(filePath.string().c_str(), &src), 0);
+    LocoCodecParams params{};
+    ASSERT_TRUE(ReadLocoCodecParams(src, params));
+    ASSERT_EQ(params.width, 80);
+    ASSERT_EQ(params.mosaicWidth, 4);
+    ASSERT_EQ(params.mosaicHeight, 4);
+    int32_t chunkBytes[2];
+    for (int64_t i = 0; i < 2; i++)
+    {
+        uint8_t *chunk;
+        bool needsFree;
+        chunkBytes[i] = blosc2_schunk_get_chunk(src->sc, i, &chunk, &needsFree);
+        if (needsFree)
+        {
+            free(chunk);
+        }
+    }
+    // the same image compresses to the same size with the same geometry
+    ASSERT_EQ(chunkBytes[0], chunkBytes[1]);
+    b2nd_free(src);
+
+    RecordingReader reader(filePath.string());
+    ASSERT_EQ(reader.GetNumberOfFrames(), 2);
+    std::vector<uint16_t> buffer;
+    reader.ReadFrame(1, buffer);
+    ASSERT_EQ(buffer, pixels);
+    boost::filesystem::remove(filePath);
+}
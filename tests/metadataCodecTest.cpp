@@ -0,0 +1,227 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <blosc2.h>
+#include <gtest/gtest.h>
+
+#include <map>
+
+#include "src/constants.h"
+#include "src/metadataCodec.h"
+#include "src/metadataProviders.h"
+#include "src/util.h"
+
+/**
+ * Packs a column and returns the unpacked encoding
+ */
+template <typename T, typename PackFunction>
+static msgpack::object_handle PackColumn(PackFunction pack, const std::vector<T> &values)
+{
+    msgpack::sbuffer sbuf;
+    msgpack::packer<msgpack::sbuffer> packer(&sbuf);
+    pack(packer, values);
+    return msgpack::unpack(sbuf.data(), sbuf.size());
+}
+
+static std::string GetEncoding(const msgpack::object &object)
+{
+    return object.as<std::map<std::string, msgpack::object>>().at("encoding").as<std::string>();
+}
+
+TEST(MetadataCodecTest, CounterIsDeltaEncoded)
+{
+    std::vector<int64_t> values(1000);
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        values[i] = 17 + static_cast<int64_t>(i);
+    }
+    auto handle = PackColumn(PackIntColumn, values);
+    ASSERT_EQ(GetEncoding(handle.get()), "delta");
+    ASSERT_EQ(DecodeMetadataColumn<int64_t>(handle.get()), values);
+}
+
+TEST(MetadataCodecTest, ConstantIsRunLengthEncoded)
+{
+    std::vector<int64_t> values(500, 40000);
+    values.insert(values.end(), 500, 20000);
+    auto handle = PackColumn(PackIntColumn, values);
+    ASSERT_EQ(GetEncoding(handle.get()), "rle");
+    ASSERT_EQ(DecodeMetadataColumn<int64_t>(handle.get()), values);
+
+    std::vector<float> temperatures(100, 36.5f);
+    auto floatHandle = PackColumn(PackFloatColumn, temperatures);
+    ASSERT_EQ(GetEncoding(floatHandle.get()), "rle");
+    ASSERT_EQ(DecodeMetadataColumn<float>(floatHandle.get()), temperatures);
+}
+
+TEST(MetadataCodecTest, IrregularValuesArePlain)
+{
+    std::vector<int64_t> values{5, -3, 12, 7, 7, 0};
+    auto handle = PackColumn(PackIntColumn, values);
+    ASSERT_EQ(GetEncoding(handle.get()), "plain");
+    ASSERT_EQ(DecodeMetadataColumn<int64_t>(handle.get()), values);
+    auto emptyHandle = PackColumn(PackIntColumn, std::vector<int64_t>());
+    ASSERT_TRUE(DecodeMetadataColumn<int64_t>(emptyHandle.get()).empty());
+}
+
+TEST(MetadataCodecTest, StringsAreDictionaryEncoded)
+{
+    std::vector<std::string> values(10, "XI_CFA_BAYER_GBRG");
+    values[4] = "XI_CFA_NONE";
+    auto handle = PackColumn(PackStringColumn, values);
+    ASSERT_EQ(GetEncoding(handle.get()), "dictionary");
+    ASSERT_EQ(DecodeMetadataColumn<std::string>(handle.get()), values);
+    EXPECT_THROW(DecodeMetadataColumn<int64_t>(handle.get()), std::runtime_error);
+}
+
+TEST(MetadataCodecTest, FormattedColumnWithManyValuesIsStoredAsIntegers)
+{
+    auto formatter = [](int64_t value) { return std::to_string(value); };
+    std::vector<int64_t> values(METADATA_DICTIONARY_MAX_ENTRIES + 1);
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        values[i] = 1000 + 10 * static_cast<int64_t>(i);
+    }
+    auto pack = [&formatter](msgpack::packer<msgpack::sbuffer> &packer, const std::vector<int64_t> &column) {
+        PackFormattedColumn(packer, column, formatter);
+    };
+    auto handle = PackColumn(pack, values);
+    ASSERT_EQ(GetEncoding(handle.get()), "delta");
+    ASSERT_EQ(DecodeMetadataColumn<int64_t>(handle.get()), values);
+
+    values.resize(3);
+    auto dictionaryHandle = PackColumn(pack, values);
+    ASSERT_EQ(DecodeMetadataColumn<std::string>(dictionaryHandle.get()),
+              (std::vector<std::string>{"1000", "1010", "1020"}));
+}
+
+TEST(MetadataCodecTest, PlainArraysAreDecoded)
+{
+    msgpack::sbuffer sbuf;
+    msgpack::pack(sbuf, std::vector<std::vector<float>>{{1.f, 2.f}, {3.f, 4.f}});
+    auto handle = msgpack::unpack(sbuf.data(), sbuf.size());
+    auto frames = DecodeMetadataColumns<float>(handle.get());
+    ASSERT_EQ(frames.size(), 2);
+    ASSERT_FLOAT_EQ(frames[1][0], 3.f);
+}
+
+TEST(MetadataCodecTest, WriteFileWithColumnarMetadata)
+{
+    XI_IMG xiImage;
+    xiImage.width = 16;
+    xiImage.height = 16;
+    xiImage.exposure_time_us = 40000;
+    xiImage.color_filter_array = XI_CFA_BAYER_GBRG;
+    std::vector<uint16_t> data(static_cast<size_t>(xiImage.width) * xiImage.height, 100);
+    xiImage.bp = data.data();
+    const char *urlpath = "test_columnar_metadata.b2nd";
+    const int nFrames = 50;
+
+    blosc2_init();
+    blosc2_remove_urlpath(urlpath);
+
+    MetadataProviderRegistry registry;
+    registry.Register(std::make_shared<ImageMetadataProvider>());
+    MetadataSchema schema = registry.GetSchema();
+    size_t bandsOffset = schema.AddFloatField("band_values", 2);
+    auto record = schema.CreateRecord();
+    {
+        FileImage fileImage(urlpath, xiImage.height, xiImage.width, schema);
+        CompressionOptions options;
+        options.columnarMetadata = true;
+        fileImage.ConfigureCompression(options);
+        for (int i = 0; i < nFrames; i++)
+        {
+            xiImage.acq_nframe = 100 + i;
+            registry.Sample(xiImage, record);
+            record.floatValues[bandsOffset] = static_cast<float>(i);
+            record.floatValues[bandsOffset + 1] = 1.f;
+            fileImage.WriteImageData(xiImage, record);
+        }
+        fileImage.AppendMetadata();
+    }
+
+    b2nd_array_t *src;
+    ASSERT_EQ(b2nd_open(urlpath, &src), 0);
+    ASSERT_EQ(GetBLOSCVLMetadata(src, METADATA_ENCODING_KEY).get().as<std::string>(), COLUMNAR_METADATA_ENCODING);
+    auto frameNumbers = ReadMetadataColumn<int64_t>(src, FRAME_NUMBER_KEY);
+    ASSERT_EQ(frameNumbers.size(), nFrames);
+    ASSERT_EQ(frameNumbers[0], 100);
+    ASSERT_EQ(frameNumbers[nFrames - 1], 100 + nFrames - 1);
+    auto exposures = ReadMetadataColumn<int64_t>(src, EXPOSURE_KEY);
+    ASSERT_EQ(exposures, std::vector<int64_t>(nFrames, 40000));
+    auto filterArrays = ReadMetadataColumn<std::string>(src, COLOR_FILTER_ARRAY_FORMAT_KEY);
+    ASSERT_EQ(filterArrays, std::vector<std::string>(nFrames, "XI_CFA_BAYER_GBRG"));
+    auto bands = ReadMetadataColumns<float>(src, "band_values");
+    ASSERT_EQ(bands.size(), nFrames);
+    ASSERT_FLOAT_EQ(bands[nFrames - 1][0], static_cast<float>(nFrames - 1));
+    ASSERT_FLOAT_EQ(bands[nFrames - 1][1], 1.f);
+
+    // a constant column is stored as a single run
+    uint8_t *content = nullptr;
+    int32_t contentLength = 0;
+    ASSERT_GE(blosc2_vlmeta_get(src->sc, EXPOSURE_KEY, &content, &contentLength), 0);
+    free(content);
+    ASSERT_LT(contentLength, 32);
+
+    b2nd_free(src);
+    blosc2_remove_urlpath(urlpath);
+    blosc2_destroy();
+}
+
+TEST(MetadataCodecTest, AppendColumnarMetadataToReopenedFile)
+{
+    XI_IMG xiImage;
+    xiImage.width = 16;
+    xiImage.height = 16;
+    xiImage.exposure_time_us = 40000;
+    xiImage.color_filter_array = XI_CFA_BAYER_GBRG;
+    std::vector<uint16_t> data(static_cast<size_t>(xiImage.width) * xiImage.height, 100);
+    xiImage.bp = data.data();
+    const char *urlpath = "test_reopened_columnar_metadata.b2nd";
+
+    blosc2_init();
+    blosc2_remove_urlpath(urlpath);
+
+    MetadataProviderRegistry registry;
+    registry.Register(std::make_shared<ImageMetadataProvider>());
+    MetadataSchema schema = registry.GetSchema();
+    size_t bandsOffset = schema.AddFloatField("band_values", 2);
+    auto record = schema.CreateRecord();
+    // two sessions write to the same file, the second one continues the frame numbers of the first one
+    for (int session = 0; session < 2; session++)
+    {
+        FileImage fileImage(urlpath, xiImage.height, xiImage.width, schema);
+        CompressionOptions options;
+        options.columnarMetadata = true;
+        fileImage.ConfigureCompression(options);
+        for (int i = 0; i < 3; i++)
+        {
+            xiImage.acq_nframe = 100 + session * 3 + i;
+            registry.Sample(xiImage, record);
+            record.floatValues[bandsOffset] = static_cast<float>(session);
+            record.floatValues[bandsOffset + 1] = static_cast<float>(i);
+            fileImage.WriteImageData(xiImage, record);
+        }
+        fileImage.AppendMetadata();
+    }
+
+    b2nd_array_t *src;
+    ASSERT_EQ(b2nd_open(urlpath, &src), 0);
+    ASSERT_EQ(src->shape[0], 6);
+    auto frameNumbers = ReadMetadataColumn<int64_t>(src, FRAME_NUMBER_KEY);
+    ASSERT_EQ(frameNumbers, std::vector<int64_t>({100, 101, 102, 103, 104, 105}));
+    auto filterArrays = ReadMetadataColumn<std::string>(src, COLOR_FILTER_ARRAY_FORMAT_KEY);
+    ASSERT_EQ(filterArrays, std::vector<std::string>(6, "XI_CFA_BAYER_GBRG"));
+    auto bands = ReadMetadataColumns<float>(src, "band_values");
+    ASSERT_EQ(bands.size(), 6);
+    ASSERT_FLOAT_EQ(bands[0][0], 0.f);
+    ASSERT_FLOAT_EQ(bands[5][0], 1.f);
+    ASSERT_FLOAT_EQ(bands[5][1], 2.f);
+
+    b2nd_free(src);
+    blosc2_remove_urlpath(urlpath);
+    blosc2_destroy();
+}
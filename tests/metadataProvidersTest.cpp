@@ -0,0 +1,179 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <blosc2.h>
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "mocks.h"
+#include "src/constants.h"
+#include "src/metadataProviders.h"
+#include "src/util.h"
+
+/**
+ * Mock API that reports a fixed temperature for every sensor.
+ */
+class MockTemperatureXiAPIWrapper : public MockXiAPIWrapper
+{
+  public:
+    int xiGetParamFloat(IN HANDLE hDevice, const char *prm, float *val) override
+    {
+        *val = 36.5;
+        return 0;
+    }
+};
+
+TEST(MetadataSchemaTest, OffsetsArePackedPerType)
+{
+    MetadataSchema schema;
+    ASSERT_EQ(schema.AddIntField("a"), 0);
+    ASSERT_EQ(schema.AddFloatField("b", 3), 0);
+    ASSERT_EQ(schema.AddIntField("c", 2), 1);
+    ASSERT_EQ(schema.AddFloatField("d"), 3);
+
+    auto record = schema.CreateRecord();
+    ASSERT_EQ(record.intValues.size(), 3);
+    ASSERT_EQ(record.floatValues.size(), 4);
+    ASSERT_TRUE(schema.Contains("c"));
+    ASSERT_FALSE(schema.Contains("e"));
+}
+
+TEST(MetadataSchemaTest, DuplicatedKeyThrows)
+{
+    MetadataSchema schema;
+    schema.AddIntField("a");
+    EXPECT_THROW(schema.AddFloatField("a"), std::invalid_argument);
+    EXPECT_THROW(schema.AddIntField("b", 0), std::invalid_argument);
+}
+
+TEST(MetadataProviderRegistryTest, SampleImageMetadata)
+{
+    MetadataProviderRegistry registry;
+    registry.Register(std::make_shared<ImageMetadataProvider>());
+    auto record = registry.GetSchema().CreateRecord();
+
+    XI_IMG image;
+    image.exposure_time_us = 40000;
+    image.acq_nframe = 7;
+    image.color_filter_array = XI_CFA_BAYER_GBRG;
+    registry.Sample(image, record);
+
+    const auto &fields = registry.GetSchema().GetFields();
+    ASSERT_EQ(fields.size(), 4);
+    ASSERT_EQ(fields[0].key, EXPOSURE_KEY);
+    ASSERT_EQ(record.intValues[fields[0].offset], 40000);
+    ASSERT_EQ(record.intValues[fields[1].offset], 7);
+    ASSERT_EQ(fields[2].formatter(record.intValues[fields[2].offset]), "XI_CFA_BAYER_GBRG");
+    ASSERT_GT(record.intValues[fields[3].offset], 0);
+    std::string timeStamp = fields[3].formatter(record.intValues[fields[3].offset]);
+    ASSERT_EQ(timeStamp.size(), std::string("yyyyMMdd_hh-mm-ss-zzz").size());
+}
+
+TEST(MetadataProviderRegistryTest, SampleCachedTemperature)
+{
+    HANDLE handle = nullptr;
+    std::unique_ptr<CameraFamily> family = std::make_unique<XiSpecFamily>(&handle);
+    family->m_apiWrapper = std::make_shared<MockTemperatureXiAPIWrapper>();
+
+    MetadataProviderRegistry registry;
+    registry.Register(std::make_shared<CameraTemperatureProvider>(&family));
+    auto record = registry.GetSchema().CreateRecord();
+    ASSERT_EQ(record.floatValues.size(), N_TEMPERATURE_KEYS);
+
+    XI_IMG image;
+    registry.Sample(image, record);
+    ASSERT_TRUE(std::isnan(record.floatValues[0]));
+
+    family->UpdateCameraTemperature();
+    registry.Sample(image, record);
+    for (float value : record.floatValues)
+    {
+        ASSERT_FLOAT_EQ(value, 36.5);
+    }
+}
+
+TEST(MetadataProviderRegistryTest, SampleUnreportedTemperatureAsNaN)
+{
+    HANDLE handle = nullptr;
+    std::unique_ptr<CameraFamily> family = std::make_unique<XiCFamily>(&handle);
+    family->m_apiWrapper = std::make_shared<MockTemperatureXiAPIWrapper>();
+    family->UpdateCameraTemperature();
+
+    MetadataProviderRegistry registry;
+    registry.Register(std::make_shared<CameraTemperatureProvider>(&family));
+    auto record = registry.GetSchema().CreateRecord();
+    XI_IMG image;
+    registry.Sample(image, record);
+    for (size_t i = 0; i < N_TEMPERATURE_KEYS; i++)
+    {
+        if (TEMPERATURE_KEYS[i] == SENSOR_BOARD_TEMP)
+        {
+            ASSERT_FLOAT_EQ(record.floatValues[i], 36.5);
+        }
+        else
+        {
+            ASSERT_TRUE(std::isnan(record.floatValues[i]));
+        }
+    }
+}
+
+TEST(MetadataProviderRegistryTest, WriteFileWithSchema)
+{
+    XI_IMG xiImage;
+    xiImage.width = 16;
+    xiImage.height = 16;
+    xiImage.exposure_time_us = 40000;
+    xiImage.acq_nframe = 1;
+    xiImage.color_filter_array = XI_CFA_NONE;
+    std::vector<uint16_t> data(static_cast<size_t>(xiImage.width) * xiImage.height, 100);
+    xiImage.bp = data.data();
+    const char *urlpath = "test_metadata_providers.b2nd";
+
+    blosc2_init();
+    blosc2_remove_urlpath(urlpath);
+
+    MetadataProviderRegistry registry;
+    registry.Register(std::make_shared<ImageMetadataProvider>());
+    MetadataSchema schema = registry.GetSchema();
+    size_t bandsOffset = schema.AddFloatField("band_values", 2);
+    auto record = schema.CreateRecord();
+    {
+        FileImage fileImage(urlpath, xiImage.height, xiImage.width, schema);
+        EXPECT_THROW(fileImage.WriteImageData(xiImage, QMap<QString, float>()), std::logic_error);
+        for (int i = 0; i < 3; i++)
+        {
+            registry.Sample(xiImage, record);
+            record.floatValues[bandsOffset] = static_cast<float>(i);
+            record.floatValues[bandsOffset + 1] = static_cast<float>(2 * i);
+            fileImage.WriteImageData(xiImage, record);
+        }
+        fileImage.AppendMetadata();
+    }
+
+    b2nd_array_t *src;
+    ASSERT_EQ(b2nd_open(urlpath, &src), 0);
+    uint8_t *content = nullptr;
+    int32_t contentLength = 0;
+    ASSERT_GE(blosc2_vlmeta_get(src->sc, "band_values", &content, &contentLength), 0);
+    auto values = msgpack::unpack(reinterpret_cast<const char *>(content), contentLength)
+                      .get()
+                      .as<std::vector<std::vector<float>>>();
+    free(content);
+    ASSERT_EQ(values.size(), 3);
+    ASSERT_FLOAT_EQ(values[2][0], 2.f);
+    ASSERT_FLOAT_EQ(values[2][1], 4.f);
+
+    ASSERT_GE(blosc2_vlmeta_get(src->sc, COLOR_FILTER_ARRAY_FORMAT_KEY, &content, &contentLength), 0);
+    auto filterArrays =
+        msgpack::unpack(reinterpret_cast<const char *>(content), contentLength).get().as<std::vector<std::string>>();
+    free(content);
+    ASSERT_EQ(filterArrays.size(), 3);
+    ASSERT_EQ(filterArrays[0], "XI_CFA_NONE");
+
+    b2nd_free(src);
+    blosc2_remove_urlpath(urlpath);
+    blosc2_destroy();
+}
@@ -0,0 +1,208 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <blosc2.h>
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include "src/mirroredRecording.h"
+#include "src/stripedRecording.h"
+#include "src/util.h"
+
+class MirroredRecordingTest : public ::testing::Test
+{
+  protected:
+    boost::filesystem::path m_root;
+    XI_IMG m_image{};
+    std::vector<uint16_t> m_pixels;
+    MetadataProviderRegistry m_providers;
+
+    void SetUp() override
+    {
+        m_root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("xilens-%%%%-%%%%");
+        boost::filesystem::create_directories(m_root / "mirror");
+        m_image.width = 16;
+        m_image.height = 8;
+        m_pixels.resize(static_cast<size_t>(m_image.width) * m_image.height);
+        m_image.bp = m_pixels.data();
+        m_providers.Register(std::make_shared<ImageMetadataProvider>());
+        blosc2_init();
+    }
+
+    void TearDown() override
+    {
+        blosc2_destroy();
+        boost::filesystem::remove_all(m_root);
+    }
+
+    void FillImage(uint16_t frame)
+    {
+        for (size_t i = 0; i < m_pixels.size(); i++)
+        {
+            m_pixels[i] = static_cast<uint16_t>(frame * 100 + i);
+        }
+    }
+};
+
+TEST_F(MirroredRecordingTest, WriteCompressedImage)
+{
+    std::string filePath = (m_root / "compressed.b2nd").string();
+    FrameCompressor compressor(m_image.height, m_image.width);
+    std::vector<uint8_t> chunk;
+    FrameMetadataRecord record = m_providers.GetSchema().CreateRecord();
+    {
+        FileImage fileImage(filePath.c_str(), m_image.height, m_image.width, m_providers.GetSchema());
+        for (uint16_t i = 0; i < 3; i++)
+        {
+            FillImage(i);
+            m_providers.Sample(m_image, record);
+            // compressed and uncompressed images can be mixed in the same file
+            if (i == 1)
+            {
+                fileImage.WriteImageData(m_image, record);
+            }
+            else
+            {
+                compressor.Compress(m_image, chunk);
+                fileImage.WriteCompressedImageData(chunk, record);
+            }
+        }
+        fileImage.AppendMetadata();
+    }
+    RecordingReader session(filePath);
+    ASSERT_EQ(session.GetNumberOfFrames(), 3);
+    std::vector<uint16_t> buffer;
+    for (uint16_t i = 0; i < 3; i++)
+    {
+        FillImage(i);
+        session.ReadFrame(i, buffer);
+        ASSERT_EQ(buffer, m_pixels);
+    }
+
+    XI_IMG wrongShape = m_image;
+    wrongShape.width = 4;
+    ASSERT_THROW(compressor.Compress(wrongShape, chunk), std::runtime_error);
+}
+
+TEST_F(MirroredRecordingTest, WriteMirrors)
+{
+    std::vector<std::string> filePaths = {(m_root / "recording.b2nd").string(),
+                                          (m_root / "mirror" / "recording.b2nd").string()};
+    FrameMetadataRecord record = m_providers.GetSchema().CreateRecord();
+    {
+        MirroredFileImage recording(filePaths, m_image.height, m_image.width, m_providers.GetSchema());
+        for (uint16_t i = 0; i < 5; i++)
+        {
+            FillImage(i);
+            m_providers.Sample(m_image, record);
+            recording.WriteImageData(m_image, record);
+        }
+        recording.AppendMetadata();
+        ASSERT_EQ(recording.GetFilePath(), filePaths[0]);
+        ASSERT_FALSE(recording.HasIncident());
+        auto status = recording.GetMirrorStatus();
+        ASSERT_EQ(status.size(), 2);
+        for (const auto &mirror : status)
+        {
+            ASSERT_TRUE(mirror.healthy);
+            ASSERT_EQ(mirror.pendingImages, 0);
+            ASSERT_EQ(mirror.writtenImages, 5);
+            ASSERT_EQ(mirror.checksum, status[0].checksum);
+        }
+    }
+    for (const auto &filePath : filePaths)
+    {
+        RecordingReader session(filePath);
+        ASSERT_EQ(session.GetNumberOfFrames(), 5);
+        std::vector<uint16_t> buffer;
+        session.ReadFrame(4, buffer);
+        FillImage(4);
+        ASSERT_EQ(buffer, m_pixels);
+    }
+}
+
+TEST_F(MirroredRecordingTest, UnsupportedCompressedImages)
+{
+    std::string manifestPath = (m_root / (std::string("striped") + RECORDING_MANIFEST_EXTENSION)).string();
+    StripedFileImage recording(manifestPath, {(m_root / "disk0").string()}, m_image.height, m_image.width,
+                               m_providers.GetSchema());
+    ASSERT_THROW(recording.WriteCompressedImageData({}, m_providers.GetSchema().CreateRecord()), std::logic_error);
+}
+
+TEST_F(MirroredRecordingTest, WriteMirrorsWithColumnarMetadata)
+{
+    std::vector<std::string> filePaths = {(m_root / "columnar.b2nd").string(),
+                                          (m_root / "mirror" / "columnar.b2nd").string()};
+    CompressionOptions compression;
+    compression.columnarMetadata = true;
+    FrameMetadataRecord record = m_providers.GetSchema().CreateRecord();
+    {
+        MirroredFileImage recording(filePaths, m_image.height, m_image.width, m_providers.GetSchema(), compression);
+        for (uint16_t i = 0; i < 3; i++)
+        {
+            FillImage(i);
+            m_providers.Sample(m_image, record);
+            recording.WriteImageData(m_image, record);
+        }
+        recording.AppendMetadata();
+    }
+    for (const auto &filePath : filePaths)
+    {
+        b2nd_array_t *src;
+        ASSERT_EQ(b2nd_open(filePath.c_str(), &src), 0);
+        ASSERT_EQ(GetBLOSCVLMetadata(src, METADATA_ENCODING_KEY).get().as<std::string>(), COLUMNAR_METADATA_ENCODING);
+        b2nd_free(src);
+    }
+}
+
+TEST_F(MirroredRecordingTest, RejectsAdaptiveCompression)
+{
+    CompressionOptions compression;
+    compression.adaptive = true;
+    ASSERT_THROW(MirroredFileImage({(m_root / "adaptive.b2nd").string()}, m_image.height, m_image.width,
+                                   m_providers.GetSchema(), compression),
+                 std::invalid_argument);
+}
+
+TEST_F(MirroredRecordingTest, WriteMirrorsWithLocoCodec)
+{
+    RegisterLocoCodec();
+    std::vector<std::string> filePaths = {(m_root / "loco.b2nd").string(),
+                                          (m_root / "mirror" / "loco.b2nd").string()};
+    CompressionOptions compression;
+    compression.locoCodec = true;
+    compression.mosaicWidth = 4;
+    compression.mosaicHeight = 2;
+    FrameMetadataRecord record = m_providers.GetSchema().CreateRecord();
+    {
+        MirroredFileImage recording(filePaths, m_image.height, m_image.width, m_providers.GetSchema(), compression);
+        for (uint16_t i = 0; i < 3; i++)
+        {
+            FillImage(i);
+            m_providers.Sample(m_image, record);
+            recording.WriteImageData(m_image, record);
+        }
+        recording.AppendMetadata();
+    }
+    for (const auto &filePath : filePaths)
+    {
+        b2nd_array_t *src;
+        ASSERT_EQ(b2nd_open(filePath.c_str(), &src), 0);
+        LocoCodecParams params{};
+        ASSERT_TRUE(ReadLocoCodecParams(src, params));
+        ASSERT_EQ(params.width, m_image.width);
+        ASSERT_EQ(params.mosaicWidth, 4);
+        ASSERT_EQ(params.mosaicHeight, 2);
+        ASSERT_EQ(src->sc->compcode, LOCO_CODEC_ID);
+        b2nd_free(src);
+
+        RecordingReader session(filePath);
+        std::vector<uint16_t> buffer;
+        session.ReadFrame(2, buffer);
+        FillImage(2);
+        ASSERT_EQ(buffer, m_pixels);
+    }
+}
@@ -0,0 +1,100 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <blosc2.h>
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <random>
+
+#include "src/archiveMigrator.h"
+#include "src/constants.h"
+#include "src/nearLossless.h"
+#include "src/util.h"
+
+TEST(NearLosslessQuantizerTest, ErrorWithinNoiseBound)
+{
+    SensorNoiseModel noiseModel;
+    noiseModel.readNoise = 1.5;
+    noiseModel.gain = 0.25;
+    NearLosslessQuantizer quantizer(noiseModel, 1);
+    for (uint32_t value = 0; value <= 4095; value++)
+    {
+        auto pixel = static_cast<uint16_t>(value);
+        unsigned int bound = quantizer.Quantize(&pixel, 1);
+        ASSERT_EQ(bound, quantizer.GetMaxError(static_cast<uint16_t>(value)));
+        ASSERT_LE(std::abs(static_cast<int>(pixel) - static_cast<int>(value)), static_cast<int>(bound));
+        ASSERT_LE(bound, noiseModel.GetNoise(value));
+    }
+    // bright values are dominated by shot noise and lose more bits than dark ones
+    ASSERT_EQ(quantizer.GetMaxError(0), 1u);
+    ASSERT_EQ(quantizer.GetMaxError(1023), 16u);
+}
+
+TEST(NearLosslessQuantizerTest, LosslessWithoutNoise)
+{
+    NearLosslessQuantizer quantizer(SensorNoiseModel(), 1);
+    std::vector<uint16_t> pixels = {0, 1, 511, 1023, 65535};
+    std::vector<uint16_t> original = pixels;
+    ASSERT_EQ(quantizer.Quantize(pixels.data(), pixels.size()), 0u);
+    ASSERT_EQ(pixels, original);
+    ASSERT_THROW(NearLosslessQuantizer(SensorNoiseModel(), -1), std::invalid_argument);
+}
+
+TEST(NearLosslessQuantizerTest, CopyAndVerify)
+{
+    auto root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("xilens-%%%%-%%%%");
+    boost::filesystem::create_directories(root);
+    std::string source = (root / "recording.b2nd").string();
+    std::string copy = (root / "near_lossless.b2nd").string();
+
+    XI_IMG image{};
+    image.width = 64;
+    image.height = 48;
+    std::vector<uint16_t> pixels(static_cast<size_t>(image.width) * image.height);
+    std::mt19937 generator(3);
+    std::normal_distribution<float> noise(0, 6);
+    image.bp = pixels.data();
+
+    blosc2_init();
+    {
+        FileImage fileImage(source.c_str(), image.height, image.width);
+        for (int i = 0; i < 3; i++)
+        {
+            for (size_t j = 0; j < pixels.size(); j++)
+            {
+                pixels[j] = static_cast<uint16_t>(std::min(std::max(400.f + j % 64 + noise(generator), 0.f), 1023.f));
+            }
+            fileImage.WriteImageData(image, QMap<QString, float>());
+        }
+        fileImage.AppendMetadata();
+    }
+
+    SensorNoiseModel noiseModel;
+    noiseModel.readNoise = 2;
+    noiseModel.gain = 0.1;
+    NearLosslessQuantizer quantizer(noiseModel, 1);
+    RecompressB2ND(source, copy, 5, &quantizer);
+    ASSERT_LT(boost::filesystem::file_size(copy), boost::filesystem::file_size(source));
+
+    NearLosslessReport report = VerifyNearLossless(source, copy);
+    ASSERT_EQ(report.frames, 3);
+    ASSERT_EQ(report.violations, 0u);
+    ASSERT_GT(report.maxError, 0u);
+    ASSERT_LE(report.maxError, report.maxBound);
+
+    b2nd_array_t *src;
+    ASSERT_EQ(b2nd_open(copy.c_str(), &src), 0);
+    auto parameters = GetBLOSCVLMetadata(src, NEAR_LOSSLESS_KEY).get().as<std::map<std::string, double>>();
+    ASSERT_EQ(parameters.at("max_error"), report.maxBound);
+    ASSERT_GE(blosc2_vlmeta_exists(src->sc, EXPOSURE_KEY), 0);
+    b2nd_free(src);
+
+    // near-lossless copies are not quantized again and lossless files can not be verified as near-lossless
+    ASSERT_THROW(RecompressB2ND(copy, (root / "twice.b2nd").string(), 5, &quantizer), std::runtime_error);
+    ASSERT_THROW(VerifyNearLossless(source, source), std::runtime_error);
+    blosc2_destroy();
+    boost::filesystem::remove_all(root);
+}
@@ -0,0 +1,177 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "src/noiseEstimator.h"
+#include "src/recordingFormat.h"
+
+/**
+ * Frame of type CV_16UC1 whose pixels are drawn from a normal distribution with the given mean and variance.
+ */
+static cv::Mat CreateNoisyFrame(const cv::Mat &mean, const cv::Mat &variance, cv::RNG &rng)
+{
+    cv::Mat frame(mean.size(), CV_16UC1);
+    for (int row = 0; row < frame.rows; row++)
+    {
+        for (int col = 0; col < frame.cols; col++)
+        {
+            double value = mean.at<float>(row, col) + rng.gaussian(std::sqrt(variance.at<float>(row, col)));
+            frame.at<uint16_t>(row, col) = cv::saturate_cast<uint16_t>(value);
+        }
+    }
+    return frame;
+}
+
+TEST(NoiseEstimatorTest, EstimatesNoiseOfEachBand)
+{
+    // 2x2 mosaic, each band with its own level and noise
+    const float levels[] = {100, 200, 300, 400};
+    const float sigmas[] = {2, 4, 6, 8};
+    cv::Mat mean(64, 64, CV_32F);
+    cv::Mat variance(64, 64, CV_32F);
+    for (int row = 0; row < mean.rows; row++)
+    {
+        for (int col = 0; col < mean.cols; col++)
+        {
+            int band = (row % 2) * 2 + col % 2;
+            mean.at<float>(row, col) = levels[band];
+            variance.at<float>(row, col) = sigmas[band] * sigmas[band];
+        }
+    }
+    NoiseEstimatorOptions options;
+    options.gridStep = 1;
+    TemporalNoiseEstimator estimator(2, 2, options);
+    ASSERT_EQ(estimator.GetNumberOfBands(), 4);
+    ASSERT_TRUE(std::isnan(estimator.GetEstimate().bandNoise[0]));
+
+    cv::RNG rng(1);
+    for (int i = 0; i < 40; i++)
+    {
+        estimator.Update(CreateNoisyFrame(mean, variance, rng));
+    }
+    NoiseEstimate estimate = estimator.GetEstimate();
+    ASSERT_EQ(estimate.frames, options.windowSize);
+    for (int band = 0; band < 4; band++)
+    {
+        ASSERT_NEAR(estimate.bandMean[band], levels[band], 0.5);
+        ASSERT_NEAR(estimate.bandNoise[band], sigmas[band], 0.1 * sigmas[band]);
+        ASSERT_NEAR(estimate.bandSnr[band], levels[band] / sigmas[band], 0.1 * levels[band] / sigmas[band]);
+    }
+    // all pixels of a band have the same level, the read noise can not be told apart from the shot noise
+    ASSERT_TRUE(std::isnan(estimate.readNoise));
+
+    estimator.Reset();
+    ASSERT_EQ(estimator.GetEstimate().frames, 0);
+    ASSERT_TRUE(std::isnan(estimator.GetEstimate().bandSnr[0]));
+}
+
+TEST(NoiseEstimatorTest, SlidingWindowMatchesDirectComputation)
+{
+    NoiseEstimatorOptions options;
+    options.windowSize = 4;
+    options.gridStep = 1;
+    TemporalNoiseEstimator estimator(1, 1, options);
+    cv::RNG rng(2);
+    std::vector<cv::Mat> frames;
+    for (int i = 0; i < 11; i++)
+    {
+        cv::Mat frame(8, 8, CV_16UC1);
+        rng.fill(frame, cv::RNG::UNIFORM, 0, 1024);
+        frames.push_back(frame);
+        estimator.Update(frame);
+    }
+    // mean and variance of the last 4 frames
+    double meanSum = 0;
+    double varianceSum = 0;
+    for (int row = 0; row < 8; row++)
+    {
+        for (int col = 0; col < 8; col++)
+        {
+            double mean = 0;
+            for (size_t i = frames.size() - 4; i < frames.size(); i++)
+            {
+                mean += frames[i].at<uint16_t>(row, col) / 4.;
+            }
+            double squares = 0;
+            for (size_t i = frames.size() - 4; i < frames.size(); i++)
+            {
+                squares += std::pow(frames[i].at<uint16_t>(row, col) - mean, 2);
+            }
+            meanSum += mean;
+            varianceSum += squares / 3;
+        }
+    }
+    NoiseEstimate estimate = estimator.GetEstimate();
+    ASSERT_EQ(estimate.frames, 4);
+    ASSERT_NEAR(estimate.bandMean[0], meanSum / 64, 1e-3);
+    ASSERT_NEAR(estimate.bandNoise[0], std::sqrt(varianceSum / 64), 1e-3);
+
+    // the window starts again with frames of another size
+    estimator.Update(cv::Mat(16, 16, CV_16UC1, cv::Scalar(10)));
+    ASSERT_EQ(estimator.GetEstimate().frames, 1);
+}
+
+TEST(NoiseEstimatorTest, EstimatesReadNoiseFromPhotonTransfer)
+{
+    // gray ramp with a read noise of 8 and a conversion gain of 0.25
+    cv::Mat mean(64, 64, CV_32F);
+    for (int col = 0; col < mean.cols; col++)
+    {
+        mean.col(col).setTo(50 + 900. * col / (mean.cols - 1));
+    }
+    cv::Mat variance = 64 + 0.25 * mean;
+    NoiseEstimatorOptions options;
+    options.windowSize = 32;
+    options.gridStep = 1;
+    TemporalNoiseEstimator estimator(1, 1, options);
+    cv::RNG rng(3);
+    for (int i = 0; i < options.windowSize; i++)
+    {
+        estimator.Update(CreateNoisyFrame(mean, variance, rng));
+    }
+    NoiseEstimate estimate = estimator.GetEstimate();
+    ASSERT_NEAR(estimate.readNoise, 8, 0.5);
+    ASSERT_NEAR(estimate.conversionGain, 0.25, 0.02);
+}
+
+TEST(NoiseEstimatorTest, ProvidesEstimateToMetadata)
+{
+    NoiseEstimatorOptions options;
+    options.windowSize = 2;
+    auto estimator = std::make_shared<TemporalNoiseEstimator>(2, 2, options);
+    MetadataProviderRegistry registry;
+    registry.Register(std::make_shared<NoiseEstimateProvider>(estimator));
+    ASSERT_TRUE(registry.GetSchema().Contains(TEMPORAL_NOISE_KEY));
+    ASSERT_TRUE(registry.GetSchema().Contains(TEMPORAL_SNR_KEY));
+    ASSERT_TRUE(registry.GetSchema().Contains(READ_NOISE_KEY));
+    FrameMetadataRecord record = registry.GetSchema().CreateRecord();
+    ASSERT_EQ(record.floatValues.size(), 9);
+
+    estimator->Update(cv::Mat(32, 32, CV_16UC1, cv::Scalar(100)));
+    estimator->Update(cv::Mat(32, 32, CV_16UC1, cv::Scalar(104)));
+    XI_IMG image{};
+    registry.Sample(image, record);
+    // each pixel alternates between 100 and 104, a standard deviation of 2.83
+    for (int band = 0; band < 4; band++)
+    {
+        ASSERT_NEAR(record.floatValues[band], std::sqrt(8.), 1e-3);
+        ASSERT_NEAR(record.floatValues[4 + band], 102 / std::sqrt(8.), 1e-3);
+    }
+    ASSERT_TRUE(std::isnan(record.floatValues[8]));
+}
+
+TEST(NoiseEstimatorTest, RejectsInvalidArguments)
+{
+    NoiseEstimatorOptions options;
+    options.windowSize = 1;
+    ASSERT_THROW(TemporalNoiseEstimator(2, 2, options), std::invalid_argument);
+    ASSERT_THROW(TemporalNoiseEstimator(0, 2), std::invalid_argument);
+    TemporalNoiseEstimator estimator(2, 2);
+    ASSERT_THROW(estimator.Update(cv::Mat::zeros(8, 8, CV_8UC1)), std::invalid_argument);
+    ASSERT_THROW(estimator.Update(cv::Mat::zeros(1, 1, CV_16UC1)), std::invalid_argument);
+}
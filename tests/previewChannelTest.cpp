@@ -0,0 +1,121 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include "src/previewChannel.h"
+
+class PreviewChannelTest : public ::testing::Test
+{
+  protected:
+    std::string m_name;
+    XI_IMG m_image{};
+    std::vector<uint16_t> m_pixels;
+
+    void SetUp() override
+    {
+        m_name = boost::filesystem::unique_path("xilens-preview-test-%%%%-%%%%").string();
+        m_image.width = 8;
+        m_image.height = 4;
+        m_image.exposure_time_us = 40000;
+        m_image.color_filter_array = XI_CFA_BAYER_GBRG;
+        m_pixels.resize(static_cast<size_t>(m_image.width) * m_image.height);
+        m_image.bp = m_pixels.data();
+    }
+
+    void FillImage(uint16_t value)
+    {
+        std::fill(m_pixels.begin(), m_pixels.end(), value);
+        m_image.acq_nframe = value;
+    }
+};
+
+TEST_F(PreviewChannelTest, SubscriberReadsLatestFrame)
+{
+    PreviewPublisher publisher(m_name, 64);
+    PreviewSubscriber subscriber(m_name);
+    PreviewFrameInfo info;
+    std::vector<uint16_t> pixels;
+    ASSERT_FALSE(subscriber.ReadLatest(info, pixels));
+
+    FillImage(1);
+    ASSERT_TRUE(publisher.Publish(m_image, false, 0));
+    FillImage(2);
+    ASSERT_TRUE(publisher.Publish(m_image, true, 7));
+    ASSERT_TRUE(subscriber.ReadLatest(info, pixels));
+    ASSERT_EQ(info.width, m_image.width);
+    ASSERT_EQ(info.height, m_image.height);
+    ASSERT_EQ(info.frameNumber, 2);
+    ASSERT_EQ(info.exposureUs, 40000);
+    ASSERT_EQ(info.recording, 1);
+    ASSERT_EQ(info.recordedFrames, 7);
+    ASSERT_EQ(pixels, m_pixels);
+    // the same frame is not read twice
+    ASSERT_FALSE(subscriber.ReadLatest(info, pixels));
+
+    XI_IMG image = PreviewFrameToImage(info, pixels);
+    ASSERT_EQ(image.width, m_image.width);
+    ASSERT_EQ(image.color_filter_array, XI_CFA_BAYER_GBRG);
+    ASSERT_EQ(image.bp, pixels.data());
+}
+
+TEST_F(PreviewChannelTest, FramesLargerThanCapacityAreNotPublished)
+{
+    PreviewPublisher publisher(m_name, 16);
+    FillImage(3);
+    ASSERT_FALSE(publisher.Publish(m_image, false, 0));
+    PreviewSubscriber subscriber(m_name);
+    PreviewFrameInfo info;
+    std::vector<uint16_t> pixels;
+    ASSERT_FALSE(subscriber.ReadLatest(info, pixels));
+}
+
+TEST_F(PreviewChannelTest, MissingChannelThrows)
+{
+    ASSERT_THROW(PreviewSubscriber subscriber(m_name), std::runtime_error);
+    {
+        PreviewPublisher publisher(m_name, 64);
+    }
+    // the publisher removes the channel
+    ASSERT_THROW(PreviewSubscriber subscriber(m_name), std::runtime_error);
+}
+
+TEST_F(PreviewChannelTest, SubscriberNeverReadsTornFrames)
+{
+    PreviewPublisher publisher(m_name, 64);
+    PreviewSubscriber subscriber(m_name);
+    boost::thread writer([this, &publisher] {
+        XI_IMG image = m_image;
+        std::vector<uint16_t> pixels(m_pixels.size());
+        image.bp = pixels.data();
+        for (uint16_t value = 1; value < 20000; value++)
+        {
+            std::fill(pixels.begin(), pixels.end(), value);
+            image.acq_nframe = value;
+            publisher.Publish(image, false, 0);
+        }
+    });
+    PreviewFrameInfo info;
+    std::vector<uint16_t> pixels;
+    int nRead = 0;
+    int nTorn = 0;
+    while (info.frameNumber < 19999)
+    {
+        if (subscriber.ReadLatest(info, pixels))
+        {
+            nRead++;
+            nTorn += std::all_of(pixels.begin(), pixels.end(),
+                                 [&info](uint16_t value) { return value == info.frameNumber; })
+                         ? 0
+                         : 1;
+        }
+    }
+    writer.join();
+    ASSERT_GT(nRead, 0);
+    ASSERT_EQ(nTorn, 0);
+}
@@ -0,0 +1,146 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <blosc2.h>
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <sstream>
+
+#include "src/archiveMigrator.h"
+#include "src/constants.h"
+#include "src/locoCodec.h"
+#include "src/recompressor.h"
+#include "src/util.h"
+
+class RecompressorTest : public ::testing::Test
+{
+  protected:
+    boost::filesystem::path m_root;
+
+    void SetUp() override
+    {
+        m_root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("xilens-%%%%-%%%%");
+        boost::filesystem::create_directories(m_root / "day1");
+        blosc2_init();
+        RegisterLocoCodec();
+    }
+
+    void TearDown() override
+    {
+        blosc2_destroy();
+        boost::filesystem::remove_all(m_root);
+    }
+
+    static void WriteRecording(const std::string &filePath, int nFrames)
+    {
+        XI_IMG image{};
+        image.width = 40;
+        image.height = 32;
+        image.exposure_time_us = 40000;
+        std::vector<uint16_t> pixels(static_cast<size_t>(image.width) * image.height);
+        image.bp = pixels.data();
+        FileImage fileImage(filePath.c_str(), image.height, image.width);
+        for (int i = 0; i < nFrames; i++)
+        {
+            for (size_t j = 0; j < pixels.size(); j++)
+            {
+                pixels[j] = static_cast<uint16_t>((j * 7 + i * 13) % 1024);
+            }
+            fileImage.WriteImageData(image, QMap<QString, float>());
+        }
+        fileImage.AppendMetadata();
+    }
+
+    static std::string ReadRawMetadata(const std::string &filePath, const char *key)
+    {
+        b2nd_array_t *src;
+        EXPECT_EQ(b2nd_open(filePath.c_str(), &src), 0);
+        uint8_t *content = nullptr;
+        int32_t contentLength = 0;
+        EXPECT_GE(blosc2_vlmeta_get(src->sc, key, &content, &contentLength), 0);
+        std::string metadata(reinterpret_cast<char *>(content), static_cast<size_t>(contentLength));
+        free(content);
+        b2nd_free(src);
+        return metadata;
+    }
+};
+
+TEST_F(RecompressorTest, FindRecordings)
+{
+    std::string first = (m_root / "day1" / "first.b2nd").string();
+    std::string second = (m_root / "second.b2nd").string();
+    WriteRecording(first, 1);
+    WriteRecording(second, 1);
+    WriteRecording(GetRecompressedPath(second), 1);
+    ASSERT_EQ(GetRecompressedPath(second), (m_root / "second.recompressed.b2nd").string());
+    ASSERT_EQ(FindRecordings({m_root.string(), first}), std::vector<std::string>({first, second}));
+    ASSERT_THROW(FindRecordings({(m_root / "missing").string()}), std::runtime_error);
+}
+
+TEST_F(RecompressorTest, RecompressAlongside)
+{
+    std::string source = (m_root / "recording.b2nd").string();
+    WriteRecording(source, 9);
+    RecompressionProfile profile;
+    profile.compcode = LOCO_CODEC_ID;
+    RecompressionResult result = RecompressRecording(source, GetRecompressedPath(source), profile, 2);
+
+    ASSERT_TRUE(boost::filesystem::exists(source));
+    ASSERT_FALSE(boost::filesystem::exists(result.destination + ".part"));
+    ASSERT_EQ(result.originalBytes, boost::filesystem::file_size(source));
+    ASSERT_EQ(result.recompressedBytes, boost::filesystem::file_size(result.destination));
+    ASSERT_EQ(ComputeB2NDDataCRC32(result.destination), ComputeB2NDDataCRC32(source));
+    ASSERT_EQ(ReadRawMetadata(result.destination, EXPOSURE_KEY), ReadRawMetadata(source, EXPOSURE_KEY));
+
+    std::stringstream stream;
+    WriteRecompressionReport({result}, stream);
+    ASSERT_NE(stream.str().find("total (1 files)"), std::string::npos);
+}
+
+TEST_F(RecompressorTest, ReplaceOriginal)
+{
+    std::string source = (m_root / "recording.b2nd").string();
+    WriteRecording(source, 5);
+    uint32_t originalCRC = ComputeB2NDDataCRC32(source);
+    RecompressionProfile profile;
+    profile.compcode = BLOSC_LZ4;
+    profile.clevel = 1;
+    RecompressRecording(source, source, profile, 3);
+
+    ASSERT_EQ(ComputeB2NDDataCRC32(source), originalCRC);
+    b2nd_array_t *src;
+    ASSERT_EQ(b2nd_open(source.c_str(), &src), 0);
+    ASSERT_EQ(src->shape[0], 5);
+    ASSERT_EQ(src->sc->compcode, BLOSC_LZ4);
+    b2nd_free(src);
+}
+
+TEST_F(RecompressorTest, LocoNeedsImageChunks)
+{
+    // an array with a chunk of several images can not be compressed with the LOCO codec
+    std::string source = (m_root / "array.b2nd").string();
+    blosc2_cparams cparams = BLOSC2_CPARAMS_DEFAULTS;
+    cparams.typesize = sizeof(uint16_t);
+    blosc2_storage storage = BLOSC2_STORAGE_DEFAULTS;
+    storage.contiguous = true;
+    storage.cparams = &cparams;
+    storage.urlpath = const_cast<char *>(source.c_str());
+    int64_t shape[] = {4, 8, 8};
+    int32_t chunkshape[] = {2, 8, 8};
+    b2nd_context_t *ctx = b2nd_create_ctx(&storage, 3, shape, chunkshape, chunkshape, "<u2", DTYPE_NUMPY_FORMAT,
+                                          nullptr, 0);
+    b2nd_array_t *array;
+    ASSERT_EQ(b2nd_zeros(ctx, &array), 0);
+    b2nd_free(array);
+    b2nd_free_ctx(ctx);
+
+    RecompressionProfile profile;
+    profile.compcode = LOCO_CODEC_ID;
+    std::string destination = GetRecompressedPath(source);
+    ASSERT_THROW(RecompressRecording(source, destination, profile, 1), std::runtime_error);
+    ASSERT_FALSE(boost::filesystem::exists(destination));
+    ASSERT_FALSE(boost::filesystem::exists(destination + ".part"));
+}
@@ -0,0 +1,151 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <boost/thread.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "src/recordingFormat.h"
+#include "src/roiTracker.h"
+
+/**
+ * Smooth random texture of type CV_16UC1, resembling tissue.
+ */
+static cv::Mat CreateTexture()
+{
+    cv::RNG rng(1);
+    cv::Mat texture(512, 512, CV_32F);
+    rng.fill(texture, cv::RNG::UNIFORM, 0, 1024);
+    cv::GaussianBlur(texture, texture, cv::Size(0, 0), 4);
+    cv::normalize(texture, texture, 0, 1023, cv::NORM_MINMAX);
+    texture.convertTo(texture, CV_16U);
+    return texture;
+}
+
+/**
+ * Moves an image by a number of pixels along the columns and rows.
+ */
+static cv::Mat Shift(const cv::Mat &image, double dx, double dy)
+{
+    cv::Mat shifted;
+    cv::warpAffine(image, shifted, (cv::Mat_<double>(2, 3) << 1, 0, dx, 0, 1, dy), image.size(), cv::INTER_LINEAR,
+                   cv::BORDER_REFLECT);
+    return shifted;
+}
+
+TEST(RoiTrackerTest, ParsesRegions)
+{
+    ASSERT_EQ(ParseRoi("10,20,30,40"), cv::Rect(10, 20, 30, 40));
+    ASSERT_EQ(ParseRoi("10, 20, 30, 40"), cv::Rect(10, 20, 30, 40));
+    ASSERT_THROW(ParseRoi("10,20,30"), std::invalid_argument);
+    ASSERT_THROW(ParseRoi("10,20,30,40,50"), std::invalid_argument);
+    ASSERT_THROW(ParseRoi("10,20,0,40"), std::invalid_argument);
+    ASSERT_THROW(ParseRoi("-1,20,30,40"), std::invalid_argument);
+    ASSERT_THROW(ParseRoi("a,b,c,d"), std::invalid_argument);
+}
+
+TEST(RoiTrackerTest, FollowsMovingTissue)
+{
+    cv::Mat texture = CreateTexture();
+    RoiTracker tracker({cv::Rect(200, 200, 64, 64), cv::Rect(100, 300, 32, 48)});
+    ASSERT_EQ(tracker.Track(texture), 2);
+    ASSERT_EQ(tracker.GetTracks()[0].rect, cv::Rect2f(200, 200, 64, 64));
+
+    for (const auto &motion : {cv::Point2d(10, -6), cv::Point2d(17, -3), cv::Point2d(25, 4)})
+    {
+        ASSERT_EQ(tracker.Track(Shift(texture, motion.x, motion.y)), 2);
+        for (const auto &track : tracker.GetTracks())
+        {
+            ASSERT_TRUE(track.found);
+            ASSERT_GT(track.confidence, 0.9);
+        }
+        ASSERT_NEAR(tracker.GetTracks()[0].rect.x, 200 + motion.x, 1);
+        ASSERT_NEAR(tracker.GetTracks()[0].rect.y, 200 + motion.y, 1);
+        ASSERT_NEAR(tracker.GetTracks()[1].rect.x, 100 + motion.x, 1);
+        ASSERT_NEAR(tracker.GetTracks()[1].rect.y, 300 + motion.y, 1);
+        ASSERT_EQ(tracker.GetTracks()[0].rect.size(), cv::Size2f(64, 64));
+    }
+
+    tracker.Reset();
+    tracker.Track(texture);
+    ASSERT_EQ(tracker.GetTracks()[0].rect, cv::Rect2f(200, 200, 64, 64));
+}
+
+TEST(RoiTrackerTest, KeepsPositionOfLostRegions)
+{
+    cv::Mat texture = CreateTexture();
+    RoiTracker tracker({cv::Rect(200, 200, 64, 64)});
+    tracker.Track(texture);
+    tracker.Track(Shift(texture, 8, 8));
+    cv::Rect2f last = tracker.GetTracks()[0].rect;
+    // the inverted texture does not correlate with the template
+    cv::Mat inverted = 1023 - Shift(texture, 16, 16);
+    tracker.Track(inverted);
+    ASSERT_FALSE(tracker.GetTracks()[0].found);
+    ASSERT_LT(tracker.GetTracks()[0].confidence, 0.5);
+    ASSERT_EQ(tracker.GetTracks()[0].rect, last);
+
+    // regions outside of the frame are never found
+    RoiTracker outside({cv::Rect(600, 600, 32, 32)});
+    outside.Track(texture);
+    outside.Track(texture);
+    ASSERT_FALSE(outside.GetTracks()[0].found);
+    ASSERT_THROW(outside.Track(cv::Mat::zeros(8, 8, CV_32F)), std::invalid_argument);
+}
+
+TEST(RoiTrackerTest, SpreadsRegionsOverFramesWithinBudget)
+{
+    cv::Mat texture = CreateTexture();
+    RoiTrackingOptions options;
+    options.budgetMilliseconds = 0;
+    RoiTracker tracker({cv::Rect(200, 200, 64, 64), cv::Rect(100, 300, 32, 48)}, options);
+    tracker.Track(texture);
+    cv::Mat shifted = Shift(texture, 10, 10);
+    // without budget a single region is updated with each frame
+    ASSERT_EQ(tracker.Track(shifted), 1);
+    ASSERT_NEAR(tracker.GetTracks()[0].rect.x, 210, 1);
+    ASSERT_EQ(tracker.GetTracks()[1].rect.x, 100);
+    ASSERT_EQ(tracker.Track(shifted), 1);
+    ASSERT_NEAR(tracker.GetTracks()[1].rect.x, 110, 1);
+}
+
+TEST(RoiTrackerTest, WorkerPublishesTracksToMetadata)
+{
+    cv::Mat texture = CreateTexture();
+    auto worker = std::make_shared<RoiTrackingWorker>(std::vector<cv::Rect>{cv::Rect(200, 200, 64, 64)});
+    auto provider = std::make_shared<RoiTrackingProvider>(worker.get());
+    MetadataProviderRegistry registry;
+    registry.Register(provider);
+    ASSERT_TRUE(registry.GetSchema().Contains(ROI_RECTS_KEY));
+    ASSERT_TRUE(registry.GetSchema().Contains(ROI_CONFIDENCE_KEY));
+    FrameMetadataRecord record = registry.GetSchema().CreateRecord();
+    ASSERT_EQ(record.floatValues.size(), 5);
+    XI_IMG image{};
+    registry.Sample(image, record);
+    ASSERT_EQ(record.intValues[0], -1);
+
+    std::vector<TrackedRoi> tracks;
+    worker->Submit(texture, 1);
+    for (int i = 0; i < 200 && worker->GetTracks(tracks) != 1; i++)
+    {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    }
+    worker->Submit(Shift(texture, 10, -6), 2);
+    for (int i = 0; i < 200 && worker->GetTracks(tracks) != 2; i++)
+    {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(tracks.size(), 1);
+    ASSERT_NEAR(tracks[0].rect.x, 210, 1);
+
+    registry.Sample(image, record);
+    ASSERT_EQ(record.intValues[0], 2);
+    ASSERT_NEAR(record.floatValues[0], 210, 1);
+    ASSERT_NEAR(record.floatValues[1], 194, 1);
+    ASSERT_EQ(record.floatValues[2], 64);
+    ASSERT_EQ(record.floatValues[3], 64);
+    ASSERT_GT(record.floatValues[4], 0.9);
+}
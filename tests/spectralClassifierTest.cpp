@@ -0,0 +1,181 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <blosc2.h>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <sstream>
+
+#include "src/spectralClassifier.h"
+
+/**
+ * Linear model on a 2x2 mosaic, the first class responds to the first band and the second class to the last band.
+ */
+static SpectralClassifier CreateLinearClassifier()
+{
+    std::vector<SpectralClass> classes = {{"first", cv::Vec3b(255, 0, 0)}, {"last", cv::Vec3b(0, 0, 255)}};
+    cv::Mat linear = (cv::Mat_<float>(2, 5) << 1, 0, 0, 0, 0, 0, 0, 0, 1, 0);
+    return {classes, linear, {}, false};
+}
+
+/**
+ * Mosaic image of 2x2 superpixels, the left half is bright in the first band and the right half in the last band.
+ */
+static cv::Mat CreateMosaicImage()
+{
+    cv::Mat image(4, 8, CV_16UC1, cv::Scalar(100));
+    for (int row = 0; row < image.rows; row += 2)
+    {
+        for (int col = 0; col < image.cols; col += 2)
+        {
+            if (col < image.cols / 2)
+            {
+                image.at<ushort>(row, col) = 800;
+            }
+            else
+            {
+                image.at<ushort>(row + 1, col + 1) = 800;
+            }
+        }
+    }
+    return image;
+}
+
+TEST(SpectralClassifierTest, LinearModelClassifiesEachSuperpixel)
+{
+    SpectralClassifier classifier = CreateLinearClassifier();
+    ASSERT_EQ(classifier.GetNumberOfBands(), 4);
+    ASSERT_FALSE(classifier.IsQuadratic());
+    cv::Mat labels;
+    classifier.Classify(CreateMosaicImage(), 2, 2, labels);
+    ASSERT_EQ(labels.type(), CV_8UC1);
+    ASSERT_EQ(labels.size(), cv::Size(4, 2));
+    cv::Mat expected = (cv::Mat_<uchar>(2, 4) << 0, 0, 1, 1, 0, 0, 1, 1);
+    ASSERT_EQ(cv::countNonZero(labels != expected), 0);
+
+    cv::Mat overlay;
+    classifier.Colorize(labels, overlay);
+    ASSERT_EQ(overlay.at<cv::Vec3b>(0, 0), cv::Vec3b(255, 0, 0));
+    ASSERT_EQ(overlay.at<cv::Vec3b>(1, 3), cv::Vec3b(0, 0, 255));
+
+    ASSERT_THROW(classifier.Classify(CreateMosaicImage(), 4, 4, labels), std::invalid_argument);
+}
+
+TEST(SpectralClassifierTest, NormalizedModelIgnoresBrightness)
+{
+    // the first class wins when the first band is bright, the second class otherwise
+    std::vector<SpectralClass> classes = {{"first", cv::Vec3b(255, 0, 0)}, {"other", cv::Vec3b(0, 0, 255)}};
+    cv::Mat linear = (cv::Mat_<float>(2, 5) << 1, 0, 0, 0, 0, 0, 0, 0, 0, 0.5);
+    cv::Mat expected = (cv::Mat_<uchar>(2, 4) << 0, 0, 1, 1, 0, 0, 1, 1);
+    cv::Mat bright = CreateMosaicImage();
+    cv::Mat dark = bright / 100;
+    cv::Mat labels;
+    SpectralClassifier normalized(classes, linear, {}, true);
+    normalized.Classify(bright, 2, 2, labels);
+    ASSERT_EQ(cv::countNonZero(labels != expected), 0);
+    normalized.Classify(dark, 2, 2, labels);
+    ASSERT_EQ(cv::countNonZero(labels != expected), 0);
+    // without normalization the scores depend on the brightness of the spectra
+    SpectralClassifier(classes, linear, {}, false).Classify(dark, 2, 2, labels);
+    ASSERT_GT(cv::countNonZero(labels != expected), 0);
+}
+
+TEST(SpectralClassifierTest, QuadraticModelSeparatesByDistance)
+{
+    // single band, the first class scores -(x - 100)^2, the second class -50^2
+    std::vector<SpectralClass> classes = {{"near", cv::Vec3b(0, 255, 0)}, {"far", cv::Vec3b(0, 0, 0)}};
+    cv::Mat linear = (cv::Mat_<float>(2, 2) << 200, -10000, 0, -2500);
+    std::vector<cv::Mat> quadratic = {cv::Mat(1, 1, CV_32F, cv::Scalar(-1)), cv::Mat(1, 1, CV_32F, cv::Scalar(0))};
+    SpectralClassifier classifier(classes, linear, quadratic, false);
+    ASSERT_TRUE(classifier.IsQuadratic());
+    cv::Mat image = (cv::Mat_<ushort>(1, 4) << 100, 140, 160, 20);
+    cv::Mat labels;
+    classifier.Classify(image, 1, 1, labels);
+    cv::Mat expected = (cv::Mat_<uchar>(1, 4) << 0, 0, 1, 1);
+    ASSERT_EQ(cv::countNonZero(labels != expected), 0);
+}
+
+TEST(SpectralClassifierTest, LoadsModelFile)
+{
+    auto filePath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.json");
+    {
+        std::ofstream file(filePath.string());
+        file << R"({"model": "qda", "bands": 1, "classes": [)"
+             << R"({"name": "near", "color": [0, 255, 0], "weights": [200], "bias": -10000, "quadratic": [[-1]]},)"
+             << R"({"name": "far", "color": [10, 20, 30], "weights": [0], "bias": -2500, "quadratic": [[0]]}]})";
+    }
+    SpectralClassifier classifier = SpectralClassifier::Load(filePath.string());
+    ASSERT_EQ(classifier.GetClasses().size(), 2);
+    ASSERT_EQ(classifier.GetClasses()[1].name, "far");
+    ASSERT_EQ(classifier.GetClasses()[1].color, cv::Vec3b(10, 20, 30));
+    cv::Mat labels;
+    classifier.Classify((cv::Mat_<ushort>(1, 2) << 110, 300), 1, 1, labels);
+    ASSERT_EQ(labels.at<uchar>(0, 0), 0);
+    ASSERT_EQ(labels.at<uchar>(0, 1), 1);
+
+    {
+        // quadratic models need the quadratic weights of each class
+        std::ofstream file(filePath.string());
+        file << R"({"model": "qda", "bands": 1, "classes": [{"name": "near", "weights": [200], "bias": 0}]})";
+    }
+    ASSERT_THROW(SpectralClassifier::Load(filePath.string()), std::runtime_error);
+    boost::filesystem::remove(filePath);
+    ASSERT_THROW(SpectralClassifier::Load(filePath.string()), std::runtime_error);
+}
+
+TEST(SpectralClassifierTest, RecordsClassMaps)
+{
+    ASSERT_EQ(GetClassMapFilePath("/data/recording.b2nd"), "/data/recording_classes.b2nd");
+    ASSERT_EQ(GetClassMapFilePath("/data/recording.xilens.json"), "/data/recording_classes.b2nd");
+
+    blosc2_init();
+    auto filePath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.b2nd");
+    ClassMapRecorder recorder;
+    ASSERT_FALSE(recorder.IsRecording());
+    cv::Mat labels = (cv::Mat_<uchar>(2, 3) << 0, 1, 2, 2, 1, 0);
+    recorder.Write(labels, 1);
+    recorder.Start(filePath.string());
+    ASSERT_TRUE(recorder.IsRecording());
+    recorder.Write(labels, 5);
+    recorder.Write(labels, 9);
+    ASSERT_EQ(recorder.Stop(), filePath.string());
+    ASSERT_FALSE(recorder.IsRecording());
+
+    b2nd_array_t *src;
+    ASSERT_EQ(b2nd_open(filePath.string().c_str(), &src), 0);
+    ASSERT_EQ(src->shape[0], 2);
+    ASSERT_EQ(src->shape[1], 2);
+    ASSERT_EQ(src->shape[2], 3);
+    std::vector<uint16_t> buffer(6);
+    int64_t start[] = {1, 0, 0};
+    int64_t stop[] = {2, 2, 3};
+    int64_t shape[] = {1, 2, 3};
+    ASSERT_EQ(b2nd_get_slice_cbuffer(src, start, stop, buffer.data(), shape,
+                                     static_cast<int64_t>(buffer.size() * sizeof(uint16_t))),
+              0);
+    ASSERT_EQ(buffer, std::vector<uint16_t>({0, 1, 2, 2, 1, 0}));
+    b2nd_free(src);
+    boost::filesystem::remove(filePath);
+    blosc2_destroy();
+
+    // nothing is written when no class map was recorded
+    recorder.Start(filePath.string());
+    ASSERT_EQ(recorder.Stop(), "");
+    ASSERT_FALSE(boost::filesystem::exists(filePath));
+}
+
+TEST(SpectralClassifierTest, BenchmarkWritesThroughput)
+{
+    std::vector<SpectralClassifier> classifiers = {CreateRandomClassifier(16, 4, false),
+                                                   CreateRandomClassifier(25, 4, true)};
+    std::stringstream stream;
+    WriteClassifierBenchmark(classifiers, 2, 64, 40, stream);
+    ASSERT_NE(stream.str().find("lda"), std::string::npos);
+    ASSERT_NE(stream.str().find("qda"), std::string::npos);
+    ASSERT_THROW(WriteClassifierBenchmark({CreateRandomClassifier(12, 2, false)}, 1, 64, 40, stream),
+                 std::invalid_argument);
+}
@@ -0,0 +1,263 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <blosc2.h>
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include "src/stripedRecording.h"
+#include "src/util.h"
+#include "src/writerQueue.h"
+
+/**
+ * Recording file that keeps the first pixel of each image in memory
+ */
+class MemoryRecordingFile : public RecordingFile
+{
+  public:
+    std::vector<uint16_t> m_firstPixels;
+    bool m_fail = false;
+
+    void WriteImageData(const XI_IMG &image, const FrameMetadataRecord &record) override
+    {
+        if (m_fail)
+        {
+            throw std::runtime_error("write failed");
+        }
+        m_firstPixels.push_back(static_cast<const uint16_t *>(image.bp)[0]);
+    }
+
+    void AppendMetadata() override
+    {
+    }
+
+    std::string GetFilePath() const override
+    {
+        return "memory";
+    }
+};
+
+/**
+ * Recording file whose writes block until it is released, like a hung network share
+ */
+class BlockingRecordingFile : public RecordingFile
+{
+  public:
+    boost::mutex m_mutex;
+    boost::condition_variable m_released;
+    bool m_blocked = true;
+    size_t m_writtenImages = 0;
+
+    void WriteImageData(const XI_IMG &image, const FrameMetadataRecord &record) override
+    {
+    }
+
+    void WriteCompressedImageData(const std::vector<uint8_t> &chunk, const FrameMetadataRecord &record) override
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_released.wait(lock, [this] { return !m_blocked; });
+        m_writtenImages++;
+    }
+
+    void Release()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+            m_blocked = false;
+        }
+        m_released.notify_all();
+    }
+
+    void AppendMetadata() override
+    {
+    }
+
+    std::string GetFilePath() const override
+    {
+        return "blocking";
+    }
+};
+
+class StripedRecordingTest : public ::testing::Test
+{
+  protected:
+    boost::filesystem::path m_root;
+    XI_IMG m_image{};
+    std::vector<uint16_t> m_pixels;
+
+    void SetUp() override
+    {
+        m_root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("xilens-%%%%-%%%%");
+        boost::filesystem::create_directories(m_root);
+        m_image.width = 16;
+        m_image.height = 8;
+        m_pixels.resize(static_cast<size_t>(m_image.width) * m_image.height);
+        m_image.bp = m_pixels.data();
+        blosc2_init();
+    }
+
+    void TearDown() override
+    {
+        blosc2_destroy();
+        boost::filesystem::remove_all(m_root);
+    }
+
+    void FillImage(uint16_t value)
+    {
+        std::fill(m_pixels.begin(), m_pixels.end(), value);
+    }
+};
+
+TEST_F(StripedRecordingTest, WriterQueueKeepsOrder)
+{
+    auto file = std::make_unique<MemoryRecordingFile>();
+    auto *memoryFile = file.get();
+    WriterQueue queue(std::move(file), 2, m_image.height, m_image.width);
+    FrameMetadataRecord record;
+    for (uint16_t i = 0; i < 10; i++)
+    {
+        FillImage(i);
+        queue.WriteImageData(m_image, record);
+    }
+    queue.Flush();
+    ASSERT_EQ(queue.GetPendingImages(), 0);
+    ASSERT_EQ(memoryFile->m_firstPixels, std::vector<uint16_t>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+}
+
+TEST_F(StripedRecordingTest, WriterQueueRethrowsErrors)
+{
+    auto file = std::make_unique<MemoryRecordingFile>();
+    file->m_fail = true;
+    WriterQueue queue(std::move(file), 2, m_image.height, m_image.width);
+    FrameMetadataRecord record;
+    queue.WriteImageData(m_image, record);
+    ASSERT_THROW(queue.Flush(), std::runtime_error);
+    ASSERT_THROW(queue.WriteImageData(m_image, record), std::runtime_error);
+}
+
+TEST_F(StripedRecordingTest, WriterQueueGivesUpWhenFull)
+{
+    auto file = std::make_unique<BlockingRecordingFile>();
+    auto *blockingFile = file.get();
+    WriterQueue queue(std::move(file), 2, 0, 0);
+    FrameMetadataRecord record;
+    std::vector<uint8_t> chunk(16, 1);
+    // the first image is being written and the second one waits, which fills both slots
+    for (int i = 0; i < 2; i++)
+    {
+        ASSERT_TRUE(queue.TryWriteCompressedImageData(chunk, record, boost::chrono::milliseconds(100)));
+    }
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+    ASSERT_FALSE(queue.TryWriteCompressedImageData(chunk, record, boost::chrono::milliseconds(20)));
+
+    // discarded images are released without being written
+    queue.Discard();
+    blockingFile->Release();
+    queue.Flush();
+    ASSERT_EQ(blockingFile->m_writtenImages, 1);
+    ASSERT_EQ(queue.GetPendingImages(), 0);
+}
+
+TEST_F(StripedRecordingTest, WriteAndReadStripedRecording)
+{
+    MetadataProviderRegistry providers;
+    providers.Register(std::make_shared<ImageMetadataProvider>());
+    FrameMetadataRecord record = providers.GetSchema().CreateRecord();
+    std::string manifestPath = (m_root / (std::string("test") + RECORDING_MANIFEST_EXTENSION)).string();
+    std::vector<std::string> folders = {(m_root / "disk0").string(), (m_root / "disk1").string(),
+                                        (m_root / "disk2").string()};
+    {
+        StripedFileImage recording(manifestPath, folders, m_image.height, m_image.width, providers.GetSchema());
+        for (uint16_t i = 0; i < 7; i++)
+        {
+            FillImage(i);
+            providers.Sample(m_image, record);
+            recording.WriteImageData(m_image, record);
+        }
+        recording.AppendMetadata();
+        ASSERT_EQ(recording.GetFilePath(), manifestPath);
+    }
+    RecordingManifest manifest = ReadRecordingManifest(manifestPath);
+    ASSERT_EQ(manifest.frames, 7);
+    ASSERT_EQ(manifest.stripes.size(), 3);
+    ASSERT_TRUE(boost::filesystem::exists(m_root / "disk1" / "test_stripe1.b2nd"));
+
+    RecordingReader session(manifestPath);
+    ASSERT_EQ(session.GetNumberOfFrames(), 7);
+    ASSERT_EQ(session.GetHeight(), m_image.height);
+    ASSERT_EQ(session.GetWidth(), m_image.width);
+    std::vector<uint16_t> buffer;
+    for (int64_t i = 0; i < 7; i++)
+    {
+        session.ReadFrame(i, buffer);
+        ASSERT_EQ(buffer.size(), m_pixels.size());
+        ASSERT_EQ(buffer[0], i);
+        ASSERT_EQ(buffer.back(), i);
+    }
+    ASSERT_THROW(session.ReadFrame(7, buffer), std::out_of_range);
+}
+
+TEST_F(StripedRecordingTest, AppendToExistingStripes)
+{
+    MetadataProviderRegistry providers;
+    providers.Register(std::make_shared<ImageMetadataProvider>());
+    FrameMetadataRecord record = providers.GetSchema().CreateRecord();
+    std::string manifestPath = (m_root / (std::string("test") + RECORDING_MANIFEST_EXTENSION)).string();
+    std::vector<std::string> folders = {(m_root / "disk0").string(), (m_root / "disk1").string(),
+                                        (m_root / "disk2").string()};
+    // test mode records every session to the same file name
+    uint16_t value = 0;
+    for (int nFrames : {4, 5})
+    {
+        StripedFileImage recording(manifestPath, folders, m_image.height, m_image.width, providers.GetSchema());
+        for (int i = 0; i < nFrames; i++)
+        {
+            FillImage(value++);
+            providers.Sample(m_image, record);
+            recording.WriteImageData(m_image, record);
+        }
+        recording.AppendMetadata();
+    }
+    ASSERT_EQ(ReadRecordingManifest(manifestPath).frames, 9);
+
+    RecordingReader session(manifestPath);
+    ASSERT_EQ(session.GetNumberOfFrames(), 9);
+    std::vector<uint16_t> buffer;
+    for (int64_t i = 0; i < 9; i++)
+    {
+        session.ReadFrame(i, buffer);
+        ASSERT_EQ(buffer[0], i);
+    }
+}
+
+TEST_F(StripedRecordingTest, ReadSingleFile)
+{
+    std::string filePath = (m_root / "single.b2nd").string();
+    {
+        FileImage fileImage(filePath.c_str(), m_image.height, m_image.width);
+        for (uint16_t i = 0; i < 3; i++)
+        {
+            FillImage(i);
+            fileImage.WriteImageData(m_image, QMap<QString, float>());
+        }
+        fileImage.AppendMetadata();
+    }
+    RecordingReader session(filePath);
+    ASSERT_EQ(session.GetNumberOfFrames(), 3);
+    std::vector<uint16_t> buffer;
+    session.ReadFrame(2, buffer);
+    ASSERT_EQ(buffer[0], 2);
+}
+
+TEST_F(StripedRecordingTest, InvalidManifest)
+{
+    std::string manifestPath = (m_root / (std::string("invalid") + RECORDING_MANIFEST_EXTENSION)).string();
+    RecordingManifest manifest;
+    manifest.stripes.push_back((m_root / "missing.b2nd").string());
+    WriteRecordingManifest(manifestPath, manifest);
+    ASSERT_THROW(RecordingReader session(manifestPath), std::runtime_error);
+    ASSERT_THROW(ReadRecordingManifest((m_root / "missing.xilens.json").string()), std::runtime_error);
+}
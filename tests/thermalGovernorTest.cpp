@@ -0,0 +1,154 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+#include "mocks.h"
+#include "src/recordingFormat.h"
+#include "src/thermalGovernor.h"
+
+/**
+ * Camera running at 70 degrees Celsius with a full frame rate of 80fps, that records the frame rates set.
+ */
+class HotXiAPIWrapper : public MockXiAPIWrapper
+{
+  public:
+    std::vector<int> m_frameRates;
+
+    int xiGetParamInt(IN HANDLE hDevice, const char *prm, int *val) override
+    {
+        *val = 80;
+        return XI_OK;
+    }
+
+    int xiGetParamFloat(IN HANDLE hDevice, const char *prm, float *val) override
+    {
+        *val = 70;
+        return XI_OK;
+    }
+
+    int xiSetParamInt(IN HANDLE hDevice, const char *prm, const int val) override
+    {
+        if (std::strcmp(prm, XI_PRM_FRAMERATE) == 0)
+        {
+            m_frameRates.push_back(val);
+        }
+        return XI_OK;
+    }
+};
+
+static ThermalGovernorOptions CreateOptions(double limitC)
+{
+    ThermalGovernorOptions options;
+    options.limitC = limitC;
+    options.hysteresisC = 3;
+    options.lookaheadSeconds = 60;
+    return options;
+}
+
+TEST(ThermalGovernorTest, DisabledByDefault)
+{
+    ThermalGovernor governor;
+    ASSERT_FALSE(governor.IsEnabled());
+    ASSERT_FALSE(governor.Update(90, 0));
+    ASSERT_EQ(governor.GetStep(), 0);
+    ASSERT_DOUBLE_EQ(governor.GetFrameRateFraction(), 1);
+}
+
+TEST(ThermalGovernorTest, StepsDownWhileHot)
+{
+    ThermalGovernor governor(CreateOptions(60));
+    ASSERT_TRUE(governor.Update(65, 0));
+    ASSERT_EQ(governor.GetStep(), 1);
+    // the camera gets time to cool down before the next step
+    ASSERT_FALSE(governor.Update(65, 10));
+    ASSERT_EQ(governor.GetStep(), 1);
+    double time = 0;
+    for (int step = 2; step <= ThermalGovernor::MAX_STEP; step++)
+    {
+        time += ThermalGovernor::STEP_HOLD_SECONDS;
+        ASSERT_TRUE(governor.Update(65, time));
+        ASSERT_EQ(governor.GetStep(), step);
+    }
+    ASSERT_FALSE(governor.Update(65, time + ThermalGovernor::STEP_HOLD_SECONDS));
+    ASSERT_DOUBLE_EQ(governor.GetFrameRateFraction(), 1 - ThermalGovernor::MAX_STEP * ThermalGovernor::STEP_FRACTION);
+}
+
+TEST(ThermalGovernorTest, AnticipatesRisingTemperature)
+{
+    ThermalGovernor governor(CreateOptions(60));
+    // warming up by 6 degrees per minute
+    double temperature = 50;
+    double time = 0;
+    while (!governor.Update(temperature, time))
+    {
+        ASSERT_LT(time, 600);
+        time += 5;
+        temperature += 0.5;
+    }
+    ASSERT_LT(temperature, 60);
+    ASSERT_GT(governor.GetTrend(), 0);
+    ASSERT_EQ(governor.GetStep(), 1);
+}
+
+TEST(ThermalGovernorTest, RestoresFullRateWhenCooled)
+{
+    ThermalGovernor governor(CreateOptions(60));
+    ASSERT_TRUE(governor.Update(65, 0));
+    // within the hysteresis the frame rate is kept
+    ASSERT_FALSE(governor.Update(58.5, 40));
+    ASSERT_EQ(governor.GetStep(), 1);
+    ASSERT_TRUE(governor.Update(56, 80));
+    ASSERT_EQ(governor.GetStep(), 0);
+    ASSERT_DOUBLE_EQ(governor.GetFrameRateFraction(), 1);
+
+    ASSERT_TRUE(governor.Update(65, 120));
+    governor.Reset();
+    ASSERT_EQ(governor.GetStep(), 0);
+    ASSERT_EQ(governor.GetTrend(), 0);
+}
+
+TEST(ThermalGovernorTest, ReducesFrameRateOfCamera)
+{
+    HANDLE handle = nullptr;
+    auto apiWrapper = std::make_shared<HotXiAPIWrapper>();
+    std::unique_ptr<CameraFamily> family = std::make_unique<XiSpecFamily>(&handle);
+    family->m_apiWrapper = apiWrapper;
+    SpectralCamera camera(&family, &handle);
+    camera.m_apiWrapper = apiWrapper;
+    camera.InitializeCamera();
+    ASSERT_EQ(apiWrapper->m_frameRates, std::vector<int>({80}));
+
+    family->UpdateCameraTemperature();
+    ASSERT_DOUBLE_EQ(GetGovernedTemperature(*family), 70);
+    ThermalGovernor governor(CreateOptions(60));
+    ASSERT_TRUE(GovernFrameRate(governor, camera));
+    ASSERT_EQ(apiWrapper->m_frameRates, std::vector<int>({80, 64}));
+
+    // the reduced frame rate is kept when the camera is reopened after a dropout
+    camera.InitializeCamera();
+    ASSERT_EQ(apiWrapper->m_frameRates, std::vector<int>({80, 64, 64}));
+}
+
+TEST(ThermalGovernorTest, StepIsRecordedWithEachFrame)
+{
+    ThermalGovernor governor(CreateOptions(60));
+    MetadataProviderRegistry registry;
+    registry.Register(std::make_shared<ThermalGovernorProvider>(&governor));
+    ASSERT_TRUE(registry.GetSchema().Contains(THERMAL_STEP_KEY));
+    ASSERT_TRUE(registry.GetSchema().Contains(FRAME_RATE_FRACTION_KEY));
+    FrameMetadataRecord record = registry.GetSchema().CreateRecord();
+    XI_IMG image{};
+    registry.Sample(image, record);
+    ASSERT_EQ(record.intValues[0], 0);
+    ASSERT_FLOAT_EQ(record.floatValues[0], 1);
+
+    governor.Update(65, 0);
+    registry.Sample(image, record);
+    ASSERT_EQ(record.intValues[0], 1);
+    ASSERT_FLOAT_EQ(record.floatValues[0], 0.8);
+}
@@ -0,0 +1,119 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "src/trueColor.h"
+
+/**
+ * Band centers of a 4x4 mosaic evenly spread over the visible range.
+ */
+static std::vector<float> CreateVisibleBandCenters()
+{
+    std::vector<float> centers;
+    for (int i = 0; i < 16; i++)
+    {
+        centers.push_back(460.f + 10.f * static_cast<float>(i));
+    }
+    return centers;
+}
+
+TEST(TrueColorTest, ColorMatchingFunctionsPeaks)
+{
+    ASSERT_NEAR(GetColorMatchingFunctions(555)[1], 1, 0.01);
+    ASSERT_NEAR(GetColorMatchingFunctions(600)[0], 1.06, 0.01);
+    ASSERT_NEAR(GetColorMatchingFunctions(446)[2], 1.78, 0.01);
+    ASSERT_NEAR(cv::norm(GetColorMatchingFunctions(850)), 0, 1e-3);
+}
+
+TEST(TrueColorTest, FlatSpectrumIsNeutral)
+{
+    cv::Mat matrix = ComputeBandToRGBMatrix(CreateVisibleBandCenters());
+    ASSERT_EQ(matrix.rows, 3);
+    ASSERT_EQ(matrix.cols, 16);
+    for (int row = 0; row < 3; row++)
+    {
+        ASSERT_NEAR(cv::sum(matrix.row(row))[0], 1, 1e-9);
+    }
+
+    TrueColorRenderer renderer(CreateVisibleBandCenters(), 4, 4, 4);
+    cv::Mat image(8, 8, CV_16UC1, cv::Scalar(400));
+    cv::Mat rgbImage;
+    renderer.Render(image, rgbImage);
+    ASSERT_EQ(rgbImage.type(), CV_8UC3);
+    ASSERT_EQ(rgbImage.size(), cv::Size(2, 2));
+    // 100 of 255 in linear sRGB is encoded as 168
+    ASSERT_NEAR(rgbImage.at<cv::Vec3b>(1, 1)[0], 168, 1);
+    ASSERT_NEAR(rgbImage.at<cv::Vec3b>(1, 1)[1], 168, 1);
+    ASSERT_NEAR(rgbImage.at<cv::Vec3b>(1, 1)[2], 168, 1);
+}
+
+TEST(TrueColorTest, RenderedImageIsEncodedAsSRGB)
+{
+    TrueColorRenderer renderer(CreateVisibleBandCenters(), 4, 4, 4);
+    cv::Mat rgbImage;
+    // the transfer function is linear near black and saturates at white
+    renderer.Render(cv::Mat(4, 4, CV_16UC1, cv::Scalar(4)), rgbImage);
+    ASSERT_NEAR(rgbImage.at<cv::Vec3b>(0, 0)[1], 13, 1);
+    renderer.Render(cv::Mat(4, 4, CV_16UC1, cv::Scalar(1020)), rgbImage);
+    ASSERT_EQ(rgbImage.at<cv::Vec3b>(0, 0), cv::Vec3b(255, 255, 255));
+    renderer.Render(cv::Mat(4, 4, CV_16UC1, cv::Scalar(4000)), rgbImage);
+    ASSERT_EQ(rgbImage.at<cv::Vec3b>(0, 0), cv::Vec3b(255, 255, 255));
+}
+
+TEST(TrueColorTest, BandOrderFollowsBandCenters)
+{
+    // the bands of the mosaic are not sorted by wavelength
+    std::vector<float> centers = CreateVisibleBandCenters();
+    std::reverse(centers.begin(), centers.end());
+    TrueColorRenderer renderer(centers, 4, 4, 4);
+    cv::Mat image(4, 4, CV_16UC1, cv::Scalar(0));
+    // long wavelengths, in the first row of the mosaic, render red
+    image.row(0).setTo(800);
+    cv::Mat rgbImage;
+    renderer.Render(image, rgbImage);
+    cv::Vec3b color = rgbImage.at<cv::Vec3b>(0, 0);
+    ASSERT_GT(color[0], color[1]);
+    ASSERT_GT(color[0], color[2]);
+
+    // short wavelengths, in the last row of the mosaic, render blue
+    image.setTo(0);
+    image.row(3).setTo(800);
+    renderer.Render(image, rgbImage);
+    color = rgbImage.at<cv::Vec3b>(0, 0);
+    ASSERT_GT(color[2], color[0]);
+    ASSERT_GT(color[2], color[1]);
+}
+
+TEST(TrueColorTest, RenderedImageHasSizeOfBandImages)
+{
+    TrueColorRenderer renderer(CreateVisibleBandCenters(), 4, 4, 4);
+    cv::Mat image(10, 9, CV_16UC1, cv::Scalar(0));
+    image(cv::Rect(4, 4, 4, 4)).setTo(400);
+    cv::Mat rgbImage(1, 1, CV_8UC3);
+    renderer.Render(image, rgbImage);
+    ASSERT_EQ(rgbImage.size(), cv::Size(3, 3));
+    // the superpixels cut by the border take the values of the last complete superpixel
+    ASSERT_EQ(rgbImage.at<cv::Vec3b>(2, 2), rgbImage.at<cv::Vec3b>(1, 1));
+    ASSERT_NEAR(rgbImage.at<cv::Vec3b>(2, 2)[1], 168, 1);
+    ASSERT_EQ(rgbImage.at<cv::Vec3b>(0, 0), cv::Vec3b(0, 0, 0));
+}
+
+TEST(TrueColorTest, RejectsInvalidBands)
+{
+    ASSERT_THROW(TrueColorRenderer(CreateVisibleBandCenters(), 5, 5, 4), std::invalid_argument);
+    std::vector<float> nearInfrared;
+    for (int i = 0; i < 25; i++)
+    {
+        nearInfrared.push_back(650.f + 12.5f * static_cast<float>(i));
+    }
+    ASSERT_THROW(TrueColorRenderer(nearInfrared, 5, 5, 4), std::invalid_argument);
+
+    TrueColorRenderer renderer(CreateVisibleBandCenters(), 4, 4, 4);
+    cv::Mat rgbImage;
+    ASSERT_THROW(renderer.Render(cv::Mat::zeros(8, 8, CV_8UC1), rgbImage), std::invalid_argument);
+}
@@ -0,0 +1,84 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <boost/thread.hpp>
+
+#include "src/uiSettings.h"
+
+TEST(UiSettingsPublisherTest, DefaultSnapshotIsNeverNull)
+{
+    UiSettingsPublisher publisher;
+
+    ASSERT_NE(publisher.Get(), nullptr);
+    EXPECT_EQ(publisher.Get()->band, 1u);
+}
+
+TEST(UiSettingsPublisherTest, PublishedValuesAreVisibleToReaders)
+{
+    UiSettingsPublisher publisher;
+    UiSettings settings;
+    settings.band = 8;
+    settings.skipFrames = 3;
+    settings.baseFolder = "/tmp";
+    publisher.Publish(settings);
+
+    auto snapshot = publisher.Get();
+    EXPECT_EQ(snapshot->band, 8u);
+    EXPECT_EQ(snapshot->skipFrames, 3);
+    EXPECT_EQ(snapshot->baseFolder, QString("/tmp"));
+}
+
+TEST(UiSettingsPublisherTest, OldSnapshotIsNotModifiedByNewPublications)
+{
+    UiSettingsPublisher publisher;
+    UiSettings settings;
+    settings.band = 2;
+    publisher.Publish(settings);
+    auto oldSnapshot = publisher.Get();
+
+    settings.band = 5;
+    publisher.Publish(settings);
+
+    EXPECT_EQ(oldSnapshot->band, 2u);
+    EXPECT_EQ(publisher.Get()->band, 5u);
+}
+
+TEST(UiSettingsPublisherTest, ConcurrentReadersObserveConsistentSnapshots)
+{
+    UiSettingsPublisher publisher;
+    UiSettings initial;
+    initial.band = 0;
+    initial.skipFrames = 0;
+    publisher.Publish(initial);
+    std::atomic<bool> running(true);
+    std::atomic<int> inconsistentReads(0);
+    boost::thread_group readers;
+    for (int i = 0; i < 4; i++)
+    {
+        readers.create_thread([&] {
+            while (running)
+            {
+                auto snapshot = publisher.Get();
+                if (static_cast<int>(snapshot->band) != snapshot->skipFrames)
+                {
+                    inconsistentReads++;
+                }
+            }
+        });
+    }
+    for (int i = 1; i < 10000; i++)
+    {
+        UiSettings settings;
+        settings.band = i;
+        settings.skipFrames = i;
+        publisher.Publish(settings);
+    }
+    running = false;
+    readers.join_all();
+
+    EXPECT_EQ(inconsistentReads, 0);
+}
@@ -0,0 +1,152 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "src/viewAlignment.h"
+
+/**
+ * Chessboard with 7x5 inner corners on a white 640x480 image.
+ */
+static cv::Mat CreateChessboard()
+{
+    cv::Mat image(480, 640, CV_8UC1, cv::Scalar(255));
+    for (int row = 0; row < 6; row++)
+    {
+        for (int col = 0; col < 8; col++)
+        {
+            if ((row + col) % 2 == 0)
+            {
+                image(cv::Rect(140 + 40 * col, 100 + 40 * row, 40, 40)).setTo(0);
+            }
+        }
+    }
+    return image;
+}
+
+/**
+ * Maps pixels of the target view to the smaller source view, e.g. of a spectral camera next to an RGB camera.
+ */
+static const cv::Matx33d TARGET_TO_SOURCE(0.45, 0.03, -30, -0.02, 0.5, -20, 0, 0, 1);
+
+TEST(ViewAlignmentTest, EstimatesHomographyFromChessboard)
+{
+    cv::Mat target = CreateChessboard();
+    cv::Mat source;
+    cv::warpPerspective(target, source, TARGET_TO_SOURCE, cv::Size(256, 200), cv::INTER_LINEAR, cv::BORDER_CONSTANT,
+                        cv::Scalar(255));
+    ViewAlignment alignment = EstimateViewAlignment(source, target, cv::Size(7, 5));
+    ASSERT_EQ(alignment.sourceSize, cv::Size(256, 200));
+    ASSERT_EQ(alignment.targetSize, cv::Size(640, 480));
+    ASSERT_LT(alignment.reprojectionError, 1);
+
+    std::vector<cv::Point2f> points = {{100, 80}, {20, 30}, {200, 150}};
+    std::vector<cv::Point2f> estimated;
+    std::vector<cv::Point2f> expected;
+    cv::perspectiveTransform(points, estimated, alignment.homography);
+    cv::perspectiveTransform(points, expected, TARGET_TO_SOURCE.inv());
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        ASSERT_LT(cv::norm(estimated[i] - expected[i]), 1);
+    }
+
+    // a target image averaged over 2x2 superpixels gives the alignment to the full target view
+    cv::Mat targetFrame;
+    target.convertTo(targetFrame, CV_16U, 4);
+    ViewAlignment reduced = EstimateViewAlignment(source, GetCalibrationImage(targetFrame, 2, 2), cv::Size(7, 5), 2);
+    ASSERT_EQ(reduced.targetSize, cv::Size(640, 480));
+    cv::perspectiveTransform(points, estimated, reduced.homography);
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        ASSERT_LT(cv::norm(estimated[i] - expected[i]), 2);
+    }
+
+    ASSERT_THROW(EstimateViewAlignment(cv::Mat(200, 256, CV_8UC1, cv::Scalar(255)), target, cv::Size(7, 5)),
+                 std::runtime_error);
+}
+
+TEST(ViewAlignmentTest, CalibrationImageHasSizeOfBandImages)
+{
+    cv::Mat frame(10, 9, CV_16UC1, cv::Scalar(0));
+    frame(cv::Rect(4, 4, 4, 4)).setTo(400);
+    cv::Mat image = GetCalibrationImage(frame, 4, 4);
+    ASSERT_EQ(image.type(), CV_8UC1);
+    ASSERT_EQ(image.size(), cv::Size(3, 3));
+    ASSERT_EQ(image.at<uchar>(1, 1), 255);
+    ASSERT_EQ(image.at<uchar>(2, 2), 255);
+    ASSERT_EQ(image.at<uchar>(0, 0), 0);
+    ASSERT_THROW(GetCalibrationImage(cv::Mat::zeros(8, 8, CV_8UC1), 4, 4), std::invalid_argument);
+}
+
+TEST(ViewAlignmentTest, WarpMatchesPerspectiveWarp)
+{
+    ViewAlignment alignment;
+    alignment.homography = TARGET_TO_SOURCE.inv();
+    alignment.sourceSize = cv::Size(256, 200);
+    alignment.targetSize = cv::Size(640, 480);
+    ViewWarper warper(alignment);
+
+    cv::Mat source(alignment.sourceSize, CV_8UC3);
+    cv::randu(source, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::GaussianBlur(source, source, cv::Size(5, 5), 0);
+    cv::Mat warped;
+    warper.Warp(source, warped);
+    cv::Mat expected;
+    cv::warpPerspective(source, expected, alignment.homography, alignment.targetSize, cv::INTER_LINEAR,
+                        cv::BORDER_CONSTANT, cv::Scalar::all(0));
+    cv::Mat difference;
+    cv::absdiff(warped, expected, difference);
+    ASSERT_LT(cv::mean(difference, warper.GetCoverage())[0], 1);
+
+    // the corners of the target view are not seen by the source camera
+    ASSERT_EQ(warper.GetCoverage().at<uchar>(0, 0), 0);
+    ASSERT_EQ(warper.GetCoverage().at<uchar>(200, 300), 255);
+    ASSERT_THROW(warper.Warp(cv::Mat::zeros(10, 10, CV_8UC3), warped), std::invalid_argument);
+
+    alignment.homography = cv::Matx33d::zeros();
+    ASSERT_THROW(ViewWarper{alignment}, std::invalid_argument);
+}
+
+TEST(ViewAlignmentTest, FusesOnlyCoveredPixels)
+{
+    ViewAlignment alignment;
+    alignment.homography = cv::Matx33d(2, 0, 10, 0, 2, 20, 0, 0, 1);
+    alignment.sourceSize = cv::Size(20, 10);
+    alignment.targetSize = cv::Size(80, 60);
+    ViewWarper warper(alignment);
+    cv::Mat target(alignment.targetSize, CV_8UC3, cv::Scalar(100, 100, 100));
+    cv::Mat source(alignment.sourceSize, CV_8UC3, cv::Scalar(200, 0, 100));
+    cv::Mat fused;
+    warper.Fuse(target, source, 0.5, fused);
+    ASSERT_EQ(fused.size(), target.size());
+    ASSERT_EQ(fused.at<cv::Vec3b>(30, 30), cv::Vec3b(150, 50, 100));
+    ASSERT_EQ(fused.at<cv::Vec3b>(5, 5), cv::Vec3b(100, 100, 100));
+    ASSERT_EQ(fused.at<cv::Vec3b>(50, 70), cv::Vec3b(100, 100, 100));
+    ASSERT_THROW(warper.Fuse(target, cv::Mat::zeros(10, 20, CV_8UC1), 0.5, fused), std::invalid_argument);
+}
+
+TEST(ViewAlignmentTest, WritesAndReadsAlignment)
+{
+    ViewAlignment alignment;
+    alignment.homography = cv::Matx33d(2.5, 0.1, 10, -0.05, 2.4, 20, 1e-5, 2e-5, 1);
+    alignment.sourceSize = cv::Size(512, 272);
+    alignment.targetSize = cv::Size(1936, 1216);
+    alignment.reprojectionError = 0.3;
+    auto filePath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.json");
+    WriteViewAlignment(filePath.string(), alignment);
+    ViewAlignment read = ReadViewAlignment(filePath.string());
+    ASSERT_EQ(read.sourceSize, alignment.sourceSize);
+    ASSERT_EQ(read.targetSize, alignment.targetSize);
+    ASSERT_DOUBLE_EQ(read.reprojectionError, 0.3);
+    for (int i = 0; i < 9; i++)
+    {
+        ASSERT_DOUBLE_EQ(read.homography.val[i], alignment.homography.val[i]);
+    }
+    boost::filesystem::remove(filePath);
+    ASSERT_THROW(ReadViewAlignment(filePath.string()), std::runtime_error);
+}
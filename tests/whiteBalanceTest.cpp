@@ -0,0 +1,143 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <gtest/gtest.h>
+
+#include "src/recordingFormat.h"
+#include "src/whiteBalance.h"
+
+/**
+ * GBRG Bayer frame of type CV_16UC1 from the red, green and blue value of each superpixel.
+ */
+static cv::Mat CreateBayerFrame(const cv::Mat_<cv::Vec3f> &superpixels)
+{
+    cv::Mat frame(2 * superpixels.rows, 2 * superpixels.cols, CV_16UC1);
+    for (int row = 0; row < superpixels.rows; row++)
+    {
+        for (int col = 0; col < superpixels.cols; col++)
+        {
+            const cv::Vec3f &rgb = superpixels(row, col);
+            frame.at<uint16_t>(2 * row, 2 * col) = cv::saturate_cast<uint16_t>(rgb[1]);
+            frame.at<uint16_t>(2 * row, 2 * col + 1) = cv::saturate_cast<uint16_t>(rgb[2]);
+            frame.at<uint16_t>(2 * row + 1, 2 * col) = cv::saturate_cast<uint16_t>(rgb[0]);
+            frame.at<uint16_t>(2 * row + 1, 2 * col + 1) = cv::saturate_cast<uint16_t>(rgb[1]);
+        }
+    }
+    return frame;
+}
+
+TEST(WhiteBalanceTest, GrayWorldBalancesMeanColor)
+{
+    WhiteBalanceEstimator estimator;
+    ASSERT_EQ(estimator.GetGains(), cv::Vec3f(1, 1, 1));
+    estimator.Update(CreateBayerFrame(cv::Mat_<cv::Vec3f>(32, 32, cv::Vec3f(600, 400, 200))), XI_CFA_BAYER_GBRG, 10);
+    cv::Vec3f gains = estimator.GetGains();
+    ASSERT_NEAR(gains[0], 400. / 600, 1e-4);
+    ASSERT_EQ(gains[1], 1);
+    ASSERT_NEAR(gains[2], 2, 1e-4);
+}
+
+TEST(WhiteBalanceTest, WhitePatchBalancesBrightestPixels)
+{
+    // ramp of a reddish light, with saturated pixels at the top that do not show the light
+    cv::Mat_<cv::Vec3f> superpixels(32, 64);
+    for (int row = 0; row < superpixels.rows; row++)
+    {
+        for (int col = 0; col < superpixels.cols; col++)
+        {
+            float level = 100.f + 600.f * static_cast<float>(col) / (superpixels.cols - 1);
+            superpixels(row, col) = row < 4 ? cv::Vec3f(1023, 1023, 1023) : cv::Vec3f(1.25, 1, 0.5) * level;
+        }
+    }
+    // a dark green object biases the mean color, but not the brightest pixels
+    superpixels(cv::Rect(0, 4, 32, 28)).setTo(cv::Scalar(20, 200, 20));
+
+    WhiteBalanceOptions options;
+    options.method = WhiteBalanceMethod::WhitePatch;
+    WhiteBalanceEstimator whitePatch(options);
+    whitePatch.Update(CreateBayerFrame(superpixels), XI_CFA_BAYER_GBRG, 10);
+    ASSERT_NEAR(whitePatch.GetGains()[0], 0.8, 0.02);
+    ASSERT_EQ(whitePatch.GetGains()[1], 1);
+    ASSERT_NEAR(whitePatch.GetGains()[2], 2, 0.05);
+
+    WhiteBalanceEstimator grayWorld;
+    grayWorld.Update(CreateBayerFrame(superpixels), XI_CFA_BAYER_GBRG, 10);
+    ASSERT_GT(grayWorld.GetGains()[2], 2.4);
+}
+
+TEST(WhiteBalanceTest, SmoothsAndLocksGains)
+{
+    WhiteBalanceOptions options;
+    options.smoothing = 0.25;
+    WhiteBalanceEstimator estimator(options);
+    cv::Mat neutral = CreateBayerFrame(cv::Mat_<cv::Vec3f>(16, 16, cv::Vec3f(300, 300, 300)));
+    cv::Mat bluish = CreateBayerFrame(cv::Mat_<cv::Vec3f>(16, 16, cv::Vec3f(300, 300, 600)));
+    estimator.Update(neutral, XI_CFA_BAYER_GBRG, 10);
+    estimator.Update(bluish, XI_CFA_BAYER_GBRG, 10);
+    ASSERT_NEAR(estimator.GetGains()[2], 1 + 0.25 * (0.5 - 1), 1e-4);
+    ASSERT_NEAR(estimator.GetGains()[0], 1, 1e-4);
+
+    estimator.SetLocked(true);
+    ASSERT_TRUE(estimator.IsLocked());
+    cv::Vec3f locked = estimator.GetGains();
+    for (int i = 0; i < 10; i++)
+    {
+        estimator.Update(bluish, XI_CFA_BAYER_GBRG, 10);
+    }
+    ASSERT_EQ(estimator.GetGains(), locked);
+
+    // black frames do not tell the color of the light
+    estimator.SetLocked(false);
+    estimator.Reset();
+    estimator.Update(cv::Mat::zeros(32, 32, CV_16UC1), XI_CFA_BAYER_GBRG, 10);
+    ASSERT_EQ(estimator.GetGains(), cv::Vec3f(1, 1, 1));
+    estimator.Update(bluish, XI_CFA_BAYER_GBRG, 10);
+    ASSERT_NEAR(estimator.GetGains()[2], 0.5, 1e-4);
+}
+
+TEST(WhiteBalanceTest, AppliesGainsWhileConvertingTo8Bit)
+{
+    cv::Mat image(4, 4, CV_16UC3, cv::Scalar(400, 400, 400));
+    image.at<cv::Vec<uint16_t, 3>>(0, 0) = cv::Vec<uint16_t, 3>(1000, 1000, 1000);
+    ApplyWhiteBalance(image, image, cv::Vec3f(0.5, 1, 2), 0.25);
+    ASSERT_EQ(image.type(), CV_8UC3);
+    ASSERT_EQ(image.at<cv::Vec3b>(3, 3), cv::Vec3b(50, 100, 200));
+    ASSERT_EQ(image.at<cv::Vec3b>(0, 0), cv::Vec3b(125, 250, 255));
+    cv::Mat balanced;
+    ASSERT_THROW(ApplyWhiteBalance(cv::Mat::zeros(4, 4, CV_8UC3), balanced, cv::Vec3f(1, 1, 1), 1),
+                 std::invalid_argument);
+}
+
+TEST(WhiteBalanceTest, ProvidesGainsToMetadata)
+{
+    WhiteBalanceEstimator estimator;
+    estimator.Update(CreateBayerFrame(cv::Mat_<cv::Vec3f>(16, 16, cv::Vec3f(200, 400, 800))), XI_CFA_BAYER_GBRG, 10);
+    estimator.SetLocked(true);
+    MetadataProviderRegistry registry;
+    registry.Register(std::make_shared<WhiteBalanceProvider>(&estimator));
+    ASSERT_TRUE(registry.GetSchema().Contains(WHITE_BALANCE_GAINS_KEY));
+    ASSERT_TRUE(registry.GetSchema().Contains(WHITE_BALANCE_LOCKED_KEY));
+    FrameMetadataRecord record = registry.GetSchema().CreateRecord();
+    XI_IMG image{};
+    registry.Sample(image, record);
+    ASSERT_NEAR(record.floatValues[0], 2, 1e-4);
+    ASSERT_EQ(record.floatValues[1], 1);
+    ASSERT_NEAR(record.floatValues[2], 0.5, 1e-4);
+    ASSERT_EQ(record.intValues[0], 1);
+}
+
+TEST(WhiteBalanceTest, RejectsInvalidArguments)
+{
+    ASSERT_EQ(ParseWhiteBalanceMethod("gray-world"), WhiteBalanceMethod::GrayWorld);
+    ASSERT_EQ(ParseWhiteBalanceMethod("white-patch"), WhiteBalanceMethod::WhitePatch);
+    ASSERT_THROW(ParseWhiteBalanceMethod("auto"), std::invalid_argument);
+    WhiteBalanceOptions options;
+    options.smoothing = 0;
+    ASSERT_THROW(WhiteBalanceEstimator{options}, std::invalid_argument);
+    WhiteBalanceEstimator estimator;
+    ASSERT_THROW(estimator.Update(cv::Mat::zeros(8, 8, CV_16UC1), XI_CFA_NONE, 10), std::invalid_argument);
+    ASSERT_THROW(estimator.Update(cv::Mat::zeros(8, 8, CV_8UC1), XI_CFA_BAYER_GBRG, 10), std::invalid_argument);
+    ASSERT_THROW(estimator.Update(cv::Mat::zeros(8, 8, CV_16UC1), XI_CFA_BAYER_GBRG, 4), std::invalid_argument);
+}
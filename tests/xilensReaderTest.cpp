@@ -0,0 +1,161 @@
+/*******************************************************
+ * Author: Intelligent Medical Systems
+ * License: see LICENSE.md file
+ *******************************************************/
+
+#include <blosc2.h>
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+#include "src/stripedRecording.h"
+#include "src/util.h"
+#include "src/xilensReader.h"
+
+class XilensReaderTest : public ::testing::Test
+{
+  protected:
+    boost::filesystem::path m_root;
+    XI_IMG m_image{};
+    std::vector<uint16_t> m_pixels;
+    MetadataProviderRegistry m_providers;
+
+    void SetUp() override
+    {
+        m_root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("xilens-%%%%-%%%%");
+        boost::filesystem::create_directories(m_root);
+        m_image.width = 8;
+        m_image.height = 4;
+        m_image.exposure_time_us = 40000;
+        m_image.color_filter_array = XI_CFA_NONE;
+        m_pixels.resize(static_cast<size_t>(m_image.width) * m_image.height);
+        m_image.bp = m_pixels.data();
+        m_providers.Register(std::make_shared<ImageMetadataProvider>());
+        blosc2_init();
+    }
+
+    void TearDown() override
+    {
+        blosc2_destroy();
+        boost::filesystem::remove_all(m_root);
+    }
+
+    /**
+     * Writes frames whose pixels hold the frame index plus the band of a 2x2 mosaic
+     */
+    void WriteFrames(RecordingFile &recording, int nFrames)
+    {
+        FrameMetadataRecord record = m_providers.GetSchema().CreateRecord();
+        for (int i = 0; i < nFrames; i++)
+        {
+            for (size_t row = 0; row < m_image.height; row++)
+            {
+                for (size_t col = 0; col < m_image.width; col++)
+                {
+                    m_pixels[row * m_image.width + col] = static_cast<uint16_t>(100 * i + (row % 2) * 2 + col % 2);
+                }
+            }
+            m_image.acq_nframe = 50 + i;
+            m_providers.Sample(m_image, record);
+            recording.WriteImageData(m_image, record);
+        }
+        recording.AppendMetadata();
+    }
+};
+
+TEST_F(XilensReaderTest, ReadFramesAndMetadata)
+{
+    std::string filePath = (m_root / "recording.b2nd").string();
+    {
+        FileImage fileImage(filePath.c_str(), m_image.height, m_image.width, m_providers.GetSchema());
+        WriteFrames(fileImage, 5);
+    }
+    RecordingReader reader(filePath);
+    ASSERT_EQ(reader.GetNumberOfFrames(), 5);
+    ASSERT_EQ(reader.GetHeight(), m_image.height);
+    ASSERT_EQ(reader.GetWidth(), m_image.width);
+    ASSERT_TRUE(reader.HasMetadata(EXPOSURE_KEY));
+    ASSERT_FALSE(reader.HasMetadata("missing"));
+    ASSERT_EQ(reader.GetMetadata<int64_t>(EXPOSURE_KEY), std::vector<int64_t>(5, 40000));
+    ASSERT_EQ(reader.GetMetadata<std::string>(COLOR_FILTER_ARRAY_FORMAT_KEY)[4], "XI_CFA_NONE");
+    ASSERT_EQ(reader.FindFrameByNumber(53), 3);
+    ASSERT_THROW(reader.FindFrameByNumber(10), std::out_of_range);
+
+    std::vector<int64_t> timeStamps = reader.GetTimeStamps();
+    ASSERT_EQ(timeStamps.size(), 5);
+    ASSERT_TRUE(std::is_sorted(timeStamps.begin(), timeStamps.end()));
+    ASSERT_EQ(reader.FindFrameAtTime(timeStamps.front() - 1000), 0);
+    ASSERT_THROW(reader.FindFrameAtTime(timeStamps.back() + 1000), std::out_of_range);
+
+    std::vector<uint16_t> cube;
+    reader.ReadBandCube(2, 2, 2, cube);
+    const size_t bandSize = static_cast<size_t>(m_image.height / 2) * (m_image.width / 2);
+    ASSERT_EQ(cube.size(), 4 * bandSize);
+    for (size_t band = 0; band < 4; band++)
+    {
+        ASSERT_EQ(cube[band * bandSize], 200 + band);
+        ASSERT_EQ(cube[(band + 1) * bandSize - 1], 200 + band);
+    }
+}
+
+TEST_F(XilensReaderTest, ReadStripedColumnarMetadata)
+{
+    std::string manifestPath = (m_root / (std::string("test") + RECORDING_MANIFEST_EXTENSION)).string();
+    std::vector<std::string> folders = {(m_root / "disk0").string(), (m_root / "disk1").string()};
+    CompressionOptions compression;
+    compression.columnarMetadata = true;
+    {
+        StripedFileImage recording(manifestPath, folders, m_image.height, m_image.width, m_providers.GetSchema(),
+                                   compression);
+        WriteFrames(recording, 7);
+    }
+    RecordingReader reader(manifestPath);
+    ASSERT_EQ(reader.GetStripePaths().size(), 2);
+    ASSERT_EQ(reader.GetNumberOfFrames(), 7);
+    std::vector<int64_t> frameNumbers = reader.GetMetadata<int64_t>(FRAME_NUMBER_KEY);
+    for (int64_t i = 0; i < 7; i++)
+    {
+        ASSERT_EQ(frameNumbers[i], 50 + i);
+    }
+    ASSERT_EQ(reader.GetTimeStamps().size(), 7);
+    ASSERT_EQ(reader.GetMetadata<std::string>(COLOR_FILTER_ARRAY_FORMAT_KEY).size(), 7);
+}
+
+TEST_F(XilensReaderTest, PrefetchFramesInOrder)
+{
+    std::string filePath = (m_root / "recording.b2nd").string();
+    {
+        FileImage fileImage(filePath.c_str(), m_image.height, m_image.width, m_providers.GetSchema());
+        WriteFrames(fileImage, 20);
+    }
+    RecordingReader reader(filePath);
+    PrefetchedFrame frame;
+    {
+        FramePrefetcher prefetcher(reader, 3, 100, 3, 4);
+        for (int64_t i = 3; i < 20; i++)
+        {
+            ASSERT_TRUE(prefetcher.Next(frame));
+            ASSERT_EQ(frame.index, i);
+            ASSERT_EQ(frame.pixels.size(), m_pixels.size());
+            ASSERT_EQ(frame.pixels[0], 100 * i);
+        }
+        ASSERT_FALSE(prefetcher.Next(frame));
+    }
+    // stopping before all frames are handed out
+    FramePrefetcher prefetcher(reader, 0, 20, 2);
+    ASSERT_TRUE(prefetcher.Next(frame));
+    ASSERT_EQ(frame.index, 0);
+}
+
+TEST_F(XilensReaderTest, InvalidManifest)
+{
+    std::string manifestPath = (m_root / (std::string("invalid") + RECORDING_MANIFEST_EXTENSION)).string();
+    std::ofstream(manifestPath) << "{\"version\": 2, \"layout\": \"round-robin\", \"stripes\": [\"a.b2nd\"]}";
+    ASSERT_THROW(ReadManifestStripes(manifestPath), std::runtime_error);
+    std::ofstream(manifestPath) << "{\"version\": 1, \"layout\": \"round-robin\", "
+                                   "\"stripes\": [\"a\\\"b\\u00e9.b2nd\"]}";
+    ASSERT_EQ(ReadManifestStripes(manifestPath), std::vector<std::string>{"a\"b\xc3\xa9.b2nd"});
+    ASSERT_THROW(RecordingReader reader(manifestPath), std::runtime_error);
+    ASSERT_THROW(RecordingReader reader(std::vector<std::string>{}), std::runtime_error);
+}